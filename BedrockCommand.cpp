@@ -8,6 +8,9 @@ BedrockCommand::BedrockCommand() :
     peekCount(0),
     processCount(0),
     onlyProcessOnSyncThread(false),
+    waitUntil(0),
+    waitWakeCount(0),
+    staleFallbackAt(0),
     _inProgressTiming(INVALID, 0, 0)
 { }
 
@@ -25,6 +28,9 @@ BedrockCommand::BedrockCommand(SQLiteCommand&& from) :
     peekCount(0),
     processCount(0),
     onlyProcessOnSyncThread(false),
+    waitUntil(0),
+    waitWakeCount(0),
+    staleFallbackAt(0),
     _inProgressTiming(INVALID, 0, 0)
 {
     _init();
@@ -38,6 +44,10 @@ BedrockCommand::BedrockCommand(BedrockCommand&& from) :
     processCount(from.processCount),
     timingInfo(from.timingInfo),
     onlyProcessOnSyncThread(from.onlyProcessOnSyncThread),
+    waitKey(move(from.waitKey)),
+    waitUntil(from.waitUntil),
+    waitWakeCount(from.waitWakeCount),
+    staleFallbackAt(from.staleFallbackAt),
     _inProgressTiming(from._inProgressTiming)
 {
     // The move constructor (and likewise, the move assignment operator), don't simply copy this pointer value, but
@@ -52,6 +62,9 @@ BedrockCommand::BedrockCommand(SData&& _request) :
     peekCount(0),
     processCount(0),
     onlyProcessOnSyncThread(false),
+    waitUntil(0),
+    waitWakeCount(0),
+    staleFallbackAt(0),
     _inProgressTiming(INVALID, 0, 0)
 {
     _init();
@@ -64,6 +77,9 @@ BedrockCommand::BedrockCommand(SData _request) :
     peekCount(0),
     processCount(0),
     onlyProcessOnSyncThread(false),
+    waitUntil(0),
+    waitWakeCount(0),
+    staleFallbackAt(0),
     _inProgressTiming(INVALID, 0, 0)
 {
     _init();
@@ -85,6 +101,10 @@ BedrockCommand& BedrockCommand::operator=(BedrockCommand&& from) {
         priority = from.priority;
         timingInfo = from.timingInfo;
         onlyProcessOnSyncThread = from.onlyProcessOnSyncThread;
+        waitKey = move(from.waitKey);
+        waitUntil = from.waitUntil;
+        waitWakeCount = from.waitWakeCount;
+        staleFallbackAt = from.staleFallbackAt;
         _inProgressTiming = from._inProgressTiming;
 
         // And call the base class's move constructor as well.
@@ -69,6 +69,21 @@ class BedrockCommand : public SQLiteCommand {
     // to the sync thread for processing, thus guaranteeing that process() will not result in a conflict.
     bool onlyProcessOnSyncThread;
 
+    // A plugin can set `waitKey` in peek or process to have the server hold on to this command, rather than sending
+    // its response, until `BedrockServer::wakeWaitingCommands` wakes that key, or `waitUntil` passes. Either way, the
+    // command is then run again from the start. If it's shutting down, the server sends the response immediately. A
+    // command escalated to the master waits on the node the client sent it to.
+    string waitKey;
+    uint64_t waitUntil;
+
+    // The server's wake count from when this command was last peeked or processed. If `waitKey` has been woken since,
+    // the command runs again rather than waiting. See `BedrockServer::getWaitingCommandWakeCount`.
+    uint64_t waitWakeCount;
+
+    // For a bounded-staleness read with `staleFallback: master` that's waiting for this node to catch up, the time
+    // (from STimeNow()) at which it gives up and is forwarded to the master instead. 0 if it never is.
+    uint64_t staleFallbackAt;
+
   private:
     // Set certain initial state on construction. Common functionality to several constructors.
     void _init();
@@ -104,6 +104,19 @@ string BedrockConflictMetrics::getMultiWriteDeniedCommands() {
     return SComposeList(commands);
 }
 
+string BedrockConflictMetrics::getConflictCounts() {
+    SAUTOLOCK(_mutex);
+    STable counts;
+    for (auto& pair : _conflictInfoMap) {
+        auto& metric = pair.second;
+        STable command;
+        command["successes"] = to_string(metric._totalSuccessCount);
+        command["conflicts"] = to_string(metric._totalConflictCount);
+        counts[metric._commandName] = SComposeJSONObject(command);
+    }
+    return SComposeJSONObject(counts);
+}
+
 void BedrockConflictMetrics::setFraction(double fraction) {
     SAUTOLOCK(_mutex);
     if (fraction > 0.0 && fraction < 1.0) {
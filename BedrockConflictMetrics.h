@@ -30,6 +30,10 @@ public:
     // Returns a comma-separated list of command names that are currently disabled due to conflicts.
     static string getMultiWriteDeniedCommands();
 
+    // Returns a JSON object with the total successes and conflicts of every command we've recorded, like
+    // {"CreateJob":{"successes":100,"conflicts":2}}.
+    static string getConflictCounts();
+
     // Change the fraction of commands required to decide that multiWriteOK will return false.
     static void setFraction(double fraction);
 
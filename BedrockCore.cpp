@@ -16,6 +16,9 @@ bool BedrockCore::peekCommand(BedrockCommand& command) {
     SDEBUG("Peeking at '" << request.methodLine << "'");
     command.peekCount++;
 
+    // Note how many waiting commands have been woken so far, in case this one asks to wait.
+    command.waitWakeCount = _server.getWaitingCommandWakeCount();
+
     // We catch any exception and handle in `_handleCommandException`.
     try {
         // We start a transaction in `peekCommand` because we want to support having atomic transactions from peek
@@ -71,6 +74,7 @@ bool BedrockCore::peekCommand(BedrockCommand& command) {
     } catch (...) {
         _handleCommandException(command, "", false);
     }
+    _returnWaitToPeer(command);
 
     // If we get here, it means the command is fully completed.
     command.complete = true;
@@ -91,6 +95,7 @@ bool BedrockCore::processCommand(BedrockCommand& command) {
     STable& content = command.jsonContent;
     SDEBUG("Processing '" << request.methodLine << "'");
     command.processCount++;
+    command.waitWakeCount = _server.getWaitingCommandWakeCount();
 
     // Keep track of whether we've modified the database and need to perform a `commit`.
     bool needsCommit = false;
@@ -155,6 +160,7 @@ bool BedrockCore::processCommand(BedrockCommand& command) {
     } catch (...) {
         _handleCommandException(command, "", true);
     }
+    _returnWaitToPeer(command);
 
     // Done, return whether or not we need the parent to commit our transaction.
     command.complete = !needsCommit;
@@ -189,3 +195,9 @@ void BedrockCore::_handleCommandException(BedrockCommand& command, const string&
     // Add the commitCount header to the response.
     command.response["commitCount"] = to_string(_db.getCommitCount());
 }
+
+void BedrockCore::_returnWaitToPeer(BedrockCommand& command) {
+    if (command.initiatingPeerID && !command.waitKey.empty()) {
+        command.response["waitKey"] = command.waitKey;
+    }
+}
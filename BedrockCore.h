@@ -44,5 +44,9 @@ class BedrockCore : public SQLiteCore {
 
   private:
     void _handleCommandException(BedrockCommand& command, const string& e, bool wasProcessing);
+
+    // A command from a peer isn't held here if it asks to wait, so this marks its response, and the peer runs it again
+    // to wait there instead.
+    void _returnWaitToPeer(BedrockCommand& command);
     const BedrockServer& _server;
 };
@@ -52,10 +52,21 @@ void BedrockServer::sync(SData& args,
     // And the command processor.
     BedrockCore core(db, server);
 
+    // If requested, replicated transactions are applied by a set of dedicated threads while we're slaving. These
+    // share the worker journal tables, which are idle on slaves, so there can't be more of them than workers.
+    unique_ptr<SQLiteApplier> applier;
+    int applyThreads = min(args.calc("-parallelReplication"), workerThreads);
+    if (applyThreads > 0) {
+        applier.reset(new SQLiteApplier(args["-db"], args.calc("-cacheSize"), args.calc("-maxJournalSize"),
+                                        applyThreads, workerThreads - 1));
+    }
+
     // And the sync node.
     uint64_t firstTimeout = STIME_US_PER_M * 2 + SRandom::rand64() % STIME_US_PER_S * 30;
     SQLiteNode syncNode(server, db, args["-nodeName"], args["-nodeHost"], args["-peerList"], args.calc("-priority"),
-                        firstTimeout, server._version, args.calc("-quorumCheckpoint"));
+                        firstTimeout, server._version, args.calc("-quorumCheckpoint"),
+                        args.calc("-replicationCompression"));
+    syncNode.setApplier(applier.get());
 
     // We expose the sync node to the server, because it needs it to respond to certain (Status) requests with data
     // about the sync node.
@@ -120,6 +131,24 @@ void BedrockServer::sync(SData& args,
                 if (eraseTo != server._futureCommitCommands.begin()) {
                     server._futureCommitCommands.erase(server._futureCommitCommands.begin(), eraseTo);
                 }
+
+                // Bounded-staleness reads that have waited as long as they can for us to catch up go to the master.
+                const uint64_t now = STimeNow();
+                auto fallbackIt = server._futureCommitCommands.begin();
+                while (fallbackIt != server._futureCommitCommands.end()) {
+                    const uint64_t fallbackAt = fallbackIt->second.staleFallbackAt;
+                    if (fallbackAt && fallbackAt <= now) {
+                        SINFO("Command (" << fallbackIt->second.request.methodLine << ") still waiting on commit "
+                              << fallbackIt->first << ", now have commit " << commitCount << ", forwarding to master.");
+                        syncNodeQueuedCommands.push(move(fallbackIt->second));
+                        fallbackIt = server._futureCommitCommands.erase(fallbackIt);
+                    } else {
+                        if (fallbackAt) {
+                            nextActivity = min(nextActivity, fallbackAt);
+                        }
+                        fallbackIt++;
+                    }
+                }
             }
         }
 
@@ -143,6 +172,14 @@ void BedrockServer::sync(SData& args,
         syncNodeQueuedCommands.prePoll(fdm);
         completedCommands.prePoll(fdm);
 
+        // Wake up when replicated transactions are applied, so that commands waiting on them can be re-queued.
+        if (applier) {
+            applier->prePoll(fdm);
+        }
+
+        // Wake any commands that have waited long enough, and make sure we're up in time for the next.
+        server._wakeExpiredCommands(nextActivity);
+
         // Wait for activity on any of those FDs, up to a timeout.
         const uint64_t now = STimeNow();
 
@@ -161,6 +198,9 @@ void BedrockServer::sync(SData& args,
         syncNode.postPoll(fdm, nextActivity);
         syncNodeQueuedCommands.postPoll(fdm);
         completedCommands.postPoll(fdm);
+        if (applier) {
+            applier->postPoll(fdm);
+        }
 
         // If any of our plugins finished any outstanding HTTPS requests, we'll move those commands back into the
         // regular queue. This code modifies a list while iterating over it.
@@ -236,7 +276,7 @@ void BedrockServer::sync(SData& args,
                     syncNode.sendResponse(command);
                 } else {
                     // The only other option is this came from a client, so respond via the server.
-                    server._reply(command);
+                    server._syncThreadReply(command);
                 }
             } else {
                 // TODO: This `else` block should be unreachable since the sync thread now blocks workers for entire
@@ -320,7 +360,7 @@ void BedrockServer::sync(SData& args,
                             command.finalizeTimingInfo();
                             syncNode.sendResponse(command);
                         } else {
-                            server._reply(command);
+                            server._syncThreadReply(command);
                         }
                         continue;
                     }
@@ -373,14 +413,18 @@ void BedrockServer::sync(SData& args,
                         command.finalizeTimingInfo();
                         syncNode.sendResponse(command);
                     } else {
-                        server._reply(command);
+                        server._syncThreadReply(command);
                     }
                 }
             } else if (nodeState == SQLiteNode::SLAVING) {
                 // If we're slaving, we just escalate directly to master without peeking. We can only get an incomplete
                 // command on the slave sync thread if a slave worker thread peeked it unsuccessfully, so we don't
-                // bother peeking it again.
-                syncNode.escalateCommand(move(command));
+                // bother peeking it again. We escalate everything that's queued at once, so that the sync node can send
+                // them to master together. When the queue runs out, `pop` throws, and we start our next loop iteration.
+                while (true) {
+                    syncNode.escalateCommand(move(command));
+                    command = syncNodeQueuedCommands.pop();
+                }
             }
         } catch (out_of_range e) {
             // syncNodeQueuedCommands had no commands to work on, we'll need to re-poll for some.
@@ -388,6 +432,11 @@ void BedrockServer::sync(SData& args,
         }
     }
 
+    // Let anything the applier's still working on finish before its threads are stopped.
+    if (applier && !applier->drain()) {
+        SWARN("Failed to apply some replicated transactions before shutdown.");
+    }
+
     // Done with the global lock.
     server._syncMutex.unlock();
 
@@ -461,16 +510,65 @@ void BedrockServer::worker(SData& args,
                   << server._commandQueue.size() << " commands in queue.");
 
             // We just spin until the node looks ready to go. Typically, this doesn't happen expect briefly at startup.
+            bool syncShutDown = false;
             while (upgradeInProgress.load() ||
                    (replicationState.load() != SQLiteNode::MASTERING &&
                     replicationState.load() != SQLiteNode::SLAVING &&
                     replicationState.load() != SQLiteNode::STANDINGDOWN)
             ) {
+                // Once the sync thread has shut down, the node will never be ready again, so waiting would keep this
+                // thread from ever exiting. This can happen to a command the master queued for itself (like a
+                // plugin's timer) just before it stood down.
+                SHUTDOWN_STATE shutdownState = server._shutdownState.load();
+                if (shutdownState == SYNC_SHUTDOWN || shutdownState == DONE) {
+                    syncShutDown = true;
+                    break;
+                }
+
                 // This sleep call is pretty ugly, but it should almost never happen. We're accepting the potential
                 // looping sleep call for the general case where we just check some bools and continue, instead of
                 // avoiding the sleep call but having every thread lock a mutex here on every loop.
                 usleep(10000);
             }
+            if (syncShutDown) {
+                SINFO("Sync thread has shut down, discarding command " << command.request.methodLine << ".");
+                continue;
+            }
+
+            // If this is a read that can tolerate some replication lag, and we're slaving, work out how far we need to
+            // have caught up with the master to serve it. If we haven't got there yet, we turn the bound into a
+            // `commitCount` and wait for it like any other command below. With `staleFallback: master`, that wait is
+            // limited to `maxStalenessMS` from when the read arrived, after which the sync thread forwards it to the
+            // master. If there's no time bound, or it's already passed, we forward it straight away.
+            bool boundedStaleness = command.request.isSet("maxStalenessMS") ||
+                                    command.request.isSet("maxStalenessCommits");
+            if (boundedStaleness && !command.complete && replicationState.load() == SQLiteNode::SLAVING) {
+                uint64_t maxCommits = command.request.isSet("maxStalenessCommits") ?
+                                      command.request.calcU64("maxStalenessCommits") : UINT64_MAX;
+                uint64_t maxMS = command.request.isSet("maxStalenessMS") ?
+                                 command.request.calcU64("maxStalenessMS") : UINT64_MAX;
+                uint64_t requiredCommitCount = server._syncNode->getStalenessBoundCommitCount(command.creationTime,
+                                                                                            maxCommits, maxMS);
+                if (requiredCommitCount > db.getCommitCount()) {
+                    if (SIEquals(command.request["staleFallback"], "master")) {
+                        uint64_t fallbackAt = 0;
+                        if (command.request.isSet("maxStalenessMS")) {
+                            fallbackAt = maxMS < (UINT64_MAX - command.creationTime) / STIME_US_PER_MS ?
+                                         command.creationTime + maxMS * STIME_US_PER_MS : UINT64_MAX;
+                        }
+                        if (fallbackAt <= STimeNow()) {
+                            SINFO("Command (" << command.request.methodLine << ") needs commit " << requiredCommitCount
+                                  << ", currently at " << db.getCommitCount() << ", forwarding to master.");
+                            syncNodeQueuedCommands.push(move(command));
+                            continue;
+                        }
+                        command.staleFallbackAt = fallbackAt;
+                    }
+                    if (requiredCommitCount > command.request.calcU64("commitCount")) {
+                        command.request["commitCount"] = to_string(requiredCommitCount);
+                    }
+                }
+            }
 
             // If this command is dependent on a commitCount newer than what we have (maybe it's a follow-up to a
             // command that was escalated to master), we'll set it aside for later processing. When the sync node
@@ -529,6 +627,12 @@ void BedrockServer::worker(SData& args,
                 // client that we can't respond to, so we don't bother sending the response.
                 SASSERT(command.initiatingClientID);
                 if (command.initiatingClientID > 0) {
+                    // A bounded-staleness read that was forwarded to the master was answered with the master's
+                    // data, so it wasn't stale at all.
+                    if (boundedStaleness) {
+                        command.response["stalenessCommits"] = "0";
+                        command.response["stalenessMS"] = "0";
+                    }
                     server._reply(command);
                 }
 
@@ -538,7 +642,15 @@ void BedrockServer::worker(SData& args,
 
             // We'll retry on conflict up to this many times.
             int retry = 3;
+            uint64_t stalenessCommits = 0;
+            uint64_t stalenessMS = 0;
             while (retry) {
+                // For a bounded-staleness read, measure how far behind the master we are as the read starts, rather
+                // than once it's done, by which point we may have caught up on commits the read didn't see.
+                if (boundedStaleness && state == SQLiteNode::SLAVING) {
+                    server._syncNode->getReplicationLag(stalenessCommits, stalenessMS);
+                }
+
                 // Try peeking the command. If this succeeds, then it's finished, and all we need to do is respond to
                 // the command at the bottom.
                 if (!core.peekCommand(command)) {
@@ -637,6 +749,10 @@ void BedrockServer::worker(SData& args,
                         // can decrement our counter.
                         server._writableCommandsInProgress--;
                     }
+                } else if (boundedStaleness) {
+                    // Report how stale the data we just read might have been.
+                    command.response["stalenessCommits"] = to_string(stalenessCommits);
+                    command.response["stalenessMS"] = to_string(stalenessMS);
                 }
 
                 // If the command was completed above, then we'll go ahead and respond. Otherwise there must have been
@@ -692,8 +808,8 @@ void BedrockServer::worker(SData& args,
 BedrockServer::BedrockServer(const SData& args)
   : SQLiteServer(""), _args(args), _requestCount(0), _replicationState(SQLiteNode::SEARCHING),
     _upgradeInProgress(false), _suppressCommandPort(false), _suppressCommandPortManualOverride(false),
-    _syncNode(nullptr), _shutdownState(RUNNING), _multiWriteEnabled(args.test("-enableMultiWrite")),
-    _backupOnShutdown(false), _controlPort(nullptr), _commandPort(nullptr)
+    _ioThreadsStopping(false), _syncNode(nullptr), _waitingCommandWakeCount(0), _shutdownState(RUNNING),
+    _multiWriteEnabled(args.test("-enableMultiWrite")), _backupOnShutdown(false)
 {
     _version = SVERSION;
 
@@ -755,6 +871,30 @@ BedrockServer::BedrockServer(const SData& args)
         }
     }
 
+    _maxRequestsInFlight = max(1, args.calc("-maxRequestsInFlight"));
+
+    _responseCompressionLevel = max(0, min(9, args.calc("-responseCompression")));
+    _responseCompressionMinSize = args.isSet("-responseCompressionMinSize") ?
+                                  max(0, args.calc("-responseCompressionMinSize")) : 1024;
+    _compressOnWorkers = args.isSet("-compressOnWorkers");
+    _responsesCompressedOnWorkers.store(0);
+    if (_responseCompressionLevel) {
+        SGZipLevel.store(_responseCompressionLevel);
+    }
+
+    // Start the IO threads, if we're using them. They all need to exist before any of them can route a response.
+    int ioThreads = max(0, args.calc("-ioThreads"));
+    for (int i = 0; i < ioThreads; i++) {
+        _ioThreads.emplace_back(new IOThread());
+        _ioThreads.back()->finalReadDone.store(false);
+    }
+    if (ioThreads) {
+        SINFO("Starting " << ioThreads << " IO threads.");
+    }
+    for (int i = 0; i < ioThreads; i++) {
+        _ioThreads[i]->ioThread = thread(&BedrockServer::_io, this, ref(*_ioThreads[i]), i);
+    }
+
     // Start the sync thread, which will start the worker threads.
     SINFO("Launching sync thread '" << _syncThreadName << "'");
     _syncThread = thread(sync,
@@ -767,8 +907,12 @@ BedrockServer::BedrockServer(const SData& args)
 }
 
 BedrockServer::~BedrockServer() {
-    // Just warn if we have outstanding requests
-    SASSERTWARN(_requestCountSocketMap.empty());
+    // Stop the IO threads, which close their own sockets.
+    _ioThreadsStopping.store(true);
+    for (auto& io : _ioThreads) {
+        io->newSockets.push(nullptr);
+        io->ioThread.join();
+    }
 
     // Shut down any outstanding keepalive connections
     for (list<Socket*>::iterator socketIt = socketList.begin(); socketIt != socketList.end();) {
@@ -862,10 +1006,17 @@ bool BedrockServer::shutdownComplete() {
 }
 
 void BedrockServer::prePoll(fd_map& fdm) {
+    _serverCommands.prePoll(fdm);
     SAUTOLOCK(_socketIDMutex);
     STCPServer::prePoll(fdm);
 }
 
+void BedrockServer::prePoll(SEventLoop& loop) {
+    _serverCommands.prePoll(loop);
+    SAUTOLOCK(_socketIDMutex);
+    STCPServer::prePoll(loop);
+}
+
 void BedrockServer::postPoll(fd_map& fdm, uint64_t& nextActivity) {
     // Let the base class do its thing. We lock around this because we allow worker threads to modify the sockets (by
     // writing to them, but this can truncate send buffers).
@@ -873,6 +1024,7 @@ void BedrockServer::postPoll(fd_map& fdm, uint64_t& nextActivity) {
         SAUTOLOCK(_socketIDMutex);
         STCPServer::postPoll(fdm);
     }
+    _serverCommands.postPoll(fdm, 1024);
 
     // Open the port the first time we enter a command-processing state
     SQLiteNode::State state = _replicationState.load();
@@ -896,13 +1048,18 @@ void BedrockServer::postPoll(fd_map& fdm, uint64_t& nextActivity) {
     if (!_suppressCommandPort && (state == SQLiteNode::MASTERING || state == SQLiteNode::SLAVING) &&
         _shutdownState.load() == RUNNING) {
         // Open the port
-        if (!_commandPort) {
+        // Each of these can be a list, of TCP hosts and Unix domain sockets, so local clients can use either.
+        if (_commandPorts.empty()) {
             SINFO("Ready to process commands, opening command port on '" << _args["-serverHost"] << "'");
-            _commandPort = openPort(_args["-serverHost"]);
+            for (const string& host : SParseList(_args["-serverHost"])) {
+                _commandPorts.push_back(openPort(host));
+            }
         }
-        if (!_controlPort) {
+        if (_controlPorts.empty()) {
             SINFO("Opening control port on '" << _args["-controlPort"] << "'");
-            _controlPort = openPort(_args["-controlPort"]);
+            for (const string& host : SParseList(_args["-controlPort"])) {
+                _controlPorts.push_back(openPort(host));
+            }
         }
 
         // Open any plugin ports on enabled plugins
@@ -966,7 +1123,22 @@ void BedrockServer::postPoll(fd_map& fdm, uint64_t& nextActivity) {
             // Remember that this socket is owned by this plugin.
             SASSERT(!s->data);
             s->data = plugin;
+        } else if (!_ioThreads.empty()) {
+            // Hand it off to an IO thread. It hasn't been polled yet, so nothing's been read from it.
+            _removeSocket(s);
+            _ioThreads[s->id % _ioThreads.size()]->newSockets.push(move(s));
+        }
+    }
+
+    // Run any status and control commands the IO threads have read.
+    while (!_serverCommands.empty()) {
+        BedrockCommand command = _serverCommands.pop();
+        if (_isStatusCommand(command)) {
+            _status(command);
+        } else {
+            _control(command);
         }
+        _reply(command);
     }
 
     // Process any new activity from incoming sockets. In order to not modify the socket list while we're iterating
@@ -986,93 +1158,62 @@ void BedrockServer::postPoll(fd_map& fdm, uint64_t& nextActivity) {
             break;
             case STCPManager::Socket::CONNECTED:
             {
-                // If nothing's been received, break early.
-                if (s->recvBuffer.empty()) {
-                    break;
-                } else {
-                    // Otherwise, we'll see if there's any activity on this socket. Currently, we don't handle clients
-                    // pipelining requests well. We process commands in no particular order, so we can't dequeue two
-                    // requests off the same socket at one time, or we don't guarantee their return order, thus we just
-                    // wait and will try again later.
-                    SAUTOLOCK(_socketIDMutex);
-                    auto socketIt = _socketIDMap.find(s->id);
-                    if (socketIt != _socketIDMap.end()) {
-                        break;
-                    }
-                }
-
-                // If there's a request, we'll dequeue it (but only the first one).
-                SData request;
-
-                // If the socket is owned by a plugin, we let the plugin populate our request.
+                // Read as many requests as we've received, up to the limit of how many a connection can have in
+                // progress at once. Plugins speak their own protocols, which may not allow for more than one request
+                // at a time, so their sockets are limited to one.
                 BedrockPlugin* plugin = static_cast<BedrockPlugin*>(s->data);
-                if (plugin) {
-                    // Call the plugin's handler.
-                    plugin->onPortRecv(s, request);
-                    if (!request.empty()) {
-                        // If it populated our request, then we'll save the plugin name so we can handle the response.
-                        request["plugin"] = plugin->getName();
+                size_t maxInFlight = plugin ? 1 : _maxRequestsInFlight;
+                while (s->state == STCPManager::Socket::CONNECTED && !s->recvBuffer.empty()) {
+                    {
+                        SAUTOLOCK(_socketIDMutex);
+                        auto socketIt = _socketIDMap.find(s->id);
+                        if (socketIt != _socketIDMap.end() && socketIt->second.pending.size() >= maxInFlight) {
+                            break;
+                        }
                     }
-                } else {
-                    // Otherwise, handle any default request.
-                    int requestSize = request.deserialize(s->recvBuffer);
-                    SConsumeFront(s->recvBuffer, requestSize);
-                }
 
-                // If we have a populated request, from either a plugin or our default handling, we'll queue up the
-                // command.
-                if (!request.empty()) {
-                    // Either shut down the socket or store it so we can eventually sync out the response.
-                    if (SIEquals(request["Connection"], "forget") ||
-                        (uint64_t)request.calc64("commandExecuteTime") > STimeNow()) {
-                        // Respond immediately to make it clear we successfully queued it, but don't add to the socket
-                        // map as we don't care about the answer.
-                        SINFO("Firing and forgetting '" << request.methodLine << "'");
-                        SData response("202 Successfully queued");
-                        s->send(response.serialize());
+                    // If the socket is owned by a plugin, we let the plugin populate our request.
+                    SData request;
+                    if (plugin) {
+                        // Call the plugin's handler.
+                        plugin->onPortRecv(s, request);
+                        if (!request.empty()) {
+                            // If it populated our request, then we'll save the plugin name so we can handle the
+                            // response.
+                            request["plugin"] = plugin->getName();
+                        }
                     } else {
-                        // Queue for later response
-                        SINFO("Waiting for '" << request.methodLine << "' to complete.");
-                        SAUTOLOCK(_socketIDMutex);
-                        _socketIDMap[s->id] = s;
+                        // Otherwise, handle any default request.
+                        try {
+                            s->httpParser.parse(s->recvBuffer, request);
+                        } catch (const char* e) {
+                            SWARN("Malformed request from '" << s->addr << "' (" << e << "), closing socket.");
+                            shutdownSocket(s);
+                            break;
+                        }
                     }
-
-                    // Create a command.
-                    BedrockCommand command(request);
-                    if (command.writeConsistency != SQLiteNode::QUORUM
-                        && _syncCommands.find(command.request.methodLine) != _syncCommands.end()) {
-
-                        command.writeConsistency = SQLiteNode::QUORUM;
-                        SINFO("Forcing QUORUM consistency for command " << command.request.methodLine);
+                    if (request.empty()) {
+                        break;
                     }
 
-                    // This is important! All commands passed through the entire cluster must have unique IDs, or they
-                    // won't get routed properly from slave to master and back.
-                    command.id = _args["-nodeName"] + "#" + to_string(_requestCount++);
-
-                    // And we and keep track of the client that initiated this command, so we can respond later.
-                    command.initiatingClientID = s->id;
+                    // Make a place for the response, and queue up the command.
+                    BedrockCommand command = _buildCommand(move(request), s);
+                    {
+                        SAUTOLOCK(_socketIDMutex);
+                        ClientReplies& replies = _socketIDMap[s->id];
+                        replies.socket = s;
+                        command.initiatingClientRequest = _startRequest(replies, command, *this);
+                    }
 
                     // Status and control requests are handled specially.
                     if (_isStatusCommand(command)) {
                         _status(command);
                         _reply(command);
                     } else if (_isControlCommand(command)) {
-                        // Verify this came from localhost.
-                        unsigned long ip = ntohl(s->addr.sin_addr.s_addr);
-
-                        // This number is the unsigned long representation of 127.0.0.1.
-                        if (2130706433 == ip) {
+                        if (_allowControlCommand(command, s)) {
                             _control(command);
-                            _reply(command);
-                        } else {
-                            char str[INET_ADDRSTRLEN];
-                            inet_ntop(AF_INET, &(s->addr.sin_addr), str, INET_ADDRSTRLEN);
-                            SWARN("Got control command " << command.request.methodLine
-                                  << " on non-localhost socket (" << str << "). Ignoring.");
-                            command.response.methodLine = "401 Unauthorized";
-                            _reply(command);
                         }
+                        _reply(command);
                     } else {
                         // Otherwise we queue it for later processing.
                         _commandQueue.push(move(command));
@@ -1108,19 +1249,58 @@ void BedrockServer::postPoll(fd_map& fdm, uint64_t& nextActivity) {
         }
     }
 
-    // If we started shutting down, we can now finish that process.
-    if (_shutdownState.load() == START_SHUTDOWN) {
+    // If we started shutting down, we can now finish that process, as long as the IO threads have also done their final
+    // read.
+    bool ioThreadsDone = all_of(_ioThreads.begin(), _ioThreads.end(),
+                                [](const unique_ptr<IOThread>& io) { return io->finalReadDone.load(); });
+    if (_shutdownState.load() == START_SHUTDOWN && ioThreadsDone) {
         _shutdownState.store(PORTS_CLOSED);
         SINFO("PORTS_CLOSED. All ports closed.");
     }
 }
 
 void BedrockServer::_reply(BedrockCommand& command) {
+    // The master doesn't hold commands we escalate to it. If one should wait, it tells us, and we run it again here,
+    // where it can wait. We wait until we've caught up with what the master saw, though, or it'd just be escalated
+    // again.
+    if (command.response.isSet("waitKey")) {
+        if (_shutdownState.load() == RUNNING) {
+            SINFO("Running " << command.request.methodLine << " again to wait on '" << command.response["waitKey"]
+                  << "' here.");
+            command.request["commitCount"] = to_string(max(command.request.calcU64("commitCount"),
+                                                           command.response.calcU64("commitCount")));
+            _requeueWaitingCommand(move(command));
+            return;
+        }
+        command.response.erase("waitKey");
+    }
+
+    // If a plugin wants this command to wait for something before it's answered, we hold on to it instead.
+    if (!command.waitKey.empty() && _waitCommand(command)) {
+        return;
+    }
+
+    // Unless a plugin is handling it, a command's socket belongs to an IO thread if we have any. We build the response
+    // here, and hand it to the IO thread to send.
+    if (!_ioThreads.empty() && command.request["plugin"].empty()) {
+        if (_isFireAndForget(command)) {
+            return;
+        }
+        command.finalizeTimingInfo();
+        command.response["nodeName"] = _args["-nodeName"];
+        _negotiateCompression(command);
+        IOThread& io = *_ioThreads[command.initiatingClientID % _ioThreads.size()];
+        io.responses.push({(uint64_t)command.initiatingClientID, command.initiatingClientRequest,
+                           command.response.serialize(), SIEquals(command.request["Connection"], "close")});
+        return;
+    }
+
     SAUTOLOCK(_socketIDMutex);
 
-    // Do we have a socket for this command?
+    // Do we have a socket for this command, that's still waiting for its response?
     auto socketIt = _socketIDMap.find(command.initiatingClientID);
-    if (socketIt != _socketIDMap.end()) {
+    if (socketIt != _socketIDMap.end() && socketIt->second.pending.count(command.initiatingClientRequest)) {
+        ClientReplies& replies = socketIt->second;
 
         // The last thing we do is total up our timing info and add it to the response.
         command.finalizeTimingInfo();
@@ -1129,30 +1309,313 @@ void BedrockServer::_reply(BedrockCommand& command) {
         // Is a plugin handling this command? If so, it gets to send the response.
         string& pluginName = command.request["plugin"];
         if (!pluginName.empty()) {
-            // Let the plugin handle it
+            // Let the plugin handle it. Plugin sockets only have one request at a time, so this can't be out of order.
             SINFO("Plugin '" << pluginName << "' handling response '" << command.response.methodLine
                   << "' to request '" << command.request.methodLine << "'");
             BedrockPlugin* plugin = BedrockPlugin::getPluginByName(pluginName);
             if (plugin) {
-                plugin->onPortRequestComplete(command, socketIt->second);
+                plugin->onPortRequestComplete(command, replies.socket);
             } else {
                 SERROR("Couldn't find plugin '" << pluginName << ".");
             }
+            replies.pending.erase(command.initiatingClientRequest);
+
+            // If `Connection: close` was set, shut down the socket.
+            if (SIEquals(command.request["Connection"], "close")) {
+                shutdownSocket(replies.socket, SHUT_RD);
+            }
         } else {
-            // Otherwise we send the standard response.
-            socketIt->second->send(command.response.serialize());
+            // Otherwise we send the standard response, once everything ahead of it has been sent.
+            _negotiateCompression(command);
+            _queueReply(replies, command.initiatingClientRequest, command.response.serialize(),
+                        SIEquals(command.request["Connection"], "close"), *this);
         }
+    }
+    else if (!_isFireAndForget(command)) {
+        SWARN("No socket to reply for: '" << command.request.methodLine << "' #" << command.initiatingClientID);
+    }
+}
 
-        // If `Connection: close` was set, shut down the socket.
-        if (SIEquals(command.request["Connection"], "close")) {
-            shutdownSocket(socketIt->second, SHUT_RD);
+bool BedrockServer::_negotiateCompression(BedrockCommand& command) {
+    SData& response = command.response;
+    if (response.isSet("Content-Encoding")) {
+        // The command picked its own encoding.
+        return SIEquals(response["Content-Encoding"], "gzip") && !response.content.empty();
+    }
+    if (_responseCompressionLevel && !response.content.empty() &&
+        response.content.size() >= _responseCompressionMinSize &&
+        SAcceptsEncoding(command.request["Accept-Encoding"], "gzip")) {
+        response["Content-Encoding"] = "gzip";
+        return true;
+    }
+    return false;
+}
+
+void BedrockServer::_syncThreadReply(BedrockCommand& command) {
+    // Everything waits on the sync thread, so it shouldn't spend its time compressing responses. A worker will pick
+    // this up, see it's complete, and reply to it instead.
+    if (_compressOnWorkers && _negotiateCompression(command)) {
+        SINFO("Sending completed command " << command.request.methodLine << " to a worker to compress the response.");
+        _responsesCompressedOnWorkers++;
+        _commandQueue.push(move(command));
+        return;
+    }
+    _reply(command);
+}
+
+void BedrockServer::wakeWaitingCommands(function<bool(const string& key)> matches) {
+    lock_guard<mutex> lock(_waitingCommandMutex);
+    const uint64_t wakeCount = ++_waitingCommandWakeCount;
+    for (auto& key : _waitKeyWakeCounts) {
+        if (matches(key.first)) {
+            key.second = wakeCount;
+        }
+    }
+    for (auto it = _waitingCommands.begin(); it != _waitingCommands.end();) {
+        if (!matches(it->first)) {
+            it++;
+            continue;
         }
+        SINFO("Waking " << it->second.size() << " commands waiting on '" << it->first << "'.");
+        for (auto& entry : it->second) {
+            _requeueWaitingCommand(move(entry.second));
+        }
+        it = _waitingCommands.erase(it);
+    }
+}
 
-        // We only keep track of sockets with pending commands.
-        _socketIDMap.erase(socketIt);
+bool BedrockServer::_waitCommand(BedrockCommand& command) {
+    // Nobody waits once we're shutting down. Nor do commands from peers; they wait on the node they came from (see
+    // `BedrockCore`).
+    if (_shutdownState.load() != RUNNING || command.initiatingPeerID) {
+        return false;
     }
-    else if (!SIEquals(command.request["Connection"], "forget")) {
-        SWARN("No socket to reply for: '" << command.request.methodLine << "' #" << command.initiatingClientID);
+    lock_guard<mutex> lock(_waitingCommandMutex);
+
+    // Any number of different keys can be waited on over time. Rather than keep track of them all forever, we start
+    // again once there are a lot of them.
+    if (_waitKeyWakeCounts.size() >= MAX_WAIT_KEYS) {
+        _waitKeyWakeCounts.clear();
+    }
+    auto wakeCountIt = _waitKeyWakeCounts.emplace(command.waitKey, _waitingCommandWakeCount.load()).first;
+    if (wakeCountIt->second > command.waitWakeCount) {
+        // This command's key was woken since it last ran, so what it's waiting for may already have happened. Rather
+        // than wait for a wake-up that's already happened, we just run it again.
+        SINFO("Re-running " << command.request.methodLine << " instead of waiting on '" << command.waitKey
+              << "', it may have missed its wake-up.");
+        _requeueWaitingCommand(move(command));
+        return true;
+    }
+    SINFO("Holding " << command.request.methodLine << " until '" << command.waitKey << "' is woken, or for up to "
+          << (command.waitUntil - min(command.waitUntil, STimeNow())) / STIME_US_PER_MS << "ms.");
+    const uint64_t waitUntil = command.waitUntil;
+    _waitingCommands[command.waitKey].emplace(waitUntil, move(command));
+    return true;
+}
+
+void BedrockServer::_requeueWaitingCommand(BedrockCommand&& command) {
+    command.complete = false;
+    command.response.clear();
+    command.jsonContent.clear();
+    command.waitKey.clear();
+    command.waitUntil = 0;
+    _commandQueue.push(move(command));
+}
+
+void BedrockServer::_wakeExpiredCommands(uint64_t& nextActivity) {
+    lock_guard<mutex> lock(_waitingCommandMutex);
+    const uint64_t now = STimeNow();
+    const bool shuttingDown = _shutdownState.load() != RUNNING;
+    for (auto it = _waitingCommands.begin(); it != _waitingCommands.end();) {
+        auto& commands = it->second;
+        while (!commands.empty() && (shuttingDown || commands.begin()->first <= now)) {
+            _requeueWaitingCommand(move(commands.begin()->second));
+            commands.erase(commands.begin());
+        }
+        if (commands.empty()) {
+            it = _waitingCommands.erase(it);
+        } else {
+            nextActivity = min(nextActivity, commands.begin()->first);
+            it++;
+        }
+    }
+}
+
+uint64_t BedrockServer::_startRequest(ClientReplies& replies, const BedrockCommand& command, STCPManager& manager) {
+    uint64_t requestNumber = replies.nextRequest++;
+    replies.pending[requestNumber];
+    if (_isFireAndForget(command)) {
+        // Respond immediately to make it clear we successfully queued it, but don't keep track of the request, as we
+        // don't care about the answer.
+        SINFO("Firing and forgetting '" << command.request.methodLine << "'");
+        _queueReply(replies, requestNumber, SData("202 Successfully queued").serialize(), false, manager);
+    } else {
+        SINFO("Waiting for '" << command.request.methodLine << "' to complete.");
+    }
+    return requestNumber;
+}
+
+bool BedrockServer::_isFireAndForget(const BedrockCommand& command) {
+    // A command that doesn't give a `commandExecuteTime` gets its creation time, so this is only true for one that
+    // asked to run later than it arrived. It's checked against the creation time, rather than the current time, so
+    // the answer is the same when the command is finally replied to.
+    return SIEquals(command.request["Connection"], "forget") ||
+           (uint64_t)command.request.calc64("commandExecuteTime") > command.creationTime;
+}
+
+void BedrockServer::_queueReply(ClientReplies& replies, uint64_t requestNumber, string&& serialized, bool close,
+                                STCPManager& manager) {
+    auto replyIt = replies.pending.find(requestNumber);
+    if (replyIt == replies.pending.end()) {
+        SWARN("No request #" << requestNumber << " to reply to on socket #" << replies.socket->id);
+        return;
+    }
+    replyIt->second.done = true;
+    replyIt->second.close = close;
+    replyIt->second.serialized = move(serialized);
+
+    // Send everything at the front of the queue that's ready.
+    while (!replies.pending.empty() && replies.pending.begin()->second.done) {
+        ClientReplies::Reply& reply = replies.pending.begin()->second;
+        replies.socket->send(reply.serialized);
+        if (reply.close) {
+            // The client asked us to close the connection after this, so anything after it will never be sent.
+            manager.shutdownSocket(replies.socket, SHUT_RD);
+            replies.pending.clear();
+            break;
+        }
+        replies.pending.erase(replies.pending.begin());
+    }
+}
+
+BedrockCommand BedrockServer::_buildCommand(SData&& request, Socket* s) {
+    // Go by way of SQLiteCommand, so the request (and its content, which may be large) is moved rather than copied.
+    BedrockCommand command(SQLiteCommand(move(request)));
+    if (command.writeConsistency != SQLiteNode::QUORUM
+        && _syncCommands.find(command.request.methodLine) != _syncCommands.end()) {
+
+        command.writeConsistency = SQLiteNode::QUORUM;
+        SINFO("Forcing QUORUM consistency for command " << command.request.methodLine);
+    }
+
+    // This is important! All commands passed through the entire cluster must have unique IDs, or they won't get
+    // routed properly from slave to master and back.
+    command.id = _args["-nodeName"] + "#" + to_string(_requestCount++);
+
+    // And we and keep track of the client that initiated this command, so we can respond later.
+    command.initiatingClientID = s->id;
+    return command;
+}
+
+bool BedrockServer::_allowControlCommand(BedrockCommand& command, Socket* s) {
+    // Verify this came from localhost. Anything on a Unix domain socket did, as it had to connect through the
+    // filesystem.
+    if (s->addr.sin_family == AF_UNIX) {
+        return true;
+    }
+    unsigned long ip = ntohl(s->addr.sin_addr.s_addr);
+
+    // This number is the unsigned long representation of 127.0.0.1.
+    if (2130706433 == ip) {
+        return true;
+    }
+    char str[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &(s->addr.sin_addr), str, INET_ADDRSTRLEN);
+    SWARN("Got control command " << command.request.methodLine << " on non-localhost socket (" << str
+          << "). Ignoring.");
+    command.response.methodLine = "401 Unauthorized";
+    return false;
+}
+
+void BedrockServer::_io(IOThread& io, int threadID) {
+    SInitialize("io" + to_string(threadID));
+    while (!_ioThreadsStopping.load()) {
+        // If shutdown has started before we read from our sockets, this is our final read.
+        bool shuttingDown = _shutdownState.load() != RUNNING;
+
+        fd_map fdm;
+        io.newSockets.prePoll(fdm);
+        io.responses.prePoll(fdm);
+        io.sockets.prePoll(fdm);
+        S_poll(fdm, STIME_US_PER_S);
+        io.newSockets.postPoll(fdm, 1024);
+        io.responses.postPoll(fdm, 1024);
+        io.sockets.postPoll(fdm);
+
+        // Pick up any sockets the main thread has accepted for us. A null socket is just a wake-up.
+        while (!io.newSockets.empty()) {
+            Socket* s = io.newSockets.pop();
+            if (s) {
+                s->manager = &io.sockets;
+                io.sockets.socketList.push_back(s);
+            }
+        }
+
+        // Send any responses that are ready.
+        while (!io.responses.empty()) {
+            IOThread::Response response = io.responses.pop();
+            auto socketIt = io.replies.find(response.socketID);
+            if (socketIt == io.replies.end()) {
+                SWARN("No socket to reply for #" << response.socketID);
+                continue;
+            }
+            _queueReply(socketIt->second, response.requestNumber, move(response.serialized), response.close,
+                        io.sockets);
+        }
+
+        // Read new requests, just like `postPoll` does for sockets on the main thread.
+        list<Socket*> socketsToClose;
+        for (Socket* s : io.sockets.socketList) {
+            if (s->state == Socket::CLOSED) {
+                io.replies.erase(s->id);
+                socketsToClose.push_back(s);
+                continue;
+            }
+            if (s->state != Socket::CONNECTED) {
+                continue;
+            }
+            ClientReplies& replies = io.replies[s->id];
+            replies.socket = s;
+            while (s->state == Socket::CONNECTED && !s->recvBuffer.empty() &&
+                   replies.pending.size() < _maxRequestsInFlight) {
+                SData request;
+                try {
+                    if (!s->httpParser.parse(s->recvBuffer, request)) {
+                        break;
+                    }
+                } catch (const char* e) {
+                    SWARN("Malformed request from '" << s->addr << "' (" << e << "), closing socket.");
+                    io.sockets.shutdownSocket(s);
+                    break;
+                }
+                BedrockCommand command = _buildCommand(move(request), s);
+                command.initiatingClientRequest = _startRequest(replies, command, io.sockets);
+
+                // Status and control commands look at state that belongs to the main thread, so they run there.
+                if (_isStatusCommand(command)) {
+                    _serverCommands.push(move(command));
+                } else if (_isControlCommand(command)) {
+                    if (_allowControlCommand(command, s)) {
+                        _serverCommands.push(move(command));
+                    } else {
+                        _reply(command);
+                    }
+                } else {
+                    _commandQueue.push(move(command));
+                }
+            }
+        }
+        for (Socket* s : socketsToClose) {
+            io.sockets.closeSocket(s);
+        }
+        if (shuttingDown) {
+            io.finalReadDone.store(true);
+        }
+    }
+
+    // We're done, close everything.
+    while (!io.sockets.socketList.empty()) {
+        io.sockets.closeSocket(io.sockets.socketList.front());
     }
 }
 
@@ -1173,9 +1636,9 @@ void BedrockServer::suppressCommandPort(const string& reason, bool suppress, boo
         // Close the command port, and all plugin's ports. Won't reopen.
         SHMMM("Suppressing command port");
         if (!portList.empty()) {
-            closePorts({_controlPort});
+            closePorts(_controlPorts);
             _portPluginMap.clear();
-            _commandPort = nullptr;
+            _commandPorts.clear();
         }
     } else {
         // Clearing past suppression, but don't reopen (It's always safe to close, but not always safe to open).
@@ -1239,6 +1702,12 @@ void BedrockServer::_status(BedrockCommand& command) {
         for (auto plugin : plugins) {
             STable pluginData = plugin->getInfo();
             pluginData["name"] = plugin->getName();
+            int managerIndex = 0;
+            for (auto manager : plugin->httpsManagers) {
+                // If a plugin has more than one, number them so their counters don't overwrite each other.
+                bool numbered = plugin->httpsManagers.size() > 1;
+                manager->getPoolInfo(pluginData, "https" + (numbered ? to_string(managerIndex++) : ""));
+            }
             pluginList.push_back(SComposeJSONObject(pluginData));
         }
         content["isMaster"] = state == SQLiteNode::MASTERING ? "true" : "false";
@@ -1246,11 +1715,13 @@ void BedrockServer::_status(BedrockCommand& command) {
         content["state"]    = SQLiteNode::stateNames[state];
         content["version"]  = _version;
         content["host"]     = _args["-nodeHost"];
+        content["responsesCompressedOnWorkers"] = to_string(_responsesCompressedOnWorkers.load());
 
-        // On master, return the current multi-write blacklists.
+        // On master, return the current multi-write blacklists, and how often each command has conflicted.
         if (state == SQLiteNode::MASTERING) {
             content["multiWriteAutoBlacklist"] = BedrockConflictMetrics::getMultiWriteDeniedCommands();
             content["multiWriteManualBlacklist"] = SComposeJSONArray(_blacklistedParallelCommands);
+            content["multiWriteConflictCounts"] = BedrockConflictMetrics::getConflictCounts();
         }
 
         // We read from syncNode internal state here, so we lock to make sure that this doesn't conflict with the sync
@@ -1262,11 +1733,24 @@ void BedrockServer::_status(BedrockCommand& command) {
 
             // Set some information about this node.
             content["CommitCount"] = to_string(_syncNode->getCommitCount());
+            uint64_t lagCommits, lagMS;
+            _syncNode->getReplicationLag(lagCommits, lagMS);
+            content["replicationLagCommits"] = to_string(lagCommits);
+            content["replicationLagMS"] = to_string(lagMS);
+
+            // If we're applying replicated transactions in parallel, report how far behind that is.
+            if (_syncNode->getApplier()) {
+                _syncNode->getApplier()->getStatus(content);
+            }
 
             // Retrieve information about our peers.
             for (SQLiteNode::Peer* peer : _syncNode->peerList) {
                 peerData.emplace_back(peer->nameValueMap);
                 peerData.back()["host"] = peer->host;
+                peerData.back()["compressedBytesSent"] = to_string(peer->compressedBytesSent);
+                peerData.back()["uncompressedBytesSent"] = to_string(peer->uncompressedBytesSent);
+                peerData.back()["compressedBytesReceived"] = to_string(peer->compressedBytesReceived);
+                peerData.back()["uncompressedBytesReceived"] = to_string(peer->uncompressedBytesReceived);
             }
 
             // Get any escalated commands that are waiting to be processed.
@@ -1280,6 +1764,14 @@ void BedrockServer::_status(BedrockCommand& command) {
         }
         content["peerList"]             = SComposeJSONArray(peerList);
         content["queuedCommandList"]    = SComposeJSONArray(_commandQueue.getRequestMethodLines());
+        {
+            lock_guard<mutex> lock(_waitingCommandMutex);
+            size_t waitingCommandCount = 0;
+            for (const auto& commands : _waitingCommands) {
+                waitingCommandCount += commands.second.size();
+            }
+            content["waitingCommandCount"] = to_string(waitingCommandCount);
+        }
         content["escalatedCommandList"] = SComposeJSONArray(escalated);
 
         // Done, compose the response.
@@ -1381,10 +1873,15 @@ void BedrockServer::_beginShutdown(const string& reason) {
         // Close our listening ports, we won't accept any new connections on them.
         closePorts();
         _portPluginMap.clear();
-        _commandPort = nullptr;
-        _controlPort = nullptr;
+        _commandPorts.clear();
+        _controlPorts.clear();
         _shutdownState.store(START_SHUTDOWN);
         SINFO("START_SHUTDOWN. Ports shutdown, will perform final socket read.");
+
+        // Wake up the IO threads so they do their final read now.
+        for (auto& io : _ioThreads) {
+            io->newSockets.push(nullptr);
+        }
     }
 }
 
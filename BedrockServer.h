@@ -63,9 +63,18 @@ class BedrockServer : public SQLiteServer {
     // Exposes the replication state to plugins.
     SQLiteNode::State getState() const { return _replicationState.load(); }
 
+    // Wakes the commands waiting on every key `matches` returns true for, so they're run again (see
+    // `BedrockCommand::waitKey`). Any thread can call this.
+    void wakeWaitingCommands(function<bool(const string& key)> matches);
+
+    // The number of times `wakeWaitingCommands` has been called. A command records this before it's run, so if it
+    // then asks to wait, we can tell whether its key was woken in the meantime, and it might have missed its wake-up.
+    uint64_t getWaitingCommandWakeCount() const { return _waitingCommandWakeCount.load(); }
+
     // Flush the send buffers
     // STCPNode API.
     void prePoll(fd_map& fdm);
+    void prePoll(SEventLoop& loop);
 
     // Accept connections and dispatch requests
     // STCPNode API.
@@ -92,16 +101,31 @@ class BedrockServer : public SQLiteServer {
     // Commands that aren't currently being processed are kept here.
     BedrockCommandQueue _commandQueue;
 
-    // Each time we read a new request from a client, we give it a unique ID.
-    uint64_t _requestCount;
+    // Each time we read a new request from a client, we give it a unique ID. IO threads do this too, so it's atomic.
+    atomic<uint64_t> _requestCount;
+
+    // The responses we owe a client connection. A client can send several requests without waiting for responses (up
+    // to `-maxRequestsInFlight` at once), and they can finish in any order, so each response waits here until the
+    // responses to everything the client sent before it have been sent.
+    struct ClientReplies {
+        struct Reply {
+            bool done = false;
+            bool close = false;
+            string serialized;
+        };
+
+        Socket* socket = nullptr;
 
-    // We keep a map of requests to socket. We should never have more than one request per socket at a given time, or
-    // we could deliver responses in the wrong order.
-    map<uint64_t, Socket*> _requestCountSocketMap;
+        // The number that'll be given to the next request read from this connection.
+        uint64_t nextRequest = 0;
 
-    // Each time we connect a new socket, we give it an ID, and we insert it in this set. When a socket disconnects, we
-    // remove that ID from this set.
-    map <uint64_t, Socket*> _socketIDMap;
+        // Requests we haven't responded to yet, by request number, with their responses once they're done.
+        map<uint64_t, Reply> pending;
+    };
+
+    // Each time we read a request from a client socket, we make sure it has an entry here, by socket ID, and we
+    // remove it when the socket disconnects. This is only used when we're not using IO threads, or for plugin sockets.
+    map<uint64_t, ClientReplies> _socketIDMap;
 
     // The above _socketIDMap is modified by multiple threads, so we lock this mutex around operations that modify it.
     recursive_mutex _socketIDMutex;
@@ -167,6 +191,87 @@ class BedrockServer : public SQLiteServer {
     // then this is an error, as the command should have been sent back to a peer.
     void _reply(BedrockCommand&);
 
+    // Gives a command just read from a client connection its request number, and makes a place for its response. If
+    // the command is "fire and forget", its response is a 202 that's ready right away. `manager` owns the socket.
+    static uint64_t _startRequest(ClientReplies& replies, const BedrockCommand& command, STCPManager& manager);
+
+    // Returns whether a client command was answered with a 202 as soon as it arrived, either because it asked for
+    // `Connection: forget`, or because it's scheduled to run later, so its eventual response isn't sent.
+    static bool _isFireAndForget(const BedrockCommand& command);
+
+    // Stores the response to request `requestNumber` on a client connection, and sends every response that's now
+    // ready, in order. If `close` is set, the socket is shut down after this response is sent.
+    static void _queueReply(ClientReplies& replies, uint64_t requestNumber, string&& serialized, bool close,
+                            STCPManager& manager);
+
+    // The most requests a single client connection can have in progress at once.
+    size_t _maxRequestsInFlight;
+
+    // Responses of at least `_responseCompressionMinSize` bytes are gzipped at `_responseCompressionLevel` for clients
+    // that send `Accept-Encoding: gzip`, unless the level is 0. If `_compressOnWorkers` is set, the sync thread leaves
+    // compressing responses to the workers, and counts them in `_responsesCompressedOnWorkers`.
+    int _responseCompressionLevel;
+    size_t _responseCompressionMinSize;
+    bool _compressOnWorkers;
+    atomic<uint64_t> _responsesCompressedOnWorkers;
+
+    // Decides whether the response to `command` should be gzipped, setting `Content-Encoding: gzip` on it if so. It's
+    // actually compressed when it's serialized. Returns true if it will be.
+    bool _negotiateCompression(BedrockCommand& command);
+
+    // The sync thread replies to client commands with this rather than `_reply`, so it can hand off responses that
+    // need compressing.
+    void _syncThreadReply(BedrockCommand& command);
+
+    // Creates a command for a request read from client socket `s`, giving it a unique ID. Its request number is set
+    // by `_startRequest`.
+    BedrockCommand _buildCommand(SData&& request, Socket* s);
+
+    // Returns true if `s` is allowed to run control commands (it's from localhost). Otherwise, sets an error response
+    // on `command`, which should be sent back to the client.
+    bool _allowControlCommand(BedrockCommand& command, Socket* s);
+
+    // When `-ioThreads` is set, client connections accepted on the command and control ports are handed off to these
+    // threads, which read and parse requests, queue commands, and send responses, leaving the main thread to accept
+    // connections and look after plugin ports. Each socket belongs to the thread at index `socket ID % thread count`,
+    // so a response can be routed to the right thread without looking anything up in `_socketIDMap`.
+    struct IOThread {
+        // Responses are serialized by whichever thread finished the command, so the IO thread only has to send them.
+        struct Response {
+            uint64_t socketID;
+            uint64_t requestNumber;
+            string serialized;
+            bool close;
+        };
+
+        // The sockets this thread owns.
+        STCPManager sockets;
+
+        // Sockets accepted by the main thread, waiting to be picked up by this one.
+        SSynchronizedQueue<Socket*> newSockets;
+
+        // Responses to send.
+        SSynchronizedQueue<Response> responses;
+
+        // Responses owed to each of our sockets, by socket ID. This is the equivalent of `_socketIDMap`, but only this
+        // thread ever touches it, so it needs no lock.
+        map<uint64_t, ClientReplies> replies;
+
+        // Set once this thread has read everything it's going to after shutdown has started.
+        atomic<bool> finalReadDone;
+
+        thread ioThread;
+    };
+    vector<unique_ptr<IOThread>> _ioThreads;
+    atomic<bool> _ioThreadsStopping;
+
+    // The function each IO thread runs.
+    void _io(IOThread& io, int threadID);
+
+    // Status and control commands read by IO threads. These are handed back to the main thread, which runs them the
+    // same way as if it had read them itself.
+    CommandQueue _serverCommands;
+
     // The following are constants used as methodlines by status command requests.
     static constexpr auto STATUS_IS_SLAVE          = "GET /status/isSlave HTTP/1.1";
     static constexpr auto STATUS_HANDLING_COMMANDS = "GET /status/handlingCommands HTTP/1.1";
@@ -202,6 +307,27 @@ class BedrockServer : public SQLiteServer {
     multimap<uint64_t, BedrockCommand> _futureCommitCommands;
     recursive_mutex _futureCommitCommandMutex;
 
+    // Commands that a plugin has asked us to hold until they're woken, by the key they're waiting on, and then by when
+    // they stop waiting regardless.
+    map<string, multimap<uint64_t, BedrockCommand>> _waitingCommands;
+    mutex _waitingCommandMutex;
+    atomic<uint64_t> _waitingCommandWakeCount;
+
+    // The wake count as of the last time each key that commands have waited on was woken. A key we haven't kept track
+    // of is taken to have been woken just now, which at worst runs a command again rather than holding it.
+    map<string, uint64_t> _waitKeyWakeCounts;
+    static constexpr size_t MAX_WAIT_KEYS = 10000;
+
+    // Holds `command` until it's woken, and returns true, unless it should be answered now.
+    bool _waitCommand(BedrockCommand& command);
+
+    // Puts a command that was waiting back in the command queue, to be run again from the start.
+    void _requeueWaitingCommand(BedrockCommand&& command);
+
+    // Called by the sync thread to wake waiting commands whose `waitUntil` has passed, or all of them once we're
+    // shutting down. Brings `nextActivity` forward to when the next one is due.
+    void _wakeExpiredCommands(uint64_t& nextActivity);
+
     // This is a shared mutex. It can be locked by many readers at once, but if the writer (the sync thread) locks it,
     // no other thread can access it. It's locked by the sync thread immediately before starting a transaction, and
     // unlocked afterward. Workers do the same, so that they won't try to start a new transaction while the sync thread
@@ -228,7 +354,7 @@ class BedrockServer : public SQLiteServer {
     // Set this to cause a backup to run when the server shuts down.
     bool _backupOnShutdown;
 
-    // Pointer to the control port, so we know which port not to shut down when we close the command ports.
-    Port* _controlPort;
-    Port* _commandPort;
+    // The control ports, so we know which ports not to shut down when we close the command ports.
+    list<Port*> _controlPorts;
+    list<Port*> _commandPorts;
 };
@@ -0,0 +1,204 @@
+#include "libstuff.h"
+#include <sys/uio.h>
+
+// The most segments we'll hand to the kernel in one `sendmsg`.
+static const int SBUFFER_MAX_IOVECS = 64;
+
+const size_t SBuffer::SEGMENT_SIZE;
+
+// Shared messages smaller than this are copied rather than referenced.
+static const size_t SBUFFER_MIN_SHARED_SIZE = SBuffer::SEGMENT_SIZE / 4;
+
+SBuffer::Segment::Segment(size_t capacity_)
+  : owned(new char[capacity_]), data(owned.get()), capacity(capacity_), start(0), end(0) { }
+
+SBuffer::Segment::Segment(const SSharedMessage& message)
+  : shared(message), data((char*)message->data()), capacity(message->size()), start(0), end(message->size()) { }
+
+SBuffer::SBuffer() : _size(0), _consumed(0) { }
+
+SBuffer::SBuffer(const string& from) : _size(0), _consumed(0) {
+    append(from.data(), from.size());
+}
+
+SBuffer& SBuffer::operator=(const string& from) {
+    clear();
+    append(from.data(), from.size());
+    return *this;
+}
+
+SBuffer& SBuffer::operator+=(const string& from) {
+    append(from.data(), from.size());
+    return *this;
+}
+
+void SBuffer::clear() {
+    _segments.clear();
+    _size = 0;
+}
+
+SBuffer::Segment& SBuffer::_tail() {
+    if (_segments.empty() || _segments.back().end == _segments.back().capacity) {
+        _segments.emplace_back(SEGMENT_SIZE);
+    }
+    return _segments.back();
+}
+
+void SBuffer::append(const char* buffer, size_t length) {
+    _size += length;
+
+    // Fill up whatever space is left at the end of the last segment.
+    if (!_segments.empty()) {
+        Segment& tail = _segments.back();
+        size_t fits = min(length, tail.capacity - tail.end);
+        memcpy(tail.data + tail.end, buffer, fits);
+        tail.end += fits;
+        buffer += fits;
+        length -= fits;
+    }
+
+    // Anything left goes in a new segment, which is big enough to take all of it at once.
+    if (length) {
+        _segments.emplace_back(max(length, SEGMENT_SIZE));
+        memcpy(_segments.back().data, buffer, length);
+        _segments.back().end = length;
+    }
+}
+
+void SBuffer::append(const SSharedMessage& message) {
+    if (message->size() < SBUFFER_MIN_SHARED_SIZE) {
+        append(message->data(), message->size());
+        return;
+    }
+    _segments.emplace_back(message);
+    _size += message->size();
+}
+
+void SBuffer::consumeFront(size_t length) {
+    SASSERT(length <= _size);
+    _size -= length;
+    _consumed += length;
+    while (length) {
+        Segment& head = _segments.front();
+        size_t available = head.end - head.start;
+        if (length < available) {
+            head.start += length;
+            return;
+        }
+        length -= available;
+        _segments.pop_front();
+    }
+}
+
+const char* SBuffer::c_str() const {
+    if (_segments.empty()) {
+        return "";
+    }
+
+    // If everything's already in one segment, with room for the null terminator, there's nothing to do.
+    Segment& head = _segments.front();
+    if (_segments.size() > 1 || head.end == head.capacity) {
+        if (head.capacity - head.start > _size) {
+            // Everything fits in the first segment, so copy the rest onto the end of it.
+            for (auto it = next(_segments.begin()); it != _segments.end(); it = _segments.erase(it)) {
+                size_t length = it->end - it->start;
+                memcpy(head.data + head.end, it->data + it->start, length);
+                head.end += length;
+            }
+        } else {
+            // Otherwise, start again with one segment that's big enough for everything, with plenty of room to grow,
+            // so that if this happens again as more data arrives, the copy above is all we'll need.
+            Segment joined(max(_size * 2, SEGMENT_SIZE));
+            for (const Segment& segment : _segments) {
+                size_t length = segment.end - segment.start;
+                memcpy(joined.data + joined.end, segment.data + segment.start, length);
+                joined.end += length;
+            }
+            _segments.clear();
+            _segments.push_back(move(joined));
+        }
+    }
+    Segment& joined = _segments.front();
+    joined.data[joined.end] = 0;
+    return joined.data + joined.start;
+}
+
+const char* SBuffer::front(size_t& length) const {
+    if (_segments.empty()) {
+        length = 0;
+        return "";
+    }
+    const Segment& head = _segments.front();
+    length = head.end - head.start;
+    return head.data + head.start;
+}
+
+void SBuffer::moveFront(size_t length, string& out) {
+    SASSERT(length <= _size);
+    size_t remaining = length;
+    for (auto it = _segments.begin(); remaining; it++) {
+        size_t chunk = min(remaining, it->end - it->start);
+        out.append(it->data + it->start, chunk);
+        remaining -= chunk;
+    }
+    consumeFront(length);
+}
+
+string SBuffer::str() const {
+    string result;
+    result.reserve(_size);
+    for (const Segment& segment : _segments) {
+        result.append(segment.data + segment.start, segment.end - segment.start);
+    }
+    return result;
+}
+
+ssize_t SBuffer::recv(int s) {
+    // Figure out if this socket is blocking or non-blocking. If it's blocking, we only read once.
+    bool blocking = !(fcntl(s, F_GETFL) & O_NONBLOCK);
+    ssize_t numRecv;
+    while (true) {
+        // Read into whatever's free at the end of our last segment. `_tail` only starts a new one when that's full,
+        // so past the first, we only allocate a segment after a read has filled the last one, rather than on every
+        // read, including the last one that finds there's nothing left.
+        Segment& tail = _tail();
+        numRecv = ::recv(s, tail.data + tail.end, tail.capacity - tail.end, 0);
+        if (numRecv <= 0) {
+            break;
+        }
+        _size += numRecv;
+        tail.end += numRecv;
+
+        // Keep reading until the socket would block, unless it's a blocking socket, in which case it would block
+        // until the next read, so we stop here.
+        if (blocking) {
+            break;
+        }
+    }
+
+    // If the last segment never got any data, don't keep it around.
+    if (!_segments.empty() && _segments.back().end == _segments.back().start) {
+        _segments.pop_back();
+    }
+    return numRecv;
+}
+
+ssize_t SBuffer::send(int s) {
+    iovec iov[SBUFFER_MAX_IOVECS];
+    int count = 0;
+    for (auto it = _segments.begin(); it != _segments.end() && count < SBUFFER_MAX_IOVECS; it++) {
+        iov[count++] = {it->data + it->start, it->end - it->start};
+    }
+    msghdr message = {};
+    message.msg_iov = iov;
+    message.msg_iovlen = count;
+    ssize_t numSent = sendmsg(s, &message, MSG_NOSIGNAL);
+    if (numSent > 0) {
+        consumeFront(numSent);
+    }
+    return numSent;
+}
+
+ostream& operator<<(ostream& os, const SBuffer& buffer) {
+    return os << buffer.str();
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+// An immutable, reference-counted message, which can be queued to send on several sockets at once. Each one's send
+// buffer holds a reference to it, rather than a copy.
+typedef shared_ptr<const string> SSharedMessage;
+inline SSharedMessage SMakeSharedMessage(string&& message) { return make_shared<const string>(move(message)); }
+
+// A byte buffer made of a chain of segments, used for socket send and receive buffers. Appending never moves data
+// that's already in the buffer, and consuming from the front just advances an offset into the first segment (freeing
+// it once it's used up), so a buffer holding many pipelined requests can be consumed one request at a time without
+// copying everything after each one, which is what `SConsumeFront` does to a string. Sockets read into and write from
+// the segments directly, with `readv` and `sendmsg`.
+//
+// A segment can also be a reference to an immutable, shared message (an `SSharedMessage`), so the same bytes can be
+// queued to send on any number of sockets without copying them into each one's buffer.
+//
+// Parsers need contiguous memory, so `c_str()` joins the segments together when there's more than one. Where it can,
+// it does that by copying the later segments onto the end of the first, which is allocated with room to grow, so a
+// large message that arrives in many pieces, and that we try to parse after each one, is still copied a bounded
+// number of times overall.
+class SBuffer {
+  public:
+    // Size of the segments we allocate for receiving, and for appending small amounts of data.
+    static const size_t SEGMENT_SIZE = 16 * 1024;
+
+    SBuffer();
+    SBuffer(const string& from);
+    SBuffer(SBuffer&& from) = default;
+    SBuffer& operator=(SBuffer&& from) = default;
+    SBuffer& operator=(const string& from);
+    SBuffer& operator+=(const string& from);
+
+    // These work like their `string` counterparts.
+    bool empty() const { return !_size; }
+    size_t size() const { return _size; }
+    void clear();
+    void append(const char* buffer, size_t length);
+
+    // Appends a shared message by reference, rather than copying it. Small messages are copied anyway, as they're
+    // cheaper to copy than to keep track of.
+    void append(const SSharedMessage& message);
+
+    // Discards `length` bytes from the front of the buffer.
+    void consumeFront(size_t length);
+
+    // Returns how many bytes have been consumed from the front of the buffer, ever. For a send buffer, anything that
+    // was appended when `consumed() + size()` was N has been sent once this reaches N.
+    uint64_t consumed() const { return _consumed; }
+
+    // Returns a pointer to the contents of the buffer as contiguous, null-terminated memory. This is valid until the
+    // buffer is next modified.
+    const char* c_str() const;
+
+    // Returns a pointer to the first contiguous run of bytes in the buffer, and sets `length` to the size of that run.
+    // Unlike `c_str()`, this never moves anything, and the result isn't null-terminated.
+    const char* front(size_t& length) const;
+
+    // Appends the first `length` bytes of the buffer to `out`, and consumes them.
+    void moveFront(size_t length, string& out);
+
+    // Returns a copy of the contents as a string.
+    string str() const;
+
+    // Reads whatever's available from socket `s` onto the end of the buffer. Returns the result of the last read, as
+    // `recv` would (so 0 means the other end closed the socket, and -1 means check `errno`).
+    ssize_t recv(int s);
+
+    // Sends as much of the buffer as `s` will take, consuming whatever was sent. Returns the result of `sendmsg`.
+    ssize_t send(int s);
+
+  private:
+    struct Segment {
+        Segment(size_t capacity);
+        Segment(const SSharedMessage& message);
+
+        // A segment's data is either its own, or a shared message. A shared segment is always full, so nothing ever
+        // writes to it.
+        unique_ptr<char[]> owned;
+        SSharedMessage shared;
+        char* data;
+        size_t capacity;
+
+        // Data lives in [start, end).
+        size_t start;
+        size_t end;
+    };
+
+    // Makes sure the last segment has some free space, adding a new one if it doesn't.
+    Segment& _tail();
+
+    // `c_str()` is logically const, but it rearranges our segments.
+    mutable list<Segment> _segments;
+    size_t _size;
+    uint64_t _consumed;
+};
+
+// Writes the buffer's contents, for logging.
+ostream& operator<<(ostream& os, const SBuffer& buffer);
+
+// Same as `SConsumeFront` on a string, but doesn't need to move the rest of the buffer.
+inline void SConsumeFront(SBuffer& lhs, ssize_t num) {
+    lhs.consumeFront(num);
+}
@@ -0,0 +1,138 @@
+#include "libstuff.h"
+#ifdef __linux__
+#include <sys/epoll.h>
+
+// We pass poll() event bits straight through to epoll. These are the same on Linux, but make sure.
+static_assert(POLLIN == EPOLLIN && POLLPRI == EPOLLPRI && POLLOUT == EPOLLOUT && POLLERR == EPOLLERR &&
+              POLLHUP == EPOLLHUP, "poll and epoll event bits differ");
+
+// The most events we'll take from the kernel in a single wait. Anything else that's ready is still ready next time.
+static const int SEVENTLOOP_MAX_EVENTS = 256;
+#endif
+
+SEventLoop::SEventLoop() : _waitCount(0), _epollFD(-1) {
+#ifdef __linux__
+    _epollFD = epoll_create1(EPOLL_CLOEXEC);
+    if (_epollFD < 0) {
+        SWARN("Couldn't create epoll instance (" << strerror(errno) << "), falling back to poll.");
+    }
+#endif
+}
+
+SEventLoop::~SEventLoop() {
+    if (_epollFD >= 0) {
+        close(_epollFD);
+    }
+}
+
+void SEventLoop::set(int fd, short events, uint64_t owner) {
+    auto it = _registrations.find(fd);
+    bool existing = it != _registrations.end();
+    if (existing && it->second.events == events && it->second.owner == owner) {
+        // Nothing's changed, but make sure this sticks around even if it was first registered from an fd_map.
+        it->second.transientWait = 0;
+        return;
+    }
+    Registration registration = {events, owner, 0};
+    _register(fd, registration, existing);
+    _registrations[fd] = registration;
+}
+
+void SEventLoop::remove(int fd) {
+    auto it = _registrations.find(fd);
+    if (it == _registrations.end()) {
+        return;
+    }
+    _registrations.erase(it);
+#ifdef __linux__
+    // If the fd has already been closed, the kernel has already forgotten it, so we don't care if this fails.
+    if (_epollFD >= 0) {
+        epoll_event ignore = {};
+        epoll_ctl(_epollFD, EPOLL_CTL_DEL, fd, &ignore);
+    }
+#endif
+}
+
+void SEventLoop::_register(int fd, const Registration& registration, bool existing) {
+#ifdef __linux__
+    if (_epollFD < 0) {
+        return;
+    }
+    epoll_event event = {};
+    event.events = (uint16_t)registration.events;
+    event.data.fd = fd;
+    if (!epoll_ctl(_epollFD, existing ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event)) {
+        return;
+    }
+
+    // If an fd was closed and re-opened without being removed, the kernel's registration will have gone away when it
+    // was closed, even though we still have a record of it. The opposite shouldn't happen, but handle it anyway.
+    if (errno == ENOENT && !epoll_ctl(_epollFD, EPOLL_CTL_ADD, fd, &event)) {
+        return;
+    }
+    if (errno == EEXIST && !epoll_ctl(_epollFD, EPOLL_CTL_MOD, fd, &event)) {
+        return;
+    }
+    SWARN("Couldn't register fd " << fd << " with epoll (" << strerror(errno) << "), it won't be watched.");
+#endif
+}
+
+int SEventLoop::wait(fd_map& fdm, uint64_t timeout) {
+    // Register anything the caller passed in. These last until a wait happens without them.
+    _waitCount++;
+    vector<int> previousTransientFDs = move(_transientFDs);
+    _transientFDs.clear();
+    for (auto& entry : fdm) {
+        auto it = _registrations.find(entry.first);
+        bool existing = it != _registrations.end();
+        if (existing && !it->second.transientWait) {
+            // Already registered persistently, which takes precedence.
+            continue;
+        }
+        Registration registration = {entry.second.events, 0, _waitCount};
+        if (!existing || it->second.events != registration.events) {
+            _register(entry.first, registration, existing);
+        }
+        _registrations[entry.first] = registration;
+        _transientFDs.push_back(entry.first);
+    }
+    for (int fd : previousTransientFDs) {
+        auto it = _registrations.find(fd);
+        if (it != _registrations.end() && it->second.transientWait && it->second.transientWait != _waitCount) {
+            remove(fd);
+        }
+    }
+    fdm.clear();
+
+#ifdef __linux__
+    if (_epollFD >= 0) {
+        // Timeout is specified in microseconds, but epoll uses milliseconds, so we divide by 1000.
+        epoll_event events[SEVENTLOOP_MAX_EVENTS];
+        int count = epoll_wait(_epollFD, events, SEVENTLOOP_MAX_EVENTS, int(timeout / 1000));
+        if (count == -1) {
+            SWARN("epoll_wait failed with response '" << strerror(errno) << "' (#" << errno << "), ignoring");
+            return count;
+        }
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            auto it = _registrations.find(fd);
+            fdm[fd] = (pollfd){fd, (short)(it != _registrations.end() ? it->second.events : 0),
+                               (short)events[i].events};
+        }
+        return count;
+    }
+#endif
+
+    // No epoll, so poll everything we've got registered.
+    fd_map all;
+    for (auto& entry : _registrations) {
+        all[entry.first] = (pollfd){entry.first, entry.second.events, 0};
+    }
+    int count = S_poll(all, timeout);
+    for (auto& entry : all) {
+        if (entry.second.revents) {
+            fdm.insert(entry);
+        }
+    }
+    return count;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+// An alternative to building an fd_map and calling S_poll on every loop iteration. Rather than handing the kernel the
+// whole set of file descriptors on every wait, they're registered once (with epoll, on Linux), and stay registered
+// until they're removed or their events change. A wait then costs time proportional to the number of ready file
+// descriptors, not the number being watched, which matters once there are thousands of idle client connections.
+//
+// `wait` returns its results as an fd_map containing only the ready file descriptors, so existing `postPoll(fd_map&)`
+// code, which checks for activity with SFDAnySet, works unchanged. Code that still fills in an fd_map in `prePoll`
+// can also share a loop: anything in the fd_map passed to `wait` is watched for that wait, in addition to the
+// persistent registrations, so a loop can be converted one component at a time.
+class SEventLoop {
+  public:
+    SEventLoop();
+    ~SEventLoop();
+    SEventLoop(const SEventLoop&) = delete;
+    SEventLoop& operator=(const SEventLoop&) = delete;
+
+    // Watches `fd` for `events` (SREADEVTS, SWRITEEVTS, as with SFDset) until it's removed. Calling this again with
+    // the same arguments is cheap, so it can be called on every loop iteration. `owner` should identify whatever owns
+    // the file descriptor (e.g., a socket ID); if an fd is closed without being removed and its number is reused by
+    // something else, the new owner is registered with the kernel even if it wants the same events.
+    void set(int fd, short events, uint64_t owner = 0);
+
+    // Stops watching `fd`. This must be called before closing a registered fd, unless its owner will never re-use it.
+    void remove(int fd);
+
+    // Waits up to `timeout` microseconds for activity. On return, `fdm` contains every file descriptor with activity,
+    // with its `revents` set, and nothing else. Returns the number of ready file descriptors, or -1 on error.
+    int wait(fd_map& fdm, uint64_t timeout);
+
+    // Returns the number of registered file descriptors.
+    size_t size() const { return _registrations.size(); }
+
+  private:
+    struct Registration {
+        short events;
+        uint64_t owner;
+
+        // If non-zero, this was registered from an fd_map passed to `wait`, and is dropped once a wait happens
+        // without it.
+        uint64_t transientWait;
+    };
+
+    // Updates the kernel's idea of what we're watching for `fd`.
+    void _register(int fd, const Registration& registration, bool existing);
+
+    map<int, Registration> _registrations;
+
+    // File descriptors registered from the fd_map passed to the last `wait`.
+    vector<int> _transientFDs;
+
+    // Counts calls to `wait`, to tell which transient registrations are stale.
+    uint64_t _waitCount;
+
+    // The epoll instance, or -1 where epoll isn't available and we fall back to `poll` over our registrations.
+    int _epollFD;
+};
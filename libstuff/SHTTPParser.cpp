@@ -0,0 +1,172 @@
+#include "libstuff.h"
+
+const size_t SHTTPParser::MAX_CONTENT_LENGTH;
+const size_t SHTTPParser::MAX_CONTENT_RESERVE;
+
+SHTTPParser::SHTTPParser() : _state(HEADERS), _scanned(0), _remaining(0) { }
+
+bool SHTTPParser::_nextLine(SBuffer& buffer, const char*& lineStart, const char*& lineEnd, size_t& consumed) {
+    // Normally the line is all in the first segment of the buffer, so look there first. If it runs off the end of
+    // that, join the buffer together and look at the whole thing. Either way, start from where we stopped last time.
+    size_t length;
+    const char* start = buffer.front(length);
+    if (_scanned >= length && buffer.size() > length) {
+        start = buffer.c_str();
+        length = buffer.size();
+    }
+    while (true) {
+        const char* end = start + length;
+        const char* eol = start + _scanned;
+        while (eol < end && *eol != '\r' && *eol != '\n') {
+            ++eol;
+        }
+        if (eol == end) {
+            if (buffer.size() > length) {
+                // The line continues past the first segment.
+                _scanned = length;
+                start = buffer.c_str();
+                length = buffer.size();
+                continue;
+            }
+            _scanned = length;
+            return false;
+        }
+
+        // Accept \r\n, \n\r, \r, or \n, just like `SParseHTTP`. If all we've got so far is a \r, wait to see if a \n
+        // follows it.
+        size_t eolLength = 1;
+        if (eol + 1 == end) {
+            if (buffer.size() > length) {
+                _scanned = eol - start;
+                start = buffer.c_str();
+                length = buffer.size();
+                continue;
+            }
+            if (*eol == '\r') {
+                _scanned = eol - start;
+                return false;
+            }
+        } else if ((eol[0] == '\r' && eol[1] == '\n') || (eol[0] == '\n' && eol[1] == '\r')) {
+            eolLength = 2;
+        }
+        lineStart = start;
+        lineEnd = eol;
+        consumed = (eol - start) + eolLength;
+        _scanned = 0;
+        return true;
+    }
+}
+
+void SHTTPParser::_headersDone() {
+    if (SIEquals(_message["Transfer-Encoding"], "chunked")) {
+        _state = CHUNKS;
+        return;
+    }
+
+    // Make sure the Content-Length is something sensible before we believe it.
+    auto it = _message.nameValueMap.find("Content-Length");
+    _remaining = 0;
+    if (it != _message.nameValueMap.end()) {
+        const string& value = it->second;
+        if (value.empty() || value.size() > 10 || value.find_first_not_of("0123456789") != string::npos) {
+            throw "invalid Content-Length";
+        }
+        _remaining = stoull(value);
+        if (_remaining > MAX_CONTENT_LENGTH) {
+            throw "Content-Length too large";
+        }
+    }
+    _message.content.reserve(min(_remaining, MAX_CONTENT_RESERVE));
+    _state = CONTENT;
+}
+
+void SHTTPParser::_finish(SData& message) {
+    message = move(_message);
+    _message.clear();
+    _lastName.clear();
+    _state = HEADERS;
+    _remaining = 0;
+}
+
+bool SHTTPParser::parse(SBuffer& buffer, SData& message) {
+    while (true) {
+        const char* lineStart;
+        const char* lineEnd;
+        size_t consumed;
+        switch (_state) {
+            case HEADERS:
+            case CHUNKS:
+            {
+                if (!_nextLine(buffer, lineStart, lineEnd, consumed)) {
+                    return false;
+                }
+                if (lineStart == lineEnd) {
+                    // A blank line. Before the method line, it's ignored. After the headers, it's the end of them,
+                    // and in a chunked body it's the end of the message.
+                    buffer.consumeFront(consumed);
+                    if (_message.methodLine.empty()) {
+                        continue;
+                    }
+                    if (_state == CHUNKS) {
+                        _finish(message);
+                        return true;
+                    }
+                    _headersDone();
+                    continue;
+                }
+                string line(lineStart, lineEnd - lineStart);
+                string chunkLength = _state == CHUNKS ? STrim(SContains(line, ";") ? SBefore(line, ";") : line) : "";
+                if (_message.methodLine.empty()) {
+                    _message.methodLine = STrim(line);
+                } else if (_state == CHUNKS && SREMatch("^[a-fA-F0-9]{1,8}$", chunkLength)) {
+                    // The start of a new chunk. A zero-length chunk is the last one, and what follows are footers,
+                    // which we treat just like headers, up to the final blank line.
+                    _remaining = SFromHex(chunkLength);
+                    if (_remaining) {
+                        _state = CHUNK_DATA;
+                    }
+                } else {
+                    SParseHTTPHeaderLine(line.data(), line.data() + line.size(), _message.methodLine,
+                                         _message.nameValueMap, _lastName);
+                }
+                buffer.consumeFront(consumed);
+                break;
+            }
+            case CONTENT:
+            case CHUNK_DATA:
+            {
+                size_t available = min(_remaining, buffer.size());
+                buffer.moveFront(available, _message.content);
+                _remaining -= available;
+                if (_remaining) {
+                    return false;
+                }
+                if (_state == CONTENT) {
+                    _finish(message);
+                    return true;
+                }
+                _state = CHUNK_END;
+                break;
+            }
+            case CHUNK_END:
+            {
+                // Skip the line ending after the chunk's data.
+                size_t length;
+                const char* start = buffer.front(length);
+                if (!length || (length == 1 && *start == '\r' && buffer.size() == 1)) {
+                    return false;
+                }
+                if (*start == '\r' || *start == '\n') {
+                    if (length == 1 && buffer.size() >= 2) {
+                        start = buffer.c_str();
+                    }
+                    bool pair = buffer.size() >= 2 && ((start[0] == '\r' && start[1] == '\n') ||
+                                                       (start[0] == '\n' && start[1] == '\r'));
+                    buffer.consumeFront(pair ? 2 : 1);
+                }
+                _state = CHUNKS;
+                break;
+            }
+        }
+    }
+}
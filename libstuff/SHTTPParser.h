@@ -0,0 +1,60 @@
+#pragma once
+
+// Parses HTTP-style messages (the format `SParseHTTP` understands) out of a socket's receive buffer as the data
+// arrives, rather than all at once when it's complete. `SParseHTTP` has to be handed the whole message, so calling it
+// after every read starts again from the first byte each time, re-scanning the headers (and re-copying a chunked body)
+// over and over while a large message trickles in. This keeps its place between calls instead: every byte it's given
+// is looked at once, and consumed from the buffer as soon as it's been parsed.
+//
+// Once the headers are complete, the Content-Length is checked, and space for the whole body is reserved up front.
+// The body is then copied straight from the receive buffer into the message's content as it arrives, so it's never
+// joined into contiguous memory first, and the finished message is moved out to the caller, so nothing is copied
+// again after that.
+//
+// Keep one of these per socket, alongside its receive buffer.
+class SHTTPParser {
+  public:
+    // The largest body we'll accept.
+    static const size_t MAX_CONTENT_LENGTH = INT_MAX;
+
+    // The most we'll reserve for a body before any of it arrives. Beyond this, the content grows as data is received,
+    // so a connection that claims a huge Content-Length and sends nothing doesn't cost us that much memory.
+    static const size_t MAX_CONTENT_RESERVE = 1 << 20;
+
+    SHTTPParser();
+
+    // Parses as much of `buffer` as it can, consuming everything it parses. Returns true if that completed a message,
+    // in which case it's moved into `message`, and whatever's left in `buffer` is the start of the next one. Otherwise,
+    // `message` isn't touched, and this should be called again when there's more data. Throws if the message is
+    // malformed in a way we can't recover from, in which case the connection should be closed.
+    bool parse(SBuffer& buffer, SData& message);
+
+    // Returns true if we've parsed part of a message but not all of it.
+    bool inProgress() const { return _state != HEADERS || !_message.methodLine.empty(); }
+
+  private:
+    enum State { HEADERS, CONTENT, CHUNKS, CHUNK_DATA, CHUNK_END };
+
+    // If there's a complete line at the front of `buffer`, points `lineStart` and `lineEnd` at it (not including its
+    // line ending), sets `consumed` to its length including its line ending, and returns true. The line stays in
+    // `buffer` until the caller consumes it.
+    bool _nextLine(SBuffer& buffer, const char*& lineStart, const char*& lineEnd, size_t& consumed);
+
+    // Handles the blank line at the end of the headers.
+    void _headersDone();
+
+    // Finishes off the message being parsed and hands it to the caller.
+    void _finish(SData& message);
+
+    State _state;
+    SData _message;
+
+    // The name of the last header we parsed, in case the next line continues it.
+    string _lastName;
+
+    // How much of the current line we've already looked at without finding the end of it.
+    size_t _scanned;
+
+    // Bytes left in the body (for CONTENT), or the current chunk (for CHUNK_DATA).
+    size_t _remaining;
+};
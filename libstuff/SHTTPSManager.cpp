@@ -1,13 +1,33 @@
 #include "libstuff.h"
 
+// Servers commonly close idle keep-alive connections after somewhere between 5 seconds and a couple of minutes. We stay
+// at the low end of that, so we're unlikely to send a request on a connection the server is just closing.
+static const size_t SHTTPSMANAGER_DEFAULT_MAX_IDLE_PER_HOST = 4;
+static const uint64_t SHTTPSMANAGER_DEFAULT_IDLE_TIMEOUT = STIME_US_PER_S * 4;
+
 SHTTPSManager::SHTTPSManager() :
+    maxIdleConnectionsPerHost(SHTTPSMANAGER_DEFAULT_MAX_IDLE_PER_HOST),
+    idleConnectionTimeout(SHTTPSMANAGER_DEFAULT_IDLE_TIMEOUT),
+    connectionsOpened(0),
+    connectionsReused(0),
+    connectionsRetried(0),
+    idleConnectionsClosed(0),
+    tlsSessionsOffered(0),
     // Generate an x509 certificate.
     _x509(SX509Open())
 {
     SASSERT(_x509);
 }
 
-SHTTPSManager::SHTTPSManager(const string& pem, const string& srvCrt, const string& caCrt) {
+SHTTPSManager::SHTTPSManager(const string& pem, const string& srvCrt, const string& caCrt) :
+    maxIdleConnectionsPerHost(SHTTPSMANAGER_DEFAULT_MAX_IDLE_PER_HOST),
+    idleConnectionTimeout(SHTTPSMANAGER_DEFAULT_IDLE_TIMEOUT),
+    connectionsOpened(0),
+    connectionsReused(0),
+    connectionsRetried(0),
+    idleConnectionsClosed(0),
+    tlsSessionsOffered(0)
+{
     // Generate an x509 certificate.
     _x509 = SX509Open(pem, srvCrt, caCrt);
     SASSERT(_x509);
@@ -26,6 +46,14 @@ SHTTPSManager::~SHTTPSManager() {
         closeTransaction(_completedTransactionList.front());
     }
 
+    // Close any idle connections.
+    for (auto& pool : _idleConnections) {
+        for (IdleConnection& idle : pool.second) {
+            closeSocket(idle.s);
+        }
+    }
+    _idleConnections.clear();
+
     // Clean up certificate.
     SX509Close(_x509);
 }
@@ -40,12 +68,44 @@ void SHTTPSManager::closeTransaction(Transaction* transaction) {
     _activeTransactionList.remove(transaction);
     _completedTransactionList.remove(transaction);
     if (transaction->s) {
-        closeSocket(transaction->s);
+        Socket* s = transaction->s;
+        list<IdleConnection>& pool = _idleConnections[transaction->poolKey];
+        if (transaction->keepAlive && maxIdleConnectionsPerHost && s->state == Socket::CONNECTED &&
+            s->sendBuffer.empty() && s->recvBuffer.empty()) {
+            // Keep it for the next request to this host, making room if we need to.
+            pool.push_back({s, STimeNow()});
+            while (pool.size() > maxIdleConnectionsPerHost) {
+                closeSocket(pool.front().s);
+                pool.pop_front();
+                idleConnectionsClosed++;
+            }
+        } else {
+            closeSocket(s);
+        }
+        if (pool.empty()) {
+            _idleConnections.erase(transaction->poolKey);
+        }
     }
     transaction->s = nullptr;
     delete transaction;
 }
 
+void SHTTPSManager::getPoolInfo(STable& info, const string& prefix) {
+    size_t idle = 0;
+    {
+        SAUTOLOCK(_listMutex);
+        for (auto& pool : _idleConnections) {
+            idle += pool.second.size();
+        }
+    }
+    info[prefix + "ConnectionsOpened"] = to_string(connectionsOpened.load());
+    info[prefix + "ConnectionsReused"] = to_string(connectionsReused.load());
+    info[prefix + "ConnectionsRetried"] = to_string(connectionsRetried.load());
+    info[prefix + "IdleConnections"] = to_string(idle);
+    info[prefix + "IdleConnectionsClosed"] = to_string(idleConnectionsClosed.load());
+    info[prefix + "TLSSessionsOffered"] = to_string(tlsSessionsOffered.load());
+}
+
 SHTTPSManager::Socket* SHTTPSManager::openSocket(const string& host, SX509* x509) {
     // Just call the base class function but in a thread-safe way.
     SAUTOLOCK(_listMutex);
@@ -69,6 +129,7 @@ void SHTTPSManager::postPoll(fd_map& fdm, uint64_t& nextActivity) {
 
     // Let the base class do its thing
     STCPManager::postPoll(fdm);
+    _closeIdleConnections(nextActivity);
 
     // Update each of the active requests
     uint64_t now = STimeNow();
@@ -79,13 +140,28 @@ void SHTTPSManager::postPoll(fd_map& fdm, uint64_t& nextActivity) {
         Transaction* active = *activeIt;
         uint64_t elapsed = now - active->created;
         const uint64_t TIMEOUT = STIME_US_PER_S * 300;
-        int size = active->fullResponse.deserialize(active->s->recvBuffer);
-        if (size) {
-            // Consume how much we read.
-            SConsumeFront(active->s->recvBuffer, size);
-
+        bool received = false;
+        try {
+            received = active->s->httpParser.parse(active->s->recvBuffer, active->fullResponse);
+        } catch (const char* e) {
+            SWARN("Malformed response (" << e << "), closing connection.");
+            shutdownSocket(active->s);
+        }
+        if (received) {
             // 200OK or any content?
             active->finished = now;
+            active->keepAlive = _canReuseConnection(active);
+
+            // Save the session from a new HTTPS connection, to offer on the next one we open to this host.
+            if (active->s->ssl && !active->reusedConnection) {
+                unique_ptr<SSSLSession>& session = _tlsSessions[active->poolKey];
+                if (!session) {
+                    session.reset(new SSSLSession());
+                }
+                if (!SSSLGetSession(active->s->ssl, *session)) {
+                    _tlsSessions.erase(active->poolKey);
+                }
+            }
             if (SContains(active->fullResponse.methodLine, " 200 ") || active->fullResponse.content.size()) {
                 // Pass the transaction down to the subclass.
                 if (_onRecv(active)) {
@@ -99,6 +175,25 @@ void SHTTPSManager::postPoll(fd_map& fdm, uint64_t& nextActivity) {
                 active->response = 500;
             }
         } else if (active->s->state > Socket::CONNECTED || elapsed > TIMEOUT) {
+            // If the other end closed an idle connection we reused before any of its response arrived, it was most
+            // likely closing it for being idle, before it even saw our request. Send it again, once, on a new one. We
+            // can't be sure it didn't see it, though, so we only do this for requests that are safe to repeat.
+            if (active->s->state > Socket::CONNECTED && active->reusedConnection && active->s->recvBuffer.empty() &&
+                !active->s->httpParser.inProgress() && _canRetryRequest(active->fullRequest)) {
+                SINFO("Reused connection to '" << active->poolKey << "' closed before responding to '"
+                      << active->fullRequest.methodLine << "', retrying on a new connection.");
+                Socket* s = _openConnection(active->poolKey, SAfter(active->poolKey, "://"),
+                                            SStartsWith(active->poolKey, "https://"));
+                if (s) {
+                    closeSocket(active->s);
+                    active->s = s;
+                    active->reusedConnection = false;
+                    active->s->sendBuffer = active->fullRequest.serialize();
+                    connectionsRetried++;
+                    continue;
+                }
+            }
+
             // Net problem. Did this transaction end in an inconsistent state?
             SWARN("Connection " << (elapsed > TIMEOUT ? "timed out" : "died prematurely") << " after "
                   << elapsed / STIME_US_PER_MS << "ms");
@@ -129,7 +224,9 @@ SHTTPSManager::Transaction::Transaction(SHTTPSManager& owner_) :
     created(STimeNow()),
     finished(0),
     response(0),
-    owner(owner_)
+    owner(owner_),
+    keepAlive(false),
+    reusedConnection(false)
 { }
 
 SHTTPSManager::Transaction::~Transaction() {
@@ -158,7 +255,11 @@ SHTTPSManager::Transaction* SHTTPSManager::_httpsSend(const string& url, const S
     if (!SContains(host, ":")) {
         host += ":443";
     }
-    Socket* s = openSocket(host, SStartsWith(url, "https://") ? _x509 : 0);
+    bool https = SStartsWith(url, "https://");
+    string poolKey = (https ? "https://" : "http://") + host;
+    SAUTOLOCK(_listMutex);
+    bool reused = false;
+    Socket* s = _getConnection(poolKey, host, https, reused);
     if (!s) {
         return _createErrorTransaction();
     }
@@ -167,12 +268,101 @@ SHTTPSManager::Transaction* SHTTPSManager::_httpsSend(const string& url, const S
     Transaction* transaction = new Transaction(*this);
     transaction->s = s;
     transaction->fullRequest = request;
+    transaction->poolKey = poolKey;
+    transaction->reusedConnection = reused;
 
     // Ship it.
     transaction->s->sendBuffer = request.serialize();
 
     // Keep track of the transaction.
-    SAUTOLOCK(_listMutex);
     _activeTransactionList.push_front(transaction);
     return transaction;
 }
+
+SHTTPSManager::Socket* SHTTPSManager::_getConnection(const string& poolKey, const string& host, bool https,
+                                                    bool& reused) {
+    // Use the most recently used idle connection, as it's the least likely to have been closed by the other end.
+    auto poolIt = _idleConnections.find(poolKey);
+    if (poolIt != _idleConnections.end()) {
+        list<IdleConnection>& pool = poolIt->second;
+        while (!pool.empty()) {
+            IdleConnection idle = pool.back();
+            pool.pop_back();
+            if (idle.s->state == Socket::CONNECTED && idle.s->recvBuffer.empty() &&
+                STimeNow() < idle.idleSince + idleConnectionTimeout) {
+                if (pool.empty()) {
+                    _idleConnections.erase(poolIt);
+                }
+                connectionsReused++;
+                reused = true;
+                return idle.s;
+            }
+            closeSocket(idle.s);
+            idleConnectionsClosed++;
+        }
+        _idleConnections.erase(poolIt);
+    }
+
+    // Nothing to reuse, so open a new one.
+    return _openConnection(poolKey, host, https);
+}
+
+SHTTPSManager::Socket* SHTTPSManager::_openConnection(const string& poolKey, const string& host, bool https) {
+    // Offer our last TLS session with this host if we have one.
+    Socket* s = openSocket(host, https ? _x509 : 0);
+    if (!s) {
+        return nullptr;
+    }
+    connectionsOpened++;
+    auto sessionIt = _tlsSessions.find(poolKey);
+    if (s->ssl && sessionIt != _tlsSessions.end() && SSSLSetSession(s->ssl, *sessionIt->second)) {
+        tlsSessionsOffered++;
+    }
+    return s;
+}
+
+bool SHTTPSManager::_canReuseConnection(const Transaction* transaction) {
+    // Either side can ask to close the connection, and HTTP/1.0 closes it unless asked not to.
+    const SData& request = transaction->fullRequest;
+    const SData& response = transaction->fullResponse;
+    if (SIEquals(request["Connection"], "close") || SIEquals(response["Connection"], "close")) {
+        return false;
+    }
+    if (!SStartsWith(response.methodLine, "HTTP/1.1") && !SIEquals(response["Connection"], "keep-alive")) {
+        return false;
+    }
+
+    // If the response doesn't say how long it is, it ends when the connection does.
+    return response.isSet("Content-Length") || SIEquals(response["Transfer-Encoding"], "chunked");
+}
+
+bool SHTTPSManager::_canRetryRequest(const SData& request) {
+    const string method = SBefore(request.methodLine, " ");
+    for (const char* idempotent : {"GET", "HEAD", "PUT", "DELETE", "OPTIONS"}) {
+        if (SIEquals(method, idempotent)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SHTTPSManager::_closeIdleConnections(uint64_t& nextActivity) {
+    uint64_t now = STimeNow();
+    for (auto poolIt = _idleConnections.begin(); poolIt != _idleConnections.end();) {
+        list<IdleConnection>& pool = poolIt->second;
+        for (auto it = pool.begin(); it != pool.end();) {
+            // Anything arriving on an idle connection is either the other end closing it, or something we're not
+            // expecting, and either way we can't use it.
+            if (it->s->state != Socket::CONNECTED || !it->s->recvBuffer.empty() ||
+                now >= it->idleSince + idleConnectionTimeout) {
+                closeSocket(it->s);
+                it = pool.erase(it);
+                idleConnectionsClosed++;
+            } else {
+                nextActivity = min(nextActivity, it->idleSince + idleConnectionTimeout);
+                it++;
+            }
+        }
+        poolIt = pool.empty() ? _idleConnections.erase(poolIt) : next(poolIt);
+    }
+}
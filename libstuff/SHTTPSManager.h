@@ -16,6 +16,12 @@ class SHTTPSManager : public STCPManager {
         int response;
         STable values;
         SHTTPSManager& owner;
+
+        // The pool `s` came from, and goes back to when the transaction is closed if `keepAlive` is set. `keepAlive`
+        // is only set once a complete response has been read, and neither side asked to close the connection.
+        string poolKey;
+        bool keepAlive;
+        bool reusedConnection;
     };
 
     // Constructor/Destructor
@@ -29,9 +35,29 @@ class SHTTPSManager : public STCPManager {
     Socket* openSocket(const string& host, SX509* x509 = nullptr);
     void closeSocket(Socket* socket);
 
-    // Close a transaction and remove it from our internal lists.
+    // Close a transaction and remove it from our internal lists. If its connection can be used again, it goes back
+    // in the pool rather than being closed.
     void closeTransaction(Transaction* transaction);
 
+    // Once a transaction is done, its connection is kept open for the next request to the same host, for up to
+    // `idleConnectionTimeout`. At most `maxIdleConnectionsPerHost` are kept for each host; set it to 0 to close every
+    // connection when its transaction is done, like we used to.
+    size_t maxIdleConnectionsPerHost;
+    uint64_t idleConnectionTimeout;
+
+    // Counters, for monitoring how well the pool is working. `tlsSessionsOffered` counts new HTTPS connections that
+    // offered a session from an earlier connection to the same host, so could skip a full handshake.
+    // `connectionsRetried` counts requests sent again on a new connection because the other end closed the idle one
+    // they were sent on before responding.
+    atomic<uint64_t> connectionsOpened;
+    atomic<uint64_t> connectionsReused;
+    atomic<uint64_t> connectionsRetried;
+    atomic<uint64_t> idleConnectionsClosed;
+    atomic<uint64_t> tlsSessionsOffered;
+
+    // Adds the counters above to `info`, with names starting with `prefix`.
+    void getPoolInfo(STable& info, const string& prefix = "https");
+
   protected: // Child API
     // Methods
     Transaction* _httpsSend(const string& url, const SData& request);
@@ -39,10 +65,35 @@ class SHTTPSManager : public STCPManager {
     virtual bool _onRecv(Transaction* transaction) = 0;
 
   private: // Internal API
+    // Returns an idle connection to `poolKey` if there is one, setting `reused`, otherwise opens a new one to `host`.
+    Socket* _getConnection(const string& poolKey, const string& host, bool https, bool& reused);
+
+    // Opens a new connection to `host`, which `poolKey` is the pool for.
+    Socket* _openConnection(const string& poolKey, const string& host, bool https);
+
+    // Returns whether the connection a transaction just got its response on can be used for another request.
+    static bool _canReuseConnection(const Transaction* transaction);
+
+    // Returns whether a request can safely be sent twice, because its method is idempotent.
+    static bool _canRetryRequest(const SData& request);
+
+    // Closes idle connections that have timed out, or been closed by the other end.
+    void _closeIdleConnections(uint64_t& nextActivity);
+
     list<Transaction*> _activeTransactionList;
     list<Transaction*> _completedTransactionList;
     SX509* _x509;
 
+    // Idle connections, by scheme and host, least recently used first.
+    struct IdleConnection {
+        Socket* s;
+        uint64_t idleSince;
+    };
+    map<string, list<IdleConnection>> _idleConnections;
+
+    // The most recent TLS session with each HTTPS host.
+    map<string, unique_ptr<SSSLSession>> _tlsSessions;
+
     // SHTTPSManager operations are thread-safe, we lock around any accesses to our transaction lists, so that
     // multiple threads can add/remove from them.
     recursive_mutex _listMutex;
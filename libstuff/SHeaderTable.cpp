@@ -0,0 +1,120 @@
+#include "libstuff.h"
+
+// Most messages have fewer headers than this, so reserving it up front means the table is allocated once.
+static const size_t SHEADERTABLE_INITIAL_CAPACITY = 16;
+
+const SHeaderTable::Key SHeaderTable::CONTENT_LENGTH("Content-Length");
+const SHeaderTable::Key SHeaderTable::CONTENT_ENCODING("Content-Encoding");
+const SHeaderTable::Key SHeaderTable::TRANSFER_ENCODING("Transfer-Encoding");
+const SHeaderTable::Key SHeaderTable::CONNECTION("Connection");
+const SHeaderTable::Key SHeaderTable::REQUEST_ID("requestID");
+const SHeaderTable::Key SHeaderTable::COMMIT_COUNT("CommitCount");
+const SHeaderTable::Key SHeaderTable::HASH("Hash");
+const SHeaderTable::Key SHeaderTable::ID("ID");
+
+SHeaderTable::Key::Key(const string& name_) : name(name_), hash(SHeaderTable::hash(name_.data(), name_.size())) { }
+
+SHeaderTable::SHeaderTable(const STable& from) {
+    _entries.reserve(max(from.size(), SHEADERTABLE_INITIAL_CAPACITY));
+    for (const auto& item : from) {
+        _entries.push_back({item.first, item.second, hash(item.first.data(), item.first.size())});
+    }
+}
+
+STable SHeaderTable::toSTable() const {
+    STable result;
+    for (const Entry& entry : _entries) {
+        result.emplace(entry.first, entry.second);
+    }
+    return result;
+}
+
+uint32_t SHeaderTable::hash(const char* name, size_t length) {
+    // FNV-1a, over the lower-cased name.
+    uint32_t result = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        result = (result ^ (uint32_t)tolower((unsigned char)name[i])) * 16777619u;
+    }
+    return result;
+}
+
+SHeaderTable::iterator SHeaderTable::_find(const char* name, size_t length, uint32_t hash) {
+    for (auto it = _entries.begin(); it != _entries.end(); it++) {
+        if (it->hash == hash && it->first.size() == length && !strncasecmp(it->first.data(), name, length)) {
+            return it;
+        }
+    }
+    return _entries.end();
+}
+
+SHeaderTable::const_iterator SHeaderTable::_find(const char* name, size_t length, uint32_t hash) const {
+    return const_cast<SHeaderTable*>(this)->_find(name, length, hash);
+}
+
+SString& SHeaderTable::_insert(const string& name, uint32_t hash) {
+    if (_entries.capacity() == 0) {
+        _entries.reserve(SHEADERTABLE_INITIAL_CAPACITY);
+    }
+    _entries.push_back({name, SString(), hash});
+    return _entries.back().second;
+}
+
+SString& SHeaderTable::operator[](const string& name) {
+    uint32_t nameHash = hash(name.data(), name.size());
+    auto it = _find(name.data(), name.size(), nameHash);
+    return it != _entries.end() ? it->second : _insert(name, nameHash);
+}
+
+SString& SHeaderTable::operator[](const Key& key) {
+    auto it = _find(key.name.data(), key.name.size(), key.hash);
+    return it != _entries.end() ? it->second : _insert(key.name, key.hash);
+}
+
+SHeaderTable::iterator SHeaderTable::find(const string& name) {
+    return _find(name.data(), name.size(), hash(name.data(), name.size()));
+}
+
+SHeaderTable::iterator SHeaderTable::find(const Key& key) {
+    return _find(key.name.data(), key.name.size(), key.hash);
+}
+
+SHeaderTable::const_iterator SHeaderTable::find(const string& name) const {
+    return _find(name.data(), name.size(), hash(name.data(), name.size()));
+}
+
+SHeaderTable::const_iterator SHeaderTable::find(const Key& key) const {
+    return _find(key.name.data(), key.name.size(), key.hash);
+}
+
+size_t SHeaderTable::erase(const string& name) {
+    auto it = find(name);
+    if (it == _entries.end()) {
+        return 0;
+    }
+    _entries.erase(it);
+    return 1;
+}
+
+string SHeaderTable::operator[](const string& name) const {
+    auto it = find(name);
+    return it != _entries.end() ? string(it->second) : string();
+}
+
+int SHeaderTable::calc(const string& name) const {
+    // Forcing 32 bitness here, like SData does.
+    return min((long)calc64(name), (long)0x7fffffffL);
+}
+
+int64_t SHeaderTable::calc64(const string& name) const {
+    auto it = find(name);
+    return it != _entries.end() ? strtoll(it->second.c_str(), 0, 10) : 0;
+}
+
+uint64_t SHeaderTable::calcU64(const string& name) const {
+    auto it = find(name);
+    return it != _entries.end() ? strtoull(it->second.c_str(), 0, 10) : 0;
+}
+
+bool SHeaderTable::test(const string& name) const {
+    return SIEquals((*this)[name], "true") || calc(name) != 0;
+}
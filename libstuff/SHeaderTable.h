@@ -0,0 +1,85 @@
+#pragma once
+
+// An alternative to STable for holding message headers. STable is a std::map with case-insensitive comparison, so
+// every lookup is O(log n) `tolower`-per-character comparisons, and every insert is a node allocation. Messages rarely
+// have more than a dozen or so headers, so this keeps them in a flat vector instead, each alongside a case-folded hash
+// of its name. A lookup hashes the name once and then only compares names whose hashes match, and the whole table is
+// a single allocation.
+//
+// It supports the parts of the std::map interface that header code uses (`find`, `operator[]`, `erase`, iteration over
+// entries with `first` and `second`), plus the accessors SData provides (`isSet`, `calc`, `test`, `set`, and so on),
+// so code written against either can use this. Unlike STable, iteration is in insertion order, not sorted.
+//
+// Headers we look up all the time are available as `Key`s, which carry their hash with them, so looking them up
+// doesn't have to hash the name at all.
+class SHeaderTable {
+  public:
+    // A header name with its hash precomputed.
+    struct Key {
+        explicit Key(const string& name_);
+        string name;
+        uint32_t hash;
+    };
+
+    // Common headers.
+    static const Key CONTENT_LENGTH;
+    static const Key CONTENT_ENCODING;
+    static const Key TRANSFER_ENCODING;
+    static const Key CONNECTION;
+    static const Key REQUEST_ID;
+    static const Key COMMIT_COUNT;
+    static const Key HASH;
+    static const Key ID;
+
+    struct Entry {
+        string first;
+        SString second;
+        uint32_t hash;
+    };
+    typedef vector<Entry>::iterator iterator;
+    typedef vector<Entry>::const_iterator const_iterator;
+
+    SHeaderTable() { }
+    explicit SHeaderTable(const STable& from);
+
+    // Converts to an STable, for code that needs one.
+    STable toSTable() const;
+
+    // Map-style interface.
+    SString& operator[](const string& name);
+    SString& operator[](const Key& key);
+    iterator find(const string& name);
+    iterator find(const Key& key);
+    const_iterator find(const string& name) const;
+    const_iterator find(const Key& key) const;
+    size_t count(const string& name) const { return find(name) != end(); }
+    size_t erase(const string& name);
+    iterator erase(const_iterator it) { return _entries.erase(it); }
+    iterator begin() { return _entries.begin(); }
+    iterator end() { return _entries.end(); }
+    const_iterator begin() const { return _entries.begin(); }
+    const_iterator end() const { return _entries.end(); }
+    bool empty() const { return _entries.empty(); }
+    size_t size() const { return _entries.size(); }
+    void clear() { _entries.clear(); }
+
+    // SData-style interface. Looking a name up with the const `operator[]` returns an empty string if it's not set,
+    // rather than adding it.
+    string operator[](const string& name) const;
+    bool isSet(const string& name) const { return find(name) != end(); }
+    int calc(const string& name) const;
+    int64_t calc64(const string& name) const;
+    uint64_t calcU64(const string& name) const;
+    bool test(const string& name) const;
+    template <typename T> void set(const string& key, const T& item) { (*this)[key] = item; }
+
+    // Returns the case-folded hash of a name.
+    static uint32_t hash(const char* name, size_t length);
+
+  private:
+    iterator _find(const char* name, size_t length, uint32_t hash);
+    const_iterator _find(const char* name, size_t length, uint32_t hash) const;
+    SString& _insert(const string& name, uint32_t hash);
+
+    vector<Entry> _entries;
+};
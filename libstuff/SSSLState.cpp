@@ -16,6 +16,14 @@ SSSLState::~SSSLState() {
     mbedtls_ssl_free(&ssl);
 }
 
+SSSLSession::SSSLSession() {
+    mbedtls_ssl_session_init(&session);
+}
+
+SSSLSession::~SSSLSession() {
+    mbedtls_ssl_session_free(&session);
+}
+
 // --------------------------------------------------------------------------
 SSSLState* SSSLOpen(int s, SX509* x509) {
     // Initialize the SSL state
@@ -168,6 +176,19 @@ bool SSSLSendConsume(SSSLState* ssl, string& sendBuffer) {
     return (numSent != -1);
 }
 
+// --------------------------------------------------------------------------
+bool SSSLSendConsume(SSSLState* ssl, SBuffer& sendBuffer) {
+    // Same as above, the buffer's segments are joined so we can hand mbedtls one contiguous block.
+    if (sendBuffer.empty()) {
+        return true;
+    }
+    int numSent = SSSLSend(ssl, sendBuffer.c_str(), (int)sendBuffer.size());
+    if (numSent > 0) {
+        SConsumeFront(sendBuffer, numSent);
+    }
+    return (numSent != -1);
+}
+
 // --------------------------------------------------------------------------
 bool SSSLSendAll(SSSLState* ssl, const string& buffer) {
     // Keep sending until there is an error or we're done
@@ -199,3 +220,34 @@ bool SSSLRecvAppend(SSSLState* ssl, string& recvBuffer) {
     // Return whether or not the socket is still alive
     return (numRecv != -1);
 }
+
+// --------------------------------------------------------------------------
+bool SSSLRecvAppend(SSSLState* ssl, SBuffer& recvBuffer) {
+    // Same as above, but appending to a segmented buffer.
+    SASSERT(ssl);
+    char buffer[1024 * 16];
+    int numRecv = 0;
+    while ((numRecv = SSSLRecv(ssl, buffer, sizeof(buffer))) > 0) {
+        recvBuffer.append(buffer, numRecv);
+    }
+    return (numRecv != -1);
+}
+
+// --------------------------------------------------------------------------
+bool SSSLGetSession(SSSLState* ssl, SSSLSession& session) {
+    SASSERT(ssl);
+    if (ssl->ssl.state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+        return false;
+    }
+
+    // This copies into whatever's already there, so free that first.
+    mbedtls_ssl_session_free(&session.session);
+    mbedtls_ssl_session_init(&session.session);
+    return mbedtls_ssl_get_session(&ssl->ssl, &session.session) == 0;
+}
+
+// --------------------------------------------------------------------------
+bool SSSLSetSession(SSSLState* ssl, const SSSLSession& session) {
+    SASSERT(ssl);
+    return mbedtls_ssl_set_session(&ssl->ssl, &session.session) == 0;
+}
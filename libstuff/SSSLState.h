@@ -15,14 +15,32 @@ struct SSSLState {
     ~SSSLState();
 };
 
+// A saved TLS session. Offering one when opening a new connection to the same server lets it resume the session
+// rather than doing a full handshake.
+struct SSSLSession {
+    mbedtls_ssl_session session;
+
+    SSSLSession();
+    ~SSSLSession();
+    SSSLSession(const SSSLSession&) = delete;
+    SSSLSession& operator=(const SSSLSession&) = delete;
+};
+
 // SSL helpers
 extern SSSLState* SSSLOpen(int s, SX509* x509);
 extern int SSSLSend(SSSLState* ssl, const char* buffer, int length);
 extern int SSSLSend(SSSLState* ssl, const string& buffer);
 extern bool SSSLSendConsume(SSSLState* ssl, string& sendBuffer);
+extern bool SSSLSendConsume(SSSLState* ssl, SBuffer& sendBuffer);
 extern bool SSSLSendAll(SSSLState* ssl, const string& buffer);
 extern int SSSLRecv(SSSLState* ssl, char* buffer, int length);
 extern bool SSSLRecvAppend(SSSLState* ssl, string& recvBuffer);
+extern bool SSSLRecvAppend(SSSLState* ssl, SBuffer& recvBuffer);
 extern string SSSLGetState(SSSLState* ssl);
 extern void SSSLShutdown(SSSLState* ssl);
 extern void SSSLClose(SSSLState* ssl);
+
+// SSSLGetSession saves the session from a connection that's finished its handshake, returning false if it hasn't.
+// SSSLSetSession offers a saved session on a connection that hasn't started its handshake yet.
+extern bool SSSLGetSession(SSSLState* ssl, SSSLSession& session);
+extern bool SSSLSetSession(SSSLState* ssl, const SSSLSession& session);
@@ -15,6 +15,9 @@ class SSynchronizedQueue {
     void prePoll(fd_map& fdm);
     void postPoll(fd_map& fdm, int bytesToRead = 1);
 
+    // Alternatively, the queue can register with an event loop, and then be passed the fd_map from its `wait`.
+    void prePoll(SEventLoop& loop);
+
     // Returns true if the queue is empty.
     bool empty() const;
 
@@ -66,6 +69,12 @@ void SSynchronizedQueue<T>::prePoll(fd_map& fdm) {
     SFDset(fdm, _pipeFD[0], SREADEVTS);
 }
 
+template<typename T>
+void SSynchronizedQueue<T>::prePoll(SEventLoop& loop) {
+    // The owner distinguishes our pipe from anything that gets the same fd number after we're destroyed.
+    loop.set(_pipeFD[0], SREADEVTS, (uint64_t)this);
+}
+
 template<typename T>
 void SSynchronizedQueue<T>::postPoll(fd_map& fdm, int bytesToRead) {
     // Caller determines the bytes to read.  If a consumer can only process one item then it will only read 1 byte. If
@@ -16,57 +16,108 @@ void STCPManager::prePoll(fd_map& fdm) {
                 SWARN("Invalid FD number("
                       << socket->s << "), we're probably about to corrupt stack memory. FD_SETSIZE=" << FD_SETSIZE);
             }
-            // Add this socket.  First, we always want to read, and we always want to learn of exceptions.
-            SFDset(fdm, socket->s, SREADEVTS);
-
-            // However, we only want to write in some states. No matter what, we want to send if we're not yet
-            // connected. And if we're not using SSL, then we want to send only when we have something buffered for
-            // sending. But if we *are* using SSL, it's a bit more complex. If we've completed the handshake, then we
-            // only want to send when we have data. But if we're inside the handshake, leave it up to the SSL engine
-            // to decide if it wants to send.
-            if (socket->state == Socket::CONNECTING) {
-                // We haven't yet connected -- send regardless of SSL
-                SFDset(fdm, socket->s, SWRITEEVTS);
-            } else if (!socket->ssl) {
-                // No SSL, just send if we have anything buffered
-                if (!socket->sendBuffer.empty()) {
-                    SFDset(fdm, socket->s, SWRITEEVTS);
-                }
-            } else {
-                // Have we completed the handshake?
-                SASSERT(socket->ssl);
-                SSSLState* sslState = socket->ssl;
-                if (sslState->ssl.state == MBEDTLS_SSL_HANDSHAKE_OVER) {
-                    // Handshake done -- send if we have anything buffered
-                    if (!socket->sendBuffer.empty()) {
-                        SFDset(fdm, socket->s, SWRITEEVTS);
-                    }
-                } else {
-                    // Handshake isn't done -- send if SSL wants to
-                    bool write;
-                    switch (sslState->ssl.state) {
-                    case MBEDTLS_SSL_HELLO_REQUEST:
-                    case MBEDTLS_SSL_CLIENT_HELLO:
-                    case MBEDTLS_SSL_CLIENT_CERTIFICATE:
-                    case MBEDTLS_SSL_CLIENT_KEY_EXCHANGE:
-                    case MBEDTLS_SSL_CERTIFICATE_VERIFY:
-                    case MBEDTLS_SSL_CLIENT_CHANGE_CIPHER_SPEC:
-                    case MBEDTLS_SSL_CLIENT_FINISHED:
-                        // In these cases, SSL is waiting to write already.
-                        // @see https://www.mail-archive.com/list@xyssl.org/msg00041.html
-                        write = true;
-                        break;
-                    default:
-                        write = false;
-                        break;
-                    }
-                    if (write) {
-                        SFDset(fdm, socket->s, SWRITEEVTS);
-                    }
-                }
+            SFDset(fdm, socket->s, _socketEvents(socket));
+        }
+    }
+}
+
+void STCPManager::prePoll(SEventLoop& loop) {
+    // The first time, register everything we've got. Remember the loop, so `postPoll` can keep registrations up to
+    // date, and we can unregister sockets when we close them.
+    if (_eventLoop != &loop) {
+        _eventLoop = &loop;
+        for (Socket* socket : socketList) {
+            socket->registeredEvents = 0;
+            _updateRegistration(socket);
+        }
+        lock_guard<mutex> lock(_changedSocketsMutex);
+        _changedSockets.clear();
+        return;
+    }
+
+    // After that, just the sockets that have changed since `postPoll`.
+    set<Socket*> changed;
+    {
+        lock_guard<mutex> lock(_changedSocketsMutex);
+        changed.swap(_changedSockets);
+    }
+    for (Socket* socket : changed) {
+        _updateRegistration(socket);
+    }
+}
+
+void STCPManager::_updateRegistration(Socket* socket) {
+    if (socket->state == Socket::CLOSED) {
+        if (socket->registeredEvents) {
+            _eventLoop->remove(socket->s);
+            socket->registeredEvents = 0;
+        }
+        return;
+    }
+    short events = _socketEvents(socket);
+    if (events != socket->registeredEvents) {
+        _eventLoop->set(socket->s, events, socket->id);
+        socket->registeredEvents = events;
+    }
+}
+
+void STCPManager::_socketChanged(Socket* socket) {
+    if (_eventLoop) {
+        lock_guard<mutex> lock(_changedSocketsMutex);
+        _changedSockets.insert(socket);
+    }
+}
+
+void STCPManager::_addSocket(Socket* socket) {
+    socket->manager = this;
+    socketList.push_back(socket);
+    _socketChanged(socket);
+}
+
+short STCPManager::_socketEvents(Socket* socket) {
+    // First, we always want to read, and we always want to learn of exceptions.
+    short events = SREADEVTS;
+
+    // However, we only want to write in some states. No matter what, we want to send if we're not yet connected. And
+    // if we're not using SSL, then we want to send only when we have something buffered for sending. But if we *are*
+    // using SSL, it's a bit more complex. If we've completed the handshake, then we only want to send when we have
+    // data. But if we're inside the handshake, leave it up to the SSL engine to decide if it wants to send.
+    if (socket->state == Socket::CONNECTING) {
+        // We haven't yet connected -- send regardless of SSL
+        events |= SWRITEEVTS;
+    } else if (!socket->ssl) {
+        // No SSL, just send if we have anything buffered
+        if (!socket->sendBuffer.empty()) {
+            events |= SWRITEEVTS;
+        }
+    } else {
+        // Have we completed the handshake?
+        SSSLState* sslState = socket->ssl;
+        if (sslState->ssl.state == MBEDTLS_SSL_HANDSHAKE_OVER) {
+            // Handshake done -- send if we have anything buffered
+            if (!socket->sendBuffer.empty()) {
+                events |= SWRITEEVTS;
+            }
+        } else {
+            // Handshake isn't done -- send if SSL wants to
+            switch (sslState->ssl.state) {
+            case MBEDTLS_SSL_HELLO_REQUEST:
+            case MBEDTLS_SSL_CLIENT_HELLO:
+            case MBEDTLS_SSL_CLIENT_CERTIFICATE:
+            case MBEDTLS_SSL_CLIENT_KEY_EXCHANGE:
+            case MBEDTLS_SSL_CERTIFICATE_VERIFY:
+            case MBEDTLS_SSL_CLIENT_CHANGE_CIPHER_SPEC:
+            case MBEDTLS_SSL_CLIENT_FINISHED:
+                // In these cases, SSL is waiting to write already.
+                // @see https://www.mail-archive.com/list@xyssl.org/msg00041.html
+                events |= SWRITEEVTS;
+                break;
+            default:
+                break;
             }
         }
     }
+    return events;
 }
 
 void STCPManager::postPoll(fd_map& fdm) {
@@ -190,6 +241,11 @@ void STCPManager::postPoll(fd_map& fdm) {
         default:
             SERROR("Unknown socket state");
         }
+
+        // Anything above can change what we need to wait for on this socket.
+        if (_eventLoop) {
+            _updateRegistration(socket);
+        }
     }
 }
 
@@ -201,11 +257,24 @@ void STCPManager::shutdownSocket(Socket* socket, int how) {
     socket->state = Socket::SHUTTINGDOWN;
 }
 
+void STCPManager::_removeSocket(Socket* socket) {
+    socketList.remove(socket);
+    socket->manager = nullptr;
+    if (_eventLoop) {
+        if (socket->registeredEvents) {
+            _eventLoop->remove(socket->s);
+            socket->registeredEvents = 0;
+        }
+        lock_guard<mutex> lock(_changedSocketsMutex);
+        _changedSockets.erase(socket);
+    }
+}
+
 void STCPManager::closeSocket(Socket* socket) {
     // Clean up this socket
     SASSERT(socket);
     SDEBUG("Closing socket '" << socket->addr << "'");
-    socketList.remove(socket);
+    _removeSocket(socket);
     ::close(socket->s);
     if (socket->ssl) {
         SSSLClose(socket->ssl);
@@ -216,7 +285,8 @@ void STCPManager::closeSocket(Socket* socket) {
 
 STCPManager::Socket::Socket(int sock, STCPManager::Socket::State state_)
   : s(sock), addr{}, state(state_), connectFailure(false), openTime(STimeNow()), lastSendTime(openTime),
-    lastRecvTime(openTime), ssl(nullptr), data(nullptr), id(STCPManager::Socket::socketCount++)
+    lastRecvTime(openTime), ssl(nullptr), data(nullptr), id(STCPManager::Socket::socketCount++), manager(nullptr),
+    registeredEvents(0)
 { }
 
 STCPManager::Socket* STCPManager::openSocket(const string& host, SX509* x509) {
@@ -231,7 +301,7 @@ STCPManager::Socket* STCPManager::openSocket(const string& host, SX509* x509) {
     Socket* socket = new Socket(s, Socket::CONNECTING);
     socket->ssl = x509 ? SSSLOpen(socket->s, x509) : 0;
     SASSERT(!x509 || socket->ssl);
-    socketList.push_back(socket);
+    _addSocket(socket);
     return socket;
 }
 
@@ -245,6 +315,11 @@ bool STCPManager::Socket::send() {
         result = S_sendconsume(s, sendBuffer);
     }
     lastSendTime = STimeNow();
+
+    // If it didn't all go, we need to wait until we can send the rest.
+    if (!sendBuffer.empty() && manager) {
+        manager->_socketChanged(this);
+    }
     return result;
 }
 
@@ -255,6 +330,13 @@ bool STCPManager::Socket::send(const string& buffer) {
     return send();
 }
 
+// --------------------------------------------------------------------------
+bool STCPManager::Socket::send(const SSharedMessage& message) {
+    // Queue a reference to the message, rather than a copy of it
+    sendBuffer.append(message);
+    return send();
+}
+
 // --------------------------------------------------------------------------
 bool STCPManager::Socket::recv() {
     // Read data
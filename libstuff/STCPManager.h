@@ -11,8 +11,11 @@ struct STCPManager {
         // Attributes
         int s;
         sockaddr_in addr;
-        string sendBuffer;
-        string recvBuffer;
+        SBuffer sendBuffer;
+        SBuffer recvBuffer;
+
+        // Keeps our place in a partly-received HTTP message, for sockets that receive them.
+        SHTTPParser httpParser;
         State state;
         bool connectFailure;
         uint64_t openTime;
@@ -22,9 +25,17 @@ struct STCPManager {
         void* data;
         bool send();
         bool send(const string& buffer);
+        bool send(const SSharedMessage& message);
         bool recv();
         uint64_t id;
 
+        // The manager this socket belongs to, which it tells when a send leaves data buffered, so a manager using an
+        // event loop can start watching it for writability.
+        STCPManager* manager;
+
+        // The events this socket is registered for with its manager's event loop, or 0 if it isn't.
+        short registeredEvents;
+
       private:
         static atomic<uint64_t> socketCount;
     };
@@ -36,6 +47,13 @@ struct STCPManager {
     void prePoll(fd_map& fdm);
     void postPoll(fd_map& fdm);
 
+    // Registers managed sockets with an event loop, instead of adding them to an fd_map. Activity is handled by
+    // passing the fd_map returned by the loop's `wait` to `postPoll` as usual. The first call registers every socket;
+    // after that, a socket's registration is only updated when the events it's interested in may have changed (it's
+    // opened or accepted, changes state, has data left to send or finishes sending it, or is closed), so this doesn't
+    // cost anything for idle sockets. A manager should only be used with one loop.
+    void prePoll(SEventLoop& loop);
+
     // Opens outgoing socket
     Socket* openSocket(const string& host, SX509* x509 = nullptr);
 
@@ -47,4 +65,29 @@ struct STCPManager {
 
     // Attributes
     list<Socket*> socketList;
+
+  protected:
+    // The loop we were last registered with, if any.
+    SEventLoop* _eventLoop = nullptr;
+
+    // Adds a socket to this manager.
+    void _addSocket(Socket* socket);
+
+    // Removes a socket from this manager without closing it, so it can be handed to another.
+    void _removeSocket(Socket* socket);
+
+  private:
+    // Returns the poll events we're interested in for a socket.
+    static short _socketEvents(Socket* socket);
+
+    // Brings a socket's registration with our event loop up to date. Only called from the thread running the loop.
+    void _updateRegistration(Socket* socket);
+
+    // Notes that a socket's events may have changed outside of `postPoll` (i.e., a send from another thread left
+    // data buffered), so its registration is updated in the next `prePoll`.
+    void _socketChanged(Socket* socket);
+
+    // Sockets waiting on `_socketChanged` updates.
+    mutex _changedSocketsMutex;
+    set<Socket*> _changedSockets;
 };
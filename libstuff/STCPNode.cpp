@@ -3,6 +3,71 @@
 #undef SLOGPREFIX
 #define SLOGPREFIX "{" << name << "} "
 
+const unsigned char STCPNode::STCP_FRAME_MAGIC;
+const unsigned char STCPNode::STCP_FRAME_HAS_ID;
+const unsigned char STCPNode::STCP_FRAME_RAW_HASH;
+
+// Message types that get a fixed code in binary frames. This list is shared between versions on the wire, so only
+// ever append to it.
+static const vector<string> _frameMethodLines = {
+    "",
+    "LOGIN",
+    "STATE",
+    "STANDUP_RESPONSE",
+    "SYNCHRONIZE",
+    "SYNCHRONIZE_RESPONSE",
+    "SUBSCRIBE",
+    "SUBSCRIPTION_APPROVED",
+    "BEGIN_TRANSACTION",
+    "APPROVE_TRANSACTION",
+    "DENY_TRANSACTION",
+    "COMMIT_TRANSACTION",
+    "ROLLBACK_TRANSACTION",
+    "ESCALATE",
+    "ESCALATE_CANCEL",
+    "ESCALATE_RESPONSE",
+    "ESCALATE_ABORTED",
+    "BATCH",
+};
+
+// Helpers for reading and writing big-endian integers and length-prefixed strings in frames.
+static void _frameAppendInt(string& out, uint64_t value, int bytes) {
+    for (int i = bytes - 1; i >= 0; --i) {
+        out += (char)((value >> (8 * i)) & 0xFF);
+    }
+}
+
+// Returns whether `length` can be written in a `lengthBytes`-wide length field.
+static bool _frameFits(uint64_t length, int lengthBytes) {
+    return lengthBytes >= 8 || length < (1ull << (8 * lengthBytes));
+}
+
+static void _frameAppendString(string& out, const string& value, int lengthBytes) {
+    _frameAppendInt(out, value.size(), lengthBytes);
+    out += value;
+}
+
+static uint64_t _frameReadInt(const char*& pos, const char* end, int bytes) {
+    if (end - pos < bytes) {
+        throw "malformed frame";
+    }
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value = (value << 8) | (unsigned char)*pos++;
+    }
+    return value;
+}
+
+static string _frameReadString(const char*& pos, const char* end, int lengthBytes) {
+    uint64_t length = _frameReadInt(pos, end, lengthBytes);
+    if ((uint64_t)(end - pos) < length) {
+        throw "malformed frame";
+    }
+    string value(pos, length);
+    pos += length;
+    return value;
+}
+
 STCPNode::STCPNode(const string& name_, const string& host, const uint64_t recvTimeout_)
     : STCPServer(host), name(name_), recvTimeout(recvTimeout_) {
 }
@@ -41,11 +106,161 @@ STCPNode::Peer* STCPNode::getPeerByID(uint64_t id) {
     return nullptr;
 }
 
+// Serializes a frame from either kind of header container, STable or SHeaderTable.
+template <typename Headers>
+static string serializeFrameHeaders(const string& methodLine, const Headers& headers, const string& content,
+                                    uint64_t commitCount, const string& hash) {
+    // Look up the message type; anything not in the table carries its method line explicitly.
+    auto typeIt = find(_frameMethodLines.begin() + 1, _frameMethodLines.end(), methodLine);
+    unsigned char type = typeIt == _frameMethodLines.end() ? 0 : (unsigned char)(typeIt - _frameMethodLines.begin());
+
+    // Committed hashes are always upper-case hex SHA1s, which we send as raw bytes. Anything else goes as-is.
+    const string hashBytes = hash.size() == 40 ? SStrFromHex(hash) : "";
+    const bool rawHash = !hashBytes.empty() && SToHex(hashBytes) == hash;
+    auto idIt = headers.find("ID");
+    unsigned char flags = (rawHash ? STCPNode::STCP_FRAME_RAW_HASH : 0) |
+                          (idIt != headers.end() ? STCPNode::STCP_FRAME_HAS_ID : 0);
+
+    // Every length field has a fixed width, so a message with a field too big for it can't be framed.
+    if ((!rawHash && !_frameFits(hash.size(), 2)) || (!type && !_frameFits(methodLine.size(), 2)) ||
+        (idIt != headers.end() && !_frameFits(idIt->second.size(), 2))) {
+        return "";
+    }
+
+    // Leave room for the magic byte and length, which we fill in at the end.
+    string frame;
+    frame.reserve(64 + methodLine.size() + content.size() + headers.size() * 32);
+    frame.resize(5);
+    frame += (char)type;
+    frame += (char)flags;
+    _frameAppendInt(frame, commitCount, 8);
+    if (rawHash) {
+        frame += hashBytes;
+    } else {
+        _frameAppendString(frame, hash, 2);
+    }
+    if (flags & STCPNode::STCP_FRAME_HAS_ID) {
+        _frameAppendString(frame, idIt->second, 2);
+    }
+    if (!type) {
+        _frameAppendString(frame, methodLine, 2);
+    }
+
+    // Every other header, skipping the ones that are fixed fields or implied by the frame.
+    size_t headerCountPos = frame.size();
+    frame.resize(frame.size() + 2);
+    uint64_t headerCount = 0;
+    for (const auto& item : headers) {
+        if (SIEquals(item.first, "CommitCount") || SIEquals(item.first, "Hash") || SIEquals(item.first, "ID") ||
+            SIEquals(item.first, "Content-Length")) {
+            continue;
+        }
+        if (!_frameFits(item.first.size(), 2) || !_frameFits(item.second.size(), 4)) {
+            return "";
+        }
+        _frameAppendString(frame, item.first, 2);
+        _frameAppendString(frame, item.second, 4);
+        headerCount++;
+    }
+    if (!_frameFits(headerCount, 2) || frame.size() - 5 + content.size() > INT_MAX - 5) {
+        return "";
+    }
+    frame[headerCountPos] = (char)(headerCount >> 8);
+    frame[headerCountPos + 1] = (char)(headerCount & 0xFF);
+    frame += content;
+
+    // Now that we know how big it is, fill in the prefix.
+    string prefix;
+    prefix += (char)STCPNode::STCP_FRAME_MAGIC;
+    _frameAppendInt(prefix, frame.size() - 5, 4);
+    memcpy(&frame[0], prefix.data(), 5);
+    return frame;
+}
+
+string STCPNode::serializeFrame(const SData& message, const string& content, uint64_t commitCount,
+                                const string& hash) {
+    return serializeFrameHeaders(message.methodLine, message.nameValueMap, content, commitCount, hash);
+}
+
+string STCPNode::serializeFrame(const string& methodLine, const SHeaderTable& headers, const string& content,
+                                uint64_t commitCount, const string& hash) {
+    return serializeFrameHeaders(methodLine, headers, content, commitCount, hash);
+}
+
+int STCPNode::deserializeFrame(const char* buffer, size_t length, SData& message) {
+    // Wait until we have the whole frame.
+    if (length < 5) {
+        return 0;
+    }
+    const char* pos = buffer + 1;
+    uint64_t frameLength = _frameReadInt(pos, pos + 4, 4);
+    if (frameLength > INT_MAX - 5) {
+        throw "malformed frame";
+    }
+    if (length < 5 + frameLength) {
+        return 0;
+    }
+
+    // Parse the fixed fields.
+    const char* end = buffer + 5 + frameLength;
+    message.clear();
+    uint64_t type = _frameReadInt(pos, end, 1);
+    uint64_t flags = _frameReadInt(pos, end, 1);
+    message["CommitCount"] = to_string(_frameReadInt(pos, end, 8));
+    if (flags & STCP_FRAME_RAW_HASH) {
+        if (end - pos < 20) {
+            throw "malformed frame";
+        }
+        message["Hash"] = SToHex(string(pos, 20));
+        pos += 20;
+    } else {
+        message["Hash"] = _frameReadString(pos, end, 2);
+    }
+    if (flags & STCP_FRAME_HAS_ID) {
+        message["ID"] = _frameReadString(pos, end, 2);
+    }
+    if (type >= _frameMethodLines.size()) {
+        throw "unknown frame type";
+    }
+    message.methodLine = type ? _frameMethodLines[type] : _frameReadString(pos, end, 2);
+
+    // Then the rest of the headers, and everything left is content.
+    uint64_t headerCount = _frameReadInt(pos, end, 2);
+    for (uint64_t i = 0; i < headerCount; i++) {
+        string name = _frameReadString(pos, end, 2);
+        message[name] = _frameReadString(pos, end, 4);
+    }
+    message.content.assign(pos, end - pos);
+    return (int)(5 + frameLength);
+}
+
+int STCPNode::deserializeMessage(const char* buffer, size_t length, SData& message) {
+    if (length && (unsigned char)buffer[0] == STCP_FRAME_MAGIC) {
+        return deserializeFrame(buffer, length, message);
+    }
+    return message.deserialize(buffer, (int)length);
+}
+
+bool STCPNode::recvMessage(Socket* socket, SData& message) {
+    size_t length;
+    const char* front = socket->recvBuffer.front(length);
+    if (!socket->httpParser.inProgress() && length && (unsigned char)front[0] == STCP_FRAME_MAGIC) {
+        int frameSize = deserializeFrame(socket->recvBuffer.c_str(), socket->recvBuffer.size(), message);
+        SConsumeFront(socket->recvBuffer, frameSize);
+        return frameSize;
+    }
+    return socket->httpParser.parse(socket->recvBuffer, message);
+}
+
 void STCPNode::prePoll(fd_map& fdm) {
     // Let the base class do its thing
     return STCPServer::prePoll(fdm);
 }
 
+void STCPNode::prePoll(SEventLoop& loop) {
+    return STCPServer::prePoll(loop);
+}
+
 void STCPNode::postPoll(fd_map& fdm, uint64_t& nextActivity) {
     // Process the sockets
     STCPServer::postPoll(fdm);
@@ -69,10 +284,8 @@ void STCPNode::postPoll(fd_map& fdm, uint64_t& nextActivity) {
 
             // Still alive; try to login
             SData message;
-            int messageSize = message.deserialize(socket->recvBuffer);
-            if (messageSize) {
+            if (socket->httpParser.parse(socket->recvBuffer, message)) {
                 // What is it?
-                SConsumeFront(socket->recvBuffer, messageSize);
                 if (SIEquals(message.methodLine, "NODE_LOGIN")) {
                     // Got it -- can we asssociate with a peer?
                     bool foundIt = false;
@@ -132,7 +345,6 @@ void STCPNode::postPoll(fd_map& fdm, uint64_t& nextActivity) {
                 // See if there is anything new.
                 peer->failedConnections = 0; // Success; reset failures
                 SData message;
-                int messageSize = 0;
                 try {
                     // peer->s->lastRecvTime is always set, it's initialized to STimeNow() at creation.
                     if (peer->s->lastRecvTime + recvTimeout < STimeNow()) {
@@ -150,9 +362,20 @@ void STCPNode::postPoll(fd_map& fdm, uint64_t& nextActivity) {
                     }
 
                     // Process all messages
-                    while ((messageSize = message.deserialize(peer->s->recvBuffer))) {
+                    while (recvMessage(peer->s, message)) {
                         // Which message?
-                        SConsumeFront(peer->s->recvBuffer, messageSize);
+
+                        // If the peer deflated the content, restore it before anybody else looks at the message.
+                        if (SIEquals(message["Content-Encoding"], "deflate")) {
+                            string inflated;
+                            if (!SInflate(message.content, inflated, SHTTPParser::MAX_CONTENT_LENGTH)) {
+                                throw "failed to inflate content";
+                            }
+                            peer->compressedBytesReceived += message.content.size();
+                            peer->uncompressedBytesReceived += inflated.size();
+                            message.content = move(inflated);
+                            message.erase("Content-Encoding");
+                        }
                         PDEBUG("Received '" << message.methodLine << "': " << message.serialize());
                         if (SIEquals(message.methodLine, "PING")) {
                             // Let's not delay on flushing the PING PONG
@@ -7,6 +7,7 @@ struct STCPNode : public STCPServer {
 
     // Updates all peers
     void prePoll(fd_map& fdm);
+    void prePoll(SEventLoop& loop);
     void postPoll(fd_map& fdm, uint64_t& nextActivity);
 
     // Represents a single peer in the database cluster
@@ -21,10 +22,18 @@ struct STCPNode : public STCPServer {
         uint64_t id;
         int failedConnections;
 
+        // Counters for deflated message content exchanged with this peer. `compressed` is the size on the wire,
+        // `uncompressed` is the size of the same content before compression. These survive reconnects.
+        uint64_t compressedBytesSent;
+        uint64_t uncompressedBytesSent;
+        uint64_t compressedBytesReceived;
+        uint64_t uncompressedBytesReceived;
+
         // Helper methods
         Peer(const string& name_, const string& host_, const STable& params_, uint64_t id_)
           : name(name_), host(host_), params(params_), s(nullptr), latency(0), nextReconnect(0), id(id_),
-            failedConnections(0)
+            failedConnections(0), compressedBytesSent(0), uncompressedBytesSent(0), compressedBytesReceived(0),
+            uncompressedBytesReceived(0)
         { }
         bool connected() { return (s && s->state == STCPManager::Socket::CONNECTED); }
         void reset() {
@@ -40,6 +49,56 @@ struct STCPNode : public STCPServer {
     // Returns a peer by it's ID. If the ID is invalid, returns nullptr.
     Peer* getPeerByID(uint64_t id);
 
+    // Binary framing for peer messages, used in place of the HTTP-like text format with peers that negotiate it. A
+    // frame is laid out as follows (all integers in network byte order):
+    //   [1]  STCP_FRAME_MAGIC, which can never be the first byte of a text message
+    //   [4]  Length of everything that follows
+    //   [1]  Message type, an index into a fixed table of method lines, or 0 if the method line is given explicitly
+    //   [1]  Flags (STCP_FRAME_HAS_ID, STCP_FRAME_RAW_HASH)
+    //   [8]  CommitCount
+    //   Hash: 20 raw bytes if STCP_FRAME_RAW_HASH is set, otherwise a [2]-length-prefixed string
+    //   ID: [2]-length-prefixed string, if STCP_FRAME_HAS_ID is set
+    //   Method line: [2]-length-prefixed string, if the message type is 0
+    //   [2]  Number of other headers, each as a [2]-length-prefixed name and a [4]-length-prefixed value
+    //   Content: everything left in the frame
+    static const unsigned char STCP_FRAME_MAGIC = 0xB7;
+    static const unsigned char STCP_FRAME_HAS_ID = 0x01;
+    static const unsigned char STCP_FRAME_RAW_HASH = 0x02;
+
+    // Serializes a message as a binary frame. `commitCount` and `hash` fill the fixed fields, so callers don't need to
+    // copy the message to add them; any CommitCount or Hash header on the message itself is ignored. Returns an empty
+    // string if the message can't be framed because a field is too long for its length prefix, or there are too many
+    // headers, in which case the caller should send it as text instead.
+    static string serializeFrame(const SData& message, uint64_t commitCount, const string& hash) {
+        return serializeFrame(message, message.content, commitCount, hash);
+    }
+
+    // Same, but with the content passed separately, and `headers.content` ignored, so a caller can change a message's
+    // headers without copying its content.
+    static string serializeFrame(const SData& headers, const string& content, uint64_t commitCount, const string& hash);
+
+    // Same, with the headers in an SHeaderTable, which is cheaper to copy and add to than an SData's STable.
+    static string serializeFrame(const string& methodLine, const SHeaderTable& headers, const string& content,
+                                 uint64_t commitCount, const string& hash);
+
+    // Parses a single binary frame from the front of `buffer`. Returns the number of bytes consumed, or 0 if the frame
+    // isn't complete yet. Throws if the frame is malformed.
+    static int deserializeFrame(const char* buffer, size_t length, SData& message);
+    static int deserializeFrame(const string& buffer, SData& message) {
+        return deserializeFrame(buffer.data(), buffer.size(), message);
+    }
+
+    // Parses either a binary frame or a text message, whichever is at the front of `buffer`.
+    static int deserializeMessage(const char* buffer, size_t length, SData& message);
+    static int deserializeMessage(const string& buffer, SData& message) {
+        return deserializeMessage(buffer.data(), buffer.size(), message);
+    }
+
+    // Like `deserializeMessage`, but takes the message from the front of a socket's receive buffer, consuming it. Text
+    // messages are parsed incrementally with the socket's `httpParser`, so a large one that arrives over many reads is
+    // only scanned once. Returns true if a complete message was read.
+    static bool recvMessage(Socket* socket, SData& message);
+
     // Attributes
     string name;
     uint64_t recvTimeout;
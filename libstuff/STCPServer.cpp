@@ -31,7 +31,14 @@ void STCPServer::closePorts(list<Port*> except) {
         while (it != portList.end()) {
             if  (find(except.begin(), except.end(), &(*it)) == except.end()) {
                 // Close this port
+                if (_eventLoop) {
+                    _eventLoop->remove(it->s);
+                }
                 ::close(it->s);
+                if (SHostIsUnixSocket(it->host)) {
+                    // Unix domain sockets leave a file behind, so clean that up too.
+                    unlink(SAfter(it->host, "unix:").c_str());
+                }
                 SINFO("Close ports closing " << it->host << ".");
                 it = portList.erase(it);
             } else {
@@ -59,7 +66,7 @@ STCPManager::Socket* STCPServer::acceptSocket(Port*& portOut) {
             SDEBUG("Accepting socket from '" << addr << "' on port '" << port.host << "'");
             socket = new Socket(s, Socket::CONNECTED);
             socket->addr = addr;
-            socketList.push_back(socket);
+            _addSocket(socket);
 
             // Try to read immediately
             S_recvappend(socket->s, socket->recvBuffer);
@@ -82,6 +89,16 @@ void STCPServer::prePoll(fd_map& fdm) {
     }
 }
 
+void STCPServer::prePoll(SEventLoop& loop) {
+    // Call the base class
+    STCPManager::prePoll(loop);
+
+    // Add the ports
+    for (Port& port : portList) {
+        loop.set(port.s, SREADEVTS);
+    }
+}
+
 void STCPServer::postPoll(fd_map& fdm) {
     // Process all the existing sockets.
     // FIXME: Detect port failure
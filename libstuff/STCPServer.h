@@ -31,6 +31,7 @@ struct STCPServer : public STCPManager {
 
     // Updates all managed ports and sockets
     void prePoll(fd_map& fdm);
+    void prePoll(SEventLoop& loop);
     void postPoll(fd_map& fdm);
 
     // Attributes
@@ -577,7 +577,63 @@ void _SParseHTTP_GetUpToEnd(const char* start, const char* end, string& out) {
 }
 
 // --------------------------------------------------------------------------
-int SParseHTTP(const char* buffer, size_t length, string& methodLine, STable& nameValueMap, string& content) {
+template <class Table>
+static void _SParseHTTPHeaderLine(const char* lineStart, const char* lineEnd, string& methodLine, Table& nameValueMap,
+                                  string& name) {
+    // Does it start with whitespace?  If so, just append to the last value
+    if (isspace(*lineStart)) {
+        // Starts with whitespace -- if we have a name, add it to the end of the last
+        // value.  Otherwise, add it to the end of the method.
+        if (!name.empty())
+            SAppend(nameValueMap[name], lineStart, (int)(lineEnd - lineStart));
+        else
+            SAppend(methodLine, lineStart, (int)(lineEnd - lineStart));
+    } else {
+        // Parse name/value pair.  Name is everything up to the ':'
+        const char* nameEnd = _SParseHTTP_GetUpToNext(lineStart, lineEnd, ':', name);
+        if (!name.empty()) {
+            // The value is everything up to the end of the line,
+            // triming leading and trailing whitespace.
+            const char* valueStart = nameEnd + 1;
+            const char* valueEnd = lineEnd;
+            while (*valueStart == ' ')
+                ++valueStart;
+            while (*(valueEnd - 1) == ' ')
+                --valueEnd;
+            int valueLength = (int)(valueEnd - valueStart);
+            string value;
+            if (valueLength > 0) {
+                // Copy the value
+                value.resize(valueLength);
+                memcpy(&value[0], valueStart, valueLength);
+            }
+
+            // Store the result.  If there's something already
+            // there just override, with the exception of
+            // Set-Cookie: generate a crappy list with 0xFF
+            // separation.  (See SComposeHTTP for explanation.)
+            auto it = nameValueMap.find(name);
+            if (it == nameValueMap.end() || !SIEquals(name, "Set-Cookie"))
+                nameValueMap[name] = SUnescape(value); // strip any slash-escaping
+            else
+                nameValueMap[name] = it->second + S_COOKIE_SEPARATOR + value;
+        }
+    }
+}
+
+void SParseHTTPHeaderLine(const char* lineStart, const char* lineEnd, string& methodLine, STable& nameValueMap,
+                          string& name) {
+    _SParseHTTPHeaderLine(lineStart, lineEnd, methodLine, nameValueMap, name);
+}
+
+void SParseHTTPHeaderLine(const char* lineStart, const char* lineEnd, string& methodLine, SHeaderTable& nameValueMap,
+                          string& name) {
+    _SParseHTTPHeaderLine(lineStart, lineEnd, methodLine, nameValueMap, name);
+}
+
+// --------------------------------------------------------------------------
+template <class Table>
+static int _SParseHTTP(const char* buffer, size_t length, string& methodLine, Table& nameValueMap, string& content) {
     // Clear the output
     methodLine.clear();
     nameValueMap.clear();
@@ -703,45 +759,7 @@ int SParseHTTP(const char* buffer, size_t length, string& methodLine, STable& na
 
             // More headers.
             if (isHeaderOrFooter) {
-                // Does it start with whitespace?  If so, just append to the last value
-                if (isspace(*lineStart)) {
-                    // Starts with whitespace -- if we have a name, add it to the end of the last
-                    // value.  Otherwise, add it to the end of the method.
-                    if (!name.empty())
-                        SAppend(nameValueMap[name], lineStart, (int)(lineEnd - lineStart));
-                    else
-                        SAppend(methodLine, lineStart, (int)(lineEnd - lineStart));
-                } else {
-                    // Parse name/value pair.  Name is everything up to the ':'
-                    const char* nameEnd = _SParseHTTP_GetUpToNext(lineStart, lineEnd, ':', name);
-                    if (!name.empty()) {
-                        // The value is everything up to the end of the line,
-                        // triming leading and trailing whitespace.
-                        const char* valueStart = nameEnd + 1;
-                        const char* valueEnd = lineEnd;
-                        while (*valueStart == ' ')
-                            ++valueStart;
-                        while (*(valueEnd - 1) == ' ')
-                            --valueEnd;
-                        int valueLength = (int)(valueEnd - valueStart);
-                        string value;
-                        if (valueLength > 0) {
-                            // Copy the value
-                            value.resize(valueLength);
-                            memcpy(&value[0], valueStart, valueLength);
-                        }
-
-                        // Store the result.  If there's something already
-                        // there just override, with the exception of
-                        // Set-Cookie: generate a crappy list with 0xFF
-                        // separation.  (See SComposeHTTP for explanation.)
-                        STable::iterator it = nameValueMap.find(name);
-                        if (it == nameValueMap.end() || !SIEquals(name, "Set-Cookie"))
-                            nameValueMap[name] = SUnescape(value); // strip any slash-escaping
-                        else
-                            nameValueMap[name] = it->second + S_COOKIE_SEPARATOR + value;
-                    }
-                }
+                _SParseHTTPHeaderLine(lineStart, lineEnd, methodLine, nameValueMap, name);
             }
         }
 
@@ -766,6 +784,14 @@ int SParseHTTP(const char* buffer, size_t length, string& methodLine, STable& na
     return 0;
 }
 
+int SParseHTTP(const char* buffer, size_t length, string& methodLine, STable& nameValueMap, string& content) {
+    return _SParseHTTP(buffer, length, methodLine, nameValueMap, content);
+}
+
+int SParseHTTP(const char* buffer, size_t length, string& methodLine, SHeaderTable& nameValueMap, string& content) {
+    return _SParseHTTP(buffer, length, methodLine, nameValueMap, content);
+}
+
 // --------------------------------------------------------------------------
 bool SParseRequestMethodLine(const string& methodLine, string& method, string& uri) {
     // Clear the input
@@ -932,13 +958,14 @@ bool SParseURIPath(const char* buffer, int length, string& path, STable& nameVal
 }
 
 // --------------------------------------------------------------------------
-void SComposeHTTP(string& buffer, const string& methodLine, const STable& nameValueMap, const string& content) {
+template <class Table>
+static void _SComposeHTTP(string& buffer, const string& methodLine, const Table& nameValueMap, const string& content) {
     bool tryGzip = false;
 
     // Just walk across and compose a valid HTTP-like message
     buffer.clear();
     buffer += methodLine + "\r\n";
-    for (pair<string, string> item : nameValueMap) {
+    for (const auto& item : nameValueMap) {
         if (SIEquals("Set-Cookie", item.first)) {
             // Parse this list and generate a separate cookie for each.
             // Technically, this shouldn't be necessary: RFC2109 section 4.2.2
@@ -958,7 +985,7 @@ void SComposeHTTP(string& buffer, const string& methodLine, const STable& nameVa
         }
     }
 
-    const string gzipContent = tryGzip ? SGZip(content) : "";
+    const string gzipContent = tryGzip ? SGZip(content, SGZipLevel.load()) : "";
     const bool gzipSuccess = !gzipContent.empty();
     const string& finalContent = gzipSuccess ? gzipContent : content;
 
@@ -974,6 +1001,14 @@ void SComposeHTTP(string& buffer, const string& methodLine, const STable& nameVa
     buffer += finalContent;
 }
 
+void SComposeHTTP(string& buffer, const string& methodLine, const STable& nameValueMap, const string& content) {
+    _SComposeHTTP(buffer, methodLine, nameValueMap, content);
+}
+
+void SComposeHTTP(string& buffer, const string& methodLine, const SHeaderTable& nameValueMap, const string& content) {
+    _SComposeHTTP(buffer, methodLine, nameValueMap, content);
+}
+
 // --------------------------------------------------------------------------
 string SComposePOST(const STable& nameValueMap) {
     // Accumulate and convert
@@ -1389,53 +1424,147 @@ list<string> SParseJSONArray(const string& array) {
 }
 
 // --------------------------------------------------------------------------
-string SGZip(const string& content) {
-    z_stream stream;
+atomic<int> SGZipLevel(Z_BEST_COMPRESSION);
 
-    stream.zalloc = Z_NULL;
-    stream.zfree = Z_NULL;
-    stream.opaque = Z_NULL;
+// Setting up a deflate context allocates a few hundred KB of tables, which for all but the largest messages costs more
+// than the compression itself. So each thread keeps one around, and resets it between uses. It's only set up again if
+// the compression level changes.
+struct SGZipContext {
+    SGZipContext() : level(-1) { }
+    ~SGZipContext() {
+        if (level != -1) {
+            deflateEnd(&stream);
+        }
+    }
+    z_stream stream;
+    int level;
+};
+static thread_local SGZipContext _SGZipContext;
+
+string SGZip(const string& content, int level) {
+    SGZipContext& context = _SGZipContext;
+    z_stream& stream = context.stream;
+    if (context.level != level) {
+        if (context.level != -1) {
+            deflateEnd(&stream);
+            context.level = -1;
+        }
+        stream.zalloc = Z_NULL;
+        stream.zfree = Z_NULL;
+        stream.opaque = Z_NULL;
+        int GZIP_ENCODING = 16;
+        if (deflateInit2(&stream, level, Z_DEFLATED, MAX_WBITS | GZIP_ENCODING, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            SHMMM("failed to initialize a GZip context");
+            return "";
+        }
+        context.level = level;
+    } else if (deflateReset(&stream) != Z_OK) {
+        SHMMM("failed to reset GZip context");
+        return "";
+    }
 
-    stream.next_in = (unsigned char*)content.c_str();
+    // deflateBound is always big enough to do the whole thing in one pass, straight into the result.
+    string result;
+    result.resize(deflateBound(&stream, content.size()));
+    stream.next_in = (unsigned char*)content.data();
     stream.avail_in = (unsigned int)content.size();
-
-    int GZIP_ENCODING = 16;
-
-    unsigned int bufferSize = stream.avail_in + (stream.avail_in / 1000) + 20;
-    unsigned char* outBuffer = new unsigned char[bufferSize];
-
-    stream.avail_out = bufferSize;
-    stream.next_out = outBuffer;
-
-    int status = deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, MAX_WBITS | GZIP_ENCODING, MAX_MEM_LEVEL,
-                              Z_DEFAULT_STRATEGY);
-
-    if (status != Z_OK) {
-        SHMMM("failed to initialize a GZip context");
+    stream.next_out = (unsigned char*)&result[0];
+    stream.avail_out = (unsigned int)result.size();
+    int status = deflate(&stream, Z_FINISH);
+    if (status != Z_STREAM_END) {
+        SHMMM("GZip operation failed status:" << status);
         return "";
     }
+    result.resize(stream.total_out);
+    return result;
+}
 
-    status = deflate(&stream, Z_FINISH);
-    if (status != Z_STREAM_END) {
-        deflateEnd(&stream);
-        if (status == Z_OK) {
-            status = Z_BUF_ERROR;
+// --------------------------------------------------------------------------
+bool SAcceptsEncoding(const string& acceptEncoding, const string& encoding) {
+    // Each item is an encoding, optionally followed by parameters, of which the only one we care about is `q`. A `q`
+    // of zero means the client specifically doesn't want that encoding. `*` matches anything not listed by name.
+    bool wildcard = false;
+    for (const string& item : SParseList(acceptEncoding, ',')) {
+        list<string> parts = SParseList(item, ';');
+        if (parts.empty()) {
+            continue;
+        }
+        bool accepted = true;
+        for (auto it = next(parts.begin()); it != parts.end(); it++) {
+            string name = STrim(SBefore(*it, "="));
+            if (SIEquals(name, "q")) {
+                accepted = atof(STrim(SAfter(*it, "=")).c_str()) > 0;
+            }
+        }
+        string name = STrim(parts.front());
+        if (SIEquals(name, encoding)) {
+            return accepted;
+        }
+        if (name == "*") {
+            wildcard = accepted;
         }
-    } else {
-        status = deflateEnd(&stream);
     }
+    return wildcard;
+}
 
+// --------------------------------------------------------------------------
+string SDeflate(const string& content, int level) {
+    // compressBound gives us a buffer that is always large enough, so this is a single pass.
+    uLongf outLength = compressBound(content.size());
     string result;
-    result.append((char*)outBuffer, stream.total_out);
+    result.resize(outLength);
+    int status = compress2((Bytef*)&result[0], &outLength, (const Bytef*)content.data(), content.size(), level);
+    if (status != Z_OK) {
+        SHMMM("Deflate operation failed status:" << status);
+        return "";
+    }
+    result.resize(outLength);
+    return result;
+}
 
-    delete[] outBuffer;
+// --------------------------------------------------------------------------
+bool SInflate(const string& content, string& out, size_t maxSize) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit(&stream) != Z_OK) {
+        SHMMM("failed to initialize an inflate context");
+        return false;
+    }
+    stream.next_in = (Bytef*)content.data();
+    stream.avail_in = (uInt)content.size();
+
+    // Inflate in chunks, growing the output as we go. Most of what we compress is SQL, which generally compresses to
+    // somewhere between a quarter and a tenth of its size, so start there.
+    out.clear();
+    char buffer[16 * 1024];
+    int status = Z_OK;
+    out.reserve(min(content.size() * 4, maxSize));
+    while (status == Z_OK) {
+        stream.next_out = (Bytef*)buffer;
+        stream.avail_out = sizeof(buffer);
+        status = inflate(&stream, Z_NO_FLUSH);
+        if (status != Z_OK && status != Z_STREAM_END) {
+            break;
+        }
 
-    if (status == Z_OK) {
-        return result;
-    } else {
-        SHMMM("GZip operation failed status:" << status);
-        return "";
+        // A small input can inflate to an enormous output, so we stop as soon as it's bigger than we'll accept,
+        // rather than once we've run out of memory.
+        const size_t length = sizeof(buffer) - stream.avail_out;
+        if (length > maxSize - out.size()) {
+            inflateEnd(&stream);
+            SHMMM("Inflated content is over " << maxSize << " bytes, giving up.");
+            out.clear();
+            return false;
+        }
+        out.append(buffer, length);
     }
+    inflateEnd(&stream);
+    if (status != Z_STREAM_END) {
+        SHMMM("Inflate operation failed status:" << status);
+        out.clear();
+        return false;
+    }
+    return true;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -1447,32 +1576,73 @@ int S_socket(const string& host, bool isTCP, bool isPort, bool isBlocking) {
     // Try to set up the socket
     int s = 0;
     try {
-        // First, just parse the host
-        string domain;
-        uint16_t port = 0;
-        if (!SParseHost(host, domain, port))
-            throw "invalid host";
-
-        // Is the domain just a raw IP?
-        unsigned int ip = inet_addr(domain.c_str());
-        if (!ip || ip == INADDR_NONE) {
-            // Nope -- resolve the domain
-            // NOTE: gethostbyname blocks so set the DNS timeout to 1s in /etc/resolv.conf
-            uint64_t start = STimeNow();
-            hostent* hostent = gethostbyname(domain.c_str());
-            uint64_t elapsed = STimeNow() - start;
-            if (elapsed > 100 * STIME_US_PER_MS) {
-                SWARN("Slow DNS lookup. " << elapsed / STIME_US_PER_MS << "ms for '" << domain << "'.");
+        // A Unix domain socket is addressed by its path, anything else by IP and port.
+        sockaddr_storage addrStorage;
+        memset(&addrStorage, 0, sizeof(addrStorage));
+        socklen_t addrLength = 0;
+        if (SHostIsUnixSocket(host)) {
+            if (!isTCP)
+                throw "Unix domain sockets are stream-only";
+            string path = SAfter(host, "unix:");
+            sockaddr_un& addr = (sockaddr_un&)addrStorage;
+            if (path.size() >= sizeof(addr.sun_path))
+                throw "path too long";
+            addr.sun_family = AF_UNIX;
+            strcpy(addr.sun_path, path.c_str());
+            addrLength = sizeof(addr);
+
+            // A socket file left behind by a process that didn't exit cleanly would stop us binding, so remove it.
+            // We only know it's stale if nothing accepts a connection on it, though; if something's still listening,
+            // it's in use. Anything else at that path, we leave alone, and fail to bind.
+            struct stat fileInfo;
+            if (isPort && !stat(path.c_str(), &fileInfo) && S_ISSOCK(fileInfo.st_mode)) {
+                int probe = (int)socket(AF_UNIX, SOCK_STREAM, 0);
+                if (probe == -1)
+                    throw "couldn't open";
+                const int result = connect(probe, (const sockaddr*)&addr, sizeof(addr));
+                const int probeErrno = S_errno;
+                close(probe);
+                if (!result)
+                    throw "address in use";
+                if (probeErrno == ECONNREFUSED)
+                    unlink(path.c_str());
             }
-            if (!hostent || hostent->h_length != 4 || !hostent->h_addr_list || !hostent->h_addr_list[0]) {
-                throw "can't resolve host";
+        } else {
+            // First, just parse the host
+            string domain;
+            uint16_t port = 0;
+            if (!SParseHost(host, domain, port))
+                throw "invalid host";
+
+            // Is the domain just a raw IP?
+            unsigned int ip = inet_addr(domain.c_str());
+            if (!ip || ip == INADDR_NONE) {
+                // Nope -- resolve the domain
+                // NOTE: gethostbyname blocks so set the DNS timeout to 1s in /etc/resolv.conf
+                uint64_t start = STimeNow();
+                hostent* hostent = gethostbyname(domain.c_str());
+                uint64_t elapsed = STimeNow() - start;
+                if (elapsed > 100 * STIME_US_PER_MS) {
+                    SWARN("Slow DNS lookup. " << elapsed / STIME_US_PER_MS << "ms for '" << domain << "'.");
+                }
+                if (!hostent || hostent->h_length != 4 || !hostent->h_addr_list || !hostent->h_addr_list[0]) {
+                    throw "can't resolve host";
+                }
+                in_addr* addr = (in_addr*)hostent->h_addr_list[0];
+                ip = addr->s_addr;
             }
-            in_addr* addr = (in_addr*)hostent->h_addr_list[0];
-            ip = addr->s_addr;
+            sockaddr_in& addr = (sockaddr_in&)addrStorage;
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = ip;
+            addrLength = sizeof(addr);
         }
+        const sockaddr* addr = (const sockaddr*)&addrStorage;
 
         // Open a socket
-        if (isTCP)
+        if (addr->sa_family == AF_UNIX)
+            s = (int)socket(AF_UNIX, SOCK_STREAM, 0);
+        else if (isTCP)
             s = (int)socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
         else
             s = (int)socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
@@ -1491,16 +1661,11 @@ int S_socket(const string& host, bool isTCP, bool isPort, bool isBlocking) {
         if (isPort) {
             // Enable port reuse (so we don't have TIME_WAIT binding issues) and
             u_long enable = 1;
-            if (setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (char*)&enable, sizeof(enable)))
+            if (addr->sa_family == AF_INET && setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (char*)&enable, sizeof(enable)))
                 throw "couldn't set REUSEADDR";
 
             // Bind to the configured port
-            sockaddr_in addr;
-            memset(&addr, 0, sizeof(addr));
-            addr.sin_family = AF_INET;
-            addr.sin_port = htons(port);
-            addr.sin_addr.s_addr = ip;
-            if (::bind(s, (sockaddr*)&addr, sizeof(addr))) {
+            if (::bind(s, addr, addrLength)) {
                 throw "couldn't bind";
             }
 
@@ -1509,12 +1674,7 @@ int S_socket(const string& host, bool isTCP, bool isPort, bool isBlocking) {
                 throw "couldn't listen";
         } else {
             // If TCP, connect
-            sockaddr_in addr;
-            memset(&addr, 0, sizeof(addr));
-            addr.sin_family = AF_INET;
-            addr.sin_port = htons(port);
-            addr.sin_addr.s_addr = ip;
-            if (connect(s, (sockaddr*)&addr, sizeof(addr)) == -1)
+            if (connect(s, addr, addrLength) == -1)
                 switch (S_errno) {
                 case S_EWOULDBLOCK:
                 case S_EALREADY:
@@ -1598,10 +1758,18 @@ ssize_t S_recvfrom(int s, char* recvBuffer, int recvBufferSize, sockaddr_in& fro
 
 // --------------------------------------------------------------------------
 int S_accept(int port, sockaddr_in& fromAddr, bool isBlocking) {
-    // Try to receive into the buffer
-    socklen_t fromAddrLen = sizeof(fromAddr);
+    // Try to receive into the buffer. The port may be a Unix domain socket, whose peer addresses don't fit in a
+    // sockaddr_in, so accept into something big enough for anything. For those, all we return is the family.
+    sockaddr_storage fromStorage;
+    socklen_t fromAddrLen = sizeof(fromStorage);
+    memset(&fromStorage, 0, sizeof(fromStorage));
     memset(&fromAddr, 0, sizeof(fromAddr));
-    int s = (int)accept(port, (sockaddr*)&fromAddr, &fromAddrLen);
+    int s = (int)accept(port, (sockaddr*)&fromStorage, &fromAddrLen);
+    if (fromStorage.ss_family == AF_INET) {
+        fromAddr = (sockaddr_in&)fromStorage;
+    } else {
+        fromAddr.sin_family = fromStorage.ss_family;
+    }
 
     // Process the result
     if (s != -1) {
@@ -1648,32 +1816,12 @@ int S_accept(int port, sockaddr_in& fromAddr, bool isBlocking) {
 }
 
 // --------------------------------------------------------------------------
-// Receives data from a socket and appends to a string.  Returns 'true' if
-// the socket is still alive when done.
-bool S_recvappend(int s, string& recvBuffer) {
-    SASSERT(s);
-    // Figure out if this socket is blocking or non-blocking
-    int flags = fcntl(s, F_GETFL);
-    bool blocking = !(flags & O_NONBLOCK);
-
-    // Keep trying to receive as long as we can
-    char buffer[4096];
-    int totalRecv = 0;
-    ssize_t numRecv = 0;
-    sockaddr_in fromAddr;
-    socklen_t fromAddrLen = sizeof(fromAddr);
-    while ((numRecv = recvfrom(s, buffer, sizeof(buffer), 0, (sockaddr*)&fromAddr, &fromAddrLen)) > 0) {
-        // Got some more data
-        recvBuffer.append(buffer, numRecv);
-        totalRecv += numRecv;
-
-        // If this is a blocking socket, don't try again, once is enough
-        if (blocking)
-            return true; // We're still alive
-    }
-
+// Given the result of a `recv` on a socket, returns 'true' if the socket is still alive.
+static bool _recvSocketAlive(ssize_t numRecv, const sockaddr_in& fromAddr) {
     // See how we finished
-    if (numRecv == 0) {
+    if (numRecv > 0) {
+        return true;
+    } else if (numRecv == 0) {
         return false; // Graceful shutdown; socket closed
     }
     else {
@@ -1708,17 +1856,51 @@ bool S_recvappend(int s, string& recvBuffer) {
 }
 
 // --------------------------------------------------------------------------
-bool S_sendconsume(int s, string& sendBuffer) {
+// Receives data from a socket and appends to a string.  Returns 'true' if
+// the socket is still alive when done.
+bool S_recvappend(int s, string& recvBuffer) {
     SASSERT(s);
-    // If empty, nothing to do
-    if (sendBuffer.empty())
-        return true; // Assume no error, still alive
+    // Figure out if this socket is blocking or non-blocking
+    int flags = fcntl(s, F_GETFL);
+    bool blocking = !(flags & O_NONBLOCK);
 
-    // Send as much as we can
-    ssize_t numSent = send(s, sendBuffer.c_str(), (int)sendBuffer.size(), MSG_NOSIGNAL);
-    if (numSent > 0)
-        SConsumeFront(sendBuffer, numSent);
+    // Keep trying to receive as long as we can
+    char buffer[4096];
+    int totalRecv = 0;
+    ssize_t numRecv = 0;
+    sockaddr_in fromAddr;
+    socklen_t fromAddrLen = sizeof(fromAddr);
+    while ((numRecv = recvfrom(s, buffer, sizeof(buffer), 0, (sockaddr*)&fromAddr, &fromAddrLen)) > 0) {
+        // Got some more data
+        recvBuffer.append(buffer, numRecv);
+        totalRecv += numRecv;
+
+        // If this is a blocking socket, don't try again, once is enough
+        if (blocking)
+            return true; // We're still alive
+    }
+    return _recvSocketAlive(numRecv, fromAddr);
+}
+
+// --------------------------------------------------------------------------
+bool S_recvappend(int s, SBuffer& recvBuffer) {
+    SASSERT(s);
+    ssize_t numRecv = recvBuffer.recv(s);
+
+    // `readv` doesn't tell us who we're reading from, so look it up in case we need to log a failure.
+    sockaddr_in fromAddr = {};
+    if (numRecv < 0) {
+        int recvErrno = errno;
+        socklen_t fromAddrLen = sizeof(fromAddr);
+        getpeername(s, (sockaddr*)&fromAddr, &fromAddrLen);
+        errno = recvErrno;
+    }
+    return _recvSocketAlive(numRecv, fromAddr);
+}
 
+// --------------------------------------------------------------------------
+// Given the result of a `send` on a socket, returns 'true' if the socket is still alive.
+static bool _sendSocketAlive(int s, ssize_t numSent) {
     // Exit of no error
     if (numSent >= 0)
         return true; // No error; still alive
@@ -1755,6 +1937,31 @@ bool S_sendconsume(int s, string& sendBuffer) {
     }
 }
 
+// --------------------------------------------------------------------------
+bool S_sendconsume(int s, string& sendBuffer) {
+    SASSERT(s);
+    // If empty, nothing to do
+    if (sendBuffer.empty())
+        return true; // Assume no error, still alive
+
+    // Send as much as we can
+    ssize_t numSent = send(s, sendBuffer.c_str(), (int)sendBuffer.size(), MSG_NOSIGNAL);
+    if (numSent > 0)
+        SConsumeFront(sendBuffer, numSent);
+    return _sendSocketAlive(s, numSent);
+}
+
+// --------------------------------------------------------------------------
+bool S_sendconsume(int s, SBuffer& sendBuffer) {
+    SASSERT(s);
+    // If empty, nothing to do
+    if (sendBuffer.empty())
+        return true; // Assume no error, still alive
+
+    // Send as much as we can, straight from the buffer's segments.
+    return _sendSocketAlive(s, sendBuffer.send(s));
+}
+
 void SFDset(fd_map& fdm, int socket, short evts) {
     fd_map::iterator existing = fdm.find(socket);
     if (existing != fdm.end()) {
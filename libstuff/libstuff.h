@@ -12,6 +12,7 @@
 #include <sys/socket.h>
 #include <sys/time.h> // for gettimeofday()
 #include <sys/types.h>
+#include <sys/un.h>
 #include <syslog.h>
 #include <stdlib.h>
 #include <time.h>
@@ -26,6 +27,7 @@
 #include <iostream>
 #include <list>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <random>
 #include <set>
@@ -136,6 +138,8 @@ class SString : public string {
 
 typedef map<string, SString, STableComp> STable;
 
+#include "SHeaderTable.h"
+
 // --------------------------------------------------------------------------
 // A very simple HTTP-like structure consisting of a method line, a table,
 // and a content body.
@@ -439,6 +443,9 @@ inline bool SContains(const string& haystack, char needle) { return haystack.fin
 inline bool SContains(const STable& nameValueMap, const string& name) {
     return (nameValueMap.find(name) != nameValueMap.end());
 }
+inline bool SContains(const SHeaderTable& nameValueMap, const string& name) {
+    return (nameValueMap.find(name) != nameValueMap.end());
+}
 
 // General testing functions
 inline bool SIEquals(const string& lhs, const string& rhs) { return !strcasecmp(lhs.c_str(), rhs.c_str()); }
@@ -529,6 +536,16 @@ int SParseHTTP(const char* buffer, size_t length, string& methodLine, STable& na
 inline int SParseHTTP(const string& buffer, string& methodLine, STable& nameValueMap, string& content) {
     return SParseHTTP(buffer.c_str(), (int)buffer.size(), methodLine, nameValueMap, content);
 }
+int SParseHTTP(const char* buffer, size_t length, string& methodLine, SHeaderTable& nameValueMap, string& content);
+inline int SParseHTTP(const string& buffer, string& methodLine, SHeaderTable& nameValueMap, string& content) {
+    return SParseHTTP(buffer.c_str(), (int)buffer.size(), methodLine, nameValueMap, content);
+}
+// Parses one non-blank line of headers (or footers) into `nameValueMap`. Lines that start with whitespace continue the
+// previous header, whose name is kept in `name` between calls.
+void SParseHTTPHeaderLine(const char* lineStart, const char* lineEnd, string& methodLine, STable& nameValueMap,
+                          string& name);
+void SParseHTTPHeaderLine(const char* lineStart, const char* lineEnd, string& methodLine, SHeaderTable& nameValueMap,
+                          string& name);
 bool SParseRequestMethodLine(const string& methodLine, string& method, string& uri);
 bool SParseResponseMethodLine(const string& methodLine, string& protocol, int& code, string& reason);
 bool SParseURI(const char* buffer, int length, string& host, string& path);
@@ -545,10 +562,22 @@ inline string SComposeHTTP(const string& methodLine, const STable& nameValueMap,
     SComposeHTTP(buffer, methodLine, nameValueMap, content);
     return buffer;
 }
+void SComposeHTTP(string& buffer, const string& methodLine, const SHeaderTable& nameValueMap, const string& content);
+inline string SComposeHTTP(const string& methodLine, const SHeaderTable& nameValueMap, const string& content) {
+    string buffer;
+    SComposeHTTP(buffer, methodLine, nameValueMap, content);
+    return buffer;
+}
 string SComposePOST(const STable& nameValueMap);
 inline string SComposeHost(const string& host, int port) { return (host + ":" + SToStr(port)); }
 bool SParseHost(const string& host, string& domain, uint16_t& port);
+
+// A host of the form `unix:<path>` is a Unix domain socket at that path, rather than a TCP host and port.
+inline bool SHostIsUnixSocket(const string& host) { return SStartsWith(host, "unix:") && host.size() > 5; }
 inline bool SHostIsValid(const string& host) {
+    if (SHostIsUnixSocket(host)) {
+        return host.size() - 5 < sizeof(sockaddr_un::sun_path);
+    }
     string domain;
     uint16_t port = 0;
     return SParseHost(host, domain, port);
@@ -628,6 +657,9 @@ inline string SGetJSONArrayFront(const string& jsonArray) {
 
 // Converts a sockaddr_in to a string of the form "aaa.bbb.ccc.ddd:port"
 inline string SToStr(const sockaddr_in& addr) {
+    if (addr.sin_family == AF_UNIX) {
+        return "unix";
+    }
     return SToStr(inet_ntoa(addr.sin_addr)) + ":" + SToStr(ntohs(addr.sin_port));
 }
 inline ostream& operator<<(ostream& os, const sockaddr_in& addr) { return os << SToStr(addr); }
@@ -646,6 +678,7 @@ void SFDset(fd_map& fdm, int socket, short evts);
 bool SFDAnySet(fd_map& fdm, int socket, short evts);
 
 // Socket helpers
+class SBuffer;
 int S_socket(const string& host, bool isTCP, bool isPort, bool isBlocking);
 int S_accept(int port, sockaddr_in& fromAddr, bool isBlocking);
 ssize_t S_recvfrom(int s, char* recvBuffer, int recvBufferSize, sockaddr_in& fromAddr);
@@ -656,6 +689,10 @@ inline string S_recv(int s) {
     return buf;
 }
 bool S_sendconsume(int s, string& sendBuffer);
+
+// Same as above, but reading and writing directly to and from a segmented buffer, rather than through a string.
+bool S_recvappend(int s, SBuffer& recvBuffer);
+bool S_sendconsume(int s, SBuffer& sendBuffer);
 inline bool S_send(int s, string sendBuffer) {
     S_sendconsume(s, sendBuffer);
     return sendBuffer.empty();
@@ -741,7 +778,18 @@ inline string SCURRENT_TIMESTAMP() { return STIMESTAMP(STimeNow()); }
 // Miscellaneous stuff
 // --------------------------------------------------------------------------
 // Compression
-string SGZip(const string& content);
+// SGZip returns an empty string on failure. SComposeHTTP compresses `Content-Encoding: gzip` messages at SGZipLevel.
+extern atomic<int> SGZipLevel;
+string SGZip(const string& content, int level = 9);
+
+// Returns whether an Accept-Encoding header value allows the given content encoding.
+bool SAcceptsEncoding(const string& acceptEncoding, const string& encoding);
+
+// Raw zlib-format compression. SDeflate returns an empty string on failure, SInflate returns false if the input isn't
+// a complete zlib stream, or if it would inflate to more than `maxSize` bytes, which defaults to the most content a
+// message can have (`SHTTPParser::MAX_CONTENT_LENGTH`).
+string SDeflate(const string& content, int level = 1);
+bool SInflate(const string& content, string& out, size_t maxSize = INT_MAX);
 
 // Command-line helpers
 SData SParseCommandLine(int argc, char* argv[]);
@@ -810,6 +858,9 @@ struct STestTimer {
 // Networking stuff
 // --------------------------------------------------------------------------
 // Networking includes
+#include "SBuffer.h"
+#include "SHTTPParser.h"
+#include "SEventLoop.h"
 #include "SX509.h"
 #include "SSSLState.h"
 #include "STCPManager.h"
@@ -202,6 +202,9 @@ int main(int argc, char* argv[]) {
         cout
             << "-serverHost     <host:port> Listen on this host:port for cluster connections (default 'localhost:8888')"
             << endl;
+        cout << "                            Either this or -controlPort can be a comma-separated list, and can include "
+                "Unix domain sockets as 'unix:<path>'"
+             << endl;
         cout << "-nodeName       <name>      Name this specfic node in the cluster as indicated (defaults to '"
              << SGetHostName() << "')" << endl;
         cout << "-nodeHost       <host:port> Listen on this host:port for connections from other nodes" << endl;
@@ -215,6 +218,25 @@ int main(int argc, char* argv[]) {
              << endl;
         cout << "-maxJournalSize <#commits>  Number of commits to retain in the historical journal (default 1000000)"
              << endl;
+        cout << "-replicationCompression <level> zlib level (1-9) used to compress large messages to peers that support "
+                "it (default 0, off)"
+             << endl;
+        cout << "-parallelReplication <#threads> Apply ASYNC transactions from the master on this many threads while "
+                "slaving (default 0, off)"
+             << endl;
+        cout << "-epoll                      Use epoll rather than poll to wait on client connections (Linux only)"
+             << endl;
+        cout << "-ioThreads      <#>         Read requests and send responses for client connections on this many "
+                "threads (default 0, main thread)"
+             << endl;
+        cout << "-maxRequestsInFlight <#>    Requests a client connection can have in progress at once; responses are "
+                "still sent in request order (default 1)"
+             << endl;
+        cout << "-responseCompression <level> zlib level (1-9) used to gzip responses for clients that accept it "
+                "(default 0, off)"
+             << endl;
+        cout << "-responseCompressionMinSize <bytes> Don't compress responses smaller than this (default 1024)" << endl;
+        cout << "-compressOnWorkers          Compress responses on worker threads rather than the sync thread" << endl;
         cout << endl;
         cout << "Quick Start Tips:" << endl;
         cout << "-----------------" << endl;
@@ -297,14 +319,23 @@ int main(int argc, char* argv[]) {
         // Run the server. Scoped to allow us to create a new server after a backup.
         {
             SINFO("Starting bedrock server");
+            // With -epoll, client sockets stay registered with the kernel between iterations, rather than being
+            // passed to poll() every time, which scales better with lots of mostly idle connections. The loop is
+            // declared first so it outlives the server, which unregisters its sockets from it as it's destroyed.
+            unique_ptr<SEventLoop> eventLoop(args.test("-epoll") ? new SEventLoop() : nullptr);
             BedrockServer server(args);
             uint64_t nextActivity = STimeNow();
             while (!server.shutdownComplete()) {
                 // Wait and process
                 fd_map fdm;
-                server.prePoll(fdm);
                 const uint64_t now = STimeNow();
-                S_poll(fdm, max(nextActivity, now) - now);
+                if (eventLoop) {
+                    server.prePoll(*eventLoop);
+                    eventLoop->wait(fdm, max(nextActivity, now) - now);
+                } else {
+                    server.prePoll(fdm);
+                    S_poll(fdm, max(nextActivity, now) - now);
+                }
                 nextActivity = STimeNow() + STIME_US_PER_S; // 1s max period
                 server.postPoll(fdm, nextActivity);
             }
@@ -1,5 +1,27 @@
 #include "Cache.h"
 
+// The name filter is sized for at least this many names, with this many bits for each, and sets this many bits for
+// each name, which gives about a 1% false positive rate when it's full.
+#define CACHE_FILTER_MIN_NAMES 1024
+#define CACHE_FILTER_BITS_PER_NAME 10
+#define CACHE_FILTER_HASHES 7
+
+// How many bytes of values each node keeps in memory, unless `-cache.hotMax` says otherwise.
+#define CACHE_DEFAULT_HOT_MAX (64 * 1024 * 1024)
+
+// Parses a size in bytes, with an optional KB, MB or GB suffix.
+static int64_t parseCacheSize(const string& size) {
+    const string& upper = SToUpper(size);
+    int64_t bytes = SToInt64(upper);
+    if (SEndsWith(upper, "KB"))
+        bytes *= 1024;
+    if (SEndsWith(upper, "MB"))
+        bytes *= 1024 * 1024;
+    if (SEndsWith(upper, "GB"))
+        bytes *= 1024 * 1024 * 1024;
+    return bytes;
+}
+
 // ==========================================================================
 BedrockPlugin_Cache::LRUMap::LRUMap() {
     // Initialize
@@ -72,14 +94,7 @@ BedrockPlugin_Cache::~BedrockPlugin_Cache() {
 // ==========================================================================
 void BedrockPlugin_Cache::initialize(const SData& args, BedrockServer& server) {
     // Check the configuration
-    const string& maxCache = SToUpper(args["-cache.max"]);
-    int64_t maxCacheSize = SToInt64(maxCache);
-    if (SEndsWith(maxCache, "KB"))
-        maxCacheSize *= 1024;
-    if (SEndsWith(maxCache, "MB"))
-        maxCacheSize *= 1024 * 1024;
-    if (SEndsWith(maxCache, "GB"))
-        maxCacheSize *= 1024 * 1024 * 1024;
+    int64_t maxCacheSize = parseCacheSize(args["-cache.max"]);
     if (!maxCacheSize) {
         // Provide a default
         SINFO("No -cache.max specified, defaulting to 16GB");
@@ -91,6 +106,23 @@ void BedrockPlugin_Cache::initialize(const SData& args, BedrockServer& server) {
     // Save this in a class constant, to enable us to access it safely in an
     // unsynchronized manner from other threads.
     *((int64_t*)&_maxCacheSize) = maxCacheSize;
+
+    // Keep up to `-cache.hotMax` bytes of recently read values in memory. 0 turns this off.
+    const int64_t hotMax = args.isSet("-cache.hotMax") ? parseCacheSize(args["-cache.hotMax"]) : CACHE_DEFAULT_HOT_MAX;
+    _hotValues.budget = max(hotMax, (int64_t)0);
+    SINFO("Keeping up to " << _hotValues.budget << " bytes of cached values in memory");
+
+    // Keep the name filter and hot values up to date with every change to the cache table.
+    SQLite::addTableObserver("cache", &_nameFilter);
+    SQLite::addTableObserver("cache", &_hotValues);
+}
+
+// ==========================================================================
+STable BedrockPlugin_Cache::getInfo() {
+    STable info;
+    _nameFilter.getInfo(info);
+    _hotValues.getInfo(info);
+    return info;
 }
 
 #undef SLOGPREFIX
@@ -158,14 +190,40 @@ bool BedrockPlugin_Cache::peekCommand(SQLite& db, BedrockCommand& command) {
         verifyAttributeSize(request, "name", 1, MAX_SIZE_SMALL);
         const string& name = request["name"];
 
-        // Get the list
+        // A name without any GLOB special characters can only match itself, so we can look it up by the primary key,
+        // and the name filter can tell us if it's not there at all. Nothing has read anything in this transaction
+        // yet, so if the filter hasn't been built, now's the time.
         SQResult result;
-        if (!db.read("SELECT name, value "
-                     "FROM cache "
-                     "WHERE name GLOB " +
-                         SQ(name) + " "
-                                    "LIMIT 1;",
-                     result)) {
+        if (name.find_first_of("*?[") == string::npos) {
+            // If we've read it recently, and it hasn't changed since, we don't need to read it again.
+            if (_hotValues.get(name, response.content)) {
+                response["name"] = name;
+                _lruMap.pushMRU(name);
+                return true;
+            }
+            const uint64_t generation = _hotValues.generation();
+            const bool filtered = _nameFilter.load(db);
+            if (filtered && !_nameFilter.mayContain(name)) {
+                throw "404 No match found";
+            }
+            if (!db.readPrepared("SELECT name, value, rowid FROM cache WHERE name=?;", {name}, result)) {
+                throw "502 Query failed";
+            }
+            if (filtered) {
+                _nameFilter.recordLookup(!result.empty());
+            }
+            if (!result.empty()) {
+                _hotValues.put(name, SToInt64(result[0][2]), result[0][1], generation);
+            }
+        }
+
+        // Otherwise, get the first match
+        else if (!db.read("SELECT name, value "
+                          "FROM cache "
+                          "WHERE name GLOB " +
+                              SQ(name) + " "
+                                         "LIMIT 1;",
+                          result)) {
             throw "502 Query failed";
         }
 
@@ -175,7 +233,7 @@ bool BedrockPlugin_Cache::peekCommand(SQLite& db, BedrockCommand& command) {
             throw "404 No match found";
         } else {
             // Return that item
-            SASSERT(result[0].size() == 2);
+            SASSERT(result[0].size() >= 2);
             response["name"] = result[0][0];
             response.content = result[0][1];
 
@@ -275,3 +333,324 @@ bool BedrockPlugin_Cache::processCommand(SQLite& db, BedrockCommand& command) {
     return false;
 }
 
+#undef SLOGPREFIX
+#define SLOGPREFIX "{Cache} "
+
+// ==========================================================================
+BedrockPlugin_Cache::NameFilter::NameFilter()
+    : _loaded(false), _capacity(0), _added(0), _full(false), _building(false), _recording(false), _definiteMisses(0),
+      _hits(0), _falsePositives(0) { }
+
+// ==========================================================================
+bool BedrockPlugin_Cache::_readNames(SQLite& db, const set<int64_t>& rowIDs, list<string>& names) {
+    // A chunk at a time, so the statement doesn't get too big.
+    for (auto it = rowIDs.begin(); it != rowIDs.end();) {
+        list<int64_t> chunk;
+        for (; it != rowIDs.end() && chunk.size() < 1000; it++) {
+            chunk.push_back(*it);
+        }
+        SQResult result;
+        if (!db.read("SELECT name FROM cache WHERE rowid IN (" + SQList(chunk) + ");", result)) {
+            return false;
+        }
+        for (auto& row : result.rows) {
+            names.push_back(move(row[0]));
+        }
+    }
+    return true;
+}
+
+// ==========================================================================
+bool BedrockPlugin_Cache::NameFilter::load(SQLite& db) {
+    if (_loaded.load() && !_full.load()) {
+        return true;
+    }
+
+    // If someone else is already building a new filter, use the old one, if there is one, until they're done.
+    if (_building.exchange(true)) {
+        return _loaded.load();
+    }
+
+    // Start recording the names that are committed before we read the table, so we don't miss any that commit after
+    // our read's snapshot. Taking the commit lock to do it means no transaction is between `prepared` and
+    // `committed`, where it would have skipped reading its names.
+    {
+        SQLITE_COMMIT_AUTOLOCK;
+        lock_guard<mutex> lock(_mutex);
+        _recordedNames.clear();
+        _recording.store(true);
+    }
+
+    // Now read and build the new filter without holding anything, so commits carry on meanwhile.
+    uint64_t start = STimeNow();
+    SQResult result;
+    if (!db.read("SELECT name FROM cache;", result)) {
+        SWARN("Couldn't build the name filter, reading the cache table instead.");
+        lock_guard<mutex> lock(_mutex);
+        _recording.store(false);
+        _recordedNames.clear();
+        _building.store(false);
+        return _loaded.load();
+    }
+    const uint64_t capacity = max((uint64_t)result.size() * 2, (uint64_t)CACHE_FILTER_MIN_NAMES);
+    vector<uint64_t> bits((capacity * CACHE_FILTER_BITS_PER_NAME + 63) / 64, 0);
+    uint64_t added = 0;
+    for (auto& row : result.rows) {
+        if (!_testBits(bits, row[0], true)) {
+            added++;
+        }
+    }
+
+    // Catch up with what was committed while we read, and swap the new filter in.
+    lock_guard<mutex> lock(_mutex);
+    if (_recording.load()) {
+        for (const string& name : _recordedNames) {
+            if (!_testBits(bits, name, true)) {
+                added++;
+            }
+        }
+        _bits.swap(bits);
+        _capacity = capacity;
+        _added = added;
+        _full.store(false);
+        _loaded.store(true);
+        SINFO("Built the name filter from " << result.size() << " names and " << _recordedNames.size()
+              << " committed meanwhile, with room for " << _capacity << ", in " << (STimeNow() - start) / 1000
+              << "ms.");
+    } else {
+        SWARN("Lost track of cache names while building the name filter, discarding it.");
+    }
+    _recording.store(false);
+    _recordedNames.clear();
+    _building.store(false);
+    return _loaded.load();
+}
+
+// ==========================================================================
+bool BedrockPlugin_Cache::NameFilter::mayContain(const string& name) {
+    lock_guard<mutex> lock(_mutex);
+
+    // If the filter's been dropped since we loaded it, we can't rule anything out.
+    if (_bits.empty() || _testBits(_bits, name, false)) {
+        return true;
+    }
+    _definiteMisses++;
+    return false;
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::NameFilter::recordLookup(bool found) {
+    if (found) {
+        _hits++;
+    } else {
+        _falsePositives++;
+    }
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::NameFilter::getInfo(STable& info) {
+    // Of the lookups for names that weren't cached, the fraction the filter didn't catch.
+    const uint64_t definiteMisses = _definiteMisses.load();
+    const uint64_t falsePositives = _falsePositives.load();
+    info["nameFilterDefiniteMisses"] = SToStr(definiteMisses);
+    info["nameFilterHits"] = SToStr(_hits.load());
+    info["nameFilterFalsePositives"] = SToStr(falsePositives);
+    info["nameFilterFalsePositiveRate"] =
+        SToStr(falsePositives ? (double)falsePositives / (falsePositives + definiteMisses) : 0.0);
+
+    // And the rate we'd expect, from how full the filter is: (1 - e^(-kn/m))^k.
+    lock_guard<mutex> lock(_mutex);
+    if (!_bits.empty()) {
+        const double bits = _bits.size() * 64;
+        info["nameFilterNames"] = SToStr(_added);
+        info["nameFilterBytes"] = SToStr(_bits.size() * sizeof(uint64_t));
+        info["nameFilterExpectedFalsePositiveRate"] =
+            SToStr(pow(1 - exp(-(double)CACHE_FILTER_HASHES * _added / bits), CACHE_FILTER_HASHES));
+    }
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::NameFilter::prepared(SQLite& db, const set<int64_t>& rowIDs) {
+    // Until we've loaded or started building, there's nothing to keep up to date.
+    if (!_loaded.load() && !_recording.load()) {
+        return;
+    }
+
+    // Read the names of the rows that were inserted or updated. Deleted rows aren't there to read, which is fine, as
+    // we couldn't take their names out anyway.
+    _pendingNames.clear();
+    if (!_readNames(db, rowIDs, _pendingNames)) {
+        // If we can't tell what was written, we can't rule anything out anymore. Drop the filter, and it'll be built
+        // again the next time it's needed.
+        SWARN("Couldn't read changed cache names, dropping the name filter.");
+        lock_guard<mutex> lock(_mutex);
+        _loaded.store(false);
+        _bits.clear();
+        _recording.store(false);
+        _recordedNames.clear();
+        _pendingNames.clear();
+    }
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::NameFilter::committed() {
+    lock_guard<mutex> lock(_mutex);
+    for (const string& name : _pendingNames) {
+        // Overwriting a name that's already there doesn't make the filter any fuller.
+        if (!_bits.empty() && !_testBits(_bits, name, true)) {
+            _added++;
+        }
+        if (_recording.load()) {
+            _recordedNames.push_back(name);
+        }
+    }
+    _pendingNames.clear();
+
+    // Once it's as full as it was sized for, it's rebuilt from just the names still in the cache, the next time it's
+    // needed. We keep using it until then.
+    if (_loaded.load() && !_full.load() && _added > _capacity) {
+        SINFO("Name filter has had " << _added << " names added, rebuilding it.");
+        _full.store(true);
+    }
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::NameFilter::rolledBack() {
+    _pendingNames.clear();
+}
+
+// ==========================================================================
+bool BedrockPlugin_Cache::NameFilter::_testBits(vector<uint64_t>& bits, const string& name, bool set) {
+    // Double hashing: the bits are h1, h1 + h2, h1 + 2 * h2, and so on, with h2 mixed from h1 and made odd, so it's
+    // never 0.
+    const uint64_t h1 = hash<string>()(name);
+    uint64_t h2 = h1 * 0x9E3779B97F4A7C15ull;
+    h2 = (h2 ^ (h2 >> 31)) | 1;
+    const uint64_t size = bits.size() * 64;
+    bool wasSet = true;
+    for (uint64_t i = 0; i < CACHE_FILTER_HASHES; i++) {
+        const uint64_t bit = (h1 + i * h2) % size;
+        const uint64_t mask = (uint64_t)1 << (bit % 64);
+        wasSet = wasSet && (bits[bit / 64] & mask);
+        if (set) {
+            bits[bit / 64] |= mask;
+        }
+    }
+    return wasSet;
+}
+
+// ==========================================================================
+BedrockPlugin_Cache::HotValues::HotValues()
+    : budget(0), _size(0), _dropAll(false), _generation(0), _hits(0), _misses(0) { }
+
+// ==========================================================================
+bool BedrockPlugin_Cache::HotValues::get(const string& name, string& value) {
+    if (!budget) {
+        return false;
+    }
+    lock_guard<mutex> lock(_mutex);
+    auto it = _entries.find(name);
+    if (it == _entries.end()) {
+        _misses++;
+        return false;
+    }
+    _lru.splice(_lru.end(), _lru, it->second.lruIt);
+    value = it->second.value;
+    _hits++;
+    return true;
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::HotValues::put(const string& name, int64_t rowID, const string& value,
+                                         uint64_t generation) {
+    // A value that would take up most of the budget would just push everything else out.
+    const size_t size = name.size() + value.size();
+    if (size > budget / 2) {
+        return;
+    }
+    lock_guard<mutex> lock(_mutex);
+    if (_generation.load() != generation || _entries.count(name)) {
+        return;
+    }
+    while (_size + size > budget) {
+        _erase(_entries.find(_lru.front()));
+    }
+    Entry& entry = _entries[name];
+    entry.value = value;
+    entry.rowID = rowID;
+    entry.lruIt = _lru.insert(_lru.end(), name);
+    _namesByRowID[rowID] = name;
+    _size += size;
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::HotValues::getInfo(STable& info) {
+    info["hotValueHits"] = SToStr(_hits.load());
+    info["hotValueMisses"] = SToStr(_misses.load());
+    info["hotValueBudget"] = SToStr(budget);
+    lock_guard<mutex> lock(_mutex);
+    info["hotValues"] = SToStr(_entries.size());
+    info["hotValueBytes"] = SToStr(_size);
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::HotValues::prepared(SQLite& db, const set<int64_t>& rowIDs) {
+    // We know which rows our values came from, so that covers changed and deleted rows. But SQLite doesn't tell us
+    // about the old row when a name is replaced, so we also need the names of the rows that were written.
+    // Even if we have no values now, one could be read before this commits, so we always need them, unless we never
+    // keep any.
+    if (!budget) {
+        return;
+    }
+    _pendingRowIDs = rowIDs;
+    _pendingNames.clear();
+    if (!_readNames(db, rowIDs, _pendingNames)) {
+        // If we can't tell what was written, drop everything.
+        SWARN("Couldn't read changed cache names, dropping all hot values.");
+        _dropAll = true;
+    }
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::HotValues::committed() {
+    lock_guard<mutex> lock(_mutex);
+    if (_dropAll) {
+        _entries.clear();
+        _namesByRowID.clear();
+        _lru.clear();
+        _size = 0;
+    }
+    for (int64_t rowID : _pendingRowIDs) {
+        auto it = _namesByRowID.find(rowID);
+        if (it != _namesByRowID.end()) {
+            _erase(_entries.find(it->second));
+        }
+    }
+    for (const string& name : _pendingNames) {
+        auto it = _entries.find(name);
+        if (it != _entries.end()) {
+            _erase(it);
+        }
+    }
+    _pendingRowIDs.clear();
+    _pendingNames.clear();
+    _dropAll = false;
+
+    // Anything read before this commit might be out of date, so it's too late to keep it.
+    _generation++;
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::HotValues::rolledBack() {
+    _pendingRowIDs.clear();
+    _pendingNames.clear();
+    _dropAll = false;
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::HotValues::_erase(map<string, Entry>::iterator it) {
+    _size -= it->first.size() + it->second.value.size();
+    _namesByRowID.erase(it->second.rowID);
+    _lru.erase(it->second.lruIt);
+    _entries.erase(it);
+}
@@ -14,6 +14,7 @@ class BedrockPlugin_Cache : public BedrockPlugin {
     virtual void upgradeDatabase(SQLite& db);
     virtual bool peekCommand(SQLite& db, BedrockCommand& command);
     virtual bool processCommand(SQLite& db, BedrockCommand& command);
+    virtual STable getInfo();
 
   private:
     // Bedrock Cache LRU map
@@ -47,7 +48,131 @@ class BedrockPlugin_Cache : public BedrockPlugin {
         map<string, Entry*> _lruMap;
     };
 
+    // Adds the names of the cache table's rows `rowIDs` to `names`, and returns whether they could be read. Rows that
+    // have been deleted aren't there to read, so they're left out. Both observers below need these for every commit.
+    static bool _readNames(SQLite& db, const set<int64_t>& rowIDs, list<string>& names);
+
+    // A Bloom filter of the names in the cache table, so ReadCache can tell that an exact name isn't cached without
+    // reading the database. It observes every commit to the cache table, on every node, and is built from the table
+    // the first time it's needed, sized for twice the names there are then. Names can't be taken back out of a Bloom
+    // filter, so deleted names stay in it, making it less accurate, until it's rebuilt. That happens once it's had as
+    // many names added as it was sized for, and the old filter keeps answering until the new one's ready.
+    class NameFilter : public SQLite::TableObserver {
+      public:
+        NameFilter();
+
+        // Builds the filter from `db`, unless it's already built and not full, and returns whether there's a filter to
+        // use. The table is read without the commit lock, and names committed meanwhile are added afterwards, so
+        // this has to be the first read in `db`'s transaction. Only one thread builds at a time; the others use the
+        // old filter, if there is one, until it's done.
+        bool load(SQLite& db);
+
+        // Returns false if `name` is definitely not in the cache, or true if it might be.
+        bool mayContain(const string& name);
+
+        // Records whether a name the filter said might be in the cache actually was, to track the false positive rate.
+        void recordLookup(bool found);
+
+        // Adds the filter's size and accuracy to `info`.
+        void getInfo(STable& info);
+
+        // TableObserver interface.
+        void prepared(SQLite& db, const set<int64_t>& rowIDs);
+        void committed();
+        void rolledBack();
+
+      private:
+        // Returns whether every bit in `bits` for `name` is set, setting them first if `set` is.
+        static bool _testBits(vector<uint64_t>& bits, const string& name, bool set);
+
+        mutex _mutex;
+        atomic<bool> _loaded;
+        vector<uint64_t> _bits;
+        uint64_t _capacity;
+        uint64_t _added;
+
+        // Whether the filter's had as many names added as it was sized for, and so should be rebuilt, and whether a
+        // thread is building a new one.
+        atomic<bool> _full;
+        atomic<bool> _building;
+
+        // While a new filter's being built, the names committed since its read of the table started, to add to it
+        // before it replaces the old one. If we lose track of what's committed, `_recording` is cleared, and the new
+        // filter's thrown away.
+        atomic<bool> _recording;
+        list<string> _recordedNames;
+
+        // The names written by the transaction that's between `prepared` and `committed`.
+        list<string> _pendingNames;
+
+        // How many lookups the filter answered with a definite miss, and, of the ones it let through, how many were
+        // found and how many weren't (the false positives).
+        atomic<uint64_t> _definiteMisses;
+        atomic<uint64_t> _hits;
+        atomic<uint64_t> _falsePositives;
+    };
+
+    // The values of recently read names, so ReadCache can answer for them without reading the database, up to a
+    // budget of bytes, least recently used out first. It observes every commit to the cache table, on every node, and
+    // drops the value of any name that's written, changed or deleted.
+    class HotValues : public SQLite::TableObserver {
+      public:
+        HotValues();
+
+        // The most bytes of names and values to keep. Set before anything's read. 0 keeps nothing.
+        size_t budget;
+
+        // Copies the value of `name` into `value` and returns true if we have it, or returns false if we don't.
+        bool get(const string& name, string& value);
+
+        // Returns the generation of the cache table, which `put` needs. Take it before reading the value to put.
+        uint64_t generation() { return _generation.load(); }
+
+        // Keeps `value`, read from the cache table's row `rowID` for `name`, unless the table has changed since
+        // `generation`, in which case the value might already be out of date.
+        void put(const string& name, int64_t rowID, const string& value, uint64_t generation);
+
+        // Adds the number of values kept, their size, and the hits and misses to `info`.
+        void getInfo(STable& info);
+
+        // TableObserver interface.
+        void prepared(SQLite& db, const set<int64_t>& rowIDs);
+        void committed();
+        void rolledBack();
+
+      private:
+        struct Entry {
+            string value;
+            int64_t rowID;
+            list<string>::iterator lruIt;
+        };
+
+        // Drops an entry. `_mutex` must be held.
+        void _erase(map<string, Entry>::iterator it);
+
+        mutex _mutex;
+        map<string, Entry> _entries;
+        map<int64_t, string> _namesByRowID;
+
+        // Names, least recently used first.
+        list<string> _lru;
+        size_t _size;
+
+        // The rows changed by the transaction that's between `prepared` and `committed`, the names they have now,
+        // and whether we couldn't read those, and have to drop everything.
+        set<int64_t> _pendingRowIDs;
+        list<string> _pendingNames;
+        bool _dropAll;
+
+        // Counts commits to the cache table.
+        atomic<uint64_t> _generation;
+        atomic<uint64_t> _hits;
+        atomic<uint64_t> _misses;
+    };
+
     // Constants
     const int64_t _maxCacheSize;
     LRUMap _lruMap;
+    NameFilter _nameFilter;
+    HotValues _hotValues;
 };
@@ -1,50 +1,232 @@
 #include "Jobs.h"
+#include "../BedrockServer.h"
 
 #undef SLOGPREFIX
 #define SLOGPREFIX "{" << getName() << "} "
 
 #define JOBS_DEFAULT_PRIORITY 500
 
+// How often the master looks for expired job leases, and the most jobs it requeues in each transaction.
+#define JOBS_LEASE_SWEEP_INTERVAL_MS 1000
+#define JOBS_LEASE_SWEEP_BATCH 1000
+
+// How often, by default, the master moves jobs that are done with to the archive, and the most it moves in each
+// transaction.
+#define JOBS_DEFAULT_ARCHIVE_INTERVAL_S 10
+#define JOBS_ARCHIVE_BATCH 1000
+
+// How often the master fills in the integer timestamps of jobs that don't have them yet, and the most it fills in
+// each transaction.
+#define JOBS_BACKFILL_INTERVAL_MS 1000
+#define JOBS_BACKFILL_BATCH 1000
+
+// `nextRun` and `lastRun` are kept as text, for anyone reading the jobs table, and in microseconds in `nextRunUS` and
+// `lastRunUS`, which is what we schedule by. These work out the microseconds from the text, in SQL, for jobs written
+// before the integer columns were added, or by hand. A `nextRun` SQLite can't read counts as due now.
+#define JOBS_TEXT_TO_US(column) "CAST(STRFTIME('%s', " column ") AS INTEGER) * 1000000"
+#define JOBS_NEXT_RUN_US "COALESCE(nextRunUS, " JOBS_TEXT_TO_US("nextRun") ", 0)"
+#define JOBS_LAST_RUN_US "COALESCE(lastRunUS, " JOBS_TEXT_TO_US("lastRun") ", 0)"
+
+// The columns the archive keeps.
+#define JOBS_ARCHIVE_COLUMNS "created, jobID, state, name, nextRun, lastRun, repeat, data, priority, parentJobID, " \
+                             "retryAfter"
+
+// Each partition's jobIDs start at its number shifted left this many bits, so the partition a job is in is the top
+// bits of its jobID. Partition 0 is the original jobs table, so existing jobIDs stay where they are.
+#define JOBS_PARTITION_SHIFT 48
+#define JOBS_MAX_PARTITIONS 256
+
+// The longest GetJob will wait for a job with `Connection: wait`, and how long it waits without a `timeout`.
+#define JOBS_MAX_WAIT_MS 60000
+
+// Returns the error for a command on a job whose lease is `jobLeaseID` (empty if it isn't leased) that was given
+// `leaseID`, or "" if they match. A leased job can only be renewed, retried, finished or failed with the leaseID
+// GetJob returned, so a runner whose lease expired can't touch the job after it's been requeued and got again.
+static string checkLeaseID(const string& jobLeaseID, const string& leaseID) {
+    if (jobLeaseID == leaseID) {
+        return "";
+    }
+    return jobLeaseID.empty() || !leaseID.empty() ? "409 Job isn't leased with this leaseID" : "402 Missing leaseID";
+}
+
+// ==========================================================================
+BedrockPlugin_Jobs::BedrockPlugin_Jobs()
+  : _partitions(1), _backfilled(false), _server(nullptr),
+    _leaseSweepTimer(JOBS_LEASE_SWEEP_INTERVAL_MS * STIME_US_PER_MS), _archiveTimer(0),
+    _backfillTimer(JOBS_BACKFILL_INTERVAL_MS * STIME_US_PER_MS) {
+    timers.insert(&_leaseSweepTimer);
+    timers.insert(&_archiveTimer);
+    timers.insert(&_backfillTimer);
+}
+
+// ==========================================================================
+void BedrockPlugin_Jobs::initialize(const SData& args, BedrockServer& server) {
+    _server = &server;
+
+    // Archive jobs every `-jobs.archiveInterval` seconds. Set it to 0 to keep them in the jobs table.
+    const int64_t archiveInterval = args.isSet("-jobs.archiveInterval") ? args.calc64("-jobs.archiveInterval")
+                                                                         : JOBS_DEFAULT_ARCHIVE_INTERVAL_S;
+    _archiveTimer.alarmDuration = max(archiveInterval, (int64_t)0) * STIME_US_PER_S;
+
+    // Split the jobs table into `-jobs.partitions` tables. This should be the same on every node. It can be raised
+    // later, but not lowered, as the jobs in the partitions that went away would be lost.
+    if (args.isSet("-jobs.partitions")) {
+        _partitions = max(min(args.calc64("-jobs.partitions"), (int64_t)JOBS_MAX_PARTITIONS), (int64_t)1);
+    }
+    _readyIndex.partitions = _partitions;
+
+    // Keep the ready index up to date with every change to any partition of the jobs table.
+    for (int64_t partition = 0; partition < _partitions; partition++) {
+        SQLite::addTableObserver(_partitionTable(partition), &_readyIndex);
+    }
+
+    // When jobs are queued, wake any GetJob commands waiting for jobs with those names.
+    _readyIndex.onQueued = [&server](const set<string>& names) {
+        server.wakeWaitingCommands([&names](const string& key) {
+            if (!SStartsWith(key, "Jobs:")) {
+                return false;
+            }
+            const char* pattern = key.c_str() + strlen("Jobs:");
+            for (const string& name : names) {
+                if (!sqlite3_strglob(pattern, name.c_str())) {
+                    return true;
+                }
+            }
+            return false;
+        });
+    };
+}
+
 // ==========================================================================
 void BedrockPlugin_Jobs::upgradeDatabase(SQLite& db) {
-    // Create or verify the jobs table
+    // Create or verify each partition of the jobs table
     bool ignore;
-    if (!db.verifyTable("jobs", "CREATE TABLE jobs ( "
-                                   "created     TIMESTAMP NOT NULL, "
-                                   "jobID       INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT, "
-                                   "state       TEXT NOT NULL, "
-                                   "name        TEXT NOT NULL, "
-                                   "nextRun     TIMESTAMP NOT NULL, "
-                                   "lastRun     TIMESTAMP, "
-                                   "repeat      TEXT NOT NULL, "
-                                   "data        TEXT NOT NULL, "
-                                   "priority    INTEGER NOT NULL DEFAULT " + SToStr(JOBS_DEFAULT_PRIORITY) + ", "
-                                   "parentJobID INTEGER NOT NULL DEFAULT 0, "
-                                   "retryAfter  TEXT NOT NULL DEFAULT \"\" )",
-                        ignore))
-    {
-        SASSERT(db.write("ALTER TABLE jobs ADD COLUMN retryAfter TEXT NOT NULL DEFAULT \"\";"));
+    for (int64_t partition = 0; partition < _partitions; partition++) {
+        const string table = _partitionTable(partition);
+        if (!db.verifyTable(table, "CREATE TABLE " + table + " ( "
+                                       "created     TIMESTAMP NOT NULL, "
+                                       "jobID       INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT, "
+                                       "state       TEXT NOT NULL, "
+                                       "name        TEXT NOT NULL, "
+                                       "nextRun     TIMESTAMP NOT NULL, "
+                                       "lastRun     TIMESTAMP, "
+                                       "repeat      TEXT NOT NULL, "
+                                       "data        TEXT NOT NULL, "
+                                       "priority    INTEGER NOT NULL DEFAULT " + SToStr(JOBS_DEFAULT_PRIORITY) + ", "
+                                       "parentJobID INTEGER NOT NULL DEFAULT 0, "
+                                       "retryAfter  TEXT NOT NULL DEFAULT \"\", "
+                                       "leaseExpires TIMESTAMP, "
+                                       "nextRunUS   INTEGER, "
+                                       "lastRunUS   INTEGER, "
+                                       "leaseID     TEXT )",
+                            ignore))
+        {
+            // Add whichever columns were added after this table was created.
+            const string& sql = db.read("SELECT sql FROM sqlite_master WHERE type='table' AND tbl_name=" + SQ(table) +
+                                        ";");
+            if (!SContains(sql, "retryAfter")) {
+                SASSERT(db.write("ALTER TABLE " + table + " ADD COLUMN retryAfter TEXT NOT NULL DEFAULT \"\";"));
+            }
+            if (!SContains(sql, "leaseExpires")) {
+                SASSERT(db.write("ALTER TABLE " + table + " ADD COLUMN leaseExpires TIMESTAMP;"));
+            }
+
+            // The existing jobs' integer timestamps are left NULL here, and filled in by the master a batch at a
+            // time, so adding them doesn't hold up starting the server.
+            if (!SContains(sql, "nextRunUS")) {
+                SASSERT(db.write("ALTER TABLE " + table + " ADD COLUMN nextRunUS INTEGER;"));
+            }
+            if (!SContains(sql, "lastRunUS")) {
+                SASSERT(db.write("ALTER TABLE " + table + " ADD COLUMN lastRunUS INTEGER;"));
+            }
+            if (!SContains(sql, "leaseID")) {
+                SASSERT(db.write("ALTER TABLE " + table + " ADD COLUMN leaseID TEXT;"));
+            }
+        }
+
+        // Start each partition's jobIDs at the bottom of its range. AUTOINCREMENT carries on from there.
+        if (partition) {
+            SASSERT(db.write("INSERT INTO sqlite_sequence (name, seq) "
+                             "SELECT " + SQ(table) + ", " + SQ(partition << JOBS_PARTITION_SHIFT) + " "
+                             "WHERE NOT EXISTS (SELECT 1 FROM sqlite_sequence WHERE name=" + SQ(table) + ");"));
+        }
+
+        // These indexes are not used by the Bedrock::Jobs plugin, but provided for easy analysis
+        // using the Bedrock::DB plugin.
+        SASSERT(db.write("CREATE INDEX IF NOT EXISTS " + table + "State    ON " + table + " ( state    );"));
+        SASSERT(db.write("CREATE INDEX IF NOT EXISTS " + table + "Name     ON " + table + " ( name     );"));
+        SASSERT(db.write("CREATE INDEX IF NOT EXISTS " + table + "NextRun  ON " + table + " ( nextRun  );"));
+        SASSERT(db.write("CREATE INDEX IF NOT EXISTS " + table + "LastRun  ON " + table + " ( lastRun  );"));
+        SASSERT(db.write("CREATE INDEX IF NOT EXISTS " + table + "Priority ON " + table + " ( priority );"));
+        SASSERT(db.write("CREATE INDEX IF NOT EXISTS " + table + "ParentJobIDState ON " + table +
+                         " ( parentJobID, state );"));
+
+        // This index is used to optimize the Bedrock::Jobs::GetJob call. It replaces one on the text `nextRun`, which
+        // GetJob uses until every job's `nextRunUS` has been filled in, so that's dropped once they have been.
+        SASSERT(db.write("CREATE INDEX IF NOT EXISTS " + table + "StatePriorityNextRunUSName ON " + table +
+                         " ( state, priority, nextRunUS, name );"));
+        if (db.read("SELECT 1 FROM " + table + " WHERE nextRunUS IS NULL LIMIT 1;").empty()) {
+            SASSERT(db.write("DROP INDEX IF EXISTS " + table + "StatePriorityNextRunName;"));
+        }
+
+        // This one lets the lease sweeper find expired leases without looking through every RUNNING job. Only leased
+        // jobs are in it.
+        SASSERT(db.write("CREATE INDEX IF NOT EXISTS " + table + "LeaseExpires ON " + table + " ( leaseExpires ) "
+                         "WHERE leaseExpires IS NOT NULL;"));
+
+        // And this one lets the master find the jobs whose integer timestamps still need filling in.
+        SASSERT(db.write("CREATE INDEX IF NOT EXISTS " + table + "NextRunUSMissing ON " + table + " ( jobID ) "
+                         "WHERE nextRunUS IS NULL;"));
+
+        // If anything changes the text `nextRun` or `lastRun` without the integer column, eg, a Query, work the integer
+        // out again, so we don't schedule by one that's out of date. We always write both, so these don't fire for us.
+        SASSERT(db.write("CREATE TRIGGER IF NOT EXISTS " + table + "NextRunUS AFTER UPDATE OF nextRun ON " + table + " "
+                         "WHEN NEW.nextRunUS IS OLD.nextRunUS "
+                         "BEGIN "
+                         "UPDATE " + table + " SET nextRunUS=COALESCE(" JOBS_TEXT_TO_US("NEW.nextRun") ", 0) "
+                         "WHERE jobID=NEW.jobID; "
+                         "END;"));
+        SASSERT(db.write("CREATE TRIGGER IF NOT EXISTS " + table + "LastRunUS AFTER UPDATE OF lastRun ON " + table + " "
+                         "WHEN NEW.lastRunUS IS OLD.lastRunUS "
+                         "BEGIN "
+                         "UPDATE " + table + " SET lastRunUS=" JOBS_TEXT_TO_US("NEW.lastRun") " "
+                         "WHERE jobID=NEW.jobID; "
+                         "END;"));
+
+        // Likewise, a job inserted without them gets them as it's inserted. So once the jobs from before they were
+        // added have been filled in, no job is ever missing them again, which `_timestampsBackfilled` relies on.
+        SASSERT(db.write("CREATE TRIGGER IF NOT EXISTS " + table + "InsertRunUS AFTER INSERT ON " + table + " "
+                         "WHEN NEW.nextRunUS IS NULL "
+                         "BEGIN "
+                         "UPDATE " + table + " SET nextRunUS=" JOBS_NEXT_RUN_US ", "
+                             "lastRunUS=COALESCE(lastRunUS, " JOBS_TEXT_TO_US("lastRun") ") "
+                         "WHERE jobID=NEW.jobID; "
+                         "END;"));
     }
 
-    // These indexes are not used by the Bedrock::Jobs plugin, but provided for easy analysis
-    // using the Bedrock::DB plugin.
-    SASSERT(db.write("CREATE INDEX IF NOT EXISTS jobsState    ON jobs ( state    );"));
-    SASSERT(db.write("CREATE INDEX IF NOT EXISTS jobsName     ON jobs ( name     );"));
-    SASSERT(db.write("CREATE INDEX IF NOT EXISTS jobsNextRun  ON jobs ( nextRun  );"));
-    SASSERT(db.write("CREATE INDEX IF NOT EXISTS jobsLastRun  ON jobs ( lastRun  );"));
-    SASSERT(db.write("CREATE INDEX IF NOT EXISTS jobsPriority ON jobs ( priority );"));
-    SASSERT(db.write("CREATE INDEX IF NOT EXISTS jobsParentJobIDState ON jobs ( parentJobID, state );"));
-
-    // This index is used to optimize the Bedrock::Jobs::GetJob call.
-    SASSERT(db.write(
-        "CREATE INDEX IF NOT EXISTS jobsStatePriorityNextRunName ON jobs ( state, priority, nextRun, name );"));
+    // Jobs that are done with are moved here, out of the way of the indexes above. It's looked up by jobID, and by
+    // name, by CreateJob's `unique`, which finds archived jobs just like it did when they stayed in the jobs table.
+    SASSERT(db.verifyTable("jobsArchive", "CREATE TABLE jobsArchive ( "
+                                              "created     TIMESTAMP NOT NULL, "
+                                              "jobID       INTEGER NOT NULL PRIMARY KEY, "
+                                              "state       TEXT NOT NULL, "
+                                              "name        TEXT NOT NULL, "
+                                              "nextRun     TIMESTAMP NOT NULL, "
+                                              "lastRun     TIMESTAMP, "
+                                              "repeat      TEXT NOT NULL, "
+                                              "data        TEXT NOT NULL, "
+                                              "priority    INTEGER NOT NULL, "
+                                              "parentJobID INTEGER NOT NULL, "
+                                              "retryAfter  TEXT NOT NULL, "
+                                              "archived    TIMESTAMP NOT NULL )",
+                           ignore));
+    SASSERT(db.write("CREATE INDEX IF NOT EXISTS jobsArchiveName ON jobsArchive ( name );"));
 }
 
 // ==========================================================================
 bool BedrockPlugin_Jobs::peekCommand(SQLite& db, BedrockCommand& command) {
     // Pull out some helpful variables
     SData& request = command.request;
-    SData& response = command.response;
     STable& content = command.jsonContent;
     const string& requestVerb = request.getVerb();
 
@@ -59,7 +241,9 @@ bool BedrockPlugin_Jobs::peekCommand(SQLite& db, BedrockCommand& command) {
         //     - name - name pattern of jobs to match
         //     - numResults - maximum number of jobs to dequeue
         //     - connection - (optional) If "wait" will pause up to "timeout" for a match
-        //     - timeout - (optional) maximum time (in ms) to wait, default forever
+        //     - timeout - (optional) maximum time (in ms) to wait, default and maximum 60s
+        //     - leaseDuration - (optional) seconds the jobs are leased for. A job that isn't finished, retried,
+        //                       failed or renewed with RenewJobLease by then is requeued.
         //
         //     Returns:
         //     - 200 - OK
@@ -67,6 +251,8 @@ bool BedrockPlugin_Jobs::peekCommand(SQLite& db, BedrockCommand& command) {
         //           o jobID - unique ID of the job
         //           o name  - name of the actual job matched
         //           o data  - JSON data associated with this job
+        //           o leaseExpires - when the job's lease expires, if it has one
+        //           o leaseID - if the job's leased, pass this to RenewJobLease, RetryJob, FinishJob or FailJob
         //         . GetJobs
         //           o jobs - Array of JSON objects, each matching the result of GetJob
         //     - 303 - Timeout
@@ -80,40 +266,40 @@ bool BedrockPlugin_Jobs::peekCommand(SQLite& db, BedrockCommand& command) {
                 throw "402 Cannot use numResults with GetJob; try GetJobs";
             }
         }
+        if (request.isSet("leaseDuration") && request.calc64("leaseDuration") < 1) {
+            throw "402 Malformed leaseDuration";
+        }
 
-        // Get the list
-        SQResult result;
+        // See if there's anything to get. The ready index can tell us without reading the jobs table. Nothing else
+        // has read anything in this transaction yet, so if the index hasn't been loaded, now's the time.
+        bool found = false;
         const string& name = request["name"];
-        if (!db.read("SELECT 1 "
-                     "FROM jobs "
-                     "WHERE state='QUEUED' "
-                     "  AND " + SCURRENT_TIMESTAMP() + ">=nextRun "
-                     "  AND name GLOB " + SQ(name) + " "
-                     "LIMIT 1;",
-                     result)) {
-            throw "502 Query failed";
-        }
-
-        // If we didn't get any results, just return an empty list
-        if (result.empty() || SToInt(result[0][0]) == 0) {
-            // Did the caller set "Connection: wait"?  If so, put a "hold"
-            // on this request -- we'll clear the hold when we get a new
-            // job.
-            if (SIEquals(request["Connection"], "wait")) {
-                // Place a hold on this request waiting for new jobs in this
-                // state.
-                SINFO("No results found and 'Connection: wait'; placing request on hold until we get a new job "
-                      "matching name '"
-                      << request["name"] << "'");
-                request["HeldBy"] = "Jobs:" + name;
-                response.clear(); // Clear default response so we don't accidentally think we're done
-                return false;     // Not processed
-            } else {
-                // Don't hold, just respond with no results
-                throw "404 No job found";
+        const uint64_t now = STimeNow();
+        if (_readyIndex.load(db)) {
+            found = !_readyIndex.find(name, now, 1).empty();
+        } else {
+            const string due = _timestampsBackfilled(db) ? "nextRunUS<=" + SQ(now) : STIMESTAMP(now) + ">=nextRun";
+            for (int64_t partition = 0; partition < _partitions && !found; partition++) {
+                SQResult result;
+                if (!db.read("SELECT 1 "
+                             "FROM " + _partitionTable(partition) + " "
+                             "WHERE state='QUEUED' "
+                             "  AND " + due + " "
+                             "  AND name GLOB " + SQ(name) + " "
+                             "LIMIT 1;",
+                             result)) {
+                    throw "502 Query failed";
+                }
+                found = !result.empty() && SToInt(result[0][0]) != 0;
             }
         }
 
+        // If we didn't get any results, just return an empty list, unless the caller wants to wait for one.
+        if (!found) {
+            _waitForJob(command);
+            throw "404 No job found";
+        }
+
         // Looks like there might be results -- queue this for processing
         SINFO("Found results, but waiting for processCommand to update");
         return false;
@@ -138,20 +324,31 @@ bool BedrockPlugin_Jobs::peekCommand(SQLite& db, BedrockCommand& command) {
         //         . lastRun - timestamp it was last run
         //         . repeat - recurring description
         //         . data - JSON data associated with this job
+        //         . leaseExpires - when a RUNNING job's lease expires, if it has one
+        //         . archived - when the job was moved to the archive, if it has been
         //     - 404 - No jobs found
         //
         verifyAttributeInt64(request, "jobID", 1);
 
-        // Verify there is a job like this
+        // Verify there is a job like this. If it's not in the jobs table, it may have been archived.
         SQResult result;
-        if (!db.read("SELECT created, jobID, state, name, nextRun, lastRun, repeat, data "
-                     "FROM jobs "
+        if (!db.read("SELECT created, jobID, state, name, nextRun, lastRun, repeat, data, leaseExpires "
+                     "FROM " + _jobsTable(request.calc64("jobID")) + " "
                      "WHERE jobID=" + SQ(request.calc64("jobID")) + ";",
                      result)) {
             throw "502 Select failed";
         }
         if (result.empty()) {
-            throw "404 No job with this jobID";
+            if (!db.read("SELECT created, jobID, state, name, nextRun, lastRun, repeat, data, NULL, archived "
+                         "FROM jobsArchive "
+                         "WHERE jobID=" + SQ(request.calc64("jobID")) + ";",
+                         result)) {
+                throw "502 Select failed";
+            }
+            if (result.empty()) {
+                throw "404 No job with this jobID";
+            }
+            content["archived"] = result[0][9];
         }
         content["created"] = result[0][0];
         content["jobID"] = result[0][1];
@@ -161,6 +358,9 @@ bool BedrockPlugin_Jobs::peekCommand(SQLite& db, BedrockCommand& command) {
         content["lastRun"] = result[0][5];
         content["repeat"] = result[0][6];
         content["data"] = result[0][7];
+        if (!result[0][8].empty()) {
+            content["leaseExpires"] = result[0][8];
+        }
         return true; // Successfully processed
     }
 
@@ -192,6 +392,15 @@ bool BedrockPlugin_Jobs::peekCommand(SQLite& db, BedrockCommand& command) {
             }
         }
 
+        // Read the states of all the parents at once, rather than one at a time.
+        set<int64_t> parentJobIDs;
+        for (auto& job : jsonJobs) {
+            if (SContains(job, "parentJobID") && SToInt64(job["parentJobID"])) {
+                parentJobIDs.insert(SToInt64(job["parentJobID"]));
+            }
+        }
+        const map<int64_t, pair<string, int64_t>> parents = _readJobStates(db, parentJobIDs);
+
         for (auto& job : jsonJobs) {
             // If no priority set, set it
             int64_t priority = SContains(job, "priority") ? SToInt(job["priority"]) : JOBS_DEFAULT_PRIORITY;
@@ -211,18 +420,23 @@ bool BedrockPlugin_Jobs::peekCommand(SQLite& db, BedrockCommand& command) {
                 throw "402 Data is not a valid JSON Object";
             }
 
+            // Throw if firstRun isn't a time we could schedule the job for.
+            uint64_t firstRun = 0;
+            if (SContains(job, "firstRun") && !job["firstRun"].empty() && !_parseTimestamp(job["firstRun"], firstRun)) {
+                throw "402 Malformed firstRun";
+            }
+
             // Validate that the parentJobID exists and is in the right state if one was passed.
-            int64_t parentJobID = SContains(job, "parentJobID") ? SToInt(job["parentJobID"]) : 0;
+            int64_t parentJobID = SContains(job, "parentJobID") ? SToInt64(job["parentJobID"]) : 0;
+            const string table = _partitionTable(_partitionForNewJob(job["name"], parentJobID));
             if (parentJobID) {
-                SQResult result;
-                if (!db.read("SELECT state FROM jobs WHERE jobID=" + SQ(parentJobID) + ";", result)) {
-                    throw "502 Select failed";
-                }
-                if (result.empty()) {
+                auto parentIt = parents.find(parentJobID);
+                if (parentIt == parents.end()) {
                     throw "404 parentJobID does not exist";
                 }
-                if (!SIEquals(result[0][0], "RUNNING") && !SIEquals(result[0][0], "PAUSED")) {
-                    SWARN("Trying to create child job with parent jobID#" << parentJobID << ", but parent isn't RUNNING or PAUSED (" << result[0][0] << ")");
+                const string& parentState = parentIt->second.first;
+                if (!SIEquals(parentState, "RUNNING") && !SIEquals(parentState, "PAUSED")) {
+                    SWARN("Trying to create child job with parent jobID#" << parentJobID << ", but parent isn't RUNNING or PAUSED (" << parentState << ")");
                     throw "405 Can only create child job when parent is RUNNING or PAUSED";
                 }
             }
@@ -232,12 +446,21 @@ bool BedrockPlugin_Jobs::peekCommand(SQLite& db, BedrockCommand& command) {
                 SQResult result;
                 SINFO("Unique flag was passed, checking existing job with name " << job["name"]);
                 if (!db.read("SELECT jobID, data "
-                             "FROM jobs "
+                             "FROM " + table + " "
                              "WHERE name=" + SQ(job["name"]) + ";",
                              result)) {
                     throw "502 Select failed";
                 }
 
+                // A job that's done with may have been archived, but it still counts.
+                if (result.empty() && !db.read("SELECT jobID, data "
+                                               "FROM jobsArchive "
+                                               "WHERE name=" + SQ(job["name"]) + " "
+                                               "ORDER BY jobID LIMIT 1;",
+                                               result)) {
+                    throw "502 Select failed";
+                }
+
                 // If there's no job or the existing job doesn't match the data we've been passed, escalate to master.
                 if (!result.empty() && ((job["data"].empty() && result[0][1] == "{}") || (!job["data"].empty() && result[0][1] == job["data"]))) {
                     // Return early, no need to pass to master, there are no more jobs to create.
@@ -266,19 +489,27 @@ bool BedrockPlugin_Jobs::peekCommand(SQLite& db, BedrockCommand& command) {
         verifyAttributeInt64(request, "jobID", 1);
         int64_t jobID = request.calc64("jobID");
 
+        const string table = _jobsTable(jobID);
         SQResult result;
         if (!db.read("SELECT j.state, GROUP_CONCAT(jj.jobID) "
-                     "FROM jobs j "
-                     "LEFT JOIN jobs jj ON jj.parentJobID = j.jobID "
+                     "FROM " + table + " j "
+                     "LEFT JOIN " + table + " jj ON jj.parentJobID = j.jobID "
                      "WHERE j.jobID=" + SQ(jobID) + " "
                      "GROUP BY j.jobID;",
                      result)) {
             throw "502 Select failed";
         }
 
-        // Verify the job exists
+        // Verify the job exists. If it's been archived, it can only be a FAILED one that still needs cancelling, as
+        // anything else in the archive is already done with.
         if (result.empty()) {
-            throw "404 No job with this jobID";
+            if (!db.read("SELECT state FROM jobsArchive WHERE jobID=" + SQ(jobID) + ";", result)) {
+                throw "502 Select failed";
+            }
+            if (result.empty()) {
+                throw "404 No job with this jobID";
+            }
+            return result[0][0] != "FAILED";
         }
 
         // If the job has any children, we are using the command in the wrong way
@@ -301,6 +532,72 @@ bool BedrockPlugin_Jobs::peekCommand(SQLite& db, BedrockCommand& command) {
         return false; // Need to process command
     }
 
+    // ----------------------------------------------------------------------
+    else if (SIEquals(requestVerb, "ExpireJobLeases")) {
+        // - ExpireJobLeases()
+        //
+        //     Requeues RUNNING jobs whose leases have expired. The master sends this to itself every second, so
+        //     there's normally no need for anyone else to.
+        //
+        //     Returns:
+        //     - 200 - OK
+        //         . jobIDs - the jobs that were requeued
+        //
+        // Most of the time there's nothing to do, and we can tell without a write.
+        for (int64_t partition = 0; partition < _partitions; partition++) {
+            if (!db.read("SELECT 1 FROM " + _partitionTable(partition) + " "
+                         "WHERE leaseExpires<=" + SCURRENT_TIMESTAMP() + " LIMIT 1;").empty()) {
+                return false;
+            }
+        }
+        content["jobIDs"] = "[]";
+        return true;
+    }
+
+    // ----------------------------------------------------------------------
+    else if (SIEquals(requestVerb, "ArchiveJobs")) {
+        // - ArchiveJobs()
+        //
+        //     Moves jobs that are done with from the jobs table to jobsArchive, so they're not in the way of the
+        //     jobs that are still to run. The master sends this to itself every `-jobs.archiveInterval` seconds.
+        //     QueryJob and DeleteJob still find archived jobs, as does CreateJob's `unique`.
+        //
+        //     Returns:
+        //     - 200 - OK
+        //         . jobIDs - the jobs that were archived
+        //
+        for (int64_t partition = 0; partition < _partitions; partition++) {
+            const string table = _partitionTable(partition);
+            if (!db.read("SELECT 1 FROM " + table + " WHERE " + _archivable(table) + " LIMIT 1;").empty()) {
+                return false;
+            }
+        }
+        content["jobIDs"] = "[]";
+        return true;
+    }
+
+    // ----------------------------------------------------------------------
+    else if (SIEquals(requestVerb, "BackfillJobTimestamps")) {
+        // - BackfillJobTimestamps()
+        //
+        //     Fills in `nextRunUS` and `lastRunUS` from `nextRun` and `lastRun` for jobs from before those columns
+        //     were added. Jobs inserted since without them, eg, with Query, get them from a trigger. The master sends
+        //     this to itself every second, until there are none left.
+        //
+        //     Returns:
+        //     - 200 - OK
+        //         . jobIDs - the jobs that were filled in
+        //
+        for (int64_t partition = 0; partition < _partitions; partition++) {
+            if (!db.read("SELECT 1 FROM " + _partitionTable(partition) + " WHERE nextRunUS IS NULL LIMIT 1;").empty()) {
+                return false;
+            }
+        }
+        _backfilled.store(true);
+        content["jobIDs"] = "[]";
+        return true;
+    }
+
     // Didn't recognize this command
     return false;
 }
@@ -326,7 +623,8 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
         //     - repeat - A description of how to repeat (optional)
         //     - priority - High priorities go first (optional, default 500)
         //     - unique - if true, it will check that no other job with this name already exists, if it does it will
-        //                return that jobID
+        //                return that jobID. A job that's been archived counts, but one still in the jobs table is
+        //                preferred.
         //     - parentJobID - The ID of the parent job (optional)
         //
         //     Returns:
@@ -344,14 +642,14 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
         //          - repeat - A description of how to repeat (optional)
         //          - priority - High priorities go first (optional, default 500)
         //          - unique - if true, it will check that no other job with this name already exists, if it does it will
-        //                     return that jobID
+        //                     return that jobID, as for CreateJob
         //          - parentJobID - The ID of the parent job (optional)
         //
         //     Returns:
         //     - jobIDs - array with the unique identifier of the jobs
         //
 
-        list<STable> jsonJobs;
+        vector<STable> jsonJobs;
         if (SIEquals(request.methodLine, "CreateJob")) {
             jsonJobs.push_back(request.nameValueMap);
         } else {
@@ -371,45 +669,154 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
             }
         }
 
-        list<string> jobIDs;
+        // Work out which partition each job goes in, and read what we need to check them against -- their parents,
+        // and the existing jobs with the names of the unique ones -- with one query per partition, rather than
+        // several per job.
+        vector<string> tables;
+        set<int64_t> parentJobIDs;
+        map<string, set<string>> uniqueNames;
         for (auto& job : jsonJobs) {
+            const int64_t parentJobID = SContains(job, "parentJobID") ? SToInt64(job["parentJobID"]) : 0;
+            tables.push_back(_partitionTable(_partitionForNewJob(job["name"], parentJobID)));
+            if (parentJobID) {
+                parentJobIDs.insert(parentJobID);
+            }
+            if (SContains(job, "unique") && job["unique"] == "true") {
+                uniqueNames[tables.back()].insert(job["name"]);
+            }
+        }
+        const map<int64_t, pair<string, int64_t>> parents = _readJobStates(db, parentJobIDs);
+
+        // The jobID and data of the first job with each of those names, by table and name.
+        map<pair<string, string>, pair<string, string>> existing;
+        for (auto& table : uniqueNames) {
+            SQResult result;
+            if (!db.read("SELECT name, jobID, data "
+                         "FROM " + table.first + " "
+                         "WHERE name IN (" + SQList(table.second) + ") "
+                         "ORDER BY jobID;",
+                         result)) {
+                throw "502 Select failed";
+            }
+            for (auto& row : result.rows) {
+                existing.emplace(make_pair(table.first, row[0]), make_pair(row[1], row[2]));
+            }
+        }
+
+        // Then the archive, for the names that aren't in the jobs table. An archived job that's reused with different
+        // data is updated there.
+        set<string> archivedJobIDs;
+        for (auto& table : uniqueNames) {
+            set<string> missing;
+            for (auto& name : table.second) {
+                if (!existing.count(make_pair(table.first, name))) {
+                    missing.insert(name);
+                }
+            }
+            if (missing.empty()) {
+                continue;
+            }
+            SQResult result;
+            if (!db.read("SELECT name, jobID, data "
+                         "FROM jobsArchive "
+                         "WHERE name IN (" + SQList(missing) + ") "
+                         "ORDER BY jobID;",
+                         result)) {
+                throw "502 Select failed";
+            }
+            for (auto& row : result.rows) {
+                if (existing.emplace(make_pair(table.first, row[0]), make_pair(row[1], row[2])).second) {
+                    archivedJobIDs.insert(row[1]);
+                }
+            }
+        }
+
+        // All the jobs are created at the same time, which is when they run, unless they say otherwise.
+        const uint64_t now = STimeNow();
+
+        // New jobs are inserted with one statement per partition once we've been through them all. Until then
+        // they're kept here, along with the names of every job we've created or changed. A unique job with one of
+        // those names inserts everything so far and looks again, so it finds what it would have if the jobs had been
+        // created one at a time.
+        vector<string> jobIDs(jsonJobs.size());
+        map<string, list<pair<size_t, string>>> inserts;
+        set<pair<string, string>> changedNames;
+        auto insertJobs = [&]() {
+            for (auto& table : inserts) {
+                list<string> values;
+                for (auto& insert : table.second) {
+                    values.push_back(insert.second);
+                }
+                if (!db.write("INSERT INTO " + table.first + " "
+                              "( created, state, name, nextRun, nextRunUS, repeat, data, priority, parentJobID ) "
+                              "VALUES " + SComposeList(values) + ";")) {
+                    throw "502 insert query failed";
+                }
+
+                // The rows of a single INSERT get consecutive jobIDs, ending at the last insert rowid.
+                const int64_t lastInsertRowID = db.getLastInsertRowID();
+                int64_t jobID = lastInsertRowID - (int64_t)table.second.size() + 1;
+                for (auto& insert : table.second) {
+                    jobIDs[insert.first] = SToStr(jobID++);
+                }
+                const int64_t maxJobID = SToInt64(db.read("SELECT MAX(jobID) FROM " + table.first + ";"));
+                if (lastInsertRowID != maxJobID) {
+                    SALERT("We might be returning the wrong jobID maxJobID=" << maxJobID
+                                                                             << " lastInsertRowID=" << lastInsertRowID);
+                }
+            }
+            inserts.clear();
+        };
+
+        for (size_t i = 0; i < jsonJobs.size(); i++) {
+            STable& job = jsonJobs[i];
+            const string& table = tables[i];
+            const int64_t parentJobID = SContains(job, "parentJobID") ? SToInt64(job["parentJobID"]) : 0;
+
             // If unique flag was passed and the job exist in the DB, then we can finish the command without escalating to
             // master.
             uint64_t updateJobID = 0;
             if (SContains(job, "unique") && job["unique"] == "true") {
-                SQResult result;
                 SINFO("Unique flag was passed, checking existing job with name " << job["name"]);
-                if (!db.read("SELECT jobID, data "
-                             "FROM jobs "
-                             "WHERE name=" + SQ(job["name"]) + ";",
-                             result)) {
-                    throw "502 Select failed";
+                const auto name = make_pair(table, job["name"]);
+                if (changedNames.count(name)) {
+                    insertJobs();
+                    SQResult result;
+                    if (!db.read("SELECT jobID, data "
+                                 "FROM " + table + " "
+                                 "WHERE name=" + SQ(job["name"]) + " "
+                                 "ORDER BY jobID LIMIT 1;",
+                                 result)) {
+                        throw "502 Select failed";
+                    }
+                    if (!result.empty()) {
+                        existing[name] = make_pair(result[0][0], result[0][1]);
+                    }
+                    changedNames.erase(name);
                 }
+                auto existingIt = existing.find(name);
 
                 // If we got a result, and it's data is the same as passed, we won't change anything.
-                if (!result.empty() && ((job["data"].empty() && result[0][1] == "{}") || (!job["data"].empty() && result[0][1] == job["data"]))) {
+                if (existingIt != existing.end() &&
+                    ((job["data"].empty() && existingIt->second.second == "{}") ||
+                     (!job["data"].empty() && existingIt->second.second == job["data"]))) {
                     SINFO("Job already existed with matching data, and unique flag was passed, reusing existing job "
-                          << result[0][0]);
-
-                    // If we are calling CreateJob, return early, there are no more jobs to create.
-                    if (SIEquals(request.methodLine, "CreateJob")) {
-                        content["jobID"] = result[0][0];
-                        return true;
-                    }
-
-                    // Append new jobID to list of created jobs.
-                    jobIDs.push_back(result[0][0]);
+                          << existingIt->second.first);
+                    jobIDs[i] = existingIt->second.first;
                     continue;
                 }
 
                 // If we found a job, but the data was different, we'll need to update it.
-                if (!result.empty()) {
-                    updateJobID = SToInt64(result[0][0]);
+                if (existingIt != existing.end()) {
+                    updateJobID = SToInt64(existingIt->second.first);
                 }
             }
 
             // If no "firstRun" was provided, use right now
-            const string& safeFirstRun = !SContains(job, "firstRun") || job["firstRun"].empty() ? SCURRENT_TIMESTAMP() : SQ(job["firstRun"]);
+            uint64_t firstRun = now;
+            if (SContains(job, "firstRun") && !job["firstRun"].empty() && !_parseTimestamp(job["firstRun"], firstRun)) {
+                throw "402 Malformed firstRun";
+            }
 
             // If no data was provided, use an empty object
             const string& safeData = !SContains(job, "data") || job["data"].empty() ? SQ("{}") : SQ(job["data"]);
@@ -439,31 +846,29 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
             }
 
             // Validate that the parentJobID exists and is in the right state if one was passed.
-            int64_t parentJobID = SContains(job, "parentJobID") ? SToInt(job["parentJobID"]) : 0;
+            auto parentIt = parents.find(parentJobID);
             if (parentJobID) {
-                SQResult result;
-                if (!db.read("SELECT state, parentJobID FROM jobs WHERE jobID=" + SQ(parentJobID) + ";", result)) {
-                    throw "502 Select failed";
-                }
-                if (result.empty()) {
+                if (parentIt == parents.end()) {
                     throw "404 parentJobID does not exist";
                 }
-                if (!SIEquals(result[0][0], "RUNNING") && !SIEquals(result[0][0], "PAUSED")) {
-                    SWARN("Trying to create child job with parent jobID#" << parentJobID << ", but parent isn't RUNNING or PAUSED (" << result[0][0] << ")");
+                const string& parentState = parentIt->second.first;
+                if (!SIEquals(parentState, "RUNNING") && !SIEquals(parentState, "PAUSED")) {
+                    SWARN("Trying to create child job with parent jobID#" << parentJobID << ", but parent isn't RUNNING or PAUSED (" << parentState << ")");
                     throw "405 Can only create child job when parent is RUNNING or PAUSED";
                 }
 
                 // Prevent jobs from creating grandchildren
-                if (!SIEquals(result[0][1], "0")) {
+                if (parentIt->second.second) {
                     SWARN("Trying to create grandchild job with parent jobID#" << parentJobID);
                     throw "405 Cannot create grandchildren";
                 }
             }
 
             // Are we creating a new job, or updating an existing job?
+            changedNames.insert(make_pair(table, job["name"]));
             if (updateJobID) {
                 // Update the existing job.
-                if(!db.write("UPDATE jobs SET "
+                if(!db.write("UPDATE " + (archivedJobIDs.count(SToStr(updateJobID)) ? "jobsArchive" : table) + " SET "
                                "repeat   = " + SQ(SToUpper(job["repeat"])) + ", " +
                                "data     = JSON_PATCH(data, " + safeData + "), " +
                                "priority = " + SQ(priority) + " " +
@@ -471,15 +876,7 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
                 {
                     throw "502 update query failed";
                 }
-
-                // If we are calling CreateJob, return early, there are no more jobs to create.
-                if (SIEquals(request.methodLine, "CreateJob")) {
-                    content["jobID"] = SToStr(updateJobID);
-                    return true;
-                }
-
-                // Append new jobID to list of created jobs.
-                jobIDs.push_back(SToStr(updateJobID));
+                jobIDs[i] = SToStr(updateJobID);
             } else {
                 // Normal jobs start out in the QUEUED state, meaning they are ready to run immediately.
                 // Child jobs normally start out in the PAUSED state, and are switched to QUEUED when the parent
@@ -487,156 +884,209 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
                 // the child is created (indicating a child is creating a sibling) then the new child starts
                 // in the QUEUED state.
                 auto initialState = "QUEUED";
-                if (parentJobID) {
-                    auto parentState = db.read("SELECT state FROM jobs WHERE jobID=" + SQ(parentJobID) + ";");
-                    if (SIEquals(parentState, "RUNNING")) {
-                        initialState = "PAUSED";
-                    }
-                }
-
-                // Create this new job
-                if (!db.write("INSERT INTO jobs ( created, state, name, nextRun, repeat, data, priority, parentJobID ) "
-                         "VALUES( " +
-                            SCURRENT_TIMESTAMP() + ", " +
-                            SQ(initialState) + ", " +
-                            SQ(job["name"]) + ", " +
-                            safeFirstRun + ", " +
-                            SQ(SToUpper(job["repeat"])) + ", " +
-                            safeData + ", " +
-                            SQ(priority) + ", " +
-                            SQ(parentJobID) + " " +
-                         " );"))
-                {
-                    throw "502 insert query failed";
-                }
-
-                // Return the new jobID
-                const int64_t lastInsertRowID = db.getLastInsertRowID();
-                const int64_t maxJobID = SToInt64(db.read("SELECT MAX(jobID) FROM jobs;"));
-                if (lastInsertRowID != maxJobID) {
-                    SALERT("We might be returning the wrong jobID maxJobID=" << maxJobID
-                                                                             << " lastInsertRowID=" << lastInsertRowID);
-                }
-
-                if (SIEquals(request.methodLine, "CreateJob")) {
-                    content["jobID"] = SToStr(lastInsertRowID);
-                    return true;
+                if (parentJobID && SIEquals(parentIt->second.first, "RUNNING")) {
+                    initialState = "PAUSED";
                 }
 
-                // Append new jobID to list of created jobs.
-                jobIDs.push_back(SToStr(lastInsertRowID));            
+                // Queue up this new job to be inserted with the rest.
+                inserts[table].emplace_back(i, "( " +
+                                                   STIMESTAMP(now) + ", " +
+                                                   SQ(initialState) + ", " +
+                                                   SQ(job["name"]) + ", " +
+                                                   STIMESTAMP(firstRun) + ", " +
+                                                   SQ(firstRun) + ", " +
+                                                   SQ(SToUpper(job["repeat"])) + ", " +
+                                                   safeData + ", " +
+                                                   SQ(priority) + ", " +
+                                                   SQ(parentJobID) + " )");
             }
         }
+        insertJobs();
 
-        content["jobIDs"] = SComposeJSONArray(jobIDs);
-
-        // Release workers waiting on this state
-        // TODO: No "HeldBy" anymore. If a plugin wants to hold a command, it should own it until it's done.
-        // node->clearCommandHolds("Jobs:" + request["name"]);
-
+        // Any GetJob commands waiting for these jobs are woken by the ready index once this commits.
+        if (SIEquals(request.methodLine, "CreateJob")) {
+            content["jobID"] = jobIDs.front();
+        } else {
+            content["jobIDs"] = SComposeJSONArray(jobIDs);
+        }
         return true; // Successfully processed
     }
 
     // ----------------------------------------------------------------------
     else if (SIEquals(requestVerb, "GetJob") || SIEquals(requestVerb, "GetJobs")) {
-        // If we're here it's because peekCommand found some data; re-execute
-        // the query for real now.  However, this time we will order by
-        // priority.  We do this as three separate queries so we only have one
-        // unbounded column in each query.  Additionally, we wrap each inner
-        // query in a "SELECT *" such that we can have an "ORDER BY" and
-        // "LIMIT" *before* we UNION ALL them together.  Looks gnarly, but it
-        // works!
+        // If we're here it's because peekCommand found some data; find it again for real now, ordered by priority.
         SQResult result;
         const string& name = request["name"];
-        string safeNumResults = SQ(max(request.calc("numResults"),1));
-        string selectQuery =
-            "SELECT jobID, name, data, parentJobID FROM ( "
-                "SELECT * FROM ("
-                    "SELECT jobID, name, data, priority, parentJobID "
-                    "FROM jobs "
-                    "WHERE state='QUEUED' "
-                    "  AND priority=1000"
-                    "  AND " + SCURRENT_TIMESTAMP() + ">=nextRun "
-                    "  AND name GLOB " + SQ(name) + " "
-                    "ORDER BY nextRun ASC LIMIT " + safeNumResults +
-                ") "
-            "UNION ALL "
-                "SELECT * FROM ("
-                    "SELECT jobID, name, data, priority, parentJobID "
-                    "FROM jobs "
-                    "WHERE state='QUEUED' "
-                    "  AND priority=500"
-                    "  AND " + SCURRENT_TIMESTAMP() + ">=nextRun "
-                    "  AND name GLOB " + SQ(name) + " "
-                    "ORDER BY nextRun ASC LIMIT " + safeNumResults +
-                ") "
-            "UNION ALL "
-                "SELECT * FROM ("
-                    "SELECT jobID, name, data, priority, parentJobID "
-                    "FROM jobs "
-                    "WHERE state='QUEUED' "
-                    "  AND priority=0"
-                    "  AND " + SCURRENT_TIMESTAMP() + ">=nextRun "
-                    "  AND name GLOB " + SQ(name) + " "
-                    "ORDER BY nextRun ASC LIMIT " + safeNumResults +
+        const size_t numResults = max(request.calc("numResults"), 1);
+        if (_readyIndex.loaded()) {
+            // Pick the jobs from the ready index, and confirm each is still QUEUED and due in the database. The index
+            // reflects the latest commits, which this transaction might not see, so a job that doesn't match isn't
+            // necessarily gone; we just skip it and ask the index for another.
+            const uint64_t now = STimeNow();
+            set<int64_t> tried;
+            for (int attempt = 0; attempt < 3 && result.size() < numResults; attempt++) {
+                list<int64_t> candidates = _readyIndex.find(name, now, numResults - result.size(), tried);
+                if (candidates.empty()) {
+                    break;
+                }
+                map<int64_t, list<int64_t>> candidatesByPartition;
+                for (int64_t jobID : candidates) {
+                    candidatesByPartition[_partitionOf(jobID)].push_back(jobID);
+                }
+                map<int64_t, vector<string>> confirmedByID;
+                for (auto& partition : candidatesByPartition) {
+                    SQResult confirmed;
+                    if (!db.read("SELECT jobID, name, data, parentJobID "
+                                 "FROM " + _partitionTable(partition.first) + " "
+                                 "WHERE jobID IN (" + SQList(partition.second) + ") "
+                                 "  AND state='QUEUED' "
+                                 "  AND " JOBS_NEXT_RUN_US "<=" + SQ(now) + ";",
+                                 confirmed)) {
+                        throw "502 Query failed";
+                    }
+                    for (auto& row : confirmed.rows) {
+                        confirmedByID[SToInt64(row[0])] = move(row);
+                    }
+                }
+
+                // Keep them in the order the index gave them to us.
+                for (int64_t jobID : candidates) {
+                    tried.insert(jobID);
+                    auto it = confirmedByID.find(jobID);
+                    if (it != confirmedByID.end()) {
+                        result.rows.push_back(move(it->second));
+                    }
+                }
+            }
+        } else {
+            // We do this as three separate queries for each partition so we only have one unbounded column in each
+            // query. Additionally, we wrap each inner query in a "SELECT *" such that we can have an "ORDER BY" and
+            // "LIMIT" *before* we UNION ALL them together.  Looks gnarly, but it works! Until every job's integer
+            // timestamps have been filled in, we go by the text ones.
+            const bool backfilled = _timestampsBackfilled(db);
+            const uint64_t now = STimeNow();
+            const string due = backfilled ? "nextRunUS<=" + SQ(now) : STIMESTAMP(now) + ">=nextRun";
+            string safeNumResults = SQ((int64_t)numResults);
+            list<string> subqueries;
+            for (int64_t partition = 0; partition < _partitions; partition++) {
+                for (const char* priority : {"1000", "500", "0"}) {
+                    subqueries.push_back(
+                        "SELECT * FROM ("
+                            "SELECT jobID, name, data, priority, parentJobID "
+                            "FROM " + _partitionTable(partition) + " "
+                            "WHERE state='QUEUED' "
+                            "  AND priority=" + priority +
+                            "  AND " + due + " "
+                            "  AND name GLOB " + SQ(name) + " "
+                            "ORDER BY " + (backfilled ? "nextRunUS" : "nextRun") + " ASC LIMIT " + safeNumResults +
+                        ") ");
+                }
+            }
+            string selectQuery =
+                "SELECT jobID, name, data, parentJobID FROM ( " +
+                    SComposeList(subqueries, "UNION ALL ") +
                 ") "
-            ") "
-            "ORDER BY priority DESC "
-            "LIMIT " + safeNumResults + ";";
-        if (!db.read(selectQuery, result)) {
-            throw "502 Query failed";
+                "ORDER BY priority DESC "
+                "LIMIT " + safeNumResults + ";";
+            if (!db.read(selectQuery, result)) {
+                throw "502 Query failed";
+            }
         }
 
         // Are there any results?
         if (result.empty()) {
-            // Ah, there were before, but aren't now -- nothing found
-            // **FIXME: If "Connection: wait" should re-apply the hold.  However, this is super edge
-            //          as we could only get here if the job somehow got consumed between the peek
-            //          and process -- which could happen during heavy load.  But it'd just return
-            //          no results (which is correct) faster than it would otherwise time out.  Either
-            //          way the worker will likely just loop, so it doesn't really matter.
+            // Ah, there were before, but aren't now -- nothing found. Someone else must have got them between peek
+            // and process, so if the caller wants to wait, it goes back to waiting.
+            _waitForJob(command);
             throw "404 No job found";
         }
 
         // There should only be at most one result if GetJob
         SASSERT(!SIEquals(requestVerb, "GetJob") || result.size()<=1);
 
-        // Prepare to update the rows, while also creating all the expense objects
-        string updateQuery = "UPDATE jobs SET state='RUNNING', lastRun=" + SCURRENT_TIMESTAMP() + " WHERE jobID IN (";
-        list<string> jobList;
-        for (size_t c=0; c<result.size(); ++c) {
-            // Add to the set, with a comma separator if necessary
-            SASSERT(result[c].size() == 4);
-            updateQuery += (c ? ", " : "") + result[c][0];
-
-            // See if this job has any FINISHED/CANCELLED child jobs, indicating it is being resumed
-            SQResult childJobs;
-            if (!db.read("SELECT jobID, data, state FROM jobs WHERE parentJobID=" + result[c][0] + " AND state IN ('FINISHED', 'CANCELLED');", childJobs)) {
+        // Look up the FINISHED/CANCELLED children of all of these jobs (indicating they're being resumed), and the data
+        // of any parents, with one query each per partition rather than one per job. Children are always in the same
+        // partition as their parent.
+        map<int64_t, list<string>> jobIDsByPartition;
+        map<int64_t, set<string>> parentJobIDsByPartition;
+        for (auto& row : result.rows) {
+            SASSERT(row.size() == 4);
+            jobIDsByPartition[_partitionOf(SToInt64(row[0]))].push_back(row[0]);
+            if (SToInt64(row[3])) {
+                parentJobIDsByPartition[_partitionOf(SToInt64(row[3]))].insert(row[3]);
+            }
+        }
+        SQResult childJobs;
+        for (auto& partition : jobIDsByPartition) {
+            SQResult partitionChildJobs;
+            if (!db.read("SELECT parentJobID, jobID, data, state "
+                         "FROM " + _partitionTable(partition.first) + " "
+                         "WHERE parentJobID IN (" + SComposeList(partition.second) + ") "
+                         "  AND state IN ('FINISHED', 'CANCELLED');",
+                         partitionChildJobs)) {
                 throw "502 Failed to select finished child jobs";
             }
+            for (auto& row : partitionChildJobs.rows) {
+                childJobs.rows.push_back(move(row));
+            }
+        }
+        map<string, list<const vector<string>*>> childJobsByParent;
+        for (auto& row : childJobs.rows) {
+            childJobsByParent[row[0]].push_back(&row);
+        }
+        map<string, string> parentData;
+        for (auto& partition : parentJobIDsByPartition) {
+            SQResult parents;
+            if (!db.read("SELECT jobID, data FROM " + _partitionTable(partition.first) + " "
+                         "WHERE jobID IN (" + SComposeList(partition.second) + ");",
+                         parents)) {
+                throw "502 Failed to select parent jobs";
+            }
+            for (auto& row : parents.rows) {
+                parentData[row[0]] = row[1];
+            }
+        }
+
+        // If the caller wants a lease on these jobs, work out when it expires, and give it an ID that only the caller
+        // knows, to prove it's still the one holding it.
+        string leaseExpires;
+        string leaseID;
+        if (request.isSet("leaseDuration")) {
+            leaseExpires = SComposeTime("%Y-%m-%d %H:%M:%S",
+                                        STimeNow() + request.calc64("leaseDuration") * STIME_US_PER_S);
+            leaseID = SToHex(SRandom::rand64()) + SToHex(SRandom::rand64());
+        }
 
+        // Prepare the output, and then update the rows in each partition.
+        list<string> jobList;
+        for (auto& row : result.rows) {
             // Add this object to our output
             STable job;
-            SINFO("Returning jobID " << result[c][0] << " from " << requestVerb);
-            job["jobID"] = result[c][0];
-            job["name"] = result[c][1];
-            job["data"] = result[c][2];
-            int64_t parentJobID = SToInt64(result[c][3]);
+            SINFO("Returning jobID " << row[0] << " from " << requestVerb);
+            job["jobID"] = row[0];
+            job["name"] = row[1];
+            job["data"] = row[2];
+            if (!leaseExpires.empty()) {
+                job["leaseExpires"] = leaseExpires;
+                job["leaseID"] = leaseID;
+            }
+            int64_t parentJobID = SToInt64(row[3]);
             if (parentJobID) {
                 // Has a parent job, add the parent data
-                job["parentJobID"] = SToStr(parentJobID);;
-                job["parentData"] = db.read("SELECT data FROM jobs WHERE jobID=" + SQ(parentJobID) + ";");
+                job["parentJobID"] = SToStr(parentJobID);
+                job["parentData"] = parentData[row[3]];
             }
-            if (!childJobs.empty()) {
+            auto childIt = childJobsByParent.find(row[0]);
+            if (childIt != childJobsByParent.end()) {
                 // Add associative arrays of all children depending on their states
                 list<string> finishedChildJobArray;
                 list<string> cancelledChildJobArray;
-                for (auto row : childJobs.rows) {
+                for (auto childRow : childIt->second) {
                     STable childJob;
-                    childJob["jobID"] = row[0];
-                    childJob["data"] = row[1];
+                    childJob["jobID"] = (*childRow)[1];
+                    childJob["data"] = (*childRow)[2];
 
-                    if (row[2] ==  "FINISHED") {
+                    if ((*childRow)[3] == "FINISHED") {
                         finishedChildJobArray.push_back(SComposeJSONObject(childJob));
                     } else {
                         cancelledChildJobArray.push_back(SComposeJSONObject(childJob));
@@ -647,9 +1097,15 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
             }
             jobList.push_back(SComposeJSONObject(job));
         }
-        updateQuery += ");";
-        if (!db.write(updateQuery)) {
-            throw "502 Update failed";
+        const uint64_t now = STimeNow();
+        for (auto& partition : jobIDsByPartition) {
+            if (!db.write("UPDATE " + _partitionTable(partition.first) + " "
+                          "SET state='RUNNING', lastRun=" + STIMESTAMP(now) + ", lastRunUS=" + SQ(now) + ", "
+                          "leaseExpires=" + (leaseExpires.empty() ? "NULL" : SQ(leaseExpires)) + ", "
+                          "leaseID=" + (leaseID.empty() ? "NULL" : SQ(leaseID)) + " "
+                          "WHERE jobID IN (" + SComposeList(partition.second) + ");")) {
+                throw "502 Update failed";
+            }
         }
 
         // Format the results as is appropriate for what was requested
@@ -691,29 +1147,48 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
         }
 
         // Verify there is a job like this
+        const string table = _jobsTable(request.calc64("jobID"));
         SQResult result;
-        if (!db.read("SELECT jobID, nextRun, lastRun "
-                     "FROM jobs "
+        if (!db.read("SELECT jobID, " JOBS_NEXT_RUN_US ", " JOBS_LAST_RUN_US " "
+                     "FROM " + table + " "
                      "WHERE jobID=" + SQ(request.calc64("jobID")) + ";",
                      result)) {
             throw "502 Select failed";
         }
-        if (result.empty() || !SToInt(result[0][0])) {
-            throw "404 No job with this jobID";
+        if (result.empty() || !SToInt64(result[0][0])) {
+            // An archived job won't run again, so we can update its data, but not reschedule it.
+            if (!db.read("SELECT 1 FROM jobsArchive WHERE jobID=" + SQ(request.calc64("jobID")) + ";", result)) {
+                throw "502 Select failed";
+            }
+            if (result.empty()) {
+                throw "404 No job with this jobID";
+            }
+            if (request.isSet("repeat")) {
+                throw "402 Cannot set repeat on an archived job";
+            }
+            if (!db.write("UPDATE jobsArchive SET data=" + SQ(request["data"]) + " "
+                          "WHERE jobID=" + SQ(request.calc64("jobID")) + ";")) {
+                throw "502 Update failed";
+            }
+            return true; // Successfully processed
         }
 
-        const string& nextRun = result[0][1];
-        const string& lastRun = result[0][2];
+        const uint64_t nextRun = SToUInt64(result[0][1]);
+        const uint64_t lastRun = SToUInt64(result[0][2]);
 
         // Are we rescheduling?
-        const string& newNextRun = request.isSet("repeat") ? _constructNextRunDATETIME(nextRun, lastRun, request["repeat"]) : "";
+        uint64_t newNextRun = 0;
+        if (request.isSet("repeat")) {
+            _computeNextRun(nextRun, lastRun, request["repeat"], newNextRun);
+        }
 
         // Update the data
-        if (!db.write("UPDATE jobs "
+        if (!db.write("UPDATE " + table + " "
                       "SET data=" +
                       SQ(request["data"]) + " " +
                       (request.isSet("repeat") ? ", repeat=" + SQ(SToUpper(request["repeat"])) : "") +
-                      (!newNextRun.empty() ? ", nextRun=" + newNextRun : "") +
+                      (newNextRun ? ", nextRun=" + STIMESTAMP(newNextRun) + ", nextRunUS=" + SQ(newNextRun) + " "
+                                  : "") +
                           "WHERE jobID=" +
                       SQ(request.calc64("jobID")) + ";")) {
             throw "502 Update failed";
@@ -735,6 +1210,7 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
         //     - jobID  - ID of the job to retry
         //     - delay  - Number of seconds to wait before retrying
         //     - data   - Data to associate with this finsihed job
+        //     - leaseID - The leaseID GetJob returned, if the job was leased
         //
         // - FinishJob( jobID, [data] )
         //
@@ -744,137 +1220,68 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
         //     Parameters:
         //     - jobID  - ID of the job to finish
         //     - data   - Data to associate with this finsihed job
+        //     - leaseID - The leaseID GetJob returned, if the job was leased
         //
         verifyAttributeInt64(request, "jobID", 1);
-        int64_t jobID = request.calc64("jobID");
-
-        // Verify there is a job like this and it's running
-        SQResult result;
-        if (!db.read("SELECT state, nextRun, lastRun, repeat, parentJobID "
-                     "FROM jobs "
-                     "WHERE jobID=" + SQ(jobID) + ";",
-                     result)) {
-            throw "502 Select failed";
-        }
-        if (result.empty()) {
-            throw "404 No job with this jobID";
-        }
-        const string& state = result[0][0];
-        const string& nextRun = result[0][1];
-        const string& lastRun = result[0][2];
-        string repeat = result[0][3];
-        int64_t parentJobID = SToInt(result[0][4]);
 
-        // Make sure we're finishing a job that's actually running
-        if (state != "RUNNING") {
-            SWARN("Trying to finish job#" << jobID << ", but isn't RUNNING (" << state << ")");
-            throw "405 Can only retry/finish RUNNING jobs";
+        // This is just the bulk version with one job.
+        vector<STable> jobs = {request.nameValueMap};
+        const string result = _finishJobs(db, SIEquals(requestVerb, "RetryJob"), jobs).front();
+        if (!SStartsWith(result, "200")) {
+            throw result;
         }
 
-        // If we have a parent, make sure it is PAUSED.  This is to just
-        // double-check that child jobs aren't somehow running in parallel to
-        // the parent.
-        if (parentJobID) {
-            auto parentState = db.read("SELECT state FROM jobs WHERE jobID=" + SQ(parentJobID) + ";");
-            if (!SIEquals(parentState, "PAUSED")) {
-                SWARN("Trying to finish job#" << jobID << ", but parent isn't PAUSED (" << parentState << ")");
-                throw "405 Can only retry/finish child job when parent is PAUSED";
-            }
-        }
+        // Successfully processed
+        return true;
+    }
 
-        // Delete any FINISHED/CANCELLED child jobs, but leave any PAUSED children alone (as those will signal that
-        // we just want to re-PAUSE this job so those new children can run)
-        if (!db.write("DELETE FROM jobs WHERE parentJobID=" + SQ(jobID) + " AND state IN ('FINISHED', 'CANCELLED');")) {
-            throw "502 Failed deleting finished/cancelled child jobs";
+    // ----------------------------------------------------------------------
+    else if (SIEquals(requestVerb, "RetryJobs") || SIEquals(requestVerb, "FinishJobs")) {
+        // - RetryJobs( jobs )
+        // - FinishJobs( jobs )
+        //
+        //     Retries or finishes a list of jobs at once, each exactly as RetryJob or FinishJob would, but with a few
+        //     statements for the lot rather than several for each. A job that can't be retried or finished doesn't
+        //     stop the rest.
+        //
+        //     Parameters:
+        //     - jobs (json array):
+        //          - jobID - ID of the job to retry or finish
+        //          - delay - (RetryJobs) Number of seconds to wait before retrying
+        //          - data  - (optional) Data to associate with the job
+        //          - leaseID - The leaseID GetJobs returned, if the job was leased
+        //
+        //     Returns:
+        //     - 200 - OK
+        //         . results - array with an object for each job, in order, with its jobID and the result RetryJob or
+        //                     FinishJob would have given for it, eg, "200 OK" or "405 Can only retry/finish RUNNING
+        //                     jobs"
+        //
+        list<string> jsonJobs = SParseJSONArray(request["jobs"]);
+        if (jsonJobs.empty()) {
+            throw "401 Invalid JSON";
         }
-
-        // If we've been asked to update the data, let's do that
-        auto data = request["data"];
-        if (!data.empty()) {
-            if (!db.write("UPDATE jobs SET data=" + SQ(data) + " WHERE jobID=" + SQ(jobID) + ";")) {
-                throw "502 Failed to update job data";
+        vector<STable> jobs;
+        for (auto& job : jsonJobs) {
+            STable jobObject = SParseJSONObject(job);
+            if (jobObject.empty()) {
+                throw "401 Invalid JSON";
             }
+            jobs.push_back(move(jobObject));
         }
 
-        // If we are finishing a job that has child jobs, set its state to paused.
-        if (SIEquals(requestVerb, "FinishJob") && _hasPendingChildJobs(db, jobID)) {
-            // Update the parent job to PAUSED
-            SINFO("Job has child jobs, PAUSING parent, QUEUING children");
-            if (!db.write("UPDATE jobs SET state='PAUSED' WHERE jobID=" + SQ(jobID) + ";")) {
-                throw "502 Parent update failed";
-            }
-
-            // Also un-pause any child jobs such that they can run
-            if (!db.write("UPDATE jobs SET state='QUEUED' "
-                          "WHERE state='PAUSED' "
-                            "AND parentJobID=" + SQ(jobID) + ";")) {
-                throw "502 Child update failed";
-            }
-
-            // All done processing this command
-            return true;
+        const vector<string> results = _finishJobs(db, SIEquals(requestVerb, "RetryJobs"), jobs);
+        list<string> resultList;
+        for (size_t i = 0; i < jobs.size(); i++) {
+            STable result;
+            result["jobID"] = jobs[i]["jobID"];
+            result["result"] = results[i];
+            resultList.push_back(SComposeJSONObject(result));
         }
-
-        // If we're doing RetryJob and there isn't a repeat, construct one with the delay
-        if (repeat.empty() && SIEquals(requestVerb, "RetryJob")) {
-            // Make sure there is a delay
-            int64_t delay = request.calc64("delay");
-            if (delay < 0) {
-                throw "402 Must specify a non-negative delay when retrying";
-            }
-            repeat = "FINISHED, +" + SToStr(delay) + " SECONDS";
-        }
-
-        // Are we rescheduling?
-        if (!repeat.empty()) {
-            // Configured to repeat.  The "nextRun" at this point is still
-            // storing the last time this job was *scheduled* to be run;
-            // lastRun contains when it was *actually* run.
-            const string& lastScheduled = nextRun;
-            const string& newNextRun = _constructNextRunDATETIME(lastScheduled, lastRun, repeat);
-            if (newNextRun.empty()) {
-                throw "402 Malformed repeat";
-            }
-            SINFO("Rescheduling job#" << jobID << ": " << newNextRun);
-
-            // Update this job
-            if (!db.write("UPDATE jobs SET nextRun=" + newNextRun + ", state='QUEUED' WHERE jobID=" + SQ(jobID) + ";")) {
-                throw "502 Update failed";
-            }
-        } else {
-            // We are done with this job.  What do we do with it?
-            SASSERT(!SIEquals(requestVerb, "RetryJob"));
-            if (parentJobID) {
-                // This is a child job.  Mark it as finished.
-                if (!db.write("UPDATE jobs SET state='FINISHED' WHERE jobID=" + SQ(jobID) + ";")) {
-                    throw "502 Failed to mark job as FINISHED";
-                }
-
-                // Resume the parent if this is the last pending child
-                if (!_hasPendingChildJobs(db, parentJobID)) {
-                    SINFO("Job has parentJobID: " + SToStr(parentJobID) +
-                          " and no other pending children, resuming parent job");
-                    if (!db.write("UPDATE jobs SET state = 'QUEUED' where jobID=" + SQ(parentJobID) + ";")) {
-                        throw "502 Update failed";
-                    }
-                }
-            } else {
-                // This is a standalone (not a child) job; delete it.
-                if (!db.write("DELETE FROM jobs WHERE jobID=" + SQ(jobID) + ";")) {
-                    throw "502 Delete failed";
-                }
-
-                // At this point, all child jobs should already be deleted, but
-                // let's double check.
-                if (!db.read("SELECT 1 FROM jobs WHERE parentJobID=" + SQ(jobID) + " LIMIT 1;").empty()) {
-                    SWARN("Child jobs still exist when deleting parent job, ignoring.");
-                }
-            }
-        }
-
-        // Successfully processed
+        content["results"] = SComposeJSONArray(resultList);
         return true;
     }
+
     // ----------------------------------------------------------------------
     else if (SIEquals(request.methodLine, "CancelJob")) {
         // - CancelJob (jobID)
@@ -886,8 +1293,10 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
         //
         int64_t jobID = request.calc64("jobID");
 
-        // Cancel the job
-        if (!db.write("UPDATE jobs SET state='CANCELLED' WHERE jobID=" + SQ(jobID) + ";")) {
+        // Cancel the job, wherever it is. Only one of these will match it.
+        const string table = _jobsTable(jobID);
+        if (!db.write("UPDATE " + table + " SET state='CANCELLED' WHERE jobID=" + SQ(jobID) + ";") ||
+            !db.write("UPDATE jobsArchive SET state='CANCELLED' WHERE jobID=" + SQ(jobID) + " AND state='FAILED';")) {
             throw "502 Failed to update job data";
         }
 
@@ -905,13 +1314,15 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
         //     Parameters:
         //     - jobID - ID of the job to fail
         //     - data  - Data to associate with this failed job
+        //     - leaseID - The leaseID GetJob returned, if the job was leased
         //
         verifyAttributeInt64(request, "jobID", 1);
 
         // Verify there is a job like this and it's running
+        const string table = _jobsTable(request.calc64("jobID"));
         SQResult result;
-        if (!db.read("SELECT state, nextRun, lastRun, repeat "
-                     "FROM jobs "
+        if (!db.read("SELECT state, nextRun, lastRun, repeat, leaseID "
+                     "FROM " + table + " "
                      "WHERE jobID=" + SQ(request.calc64("jobID")) + ";",
                      result)) {
             throw "502 Select failed";
@@ -926,6 +1337,11 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
             SWARN("Trying to fail job#" << request["jobID"] << ", but isn't RUNNING (" << state << ")");
             throw "405 Can only fail RUNNING jobs";
         }
+        const string leaseError = checkLeaseID(result[0][4], request["leaseID"]);
+        if (!leaseError.empty()) {
+            SWARN("Trying to fail job#" << request["jobID"] << " without its lease");
+            throw leaseError;
+        }
 
         // Are we updating the data too?
         list<string> updateList;
@@ -936,9 +1352,11 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
 
         // Not repeating; just finish
         updateList.push_back("state='FAILED'");
+        updateList.push_back("leaseExpires=NULL");
+        updateList.push_back("leaseID=NULL");
 
         // Update this job
-        if (!db.write("UPDATE jobs SET " + SComposeList(updateList) + "WHERE jobID=" + SQ(request.calc64("jobID")) + ";")) {
+        if (!db.write("UPDATE " + table + " SET " + SComposeList(updateList) + " WHERE jobID=" + SQ(request.calc64("jobID")) + ";")) {
             throw "502 Fail failed";
         }
 
@@ -948,6 +1366,171 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
 
     // ----------------------------------------------------------------------
 
+    else if (SIEquals(requestVerb, "RenewJobLease")) {
+        // - RenewJobLease( jobID, leaseDuration, leaseID )
+        //
+        //     Extends the lease on a RUNNING job, so it isn't requeued while it's still being worked on.
+        //
+        //     Parameters:
+        //     - jobID - ID of the job to renew the lease on
+        //     - leaseDuration - seconds from now the lease expires
+        //     - leaseID - the leaseID GetJob returned
+        //
+        //     Returns:
+        //     - 200 - OK
+        //         . leaseExpires - when the lease now expires
+        //     - 405 - The job isn't RUNNING, perhaps because its lease already expired
+        //     - 409 - The job's been got again since, by someone else
+        //
+        verifyAttributeInt64(request, "jobID", 1);
+        verifyAttributeInt64(request, "leaseDuration", 1);
+        const int64_t leaseDuration = request.calc64("leaseDuration");
+        if (leaseDuration < 1) {
+            throw "402 Malformed leaseDuration";
+        }
+
+        // Verify there is a job like this and it's running
+        const string table = _jobsTable(request.calc64("jobID"));
+        SQResult result;
+        if (!db.read("SELECT state, leaseID FROM " + table + " WHERE jobID=" + SQ(request.calc64("jobID")) + ";",
+                     result)) {
+            throw "502 Select failed";
+        }
+        if (result.empty()) {
+            throw "404 No job with this jobID";
+        }
+        const string& state = result[0][0];
+        if (state != "RUNNING") {
+            SWARN("Trying to renew the lease on job#" << request["jobID"] << ", but isn't RUNNING (" << state << ")");
+            throw "405 Can only renew the lease on RUNNING jobs";
+        }
+        const string leaseError = checkLeaseID(result[0][1], request["leaseID"]);
+        if (!leaseError.empty()) {
+            SWARN("Trying to renew the lease on job#" << request["jobID"] << " without its leaseID");
+            throw leaseError;
+        }
+
+        const string leaseExpires = SComposeTime("%Y-%m-%d %H:%M:%S", STimeNow() + leaseDuration * STIME_US_PER_S);
+        if (!db.write("UPDATE " + table + " SET leaseExpires=" + SQ(leaseExpires) + " "
+                      "WHERE jobID=" + SQ(request.calc64("jobID")) + ";")) {
+            throw "502 Update failed";
+        }
+        content["leaseExpires"] = leaseExpires;
+        return true;
+    }
+
+    // ----------------------------------------------------------------------
+    else if (SIEquals(requestVerb, "ExpireJobLeases")) {
+        // Requeue the jobs whose leases expired first, a batch at a time. If there are more, the next sweep gets them.
+        list<string> jobIDs;
+        for (int64_t partition = 0; partition < _partitions && jobIDs.size() < JOBS_LEASE_SWEEP_BATCH; partition++) {
+            const string table = _partitionTable(partition);
+            SQResult result;
+            if (!db.read("SELECT jobID "
+                         "FROM " + table + " "
+                         "WHERE leaseExpires<=" + SCURRENT_TIMESTAMP() + " "
+                         "ORDER BY leaseExpires "
+                         "LIMIT " + SToStr(JOBS_LEASE_SWEEP_BATCH - jobIDs.size()) + ";",
+                         result)) {
+                throw "502 Select failed";
+            }
+            if (result.empty()) {
+                continue;
+            }
+            list<string> partitionJobIDs;
+            for (auto& row : result.rows) {
+                partitionJobIDs.push_back(row[0]);
+            }
+
+            // Only RUNNING jobs should have leases, but if anything else does, we just clear it.
+            if (!db.write("UPDATE " + table + " "
+                          "SET state=CASE state WHEN 'RUNNING' THEN 'QUEUED' ELSE state END, leaseExpires=NULL, "
+                          "leaseID=NULL "
+                          "WHERE jobID IN (" + SComposeList(partitionJobIDs) + ");")) {
+                throw "502 Update failed";
+            }
+            jobIDs.splice(jobIDs.end(), partitionJobIDs);
+        }
+        if (!jobIDs.empty()) {
+            SINFO("Requeued " << jobIDs.size() << " jobs with expired leases.");
+        }
+        content["jobIDs"] = SComposeJSONArray(jobIDs);
+        return true;
+    }
+
+    // ----------------------------------------------------------------------
+    else if (SIEquals(requestVerb, "ArchiveJobs")) {
+        // Move a batch of jobs at a time. If there are more, the next run gets them.
+        list<string> jobIDs;
+        for (int64_t partition = 0; partition < _partitions && jobIDs.size() < JOBS_ARCHIVE_BATCH; partition++) {
+            const string table = _partitionTable(partition);
+            SQResult result;
+            if (!db.read("SELECT jobID FROM " + table + " WHERE " + _archivable(table) + " "
+                         "LIMIT " + SToStr(JOBS_ARCHIVE_BATCH - jobIDs.size()) + ";",
+                         result)) {
+                throw "502 Select failed";
+            }
+            if (result.empty()) {
+                continue;
+            }
+            list<string> partitionJobIDs;
+            for (auto& row : result.rows) {
+                partitionJobIDs.push_back(row[0]);
+            }
+            const string& jobIDList = SComposeList(partitionJobIDs);
+            if (!db.write("INSERT INTO jobsArchive (" JOBS_ARCHIVE_COLUMNS ", archived) "
+                          "SELECT " JOBS_ARCHIVE_COLUMNS ", " + SCURRENT_TIMESTAMP() + " "
+                          "FROM " + table + " WHERE jobID IN (" + jobIDList + ");")) {
+                throw "502 Failed to archive jobs";
+            }
+            if (!db.write("DELETE FROM " + table + " WHERE jobID IN (" + jobIDList + ");")) {
+                throw "502 Failed to delete archived jobs";
+            }
+            jobIDs.splice(jobIDs.end(), partitionJobIDs);
+        }
+        if (!jobIDs.empty()) {
+            SINFO("Archived " << jobIDs.size() << " jobs.");
+        }
+        content["jobIDs"] = SComposeJSONArray(jobIDs);
+        return true;
+    }
+
+    // ----------------------------------------------------------------------
+    else if (SIEquals(requestVerb, "BackfillJobTimestamps")) {
+        // Fill in a batch at a time, so the master's never held up for long. If there are more, the next run gets
+        // them.
+        list<string> jobIDs;
+        for (int64_t partition = 0; partition < _partitions && jobIDs.size() < JOBS_BACKFILL_BATCH; partition++) {
+            const string table = _partitionTable(partition);
+            SQResult result;
+            if (!db.read("SELECT jobID FROM " + table + " WHERE nextRunUS IS NULL "
+                         "LIMIT " + SToStr(JOBS_BACKFILL_BATCH - jobIDs.size()) + ";",
+                         result)) {
+                throw "502 Select failed";
+            }
+            if (result.empty()) {
+                continue;
+            }
+            list<string> partitionJobIDs;
+            for (auto& row : result.rows) {
+                partitionJobIDs.push_back(row[0]);
+            }
+            if (!db.write("UPDATE " + table + " "
+                          "SET nextRunUS=" JOBS_NEXT_RUN_US ", "
+                              "lastRunUS=COALESCE(lastRunUS, " JOBS_TEXT_TO_US("lastRun") ") "
+                          "WHERE jobID IN (" + SComposeList(partitionJobIDs) + ");")) {
+                throw "502 Update failed";
+            }
+            jobIDs.splice(jobIDs.end(), partitionJobIDs);
+        }
+        if (!jobIDs.empty()) {
+            SINFO("Filled in the integer timestamps of " << jobIDs.size() << " jobs.");
+        }
+        content["jobIDs"] = SComposeJSONArray(jobIDs);
+        return true;
+    }
+
+    // ----------------------------------------------------------------------
     else if (SIEquals(requestVerb, "DeleteJob")) {
         // - DeleteJob( jobID )
         //
@@ -959,22 +1542,30 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
         verifyAttributeInt64(request, "jobID", 1);
 
         // Verify there is a job like this and it's not running
+        const string table = _jobsTable(request.calc64("jobID"));
         SQResult result;
         if (!db.read("SELECT state "
-                     "FROM jobs "
+                     "FROM " + table + " "
                      "WHERE jobID=" + SQ(request.calc64("jobID")) + ";",
                      result)) {
             throw "502 Select failed";
         }
         if (result.empty()) {
-            throw "404 No job with this jobID";
+            // If it's been archived, delete it from there.
+            if (db.read("SELECT 1 FROM jobsArchive WHERE jobID=" + SQ(request.calc64("jobID")) + ";").empty()) {
+                throw "404 No job with this jobID";
+            }
+            if (!db.write("DELETE FROM jobsArchive WHERE jobID=" + SQ(request.calc64("jobID")) + ";")) {
+                throw "502 Delete failed";
+            }
+            return true;
         }
         if (result[0][0] == "RUNNING") {
             throw "405 Can't delete a RUNNING job";
         }
 
         // Delete the job
-        if (!db.write("DELETE FROM jobs "
+        if (!db.write("DELETE FROM " + table + " "
                       "WHERE jobID=" +
                       SQ(request.calc64("jobID")) + ";")) {
             throw "502 Delete failed";
@@ -993,73 +1584,712 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
 #define SLOGPREFIX "{" << getName() << "} "
 
 // ==========================================================================
-string BedrockPlugin_Jobs::_constructNextRunDATETIME(const string& lastScheduled, const string& lastRun,
-                                                     const string& repeat) {
-    // Some "canned" times for convenience
-    if (SIEquals(repeat, "HOURLY"))
-        return "STRFTIME( '%Y-%m-%d %H:00:00', DATETIME( " + SCURRENT_TIMESTAMP() + ", '+1 HOUR' ) )";
+void BedrockPlugin_Jobs::timerFired(SStopwatch* timer) {
+    // Only the master requeues jobs with expired leases, archives old ones, and fills in missing timestamps. It does
+    // each with a command to itself, so they happen in transactions like any other change to the jobs table.
+    // Once every job's timestamps have been filled in, there are never any more to fill in.
+    if (timer == &_backfillTimer && _backfilled.load()) {
+        return;
+    }
+    if ((timer == &_leaseSweepTimer || timer == &_archiveTimer || timer == &_backfillTimer) && _server &&
+        _server->getState() == SQLiteNode::MASTERING) {
+        SData request(timer == &_leaseSweepTimer ? "ExpireJobLeases"
+                      : timer == &_archiveTimer  ? "ArchiveJobs"
+                                                 : "BackfillJobTimestamps");
+        request["priority"] = SToStr(BedrockCommand::PRIORITY_LOW);
+        request["Connection"] = "forget";
+        SQLiteCommand command(move(request));
+        command.initiatingClientID = -1;
+        _server->acceptCommand(move(command));
+    }
+}
+
+// ==========================================================================
+void BedrockPlugin_Jobs::_waitForJob(BedrockCommand& command) {
+    const SData& request = command.request;
+    if (!SIEquals(request["Connection"], "wait")) {
+        return;
+    }
+
+    // Work out how much longer we can wait, counting from when we got the command.
+    uint64_t timeoutMS = JOBS_MAX_WAIT_MS;
+    if (request.isSet("timeout")) {
+        timeoutMS = min(request.calcU64("timeout"), timeoutMS);
+    }
+    const uint64_t deadline = command.creationTime + timeoutMS * STIME_US_PER_MS;
+    const uint64_t now = STimeNow();
+    if (now >= deadline) {
+        throw "303 Timeout";
+    }
+
+    // The ready index wakes us when a job we could get is queued. We also need to try again when one that's already
+    // queued comes due. Without the index, we won't be woken, so we just try again every second.
+    command.waitKey = "Jobs:" + request["name"];
+    command.waitUntil = deadline;
+    if (_readyIndex.loaded()) {
+        const uint64_t nextDue = _readyIndex.nextDue(request["name"], now);
+        if (nextDue) {
+            command.waitUntil = min(deadline, nextDue);
+        }
+    } else {
+        command.waitUntil = min(deadline, now + STIME_US_PER_S);
+    }
+}
+
+// ==========================================================================
+bool BedrockPlugin_Jobs::_computeNextRun(uint64_t lastScheduled, uint64_t lastRun, const string& repeat,
+                                         uint64_t& nextRun) {
+    // Some "canned" times for convenience. There's no modifier for the start of the hour, so HOURLY is done here.
+    const uint64_t now = STimeNow();
+    string advanced = repeat;
+    if (SIEquals(repeat, "HOURLY")) {
+        const uint64_t nextHour = now / STIME_US_PER_S + 60 * 60;
+        nextRun = (nextHour - nextHour % (60 * 60)) * STIME_US_PER_S;
+        return true;
+    }
     if (SIEquals(repeat, "DAILY"))
-        return "DATETIME( " + SCURRENT_TIMESTAMP() + ", '+1 DAY', 'START OF DAY'  )";
+        advanced = "FINISHED, +1 DAY, START OF DAY";
     if (SIEquals(repeat, "WEEKLY"))
-        return "DATETIME( " + SCURRENT_TIMESTAMP() + ", '+1 DAY', 'WEEKDAY 0', 'START OF DAY' )";
+        advanced = "FINISHED, +1 DAY, WEEKDAY 0, START OF DAY";
 
     // Not canned, split the advanced repeat into its parts
-    list<string> parts = SParseList(SToUpper(repeat));
+    list<string> parts = SParseList(SToUpper(advanced));
     if (parts.size() < 2) {
         SWARN("Syntax error, failed parsing repeat '" << repeat << "': too short.");
-        return "";
+        return false;
     }
 
     // Make sure the first part indicates the base (eg, what we are modifying)
-    list<string> safeParts;
-    string base = parts.front();
+    uint64_t base = 0;
+    string baseName = parts.front();
     parts.pop_front();
-    if (base == "SCHEDULED") {
-        safeParts.push_back(SQ(lastScheduled));
-    } else if (base == "STARTED") {
-        safeParts.push_back(SQ(lastRun));
-    } else if (base == "FINISHED") {
-        safeParts.push_back(SCURRENT_TIMESTAMP());
+    if (baseName == "SCHEDULED") {
+        base = lastScheduled;
+    } else if (baseName == "STARTED") {
+        base = lastRun;
+    } else if (baseName == "FINISHED") {
+        base = now;
     } else {
-        SWARN("Syntax error, failed parsing repeat '" << repeat << "': missing base (" << base << ")");
-        return "";
+        SWARN("Syntax error, failed parsing repeat '" << repeat << "': missing base (" << baseName << ")");
+        return false;
     }
 
-    // Validate the sqlite date modifiers
+    // Apply each of the modifiers in turn, the way SQLite's date and time functions would, to whole seconds in UTC.
+    // timegm() normalizes the fields we've changed, so, for instance, a month after January 31st is March 3rd (or
+    // 2nd), as it is in SQLite.
     // See: https://www.sqlite.org/lang_datefunc.html
+    time_t seconds = (time_t)(base / STIME_US_PER_S);
+    struct tm time = {};
+    gmtime_r(&seconds, &time);
     for (const string& part : parts) {
         // Simple regexp validation
         if (SREMatch("^(\\+|-)\\d{1,3} (YEAR|MONTH|DAY|HOUR|MINUTE|SECOND)S?$", part)) {
-            safeParts.push_back(SQ(part));
+            const int amount = SToInt(part);
+            const string unit = part.substr(part.find(' ') + 1);
+            if (SStartsWith(unit, "YEAR")) {
+                time.tm_year += amount;
+            } else if (SStartsWith(unit, "MONTH")) {
+                time.tm_mon += amount;
+            } else if (SStartsWith(unit, "DAY")) {
+                time.tm_mday += amount;
+            } else if (SStartsWith(unit, "HOUR")) {
+                time.tm_hour += amount;
+            } else if (SStartsWith(unit, "MINUTE")) {
+                time.tm_min += amount;
+            } else {
+                time.tm_sec += amount;
+            }
         } else if (SREMatch("^START OF (DAY|MONTH|YEAR)$", part)) {
-            safeParts.push_back(SQ(part));
+            time.tm_hour = time.tm_min = time.tm_sec = 0;
+            if (part != "START OF DAY") {
+                time.tm_mday = 1;
+            }
+            if (part == "START OF YEAR") {
+                time.tm_mon = 0;
+            }
         } else if (SREMatch("^WEEKDAY [0-6]$", part)) {
-            safeParts.push_back(SQ(part));
+            // Forward to the next day that's this day of the week, unless it already is.
+            time.tm_mday += (part.back() - '0' - time.tm_wday + 7) % 7;
         } else {
             // Malformed part
             SWARN("Syntax error, failed parsing repeat '" << repeat << "' on part '" << part << "'");
-            return "";
+            return false;
+        }
+        seconds = timegm(&time);
+        gmtime_r(&seconds, &time);
+    }
+    nextRun = seconds > 0 ? (uint64_t)seconds * STIME_US_PER_S : 0;
+    return true;
+}
+
+bool BedrockPlugin_Jobs::_parseTimestamp(const string& timestamp, uint64_t& when) {
+    for (const char* format : {"%Y-%m-%d %H:%M:%S", "%Y-%m-%d"}) {
+        struct tm time = {};
+        const char* end = strptime(timestamp.c_str(), format, &time);
+        if (end && !*end) {
+            const time_t seconds = timegm(&time);
+            if (seconds < 0) {
+                return false;
+            }
+            when = (uint64_t)seconds * STIME_US_PER_S;
+            return true;
         }
     }
+    return false;
+}
 
-    // Combine the parts together and return the full DATETIME statement
-    return "DATETIME( " + SComposeList(safeParts) + " )";
+bool BedrockPlugin_Jobs::_timestampsBackfilled(SQLite& db) {
+    if (_backfilled.load()) {
+        return true;
+    }
+    for (int64_t partition = 0; partition < _partitions; partition++) {
+        if (!db.read("SELECT 1 FROM " + _partitionTable(partition) + " WHERE nextRunUS IS NULL LIMIT 1;").empty()) {
+            return false;
+        }
+    }
+    _backfilled.store(true);
+    return true;
 }
 
 // ==========================================================================
+vector<string> BedrockPlugin_Jobs::_finishJobs(SQLite& db, bool retry, vector<STable>& jobs) {
+    vector<string> results(jobs.size(), "200 OK");
+    set<int64_t> jobIDs;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const string& jobID = jobs[i]["jobID"];
+        if (jobID.empty()) {
+            results[i] = "402 Missing jobID";
+        } else if (jobID != SToStr(SToInt64(jobID))) {
+            results[i] = "402 Malformed jobID";
+        } else if (!jobIDs.insert(SToInt64(jobID)).second) {
+            results[i] = "402 Duplicate jobID";
+        }
+    }
 
-bool BedrockPlugin_Jobs::_hasPendingChildJobs(SQLite& db, int64_t jobID) {
-    // Returns true if there are any children of this jobID in a "pending" (eg,
-    // running or yet to run) state
+    // Read all the jobs, then all their parents, then which of them have children still to run, with one query per
+    // partition for each. A job's parent and children are always in its partition, so everything else is too.
+    map<int64_t, vector<string>> rows;
+    for (auto& table : _groupByTable(jobIDs)) {
+        SQResult result;
+        if (!db.read("SELECT jobID, state, " JOBS_NEXT_RUN_US ", " JOBS_LAST_RUN_US ", repeat, parentJobID, "
+                     "leaseExpires, leaseID "
+                     "FROM " + table.first + " "
+                     "WHERE jobID IN (" + SQList(table.second) + ");",
+                     result)) {
+            throw "502 Select failed";
+        }
+        for (auto& row : result.rows) {
+            rows[SToInt64(row[0])] = move(row);
+        }
+    }
+    set<int64_t> parentJobIDs;
+    for (auto& row : rows) {
+        if (SToInt64(row.second[5])) {
+            parentJobIDs.insert(SToInt64(row.second[5]));
+        }
+    }
+    const map<int64_t, pair<string, int64_t>> parents = _readJobStates(db, parentJobIDs);
+    set<int64_t> hasPendingChildJobs;
+    if (!retry) {
+        for (auto& table : _groupByTable(jobIDs)) {
+            SQResult result;
+            if (!db.read("SELECT DISTINCT parentJobID "
+                         "FROM " + table.first + " "
+                         "WHERE parentJobID IN (" + SQList(table.second) + ") "
+                         "  AND state IN ('QUEUED', 'RUNNING', 'PAUSED');",
+                         result)) {
+                throw "502 Select failed";
+            }
+            for (auto& row : result.rows) {
+                hasPendingChildJobs.insert(SToInt64(row[0]));
+            }
+        }
+    }
+
+    // Check each job, and sort the ones we can finish by what we do with them, by table.
+    struct Changes {
+        list<int64_t> all;
+        map<int64_t, string> data;
+        list<int64_t> leased;
+        list<int64_t> paused;
+        map<int64_t, uint64_t> rescheduled;
+        list<int64_t> finishedChildren;
+        set<int64_t> finishedChildrensParents;
+        list<int64_t> deleted;
+    };
+    map<string, Changes> changes;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (!SStartsWith(results[i], "200")) {
+            continue;
+        }
+        const int64_t jobID = SToInt64(jobs[i]["jobID"]);
+        auto rowIt = rows.find(jobID);
+        if (rowIt == rows.end()) {
+            results[i] = "404 No job with this jobID";
+            continue;
+        }
+        const vector<string>& row = rowIt->second;
+        const string& state = row[1];
+        const uint64_t nextRun = SToUInt64(row[2]);
+        const uint64_t lastRun = SToUInt64(row[3]);
+        string repeat = row[4];
+        const int64_t parentJobID = SToInt64(row[5]);
+
+        // Make sure we're finishing a job that's actually running
+        if (state != "RUNNING") {
+            SWARN("Trying to finish job#" << jobID << ", but isn't RUNNING (" << state << ")");
+            results[i] = "405 Can only retry/finish RUNNING jobs";
+            continue;
+        }
+        const string leaseError = checkLeaseID(row[7], jobs[i]["leaseID"]);
+        if (!leaseError.empty()) {
+            SWARN("Trying to finish job#" << jobID << " without its leaseID");
+            results[i] = leaseError;
+            continue;
+        }
+
+        // If we have a parent, make sure it is PAUSED.  This is to just
+        // double-check that child jobs aren't somehow running in parallel to
+        // the parent.
+        if (parentJobID) {
+            auto parentIt = parents.find(parentJobID);
+            const string parentState = parentIt == parents.end() ? "" : parentIt->second.first;
+            if (!SIEquals(parentState, "PAUSED")) {
+                SWARN("Trying to finish job#" << jobID << ", but parent isn't PAUSED (" << parentState << ")");
+                results[i] = "405 Can only retry/finish child job when parent is PAUSED";
+                continue;
+            }
+        }
+
+        // Work out what happens to it. If we are finishing a job that has child jobs, it's paused, so they can run.
+        Changes& table = changes[_jobsTable(jobID)];
+        if (!retry && hasPendingChildJobs.count(jobID)) {
+            table.paused.push_back(jobID);
+        } else {
+            // If we're doing RetryJob and there isn't a repeat, construct one with the delay
+            if (repeat.empty() && retry) {
+                // Make sure there is a delay
+                const int64_t delay = SToInt64(jobs[i]["delay"]);
+                if (delay < 0) {
+                    results[i] = "402 Must specify a non-negative delay when retrying";
+                    continue;
+                }
+                repeat = "FINISHED, +" + SToStr(delay) + " SECONDS";
+            }
+
+            // Are we rescheduling?
+            if (!repeat.empty()) {
+                // Configured to repeat.  The "nextRun" at this point is still
+                // storing the last time this job was *scheduled* to be run;
+                // lastRun contains when it was *actually* run.
+                const uint64_t lastScheduled = nextRun;
+                uint64_t newNextRun = 0;
+                if (!_computeNextRun(lastScheduled, lastRun, repeat, newNextRun)) {
+                    results[i] = "402 Malformed repeat";
+                    continue;
+                }
+                SINFO("Rescheduling job#" << jobID << ": " << SComposeTime("%Y-%m-%d %H:%M:%S", newNextRun));
+                table.rescheduled[jobID] = newNextRun;
+            } else if (parentJobID) {
+                // This is a child job.  Mark it as finished, and resume the parent if this is the last pending child.
+                table.finishedChildren.push_back(jobID);
+                table.finishedChildrensParents.insert(parentJobID);
+            } else {
+                // This is a standalone (not a child) job; delete it.
+                table.deleted.push_back(jobID);
+            }
+        }
+
+        // Whatever happens next, the job isn't RUNNING anymore, so it's done with its lease.
+        table.all.push_back(jobID);
+        if (!jobs[i]["data"].empty()) {
+            table.data[jobID] = jobs[i]["data"];
+        }
+        if (!row[6].empty() || !row[7].empty()) {
+            table.leased.push_back(jobID);
+        }
+    }
+
+    // Now make the changes, a table at a time.
+    for (auto& tableChanges : changes) {
+        const string& table = tableChanges.first;
+        Changes& c = tableChanges.second;
+        if (c.all.empty()) {
+            continue;
+        }
+
+        // Delete any FINISHED/CANCELLED child jobs, but leave any PAUSED children alone (as those will signal that
+        // we just want to re-PAUSE this job so those new children can run)
+        if (!db.write("DELETE FROM " + table + " "
+                      "WHERE parentJobID IN (" + SQList(c.all) + ") AND state IN ('FINISHED', 'CANCELLED');")) {
+            throw "502 Failed deleting finished/cancelled child jobs";
+        }
+
+        // Update the data of the jobs we were given data for, and clear any leases.
+        if (!c.data.empty() || !c.leased.empty()) {
+            set<int64_t> updated(c.leased.begin(), c.leased.end());
+            string dataCase = "CASE jobID";
+            for (auto& data : c.data) {
+                updated.insert(data.first);
+                dataCase += " WHEN " + SQ(data.first) + " THEN " + SQ(data.second);
+            }
+            list<string> updateList;
+            if (!c.data.empty()) {
+                updateList.push_back("data=" + dataCase + " ELSE data END");
+            }
+            updateList.push_back("leaseExpires=NULL");
+            updateList.push_back("leaseID=NULL");
+            if (!db.write("UPDATE " + table + " SET " + SComposeList(updateList) + " "
+                          "WHERE jobID IN (" + SQList(updated) + ");")) {
+                throw "502 Failed to update job data";
+            }
+        }
+
+        // Pause the jobs with children to run, and un-pause those children.
+        if (!c.paused.empty()) {
+            SINFO("Jobs have child jobs, PAUSING " << c.paused.size() << " parents, QUEUING children");
+            if (!db.write("UPDATE " + table + " SET state='PAUSED' WHERE jobID IN (" + SQList(c.paused) + ");")) {
+                throw "502 Parent update failed";
+            }
+            if (!db.write("UPDATE " + table + " SET state='QUEUED' "
+                          "WHERE state='PAUSED' "
+                            "AND parentJobID IN (" + SQList(c.paused) + ");")) {
+                throw "502 Child update failed";
+            }
+        }
+
+        // Reschedule the jobs that repeat, or are being retried.
+        if (!c.rescheduled.empty()) {
+            string nextRunCase = "CASE jobID";
+            string nextRunUSCase = "CASE jobID";
+            list<int64_t> rescheduled;
+            for (auto& nextRun : c.rescheduled) {
+                nextRunCase += " WHEN " + SQ(nextRun.first) + " THEN " + STIMESTAMP(nextRun.second);
+                nextRunUSCase += " WHEN " + SQ(nextRun.first) + " THEN " + SQ(nextRun.second);
+                rescheduled.push_back(nextRun.first);
+            }
+            if (!db.write("UPDATE " + table + " "
+                          "SET nextRun=" + nextRunCase + " END, nextRunUS=" + nextRunUSCase + " END, state='QUEUED' "
+                          "WHERE jobID IN (" + SQList(rescheduled) + ");")) {
+                throw "502 Update failed";
+            }
+        }
+
+        // Mark finished children as FINISHED, and then resume any parents that have no children left to run.
+        if (!c.finishedChildren.empty()) {
+            if (!db.write("UPDATE " + table + " SET state='FINISHED' "
+                          "WHERE jobID IN (" + SQList(c.finishedChildren) + ");")) {
+                throw "502 Failed to mark job as FINISHED";
+            }
+            if (!db.write("UPDATE " + table + " SET state='QUEUED' "
+                          "WHERE jobID IN (" + SQList(c.finishedChildrensParents) + ") "
+                            "AND NOT EXISTS (SELECT 1 FROM " + table + " child "
+                                            "WHERE child.parentJobID=" + table + ".jobID "
+                                              "AND child.state IN ('QUEUED', 'RUNNING', 'PAUSED'));")) {
+                throw "502 Update failed";
+            }
+        }
+
+        // Delete the standalone jobs we're done with.
+        if (!c.deleted.empty()) {
+            if (!db.write("DELETE FROM " + table + " WHERE jobID IN (" + SQList(c.deleted) + ");")) {
+                throw "502 Delete failed";
+            }
+
+            // At this point, all child jobs should already be deleted, but
+            // let's double check.
+            if (!db.read("SELECT 1 FROM " + table + " WHERE parentJobID IN (" + SQList(c.deleted) + ") LIMIT 1;")
+                     .empty()) {
+                SWARN("Child jobs still exist when deleting parent job, ignoring.");
+            }
+        }
+    }
+    return results;
+}
+
+// ==========================================================================
+map<string, list<int64_t>> BedrockPlugin_Jobs::_groupByTable(const set<int64_t>& jobIDs) {
+    map<string, list<int64_t>> tables;
+    for (int64_t jobID : jobIDs) {
+        const int64_t partition = _partitionOf(jobID);
+        if (partition >= 0 && partition < _partitions) {
+            tables[_partitionTable(partition)].push_back(jobID);
+        }
+    }
+    return tables;
+}
+
+map<int64_t, pair<string, int64_t>> BedrockPlugin_Jobs::_readJobStates(SQLite& db, const set<int64_t>& jobIDs) {
+    map<int64_t, pair<string, int64_t>> states;
+    for (auto& table : _groupByTable(jobIDs)) {
+        SQResult result;
+        if (!db.read("SELECT jobID, state, parentJobID "
+                     "FROM " + table.first + " "
+                     "WHERE jobID IN (" + SQList(table.second) + ");",
+                     result)) {
+            throw "502 Select failed";
+        }
+        for (auto& row : result.rows) {
+            states[SToInt64(row[0])] = make_pair(row[1], SToInt64(row[2]));
+        }
+    }
+    return states;
+}
+
+// ==========================================================================
+string BedrockPlugin_Jobs::_partitionTable(int64_t partition) {
+    if (!partition) {
+        return "jobs";
+    }
+    char buff[20] = {0};
+    sprintf(buff, "jobs%04d", (int)partition);
+    return buff;
+}
+
+int64_t BedrockPlugin_Jobs::_partitionOf(int64_t jobID) {
+    return jobID >> JOBS_PARTITION_SHIFT;
+}
+
+int64_t BedrockPlugin_Jobs::_partitionForNewJob(const string& name, int64_t parentJobID) {
+    // Children go with their parent, so a parent and its children can always be found in one table.
+    if (parentJobID) {
+        const int64_t partition = _partitionOf(parentJobID);
+        if (partition < 0 || partition >= _partitions) {
+            throw "404 parentJobID does not exist";
+        }
+        return partition;
+    }
+
+    // Otherwise, hash the queue the job's in, so all the jobs in a queue are in the same partition. This has to give
+    // the same answer on every node, whatever it's built with, so we don't use std::hash. This is FNV-1a.
+    const string queue = name.substr(0, name.find('/'));
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : queue) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    return (int64_t)(hash % (uint64_t)_partitions);
+}
+
+string BedrockPlugin_Jobs::_jobsTable(int64_t jobID) {
+    const int64_t partition = _partitionOf(jobID);
+    if (partition < 0 || partition >= _partitions) {
+        throw "404 No job with this jobID";
+    }
+    return _partitionTable(partition);
+}
+
+string BedrockPlugin_Jobs::_archivable(const string& table) {
+    // Jobs that are done with: FAILED, FINISHED and CANCELLED jobs, unless they're the children of a job that's still
+    // around. That job gets its FINISHED and CANCELLED children when it resumes, and a sibling may still cancel a
+    // FAILED one.
+    return "state IN ('FAILED', 'FINISHED', 'CANCELLED') "
+           "AND (parentJobID=0 OR NOT EXISTS (SELECT 1 FROM " + table + " parent "
+                                             "WHERE parent.jobID=" + table + ".parentJobID))";
+}
+
+// The ready index isn't the plugin itself, so it can't call `getName()`.
+#undef SLOGPREFIX
+#define SLOGPREFIX "{Jobs} "
+
+// ==========================================================================
+BedrockPlugin_Jobs::ReadyIndex::ReadyIndex() : partitions(1), _loaded(false) { }
+
+bool BedrockPlugin_Jobs::ReadyIndex::load(SQLite& db) {
+    if (_loaded.load()) {
+        return true;
+    }
+
+    // Nothing can commit while we hold this, so between the snapshot we read and the commits we observe, we see
+    // everything exactly once.
+    SQLITE_COMMIT_AUTOLOCK;
+    if (_loaded.load()) {
+        return true;
+    }
+    map<int64_t, Job> jobs;
+    uint64_t start = STimeNow();
+    for (int64_t partition = 0; partition < partitions; partition++) {
+        if (!_readQueued(db, partition, "", jobs)) {
+            SWARN("Couldn't load the ready index, finding jobs in the database instead.");
+            return false;
+        }
+    }
+    lock_guard<mutex> lock(_mutex);
+    for (auto& job : jobs) {
+        _insert(job.first, job.second);
+    }
+    _loaded.store(true);
+    SINFO("Loaded " << _jobs.size() << " QUEUED jobs into the ready index in " << (STimeNow() - start) / 1000
+          << "ms.");
+    return true;
+}
+
+list<int64_t> BedrockPlugin_Jobs::ReadyIndex::find(const string& pattern, uint64_t now, size_t limit,
+                                                   const set<int64_t>& exclude) {
+    // A pattern without any GLOB special characters can only match one name, so we can look it up directly.
+    // Otherwise, we check it against every name that has jobs queued.
+    const bool exact = pattern.find_first_of("*?[") == string::npos;
+    list<int64_t> jobIDs;
+    lock_guard<mutex> lock(_mutex);
+    for (auto& priority : _queues) {
+        if (jobIDs.size() >= limit) {
+            break;
+        }
+
+        // Take the earliest due jobs of each matching name at this priority, and then the earliest of those.
+        const size_t wanted = limit - jobIDs.size();
+        vector<pair<uint64_t, int64_t>> due;
+        auto takeDue = [&](const set<pair<uint64_t, int64_t>>& queue) {
+            size_t taken = 0;
+            for (auto& job : queue) {
+                if (job.first > now || taken >= wanted) {
+                    break;
+                }
+                if (!exclude.count(job.second)) {
+                    due.push_back(job);
+                    taken++;
+                }
+            }
+        };
+        if (exact) {
+            auto it = priority.second.find(pattern);
+            if (it != priority.second.end()) {
+                takeDue(it->second);
+            }
+        } else {
+            for (auto& queue : priority.second) {
+                if (!sqlite3_strglob(pattern.c_str(), queue.first.c_str())) {
+                    takeDue(queue.second);
+                }
+            }
+        }
+        sort(due.begin(), due.end());
+        for (size_t i = 0; i < due.size() && i < wanted; i++) {
+            jobIDs.push_back(due[i].second);
+        }
+    }
+    return jobIDs;
+}
+
+uint64_t BedrockPlugin_Jobs::ReadyIndex::nextDue(const string& pattern, uint64_t now) {
+    uint64_t earliest = 0;
+    lock_guard<mutex> lock(_mutex);
+    for (auto& priority : _queues) {
+        for (auto& queue : priority.second) {
+            if (sqlite3_strglob(pattern.c_str(), queue.first.c_str())) {
+                continue;
+            }
+            auto it = queue.second.upper_bound(make_pair(now, INT64_MAX));
+            if (it != queue.second.end() && (!earliest || it->first < earliest)) {
+                earliest = it->first;
+            }
+        }
+    }
+    return earliest;
+}
+
+size_t BedrockPlugin_Jobs::ReadyIndex::size() {
+    lock_guard<mutex> lock(_mutex);
+    return _jobs.size();
+}
+
+void BedrockPlugin_Jobs::ReadyIndex::prepared(SQLite& db, const set<int64_t>& rowIDs) {
+    // Until we've loaded, there's nothing to keep up to date.
+    if (!_loaded.load()) {
+        return;
+    }
+
+    // Read back whichever of the changed jobs are QUEUED now, a chunk at a time, as a transaction can change a lot.
+    _pendingChanged = rowIDs;
+    _pendingQueued.clear();
+    map<int64_t, list<int64_t>> rowIDsByPartition;
+    for (int64_t rowID : rowIDs) {
+        rowIDsByPartition[_partitionOf(rowID)].push_back(rowID);
+    }
+    for (auto& partition : rowIDsByPartition) {
+        for (auto it = partition.second.begin(); it != partition.second.end();) {
+            list<int64_t> chunk;
+            for (; it != partition.second.end() && chunk.size() < 1000; it++) {
+                chunk.push_back(*it);
+            }
+            if (!_readQueued(db, partition.first, "AND jobID IN (" + SQList(chunk) + ")", _pendingQueued)) {
+                // If we can't tell what changed, we can't trust the index anymore. Drop it, and it'll be loaded
+                // again the next time it's needed.
+                SWARN("Couldn't read changed jobs, unloading the ready index.");
+                lock_guard<mutex> lock(_mutex);
+                _loaded.store(false);
+                _queues.clear();
+                _jobs.clear();
+                _pendingChanged.clear();
+                _pendingQueued.clear();
+                return;
+            }
+        }
+    }
+}
+
+void BedrockPlugin_Jobs::ReadyIndex::committed() {
+    set<string> queuedNames;
+    {
+        lock_guard<mutex> lock(_mutex);
+        for (int64_t jobID : _pendingChanged) {
+            _erase(jobID);
+        }
+        for (auto& job : _pendingQueued) {
+            _insert(job.first, job.second);
+            queuedNames.insert(job.second.name);
+        }
+        _pendingChanged.clear();
+        _pendingQueued.clear();
+    }
+    if (!queuedNames.empty() && onQueued) {
+        onQueued(queuedNames);
+    }
+}
+
+void BedrockPlugin_Jobs::ReadyIndex::rolledBack() {
+    _pendingChanged.clear();
+    _pendingQueued.clear();
+}
+
+void BedrockPlugin_Jobs::ReadyIndex::_insert(int64_t jobID, const Job& job) {
+    _erase(jobID);
+    _jobs[jobID] = job;
+    _queues[job.priority][job.name].emplace(job.nextRun, jobID);
+}
+
+void BedrockPlugin_Jobs::ReadyIndex::_erase(int64_t jobID) {
+    auto jobIt = _jobs.find(jobID);
+    if (jobIt == _jobs.end()) {
+        return;
+    }
+    const Job& job = jobIt->second;
+    auto priorityIt = _queues.find(job.priority);
+    auto nameIt = priorityIt->second.find(job.name);
+    nameIt->second.erase(make_pair(job.nextRun, jobID));
+
+    // Don't leave empty queues around for `find` to look through.
+    if (nameIt->second.empty()) {
+        priorityIt->second.erase(nameIt);
+        if (priorityIt->second.empty()) {
+            _queues.erase(priorityIt);
+        }
+    }
+    _jobs.erase(jobIt);
+}
+
+bool BedrockPlugin_Jobs::ReadyIndex::_readQueued(SQLite& db, int64_t partition, const string& where,
+                                                 map<int64_t, Job>& jobs) {
     SQResult result;
-    if (!db.read("SELECT 1 "
-                 "FROM jobs "
-                 "WHERE parentJobID = " + SQ(jobID) + " " +
-                 "  AND state IN ('QUEUED', 'RUNNING', 'PAUSED') "
-                 "LIMIT 1;",
+    if (!db.read("SELECT jobID, name, priority, " JOBS_NEXT_RUN_US " FROM " + _partitionTable(partition) + " "
+                 "WHERE state='QUEUED' " + where + ";",
                  result)) {
-        throw "502 Select failed";
+        return false;
     }
-    return !result.empty();
+    for (auto& row : result.rows) {
+        Job& job = jobs[SToInt64(row[0])];
+        job.name = move(row[1]);
+        job.priority = SToInt64(row[2]);
+        job.nextRun = SToUInt64(row[3]);
+    }
+    return true;
 }
-
@@ -4,15 +4,140 @@
 // Declare the class we're going to implement below
 class BedrockPlugin_Jobs : public BedrockPlugin {
   public:
+    BedrockPlugin_Jobs();
+
     // Implement base class interface
     virtual string getName() { return "Jobs"; }
+    virtual void initialize(const SData& args, BedrockServer& server);
     virtual void upgradeDatabase(SQLite& db);
     virtual bool peekCommand(SQLite& db, BedrockCommand& command);
     virtual bool processCommand(SQLite& db, BedrockCommand& command);
+    virtual void timerFired(SStopwatch* timer);
 
   private:
+    // An in-memory index of QUEUED jobs, so GetJob and GetJobs can pick jobs without searching the jobs table for
+    // them. It observes every commit to the jobs table, on every node, so it's up to date on whichever node is
+    // mastering. The database is still the authority, though: GetJob confirms the jobs it picks there before it takes
+    // them, and skips any that don't match.
+    class ReadyIndex : public SQLite::TableObserver {
+      public:
+        ReadyIndex();
+
+        // Loads every QUEUED job from `db`, unless we already have, and returns whether we have. This has to be the
+        // first read in `db`'s transaction, so it sees everything committed so far. We hold the commit lock while we
+        // load, so nothing else can commit before we start observing commits.
+        bool load(SQLite& db);
+        bool loaded() { return _loaded.load(); }
+
+        // Returns the IDs of up to `limit` jobs whose names match `pattern` (a GLOB, like GetJob's `name`) and that
+        // are due to run by `now`, highest priority first, then earliest `nextRun` first. Jobs in `exclude` are
+        // skipped.
+        list<int64_t> find(const string& pattern, uint64_t now, size_t limit,
+                           const set<int64_t>& exclude = set<int64_t>());
+
+        // Returns when the first job matching `pattern` that isn't due by `now` will be, or 0 if there isn't one.
+        uint64_t nextDue(const string& pattern, uint64_t now);
+
+        // The number of jobs in the index.
+        size_t size();
+
+        // How many partitions of the jobs table there are to load from. Set before anything's loaded.
+        int64_t partitions;
+
+        // If set, this is called with the names of the jobs each commit queues, once they're in the index.
+        function<void(const set<string>& names)> onQueued;
+
+        // TableObserver interface.
+        void prepared(SQLite& db, const set<int64_t>& rowIDs);
+        void committed();
+        void rolledBack();
+
+      private:
+        struct Job {
+            string name;
+            int64_t priority;
+            uint64_t nextRun;
+        };
+
+        // Adds or removes a single job. `_mutex` must be held.
+        void _insert(int64_t jobID, const Job& job);
+        void _erase(int64_t jobID);
+
+        // Reads the QUEUED jobs in `partition` matching `where` into `jobs`.
+        static bool _readQueued(SQLite& db, int64_t partition, const string& where, map<int64_t, Job>& jobs);
+
+        mutex _mutex;
+        atomic<bool> _loaded;
+
+        // Queued jobs by priority, highest first, then by name, each ordered by `nextRun` and then jobID.
+        map<int64_t, map<string, set<pair<uint64_t, int64_t>>>, greater<int64_t>> _queues;
+
+        // The same jobs, by jobID.
+        map<int64_t, Job> _jobs;
+
+        // What the prepared transaction changed, to be applied if it commits: every job it changed, and which of those
+        // are QUEUED now. These are only touched with the commit lock held.
+        set<int64_t> _pendingChanged;
+        map<int64_t, Job> _pendingQueued;
+    };
+
+    // Jobs are split across `_partitions` tables with the same schema: `jobs`, then `jobs0001`, `jobs0002`, and so on.
+    // A new job goes in the partition for its queue (the part of its name before the first `/`), or its parent's, if
+    // it has one. From then on, which partition it's in can be told from its jobID.
+    int64_t _partitions;
+    static string _partitionTable(int64_t partition);
+    static int64_t _partitionOf(int64_t jobID);
+    int64_t _partitionForNewJob(const string& name, int64_t parentJobID);
+
+    // Returns the table job `jobID` would be in, or throws `404` if it couldn't be in any of them.
+    string _jobsTable(int64_t jobID);
+
+    // Groups `jobIDs` by the table they'd be in, leaving out any that couldn't be in any of them.
+    map<string, list<int64_t>> _groupByTable(const set<int64_t>& jobIDs);
+
+    // Returns the condition for jobs in `table` that can be moved to the archive.
+    static string _archivable(const string& table);
+
     // Helper functions
-    string _constructNextRunDATETIME(const string& lastScheduled, const string& lastRun, const string& repeat);
-    bool _validateRepeat(const string& repeat) { return !_constructNextRunDATETIME("", "", repeat).empty(); }
-    bool _hasPendingChildJobs(SQLite& db, int64_t jobID);
+    // Works out when a job that repeats with `repeat`, that was last scheduled for `lastScheduled` and last ran at
+    // `lastRun`, runs next, in the same way as SQLite's date and time functions would. Returns false if `repeat` is
+    // malformed.
+    bool _computeNextRun(uint64_t lastScheduled, uint64_t lastRun, const string& repeat, uint64_t& nextRun);
+    bool _validateRepeat(const string& repeat) {
+        uint64_t ignore;
+        return _computeNextRun(0, 0, repeat, ignore);
+    }
+
+    // Parses a "YYYY-MM-DD [HH:MM:SS]" timestamp, like CreateJob's `firstRun`, into `when`. Returns false if it isn't
+    // one.
+    static bool _parseTimestamp(const string& timestamp, uint64_t& when);
+
+    // Returns whether every job has its integer timestamps filled in, so GetJob can find jobs by them alone. Once
+    // this is true, it stays true, as the jobs tables' insert triggers fill them in for any new job that's missing
+    // them.
+    bool _timestampsBackfilled(SQLite& db);
+    atomic<bool> _backfilled;
+
+    // Finishes, or retries, each of `jobs` the way FinishJob or RetryJob would, with a few statements for all of them
+    // rather than several for each. Returns the result for each job, in order: "200 OK", or the error FinishJob or
+    // RetryJob would have given for it. Jobs with errors are left alone, and don't stop the rest.
+    vector<string> _finishJobs(SQLite& db, bool retry, vector<STable>& jobs);
+
+    // Reads the state and parentJobID of whichever of `jobIDs` exist, with one query per partition.
+    map<int64_t, pair<string, int64_t>> _readJobStates(SQLite& db, const set<int64_t>& jobIDs);
+
+    // If a GetJob command that didn't find a job asked to wait for one, has the server hold on to it until one could
+    // be there, or throws `303 Timeout` if it's already waited as long as it can.
+    void _waitForJob(BedrockCommand& command);
+
+    ReadyIndex _readyIndex;
+
+    // The server we're running in, so the lease sweeper can check whether we're mastering and send it commands.
+    BedrockServer* _server;
+
+    // Ring every time the master should look for expired leases, for jobs to archive, and for jobs without integer
+    // timestamps.
+    SStopwatch _leaseSweepTimer;
+    SStopwatch _archiveTimer;
+    SStopwatch _backfillTimer;
 };
@@ -18,9 +18,9 @@ string MySQLPacket::serialize() {
     return header + payload;
 }
 
-int MySQLPacket::deserialize(const string& packet) {
+int MySQLPacket::deserialize(const char* packet, size_t length) {
     // Does it have a header?
-    if (packet.size() < 4) {
+    if (length < 4) {
         return 0;
     }
 
@@ -29,7 +29,7 @@ int MySQLPacket::deserialize(const string& packet) {
     sequenceID = (uint8_t)packet[3];
 
     // Do we have enough data for the full payload?
-    if (packet.size() < (4 + payloadLength)) {
+    if (length < (4 + payloadLength)) {
         return 0;
     }
 
@@ -229,7 +229,7 @@ void BedrockPlugin_MySQL::onPortRecv(STCPManager::Socket* s, SData& request) {
     // Get any new MySQL requests
     int packetSize = 0;
     MySQLPacket packet;
-    while ((packetSize = packet.deserialize(s->recvBuffer))) {
+    while ((packetSize = packet.deserialize(s->recvBuffer.c_str(), s->recvBuffer.size()))) {
         // Got a packet, process it
         SDEBUG("Received command #" << (int)packet.payload[0] << ": '" << SToHex(packet.serialize()) << "'");
         SConsumeFront(s->recvBuffer, packetSize);
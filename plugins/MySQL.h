@@ -30,7 +30,8 @@ struct MySQLPacket {
      * @param packet Binary data received from the MySQL client
      * @return       Number of bytes deserialized, or 0 on failure
      */
-    int deserialize(const string& packet);
+    int deserialize(const char* packet, size_t length);
+    int deserialize(const string& packet) { return deserialize(packet.data(), packet.size()); }
 
     /**
      * Creates a MySQL length-encoded integer
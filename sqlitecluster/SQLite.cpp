@@ -10,6 +10,7 @@ set<uint64_t>                       SQLite::_committedTransactionIDs;
 map<uint64_t, pair<string, string>> SQLite::_inFlightTransactions;
 atomic<string>                      SQLite::_lastCommittedHash;
 atomic_flag                         SQLite::_sqliteInitialized = ATOMIC_FLAG_INIT;
+map<string, list<SQLite::TableObserver*>> SQLite::_tableObservers;
 
 // This is our only public static variable. It needs to be initialized after `_commitLock`.
 SLockTimer<recursive_mutex> SQLite::g_commitLock("Commit Lock", SQLite::_commitLock);
@@ -26,6 +27,7 @@ SQLite::SQLite(const string& filename, int cacheSize, int autoCheckpoint, int ma
     SASSERT(maxJournalSize > 0);
     _filename = filename;
     _insideTransaction = false;
+    _observersPrepared = false;
     _maxJournalSize = maxJournalSize;
     _beginElapsed = 0;
     _readElapsed = 0;
@@ -143,6 +145,30 @@ SQLite::SQLite(const string& filename, int cacheSize, int autoCheckpoint, int ma
 
     // Register the authorizer callback which allows callers to whitelist particular data in the DB.
     sqlite3_set_authorizer(_db, SQLite::_sqliteAuthorizerCallback, this);
+
+    // And the update callback, which keeps track of changes to observed tables.
+    sqlite3_update_hook(_db, SQLite::_sqliteUpdateCallback, this);
+}
+
+void SQLite::addTableObserver(const string& table, TableObserver* observer) {
+    SQLITE_COMMIT_AUTOLOCK;
+    list<TableObserver*>& observers = _tableObservers[table];
+    if (find(observers.begin(), observers.end(), observer) == observers.end()) {
+        observers.push_back(observer);
+    }
+}
+
+void SQLite::_sqliteUpdateCallback(void* pUserData, int operation, const char* database, const char* table,
+                                   sqlite3_int64 rowID) {
+    if (_tableObservers.empty()) {
+        return;
+    }
+    auto it = _tableObservers.find(table);
+    if (it != _tableObservers.end()) {
+        for (TableObserver* observer : it->second) {
+            static_cast<SQLite*>(pUserData)->_changedRows[observer].insert(rowID);
+        }
+    }
 }
 
 void SQLite::_sqliteLogCallback(void* pArg, int iErrCode, const char* zMsg) {
@@ -173,7 +199,10 @@ SQLite::~SQLite() {
         rollback();
     }
 
-    // Close the DB.
+    // Close the DB, once nothing's using it.
+    for (auto& statement : _preparedStatements) {
+        sqlite3_finalize(statement.second);
+    }
     DBINFO("Closing database '" << _filename << ".");
     SASSERTWARN(_uncommittedQuery.empty());
     SASSERT(!sqlite3_close(_db));
@@ -283,6 +312,50 @@ bool SQLite::read(const string& query, SQResult& result) {
     return queryResult;
 }
 
+bool SQLite::readPrepared(const string& query, const vector<string>& params, SQResult& result) {
+    uint64_t before = STimeNow();
+    result.clear();
+    auto it = _preparedStatements.find(query);
+    if (it == _preparedStatements.end()) {
+        sqlite3_stmt* statement = nullptr;
+        if (sqlite3_prepare_v2(_db, query.c_str(), query.size(), &statement, nullptr) != SQLITE_OK) {
+            SWARN("Couldn't prepare query (" << sqlite3_errmsg(_db) << "): " << query);
+            sqlite3_finalize(statement);
+            return false;
+        }
+        it = _preparedStatements.emplace(query, statement).first;
+    }
+    sqlite3_stmt* statement = it->second;
+    for (size_t i = 0; i < params.size(); i++) {
+        sqlite3_bind_text(statement, i + 1, params[i].data(), params[i].size(), SQLITE_STATIC);
+    }
+
+    // Read the columns as blobs, which gives us text and blobs exactly as they were stored, and numbers as text.
+    int error;
+    while ((error = sqlite3_step(statement)) == SQLITE_ROW) {
+        const int columns = sqlite3_column_count(statement);
+        if (result.headers.empty()) {
+            for (int c = 0; c < columns; c++) {
+                result.headers.push_back(sqlite3_column_name(statement, c));
+            }
+        }
+        result.rows.emplace_back();
+        for (int c = 0; c < columns; c++) {
+            const char* value = static_cast<const char*>(sqlite3_column_blob(statement, c));
+            result.rows.back().emplace_back(value ? string(value, sqlite3_column_bytes(statement, c)) : "");
+        }
+    }
+    if (error != SQLITE_DONE) {
+        SWARN("Prepared query failed with error #" << error << " (" << sqlite3_errmsg(_db) << "): " << query);
+    }
+
+    // Leave the statement ready for next time, without holding on to `params`.
+    sqlite3_reset(statement);
+    sqlite3_clear_bindings(statement);
+    _readElapsed += STimeNow() - before;
+    return error == SQLITE_DONE;
+}
+
 bool SQLite::write(const string& query) {
     SASSERT(_insideTransaction);
     SASSERT(SEndsWith(query, ";"));                                         // Must finish everything with semicolon
@@ -348,6 +421,12 @@ bool SQLite::prepare() {
         return false;
     }
 
+    // Let any observers know what this transaction changed, while they can still read it.
+    for (auto& changed : _changedRows) {
+        changed.first->prepared(*this, changed.second);
+    }
+    _observersPrepared = !_changedRows.empty();
+
     // Ready to commit
     SDEBUG("Prepared transaction");
 
@@ -395,6 +474,13 @@ int SQLite::commit() {
         _commitCount++;
         _committedTransactionIDs.insert(_commitCount.load());
         _lastCommittedHash.store(_uncommittedHash);
+        if (_observersPrepared) {
+            for (auto& changed : _changedRows) {
+                changed.first->committed();
+            }
+            _observersPrepared = false;
+        }
+        _changedRows.clear();
         SDEBUG("Commit successful (" << _commitCount.load() << "), releasing commitLock.");
         _insideTransaction = false;
         _uncommittedHash.clear();
@@ -447,6 +533,13 @@ void SQLite::rollback() {
         _insideTransaction = false;
         _uncommittedHash.clear();
         _uncommittedQuery.clear();
+        if (_observersPrepared) {
+            for (auto& changed : _changedRows) {
+                changed.first->rolledBack();
+            }
+            _observersPrepared = false;
+        }
+        _changedRows.clear();
         SINFO("Rollback successful.");
 
         // Only unlock the mutex if we've previously locked it. We can call `rollback` to cancel a transaction without
@@ -543,8 +636,13 @@ int SQLite::_sqliteAuthorizerCallback(void* pUserData, int actionCode, const cha
 }
 
 int SQLite::_authorize(int actionCode, const char* table, const char* column) {
-    // If the whitelist isn't set, we always return OK.
+    // If the whitelist isn't set, we always return OK, except that deletes from observed tables are "ignored", which
+    // only stops SQLite from deleting every row at once without calling our update callback for each one.
     if (!whitelist) {
+        if (actionCode == SQLITE_DELETE && !_tableObservers.empty() && table &&
+            _tableObservers.find(table) != _tableObservers.end()) {
+            return SQLITE_IGNORE;
+        }
         return SQLITE_OK;
     }
 
@@ -12,6 +12,28 @@ class SQLite {
     // This can be locked with the SQLITE_COMMIT_AUTOLOCK macro, as well.
     static SLockTimer<recursive_mutex> g_commitLock;
 
+    // A table observer is told about every change to the rows of a table, as each transaction that makes them
+    // commits, whichever handle it's made on. That includes transactions replicated from other nodes, so an observer
+    // can keep an in-memory copy of some part of a table up to date on every node.
+    class TableObserver {
+      public:
+        virtual ~TableObserver() { }
+
+        // Called from `prepare()` with the rowids of every row the transaction inserted, updated or deleted in the
+        // observed table. It's called inside the transaction, so the observer can read whatever it needs about those
+        // rows from `db`, but mustn't write. The commit lock is held from here until the matching `committed()` or
+        // `rolledBack()`, so only one transaction at a time is ever between the two, and they're seen in commit order.
+        virtual void prepared(SQLite& db, const set<int64_t>& rowIDs) = 0;
+        virtual void committed() = 0;
+        virtual void rolledBack() = 0;
+    };
+
+    // Registers `observer` for changes to `table`, which can have any number of observers. This should be done at
+    // startup, before any handles are opened.
+    // To make sure every change is seen, observed tables don't get SQLite's optimization that deletes every row of a
+    // table without visiting each one.
+    static void addTableObserver(const string& table, TableObserver* observer);
+
     // Loads a database and confirms its schema
     // The journalTable and numJournalTables parameters are maybe less than straightforward, here's what they mean:
     //
@@ -36,6 +58,11 @@ class SQLite {
     // Performs a read-only query (eg, SELECT) that returns a single cell.
     string read(const string& query);
 
+    // Performs a read-only query with `?` placeholders, bound in order to `params`. The statement is compiled the first
+    // time this handle runs `query`, and kept for next time, so a query run over and over with different values is
+    // only parsed and planned once. Returns true on success, and fills 'result' with the result of the query.
+    bool readPrepared(const string& query, const vector<string>& params, SQResult& result);
+
     // Begins a new transaction. Returns true on success.
     bool beginTransaction();
 
@@ -191,6 +218,7 @@ class SQLite {
 
     // Attributes
     sqlite3* _db;
+    map<string, sqlite3_stmt*> _preparedStatements;
     string _filename;
     uint64_t _journalSize;
     uint64_t _maxJournalSize;
@@ -241,6 +269,14 @@ class SQLite {
     //  this limitation.
     string _getJournalQuery(const list<string>& queryParts, bool append = false);
 
+    // Observers, by table name, and the rows changed in each observed table by the current transaction, which we
+    // collect with `_sqliteUpdateCallback`.
+    static map<string, list<TableObserver*>> _tableObservers;
+    map<TableObserver*, set<int64_t>> _changedRows;
+    bool _observersPrepared;
+    static void _sqliteUpdateCallback(void* pUserData, int operation, const char* database, const char* table,
+                                      sqlite3_int64 rowID);
+
     // Callback function that we'll register for authorizing queries in sqlite.
     static int _sqliteAuthorizerCallback(void*, int, const char*, const char*, const char*, const char*);
 
@@ -0,0 +1,194 @@
+#include <libstuff/libstuff.h>
+#include "SQLiteApplier.h"
+#include "SQLite.h"
+#include <iomanip>
+
+SQLiteApplier::SQLiteApplier(const string& filename, int cacheSize, int maxJournalSize, int threads,
+                             int maxRequiredJournalTableID)
+  : _nextToStart(1), _nextToCommit(1), _lastQueued(0), _inFlight(0), _failed(false), _stopping(false), _applied(0),
+    _conflicts(0), _inFlightAtCommitTotal(0)
+{
+    SASSERT(threads > 0);
+    SASSERT(threads - 1 <= maxRequiredJournalTableID);
+    SINFO("Starting " << threads << " replication apply threads.");
+    for (int threadID = 0; threadID < threads; threadID++) {
+        _threads.emplace_back(&SQLiteApplier::_applyThread, this, threadID, filename, cacheSize, maxJournalSize,
+                              maxRequiredJournalTableID);
+    }
+}
+
+SQLiteApplier::~SQLiteApplier() {
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (!_pending.empty()) {
+            SWARN("Stopping replication apply threads with " << _pending.size() << " uncommitted transactions.");
+        }
+        _stopping = true;
+        _workAvailable.notify_all();
+        _committed.notify_all();
+    }
+    for (auto& thread : _threads) {
+        thread.join();
+    }
+}
+
+void SQLiteApplier::enqueue(uint64_t commitCount, const string& query, const string& hash) {
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (_pending.empty()) {
+            // Nothing outstanding, start from here.
+            _nextToStart = commitCount;
+            _nextToCommit = commitCount;
+        } else {
+            SASSERT(commitCount == _lastQueued + 1);
+        }
+        _pending[commitCount] = {query, hash, STimeNow()};
+        _lastQueued = commitCount;
+    }
+    _workAvailable.notify_one();
+}
+
+bool SQLiteApplier::drain() {
+    unique_lock<mutex> lock(_mutex);
+    _committed.wait(lock, [this]{ return _pending.empty() || (_failed && !_inFlight); });
+    bool success = !_failed;
+    if (!success) {
+        SWARN("Discarding " << _pending.size() << " replicated transactions after apply failure.");
+    }
+    _pending.clear();
+    _failed = false;
+    _nextToStart = _lastQueued + 1;
+    _nextToCommit = _lastQueued + 1;
+    return success;
+}
+
+bool SQLiteApplier::failed() {
+    lock_guard<mutex> lock(_mutex);
+    return _failed;
+}
+
+uint64_t SQLiteApplier::getLastQueuedCommitCount() {
+    lock_guard<mutex> lock(_mutex);
+    return _pending.empty() ? 0 : _lastQueued;
+}
+
+void SQLiteApplier::getStatus(STable& content) {
+    lock_guard<mutex> lock(_mutex);
+    uint64_t lagUS = _pending.empty() ? 0 : STimeNow() - _pending.begin()->second.queuedTime;
+    ostringstream parallelism;
+    parallelism << fixed << setprecision(2) << (_applied ? (double)_inFlightAtCommitTotal / _applied : 0.0);
+    content["applyThreads"] = to_string(_threads.size());
+    content["applyLagCommits"] = to_string(_pending.size());
+    content["applyLagMS"] = to_string(lagUS / STIME_US_PER_MS);
+    content["applyInFlight"] = to_string(_inFlight);
+    content["applyParallelism"] = parallelism.str();
+    content["applyCommits"] = to_string(_applied);
+    content["applyConflicts"] = to_string(_conflicts);
+}
+
+void SQLiteApplier::prePoll(fd_map& fdm) {
+    _commitNotifications.prePoll(fdm);
+}
+
+void SQLiteApplier::postPoll(fd_map& fdm) {
+    // We don't care what was committed, only that something was, so just throw these away.
+    _commitNotifications.postPoll(fdm, 1024);
+    while (!_commitNotifications.empty()) {
+        _commitNotifications.pop();
+    }
+}
+
+void SQLiteApplier::_applyThread(int threadID, const string& filename, int cacheSize, int maxJournalSize,
+                                 int maxRequiredJournalTableID) {
+    SInitialize("apply" + to_string(threadID));
+
+    // We pass `0` as the checkpoint size, like worker threads do, so that only the sync thread checkpoints.
+    SQLite db(filename, cacheSize, 0, maxJournalSize, threadID, maxRequiredJournalTableID);
+    while (true) {
+        // Wait for something to do.
+        uint64_t commitCount;
+        Transaction transaction;
+        {
+            unique_lock<mutex> lock(_mutex);
+            _workAvailable.wait(lock, [this]{ return _stopping || (!_failed && _nextToStart <= _lastQueued &&
+                                                                   _pending.count(_nextToStart)); });
+            if (_stopping) {
+                break;
+            }
+            commitCount = _nextToStart++;
+            transaction = _pending.at(commitCount);
+            _inFlight++;
+        }
+
+        // Run the query speculatively, against whatever the database looks like now. Transactions ahead of this one
+        // may not have committed yet, in which case we'll find out when we try to commit.
+        bool speculative = db.beginConcurrentTransaction() && db.write(transaction.query);
+
+        // Wait our turn to commit.
+        bool abandon = false;
+        {
+            unique_lock<mutex> lock(_mutex);
+            _committed.wait(lock, [&]{ return _stopping || _failed || _nextToCommit == commitCount; });
+            abandon = _stopping || _failed;
+        }
+        if (abandon) {
+            if (db.insideTransaction()) {
+                db.rollback();
+            }
+            lock_guard<mutex> lock(_mutex);
+            _inFlight--;
+            _committed.notify_all();
+            continue;
+        }
+
+        // It's our turn, nothing else can commit until we're done. `prepare` rolls back by itself if it fails.
+        bool success = false;
+        if (speculative && db.prepare()) {
+            success = db.getUncommittedHash() == transaction.hash && db.commit() == SQLITE_OK;
+        }
+        if (!success && db.insideTransaction()) {
+            db.rollback();
+        }
+
+        // If that didn't work, it conflicted with something that committed ahead of it (or it was never going to
+        // work). Apply it again serially, which can't conflict.
+        bool conflicted = !success;
+        if (!success) {
+            SINFO("Replicated transaction #" << commitCount << " conflicted, re-applying serially.");
+            if (db.beginTransaction()) {
+                if (db.write(transaction.query) && db.prepare()) {
+                    success = db.getUncommittedHash() == transaction.hash && db.commit() == SQLITE_OK;
+                }
+                if (!success && db.insideTransaction()) {
+                    db.rollback();
+                }
+            }
+        }
+        if (success) {
+            // We're slaving, there's nobody to replicate these to.
+            db.getCommittedTransactions();
+        } else {
+            SWARN("Failed to apply replicated transaction #" << commitCount << " (" << transaction.hash << "): "
+                  << db.getLastError());
+        }
+
+        {
+            lock_guard<mutex> lock(_mutex);
+            if (success) {
+                _inFlightAtCommitTotal += _inFlight;
+                _pending.erase(commitCount);
+                _nextToCommit++;
+                _applied++;
+                _conflicts += conflicted;
+            } else {
+                _failed = true;
+                _workAvailable.notify_all();
+            }
+            _inFlight--;
+            _committed.notify_all();
+        }
+        if (success) {
+            _commitNotifications.push(move(commitCount));
+        }
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+class SQLite;
+
+// Applies transactions replicated from the master on a set of threads, each with its own database handle. Each
+// transaction is executed speculatively in a `BEGIN CONCURRENT` transaction as soon as a thread is free, but they're
+// prepared and committed strictly in the order they were queued (which is journal order), so the committed hash chain
+// is the same as applying them one at a time. If a transaction conflicts with one committed ahead of it, it's rolled
+// back and re-applied serially, which can't conflict, as nothing else can commit until it's done.
+//
+// This is only used while SLAVING. Worker threads never commit while the node is SLAVING, so the applier threads use
+// the worker journal tables.
+class SQLiteApplier {
+  public:
+    // Opens `threads` handles on `filename`, writing to journal tables 0 through `threads - 1`.
+    SQLiteApplier(const string& filename, int cacheSize, int maxJournalSize, int threads,
+                  int maxRequiredJournalTableID);
+    ~SQLiteApplier();
+
+    // Queues a transaction that the master has committed. Commit counts must be consecutive.
+    void enqueue(uint64_t commitCount, const string& query, const string& hash);
+
+    // Blocks until everything queued has been committed, or until applying something has failed. On failure, anything
+    // still queued is discarded, and this returns false. Either way, the applier is empty and ready for more when this
+    // returns.
+    bool drain();
+
+    // Returns true if applying a transaction has failed. Nothing else will be committed until `drain` is called.
+    bool failed();
+
+    // Returns the highest commit count that has been queued but not yet committed, or 0 if everything's committed.
+    uint64_t getLastQueuedCommitCount();
+
+    // Adds a description of the applier's state to a Status response: apply lag in commits and milliseconds, how many
+    // transactions are executing right now, and the average number that were in flight when each one committed.
+    void getStatus(STable& content);
+
+    // This can be watched by a `poll` loop, so that the loop wakes up whenever a transaction is committed.
+    void prePoll(fd_map& fdm);
+    void postPoll(fd_map& fdm);
+
+  private:
+    struct Transaction {
+        string query;
+        string hash;
+        uint64_t queuedTime;
+    };
+
+    // The loop run by each of our threads.
+    void _applyThread(int threadID, const string& filename, int cacheSize, int maxJournalSize,
+                      int maxRequiredJournalTableID);
+
+    // Everything below is protected by `_mutex`.
+    mutex _mutex;
+
+    // Signaled when there's a new transaction to start, when we're stopping, or when we fail.
+    condition_variable _workAvailable;
+
+    // Signaled whenever a transaction commits (or gives up on committing).
+    condition_variable _committed;
+
+    // Queued transactions that haven't committed yet, by commit count.
+    map<uint64_t, Transaction> _pending;
+
+    // The next commit count to start executing, the next one to commit, and the last one queued.
+    uint64_t _nextToStart;
+    uint64_t _nextToCommit;
+    uint64_t _lastQueued;
+
+    // Number of transactions currently being executed by our threads.
+    int _inFlight;
+
+    // Set when a transaction fails to apply even serially.
+    bool _failed;
+    bool _stopping;
+
+    // Counters for Status.
+    uint64_t _applied;
+    uint64_t _conflicts;
+    uint64_t _inFlightAtCommitTotal;
+
+    // Gets an entry for every commit, to wake up a poll loop.
+    SSynchronizedQueue<uint64_t> _commitNotifications;
+
+    list<thread> _threads;
+};
@@ -3,6 +3,7 @@
 SQLiteCommand::SQLiteCommand(SData&& _request) : 
     initiatingPeerID(0),
     initiatingClientID(0),
+    initiatingClientRequest(0),
     request(move(_request)),
     writeConsistency(SQLiteNode::ASYNC),
     complete(false),
@@ -27,15 +28,17 @@ SQLiteCommand::SQLiteCommand(SData&& _request) :
         }
     }
 
-    // If the request doesn't specify an execution time, default to right now.
+    // If the request doesn't specify an execution time, default to right now, which is exactly when we were created,
+    // so a command can tell whether it was asked to run later than it arrived.
     if (!request.isSet("commandExecuteTime")) {
-        request["commandExecuteTime"] = to_string(STimeNow());
+        request["commandExecuteTime"] = to_string(creationTime);
     }
 }
 
 SQLiteCommand::SQLiteCommand() :
     initiatingPeerID(0),
     initiatingClientID(0),
+    initiatingClientRequest(0),
     writeConsistency(SQLiteNode::ASYNC),
     complete(false),
     escalationTimeUS(0),
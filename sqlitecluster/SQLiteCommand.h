@@ -19,6 +19,11 @@ class SQLiteCommand {
     // can't respond to.
     int64_t initiatingClientID;
 
+    // For commands from a client, the position of the request among those read from its connection, counting from
+    // zero. A client can have several requests in progress at once, and this is how we send the responses back in the
+    // same order.
+    uint64_t initiatingClientRequest;
+
     // Each command is given a unique id that can be serialized and passed back and forth across nodes. Its id must be
     // uniquely identifiable for cases where, for instance, two peers escalate commands to the master, and master will
     // need to  respond to them.
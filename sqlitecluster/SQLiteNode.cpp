@@ -27,6 +27,7 @@
 // Initializations for static vars.
 const uint64_t SQLiteNode::SQL_NODE_DEFAULT_RECV_TIMEOUT = STIME_US_PER_M * 5;
 const uint64_t SQLiteNode::SQL_NODE_SYNCHRONIZING_RECV_TIMEOUT = STIME_US_PER_M;
+const size_t SQLiteNode::SQL_NODE_COMPRESSION_THRESHOLD = 1024;
 atomic<bool> SQLiteNode::unsentTransactions(false);
 uint64_t SQLiteNode::_lastSentTransactionID = 0;
 
@@ -45,7 +46,7 @@ const string SQLiteNode::consistencyLevelNames[] = {"ASYNC",
 
 SQLiteNode::SQLiteNode(SQLiteServer& server, SQLite& db, const string& name, const string& host,
                        const string& peerList, int priority, uint64_t firstTimeout, const string& version,
-                       int quorumCheckpoint)
+                       int quorumCheckpoint, int compressionLevel)
     : STCPNode(name, host, max(SQL_NODE_DEFAULT_RECV_TIMEOUT, SQL_NODE_SYNCHRONIZING_RECV_TIMEOUT)),
       _db(db), _commitState(CommitState::UNINITIALIZED), _server(server)
     {
@@ -58,6 +59,8 @@ SQLiteNode::SQLiteNode(SQLiteServer& server, SQLite& db, const string& name, con
     _version = version;
     _commitsSinceCheckpoint = 0;
     _quorumCheckpoint = quorumCheckpoint;
+    _compressionLevel = max(0, min(9, compressionLevel));
+    _applier = nullptr;
 
     // Get this party started
     _changeState(SEARCHING);
@@ -101,7 +104,22 @@ void SQLiteNode::sendResponse(const SQLiteCommand& command)
     SData escalate("ESCALATE_RESPONSE");
     escalate["ID"] = command.id;
     escalate.content = command.response.serialize();
-    _sendToPeer(peer, escalate);
+    _queueToPeer(peer, escalate);
+}
+
+void SQLiteNode::prePoll(fd_map& fdm) {
+    // Send everything we batched up since the last poll before we wait on the network again.
+    while (!_peerBatches.empty()) {
+        _flushBatch(_peerBatches.begin()->first);
+    }
+    STCPNode::prePoll(fdm);
+}
+
+void SQLiteNode::prePoll(SEventLoop& loop) {
+    while (!_peerBatches.empty()) {
+        _flushBatch(_peerBatches.begin()->first);
+    }
+    STCPNode::prePoll(loop);
 }
 
 void SQLiteNode::beginShutdown() {
@@ -129,6 +147,11 @@ bool SQLiteNode::_isNothingBlockingShutdown() {
         return false;
     }
 
+    // If we have messages batched up that haven't been sent yet, not done
+    if (!_peerBatches.empty()) {
+        return false;
+    }
+
     return true;
 }
 
@@ -252,8 +275,8 @@ void SQLiteNode::escalateCommand(SQLiteCommand&& command) {
     command.escalationTimeUS = STimeNow();
     _escalatedCommandMap.emplace(command.id, move(command));
 
-    // And send to master.
-    _sendToPeer(_masterPeer, escalate);
+    // And send to master, along with anything else escalated before we next poll.
+    _queueToPeer(_masterPeer, escalate);
 }
 
 list<string> SQLiteNode::getEscalatedCommandRequestMethodLines() {
@@ -1038,6 +1061,17 @@ void SQLiteNode::_onMESSAGE(Peer* peer, const SData& message) {
     (*peer)["CommitCount"] = message["CommitCount"];
     (*peer)["Hash"] = message["Hash"];
 
+    // Every message from the master tells us how far ahead of us it is, which is how we measure replication lag.
+    if (_state == SLAVING && peer == _masterPeer) {
+        uint64_t masterCommitCount = message.calcU64("CommitCount");
+        lock_guard<mutex> lock(_masterCommitsMutex);
+        if (masterCommitCount > _db.getCommitCount() &&
+            (_masterCommits.empty() || masterCommitCount > _masterCommits.back().first)) {
+            _masterCommits.emplace_back(masterCommitCount, STimeNow());
+        }
+        _trimMasterCommits();
+    }
+
     // Classify and process the message
     if (SIEquals(message.methodLine, "LOGIN")) {
         // LOGIN: This is the first message sent to and received from a new peer. It communicates the current state of
@@ -1069,6 +1103,17 @@ void SQLiteNode::_onMESSAGE(Peer* peer, const SData& message) {
         peer->set("State",    message["State"]);
         peer->set("LoggedIn", "true");
         peer->set("Version",  message["Version"]);
+
+        // Older peers don't send this, and so never receive compressed messages from us.
+        if (SIEquals(message["Compression"], "deflate")) {
+            peer->set("Compression", "deflate");
+        }
+        if (SIEquals(message["Framing"], "binary")) {
+            peer->set("Framing", "binary");
+        }
+        if (SIEquals(message["Batching"], "true")) {
+            peer->set("Batching", "true");
+        }
     } else if (!SIEquals((*peer)["LoggedIn"], "true")) {
         throw "not logged in";
     }
@@ -1384,6 +1429,34 @@ void SQLiteNode::_onMESSAGE(Peer* peer, const SData& message) {
             _changeState(SEARCHING);
             throw e;
         }
+    } else if (SIEquals(message.methodLine, "BEGIN_TRANSACTION") && _applier && SStartsWith(message["ID"], "ASYNC_")) {
+        // BEGIN_TRANSACTION for an ASYNC command, with an applier: nobody is waiting on our approval of these, so
+        // rather than beginning the transaction here, we hold on to it until the master commits it, and then hand it
+        // off to the applier. That lets us keep reading from the master while earlier transactions are applied.
+        if (!message.isSet("NewCount")) {
+            throw "missing NewCount";
+        }
+        if (!message.isSet("NewHash")) {
+            throw "missing NewHash";
+        }
+        if (_state != SLAVING) {
+            throw "not slaving";
+        }
+        if (!_masterPeer) {
+            throw "no master?";
+        }
+        if (!_db.getUncommittedHash().empty() || !_pendingAsyncTransaction.empty()) {
+            throw "already in a transaction";
+        }
+        if (_applier->failed()) {
+            throw "parallel apply failed";
+        }
+        uint64_t expectedCount = max(_db.getCommitCount(), _applier->getLastQueuedCommitCount()) + 1;
+        if (expectedCount != message.calcU64("NewCount")) {
+            throw "commit count mismatch. Expected: " + message["NewCount"] + ", but would actually be: "
+                  + to_string(expectedCount);
+        }
+        _pendingAsyncTransaction = message;
     } else if (SIEquals(message.methodLine, "BEGIN_TRANSACTION")) {
         // BEGIN_TRANSACTION: Sent by the MASTER to all subscribed slaves to begin a new distributed transaction. Each
         // slave begins a local transaction with this query and responds APPROVE_TRANSACTION. If the slave cannot start
@@ -1406,9 +1479,14 @@ void SQLiteNode::_onMESSAGE(Peer* peer, const SData& message) {
         if (!_masterPeer) {
             throw "no master?";
         }
-        if (!_db.getUncommittedHash().empty()) {
+        if (!_db.getUncommittedHash().empty() || !_pendingAsyncTransaction.empty()) {
             throw "already in a transaction";
         }
+
+        // We apply this one ourselves, so anything the applier is still working on has to be committed first.
+        if (!_drainApplier()) {
+            throw "parallel apply failed";
+        }
         if (_db.getCommitCount() + 1 != message.calcU64("NewCount")) {
             throw "commit count mismatch. Expected: " + message["NewCount"] + ", but would actually be: " + to_string(_db.getCommitCount() + 1);
         }
@@ -1520,6 +1598,24 @@ void SQLiteNode::_onMESSAGE(Peer* peer, const SData& message) {
                   << message.calc("NewCount") << " (" << message["NewHash"] << ", " << message["ID"] << ") but '" << e
                   << "', ignoring.");
         }
+    } else if (SIEquals(message.methodLine, "COMMIT_TRANSACTION") && !_pendingAsyncTransaction.empty()) {
+        // COMMIT_TRANSACTION for a transaction we're going to hand to the applier.
+        if (_state != SLAVING) {
+            throw "not slaving";
+        }
+        if (message["CommitCount"] != _pendingAsyncTransaction["NewCount"]) {
+            throw "commit count mismatch. Expected: " + message["CommitCount"] + ", but would actually be: "
+                  + _pendingAsyncTransaction["NewCount"];
+        }
+        if (message["Hash"] != _pendingAsyncTransaction["NewHash"]) {
+            throw "hash mismatch";
+        }
+        if (_applier->failed()) {
+            throw "parallel apply failed";
+        }
+        PINFO("Queuing transaction #" << message["CommitCount"] << " (" << message["Hash"] << ") for parallel apply.");
+        _applier->enqueue(message.calcU64("CommitCount"), _pendingAsyncTransaction.content, message["Hash"]);
+        _pendingAsyncTransaction.clear();
     } else if (SIEquals(message.methodLine, "COMMIT_TRANSACTION")) {
         // COMMIT_TRANSACTION: Sent to all subscribed slaves by the master when it determines that the current
         // outstanding transaction should be committed to the database. This completes a given distributed transaction.
@@ -1561,6 +1657,14 @@ void SQLiteNode::_onMESSAGE(Peer* peer, const SData& message) {
             SINFO("Master has committed in response to our command " << message["ID"]);
             commandIt->second.transaction = message;
         }
+    } else if (SIEquals(message.methodLine, "ROLLBACK_TRANSACTION") && !_pendingAsyncTransaction.empty()) {
+        // ROLLBACK_TRANSACTION for a transaction we were holding for the applier. We never started it, so there's
+        // nothing to roll back.
+        if (_state != SLAVING) {
+            throw "not slaving";
+        }
+        PINFO("Discarding ASYNC transaction #" << _pendingAsyncTransaction["NewCount"] << " rolled back by master.");
+        _pendingAsyncTransaction.clear();
     } else if (SIEquals(message.methodLine, "ROLLBACK_TRANSACTION")) {
         // ROLLBACK_TRANSACTION: Sent to all subscribed slaves by the master when it determines that the current
         // outstanding transaction should be rolled back. This completes a given distributed transaction.
@@ -1583,6 +1687,24 @@ void SQLiteNode::_onMESSAGE(Peer* peer, const SData& message) {
             SINFO("Master has rolled back in response to our command " << message["ID"]);
             commandIt->second.transaction = message;
         }
+    } else if (SIEquals(message.methodLine, "BATCH")) {
+        // BATCH: Several messages to the same peer, coalesced into one to save on per-message overhead. Currently
+        // these are ESCALATEs from a slave, or ESCALATE_RESPONSEs from the master. Each is handled in order, exactly
+        // as if it had arrived on its own, with the CommitCount and Hash of the BATCH.
+        const char* data = message.content.data();
+        size_t remaining = message.content.size();
+        while (remaining) {
+            SData batched;
+            int consumed = batched.deserialize(data, remaining);
+            if (!consumed) {
+                throw "malformed batch";
+            }
+            batched["CommitCount"] = message["CommitCount"];
+            batched["Hash"] = message["Hash"];
+            _onMESSAGE(peer, batched);
+            data += consumed;
+            remaining -= consumed;
+        }
     } else if (SIEquals(message.methodLine, "ESCALATE")) {
         // ESCALATE: Sent to the master by a slave. Is processed like a normal command, except when complete an
         // ESCALATE_RESPONSE is sent to the slave that initiated the escalation.
@@ -1713,6 +1835,15 @@ void SQLiteNode::_onConnect(Peer* peer) {
     login["Priority"] = to_string(_priority);
     login["State"] = stateNames[_state];
     login["Version"] = _version;
+
+    // Advertise that we can inflate compressed content. Whether we compress what we send is up to our own config.
+    login["Compression"] = "deflate";
+
+    // Likewise, we can parse binary frames. Once we've seen the peer's LOGIN say the same, that's all we send it.
+    login["Framing"] = "binary";
+
+    // And we can unpack BATCH messages.
+    login["Batching"] = "true";
     _sendToPeer(peer, login);
 }
 
@@ -1733,8 +1864,24 @@ void SQLiteNode::_onDisconnect(Peer* peer) {
     ///   is out of touch with reality: we processed a command and reality doesn't
     ///   know it.  Not cool!
     ///
-    if (peer->s && peer->s->sendBuffer.find("ESCALATE_RESPONSE") != string::npos)
-        PWARN("Initiating slave died before receiving response to escalation: " << peer->s->sendBuffer);
+    auto unsentIt = _unsentEscalateResponses.find(peer);
+    if (unsentIt != _unsentEscalateResponses.end()) {
+        for (auto& response : unsentIt->second) {
+            if (!peer->s || response.second > peer->s->sendBuffer.consumed()) {
+                PWARN("Initiating slave died before receiving response to escalation " << response.first);
+            }
+        }
+        _unsentEscalateResponses.erase(unsentIt);
+    }
+    auto batchIt = _peerBatches.find(peer);
+    if (batchIt != _peerBatches.end()) {
+        for (auto& message : batchIt->second) {
+            if (SIEquals(message.methodLine, "ESCALATE_RESPONSE")) {
+                PWARN("Initiating slave died before we sent response to escalation " << message["ID"]);
+            }
+        }
+        _peerBatches.erase(batchIt);
+    }
 
     /// - Verify we didn't just lose contact with our master.  This should
     ///   only be possible if we're SUBSCRIBING or SLAVING.  If we did lose our
@@ -1785,43 +1932,245 @@ void SQLiteNode::_onDisconnect(Peer* peer) {
     }
 }
 
+void SQLiteNode::_queueToPeer(Peer* peer, const SData& message) {
+    if (!_peerWantsBatching(peer)) {
+        _sendToPeer(peer, message);
+        _trackEscalateResponses(peer, {message});
+        return;
+    }
+    _peerBatches[peer].push_back(message);
+}
+
+void SQLiteNode::_flushBatch(Peer* peer) {
+    auto batchIt = _peerBatches.find(peer);
+    if (batchIt == _peerBatches.end()) {
+        return;
+    }
+
+    // Take the messages out before sending, as `_sendToPeer` flushes the batch itself.
+    list<SData> messages = move(batchIt->second);
+    _peerBatches.erase(batchIt);
+    if (messages.size() == 1) {
+        _sendToPeer(peer, messages.front());
+    } else {
+        SData batch("BATCH");
+        for (const SData& message : messages) {
+            batch.content += message.serialize();
+        }
+        PDEBUG("Sending BATCH of " << messages.size() << " messages.");
+        _sendToPeer(peer, batch);
+    }
+    _trackEscalateResponses(peer, messages);
+}
+
+void SQLiteNode::_trackEscalateResponses(Peer* peer, const list<SData>& messages) {
+    if (!peer->s) {
+        return;
+    }
+    auto& unsent = _unsentEscalateResponses[peer];
+
+    // Forget the ones the socket's sent since we last looked.
+    const SBuffer& sendBuffer = peer->s->sendBuffer;
+    while (!unsent.empty() && unsent.front().second <= sendBuffer.consumed()) {
+        unsent.pop_front();
+    }
+
+    // Everything we just sent is in the buffer up to its current end.
+    for (const SData& message : messages) {
+        if (SIEquals(message.methodLine, "ESCALATE_RESPONSE")) {
+            unsent.emplace_back(message["ID"], sendBuffer.consumed() + sendBuffer.size());
+        }
+    }
+    if (unsent.empty()) {
+        _unsentEscalateResponses.erase(peer);
+    }
+}
+
 void SQLiteNode::_sendToPeer(Peer* peer, const SData& message) {
     SASSERT(peer);
     SASSERT(!message.empty());
 
+    // Anything we've batched for this peer has to go first.
+    _flushBatch(peer);
+
     // If a peer is currently disconnected, we can't send it a message.
     if (!peer->s) {
         PWARN("Can't send message to peer, no socket. Message '" << message.methodLine << "' will be discarded.");
         return;
     }
-    // Piggyback on whatever we're sending to add the CommitCount/Hash
-    SData messageCopy = message;
-    messageCopy["CommitCount"] = to_string(_db.getCommitCount());
-    messageCopy["Hash"] = _db.getCommittedHash();
-    peer->s->send(messageCopy.serialize());
+
+    // We may need to add CommitCount/Hash or Content-Encoding headers, so we copy those, but the content, which can be
+    // large (a SYNCHRONIZE_RESPONSE, for instance), is used straight from the original message. The copy is an
+    // SHeaderTable, which is a single allocation rather than one per header.
+    SHeaderTable headers(message.nameValueMap);
+    const string* content = &message.content;
+    string deflated;
+    if (_peerWantsCompression(peer)) {
+        deflated = _deflateContent(message.content);
+        if (!deflated.empty()) {
+            headers[SHeaderTable::CONTENT_ENCODING] = "deflate";
+            peer->compressedBytesSent += deflated.size();
+            peer->uncompressedBytesSent += message.content.size();
+            content = &deflated;
+        }
+    }
+    string serialized;
+    if (_peerWantsBinaryFraming(peer)) {
+        // Binary frames carry CommitCount/Hash as fixed fields.
+        serialized = serializeFrame(message.methodLine, headers, *content, _db.getCommitCount(),
+                                    _db.getCommittedHash());
+    }
+    if (serialized.empty()) {
+        // Either the peer wants text or the message doesn't fit in a frame. Piggyback on whatever we're sending to add
+        // the CommitCount/Hash.
+        headers[SHeaderTable::COMMIT_COUNT] = to_string(_db.getCommitCount());
+        headers[SHeaderTable::HASH] = _db.getCommittedHash();
+        serialized = SComposeHTTP(message.methodLine, headers, *content);
+    }
+
+    // The socket holds on to the serialized message itself, rather than copying it into its send buffer.
+    peer->s->send(SMakeSharedMessage(move(serialized)));
 }
 
 void SQLiteNode::_sendToAllPeers(const SData& message, bool subscribedOnly) {
-    // Piggyback on whatever we're sending to add the CommitCount/Hash, but only serialize once before broadcasting.
-    SData messageCopy = message;
-    if (!messageCopy.isSet("CommitCount")) {
-        messageCopy["CommitCount"] = SToStr(_db.getCommitCount());
+    // Anything we've batched has to go first.
+    while (!_peerBatches.empty()) {
+        _flushBatch(_peerBatches.begin()->first);
     }
-    if (!messageCopy.isSet("Hash")) {
-        messageCopy["Hash"] = _db.getCommittedHash();
+
+    // Piggyback on whatever we're sending to add the CommitCount/Hash. As in `_sendToPeer`, we only copy the headers.
+    SHeaderTable headers(message.nameValueMap);
+    if (headers.find(SHeaderTable::COMMIT_COUNT) == headers.end()) {
+        headers[SHeaderTable::COMMIT_COUNT] = SToStr(_db.getCommitCount());
+    }
+    if (headers.find(SHeaderTable::HASH) == headers.end()) {
+        headers[SHeaderTable::HASH] = _db.getCommittedHash();
     }
-    const string& serializedMessage = messageCopy.serialize();
+
+    // Depending on what each peer negotiated, it gets the message as text or as a binary frame, and with or without
+    // deflated content. Each of those encodings is built at most once, the first time a peer needs it, and then shared
+    // by every peer that gets it, so a broadcast costs the same however many peers there are.
+    bool deflateAttempted = false;
+    string deflated;
+    SHeaderTable compressedHeaders;
+    SSharedMessage encodings[2][2];
 
     // Loop across all connected peers and send the message
     for (auto peer : peerList) {
         // Send either to everybody, or just subscribed peers.
         if (peer->s && (!subscribedOnly || SIEquals((*peer)["Subscribed"], "true"))) {
+            bool compressed = false;
+            if (_peerWantsCompression(peer)) {
+                if (!deflateAttempted) {
+                    deflateAttempted = true;
+                    deflated = _deflateContent(message.content);
+                    compressedHeaders = headers;
+                    compressedHeaders[SHeaderTable::CONTENT_ENCODING] = "deflate";
+                }
+                compressed = !deflated.empty();
+            }
+            const bool binary = _peerWantsBinaryFraming(peer);
+            SSharedMessage& encoded = encodings[compressed][binary];
+            if (!encoded) {
+                const SHeaderTable& source = compressed ? compressedHeaders : headers;
+                const string& content = compressed ? deflated : message.content;
+                string serialized;
+                if (binary) {
+                    serialized = serializeFrame(message.methodLine, source, content, source.calcU64("CommitCount"),
+                                                source["Hash"]);
+                }
+                if (serialized.empty()) {
+                    // Anything that doesn't fit in a frame goes as text, which binary peers can read as well.
+                    serialized = SComposeHTTP(message.methodLine, source, content);
+                }
+                encoded = SMakeSharedMessage(move(serialized));
+            }
+            if (compressed) {
+                peer->compressedBytesSent += deflated.size();
+                peer->uncompressedBytesSent += message.content.size();
+            }
+
             // Send it now, without waiting for the outer event loop
-            peer->s->send(serializedMessage);
+            peer->s->send(encoded);
         }
     }
 }
 
+bool SQLiteNode::_peerWantsBinaryFraming(Peer* peer) {
+    return SIEquals((*peer)["Framing"], "binary");
+}
+
+bool SQLiteNode::_peerWantsBatching(Peer* peer) {
+    return SIEquals((*peer)["Batching"], "true");
+}
+
+void SQLiteNode::getReplicationLag(uint64_t& commits, uint64_t& ms) {
+    lock_guard<mutex> lock(_masterCommitsMutex);
+    _trimMasterCommits();
+    commits = 0;
+    ms = 0;
+    if (!_masterCommits.empty()) {
+        commits = _masterCommits.back().first - _db.getCommitCount();
+        ms = (STimeNow() - _masterCommits.front().second) / STIME_US_PER_MS;
+    }
+}
+
+uint64_t SQLiteNode::getStalenessBoundCommitCount(uint64_t asOf, uint64_t maxCommits, uint64_t maxMS) {
+    lock_guard<mutex> lock(_masterCommitsMutex);
+    _trimMasterCommits();
+
+    // We need everything the master had `maxMS` before `asOf`, and everything but the last `maxCommits` commits of
+    // what it had at `asOf`. Anything we've already dropped from the front we've committed, so it doesn't matter.
+    uint64_t cutoff = maxMS < asOf / STIME_US_PER_MS ? asOf - maxMS * STIME_US_PER_MS : 0;
+    uint64_t required = 0;
+    for (auto& entry : _masterCommits) {
+        if (entry.second > asOf) {
+            break;
+        }
+        if (entry.second <= cutoff) {
+            required = max(required, entry.first);
+        }
+        if (entry.first > maxCommits) {
+            required = max(required, entry.first - maxCommits);
+        }
+    }
+    return required;
+}
+
+void SQLiteNode::_trimMasterCommits() {
+    // Must be called with _masterCommitsMutex held.
+    uint64_t commitCount = _db.getCommitCount();
+    while (!_masterCommits.empty() && _masterCommits.front().first <= commitCount) {
+        _masterCommits.pop_front();
+    }
+}
+
+bool SQLiteNode::_drainApplier() {
+    if (!_applier) {
+        return true;
+    }
+    uint64_t start = STimeNow();
+    bool success = _applier->drain();
+    SDEBUG("Drained applier in " << (STimeNow() - start) / STIME_US_PER_MS << "ms.");
+    return success;
+}
+
+bool SQLiteNode::_peerWantsCompression(Peer* peer) {
+    return _compressionLevel && SIEquals((*peer)["Compression"], "deflate");
+}
+
+string SQLiteNode::_deflateContent(const string& content) {
+    // Returns a smaller, deflated version of `content`, or an empty string if it's not worth sending one.
+    if (content.size() < SQL_NODE_COMPRESSION_THRESHOLD) {
+        return "";
+    }
+    string deflated = SDeflate(content, _compressionLevel);
+    if (deflated.size() >= content.size()) {
+        return "";
+    }
+    return deflated;
+}
+
 void SQLiteNode::_changeState(SQLiteNode::State newState) {
     SAUTOLOCK(stateMutex);
 
@@ -1860,6 +2209,24 @@ void SQLiteNode::_changeState(SQLiteNode::State newState) {
             }
         }
 
+        // If we're no longer slaving, let the applier finish what the master has already committed, and drop anything
+        // it hasn't.
+        if (_state == SLAVING) {
+            if (!_pendingAsyncTransaction.empty()) {
+                SINFO("Leaving SLAVING with uncommitted ASYNC transaction #" << _pendingAsyncTransaction["NewCount"]
+                      << ", discarding.");
+                _pendingAsyncTransaction.clear();
+            }
+            if (!_drainApplier()) {
+                SWARN("Failed to apply replicated transactions while leaving SLAVING, will resynchronize.");
+            }
+        }
+
+        if (_state == SLAVING) {
+            lock_guard<mutex> lock(_masterCommitsMutex);
+            _masterCommits.clear();
+        }
+
         // Clear some state if we can
         if (newState < SUBSCRIBING) {
             // We're no longer SUBSCRIBING or SLAVING, so we have no master
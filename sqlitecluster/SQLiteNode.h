@@ -1,5 +1,6 @@
 #pragma once
 #include "SQLite.h"
+#include "SQLiteApplier.h"
 class SQLiteCommand;
 class SQLiteServer;
 
@@ -15,6 +16,9 @@ class SQLiteNode : public STCPNode {
     // Separate timeout for receiving and applying synchronization commits.
     static const uint64_t SQL_NODE_SYNCHRONIZING_RECV_TIMEOUT;
 
+    // Messages with less content than this are never compressed, the headers dominate and it's not worth the CPU.
+    static const size_t SQL_NODE_COMPRESSION_THRESHOLD;
+
     // Possible states of a node in a DB cluster
     enum State {
         SEARCHING,     // Searching for peers
@@ -49,7 +53,8 @@ class SQLiteNode : public STCPNode {
 
     // Constructor/Destructor
     SQLiteNode(SQLiteServer& server, SQLite& db, const string& name, const string& host, const string& peerList,
-               int priority, uint64_t firstTimeout, const string& version, int quorumCheckpoint = 0);
+               int priority, uint64_t firstTimeout, const string& version, int quorumCheckpoint = 0,
+               int compressionLevel = 0);
     ~SQLiteNode();
 
     // Simple Getters. See property definitions for details.
@@ -59,6 +64,21 @@ class SQLiteNode : public STCPNode {
     const string& getVersion()       { return _version; }
     uint64_t      getCommitCount()   { return _db.getCommitCount(); }
 
+    // If set, ASYNC transactions replicated from the master are handed to this applier to be committed in parallel,
+    // rather than being committed by this node, one at a time. The node doesn't take ownership of it.
+    void setApplier(SQLiteApplier* applier) { _applier = applier; }
+    SQLiteApplier* getApplier() { return _applier; }
+
+    // While SLAVING, returns how many commits the master has told us about that we haven't committed yet, and how long
+    // ago (in ms) we first heard about the oldest of them. Both are 0 when we're caught up, or not slaving. These, and
+    // `getStalenessBoundCommitCount`, are safe to call from any thread.
+    void getReplicationLag(uint64_t& commits, uint64_t& ms);
+
+    // Returns the commit count our database needs to reach to serve a read that arrived at `asOf` (a STimeNow()
+    // timestamp) with no more than `maxCommits` commits or `maxMS` milliseconds of replication lag. The answer
+    // doesn't change as newer commits arrive from the master, so it can be waited on like a request's `commitCount`.
+    uint64_t getStalenessBoundCommitCount(uint64_t asOf, uint64_t maxCommits, uint64_t maxMS);
+
     // Returns whether we're in the process of gracefully shutting down.
     bool gracefulShutdown() { return (_gracefulShutdownTimeout.alarmDuration != 0); }
 
@@ -76,6 +96,10 @@ class SQLiteNode : public STCPNode {
     // Call this to check if the node's completed shutting down.
     bool shutdownComplete();
 
+    // Sends any messages we've batched up for peers, and then prepares our sockets for `poll`, as in STCPNode.
+    void prePoll(fd_map& fdm);
+    void prePoll(SEventLoop& loop);
+
     // Updates the internal state machine. Returns true if it wants immediate re-updating. Returns false to indicate it
     // would be a good idea for the caller to read any new commands or traffic from the network.
     bool update();
@@ -163,9 +187,45 @@ class SQLiteNode : public STCPNode {
     // The number of commits we've actually done since the last quorum command.
     int _commitsSinceCheckpoint;
 
+    // zlib level used to deflate message content sent to peers that advertised `Compression: deflate` in their LOGIN.
+    // 0 disables compression of outgoing messages; we can always inflate what peers send us.
+    int _compressionLevel;
+
+    // Applies ASYNC transactions in parallel while we're slaving, if set. See `setApplier`.
+    SQLiteApplier* _applier;
+
+    // An ASYNC BEGIN_TRANSACTION that we've received while slaving, that will be handed to `_applier` when its
+    // COMMIT_TRANSACTION arrives.
+    SData _pendingAsyncTransaction;
+
+    // Commit counts the master has sent us while we're slaving, with the time we first saw each one, oldest first.
+    // Entries we've committed are dropped, so the front is the oldest commit we're still missing.
+    deque<pair<uint64_t, uint64_t>> _masterCommits;
+    mutex _masterCommitsMutex;
+    void _trimMasterCommits();
+
+    // Waits for `_applier` to commit everything it has queued. Returns false if something failed to apply.
+    bool _drainApplier();
+
+    // Escalations and their responses for peers that advertised `Batching: true` in their LOGIN are queued here rather
+    // than sent immediately, and sent as a single BATCH message per peer the next time we `prePoll`. Anything else
+    // sent to a peer flushes its batch first, so messages are never reordered.
+    map<Peer*, list<SData>> _peerBatches;
+    void _queueToPeer(Peer* peer, const SData& message);
+    void _flushBatch(Peer* peer);
+
+    // The IDs of the ESCALATE_RESPONSEs we've handed to each peer's socket, with the send buffer's `consumed()` count
+    // at which each will have been sent, so if the peer disconnects first, we know which ones it never got.
+    map<Peer*, list<pair<string, uint64_t>>> _unsentEscalateResponses;
+    void _trackEscalateResponses(Peer* peer, const list<SData>& messages);
+
     // Helper methods
     void _sendToPeer(Peer* peer, const SData& message);
     void _sendToAllPeers(const SData& message, bool subscribedOnly = false);
+    bool _peerWantsCompression(Peer* peer);
+    bool _peerWantsBinaryFraming(Peer* peer);
+    bool _peerWantsBatching(Peer* peer);
+    string _deflateContent(const string& content);
     void _changeState(State newState);
     void _queueSynchronize(Peer* peer, SData& response, bool sendAll);
     void _recvSynchronize(Peer* peer, const SData& message);
@@ -0,0 +1,45 @@
+#include "../BedrockClusterTester.h"
+
+struct i_cacheTest : tpunit::TestFixture {
+    i_cacheTest()
+        : tpunit::TestFixture("i_cache",
+                              TEST(i_cacheTest::replicatedWrite)) { }
+
+    void writeCache(BedrockTester* brtester, const string& name, const string& value) {
+        SData command("WriteCache");
+        command["name"] = name;
+        command["value"] = value;
+        brtester->executeWaitVerifyContent(command);
+    }
+
+    // Reads `name` until it's `value`, or until a few seconds have passed, and returns what it read last.
+    string waitForValue(BedrockTester* brtester, const string& name, const string& value) {
+        SData command("ReadCache");
+        command["name"] = name;
+        string content;
+        uint64_t start = STimeNow();
+        while (STimeNow() - start < 5 * STIME_US_PER_S) {
+            SData response = brtester->executeWaitMultipleData({command}, 1).front();
+            content = response.content;
+            if (SStartsWith(response.methodLine, "200") && content == value) {
+                break;
+            }
+            usleep(100 * 1000);
+        }
+        return content;
+    }
+
+    void replicatedWrite() {
+        BedrockClusterTester* tester = BedrockClusterTester::testers.front();
+        BedrockTester* master = tester->getBedrockTester(0);
+        BedrockTester* slave = tester->getBedrockTester(1);
+
+        // Once the slave has read a value, it keeps it in memory, but drops it when a new one is replicated to it.
+        writeCache(master, "replicated", "one");
+        ASSERT_EQUAL(waitForValue(slave, "replicated", "one"), "one");
+        ASSERT_EQUAL(waitForValue(slave, "replicated", "one"), "one");
+        writeCache(master, "replicated", "two");
+        ASSERT_EQUAL(waitForValue(slave, "replicated", "two"), "two");
+    }
+
+} __i_cacheTest;
@@ -0,0 +1,67 @@
+#include "../BedrockClusterTester.h"
+
+struct j_jobWaitTest : tpunit::TestFixture {
+    j_jobWaitTest()
+        : tpunit::TestFixture("j_jobWait",
+                              TEST(j_jobWaitTest::waitOnSlave),
+                              TEST(j_jobWaitTest::escalatedWait)) { }
+
+    // Starts a waiting GetJob for `name` on `brtester`, which is answered on another thread.
+    thread waitForJob(BedrockTester* brtester, const string& name, SData& response) {
+        SData command("GetJob");
+        command["name"] = name;
+        command["Connection"] = "wait";
+        command["timeout"] = "10000";
+        return thread([brtester, command, &response]() {
+            response = brtester->executeWaitMultipleData({command}, 1).front();
+        });
+    }
+
+    void createJob(BedrockTester* brtester, const string& name) {
+        SData command("CreateJob");
+        command["name"] = name;
+        brtester->executeWaitVerifyContent(command);
+    }
+
+    void waitOnSlave() {
+        BedrockClusterTester* tester = BedrockClusterTester::testers.front();
+        BedrockTester* master = tester->getBedrockTester(0);
+        BedrockTester* slave = tester->getBedrockTester(1);
+
+        // A GetJob waiting on the slave gets a job created on the master once it's replicated.
+        SData response;
+        thread waiter = waitForJob(slave, "slaveWait", response);
+        sleep(1);
+        createJob(master, "slaveWait");
+        waiter.join();
+        ASSERT_TRUE(SStartsWith(response.methodLine, "200"));
+        ASSERT_TRUE(SContains(response.content, "slaveWait"));
+    }
+
+    void escalatedWait() {
+        BedrockClusterTester* tester = BedrockClusterTester::testers.front();
+        BedrockTester* master = tester->getBedrockTester(0);
+        BedrockTester* slave = tester->getBedrockTester(1);
+
+        // The slave sees the first job and escalates to the master, but a client of the master has probably taken it
+        // by then. Either way, the slave's request keeps waiting until there's a job for it, rather than getting a
+        // 404 from the master.
+        SData response;
+        thread waiter = waitForJob(slave, "escalatedWait", response);
+        sleep(1);
+        createJob(master, "escalatedWait");
+        SData command("GetJob");
+        command["name"] = "escalatedWait";
+        for (int i = 0; i < 100; i++) {
+            if (SStartsWith(master->executeWaitMultipleData({command}, 1).front().methodLine, "200")) {
+                break;
+            }
+        }
+        sleep(1);
+        createJob(master, "escalatedWait");
+        waiter.join();
+        ASSERT_TRUE(SStartsWith(response.methodLine, "200"));
+        ASSERT_TRUE(SContains(response.content, "escalatedWait"));
+    }
+
+} __j_jobWaitTest;
@@ -66,6 +66,9 @@ BedrockTester::BedrockTester(const map<string, string>& args, const list<string>
         {"-quorumCheckpoint", "50"},
         {"-parallelCommands", "Query,idcollision"},
         {"-cacheSize",        "1000"},
+
+        // Don't archive jobs out from under tests that look at the jobs table. ArchiveJobsTest turns it back on.
+        {"-jobs.archiveInterval", "0"},
     };
 
     // Set defaults.
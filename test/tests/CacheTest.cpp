@@ -0,0 +1,152 @@
+#include <test/lib/BedrockTester.h>
+
+struct CacheTest : tpunit::TestFixture {
+    CacheTest()
+        : tpunit::TestFixture("Cache",
+                              BEFORE_CLASS(CacheTest::setupClass),
+                              TEST(CacheTest::exactName),
+                              TEST(CacheTest::namePattern),
+                              TEST(CacheTest::missingName),
+                              TEST(CacheTest::invalidatedName),
+                              TEST(CacheTest::writtenByQuery),
+                              TEST(CacheTest::hotValues),
+                              TEST(CacheTest::filterRebuilt),
+                              AFTER(CacheTest::tearDown),
+                              AFTER_CLASS(CacheTest::tearDownClass)) { }
+
+    BedrockTester* tester;
+
+    void setupClass() { tester = new BedrockTester({{"-plugins", "Cache,DB"}}, {});}
+
+    // Empty the cache
+    void tearDown() {
+        SData command("Query");
+        command["query"] = "DELETE FROM cache;";
+        command["nowhere"] = "true";
+        tester->executeWaitVerifyContent(command);
+    }
+
+    void tearDownClass() { delete tester; }
+
+    void writeCache(const string& name, const string& value, const string& invalidateName = "") {
+        SData command("WriteCache");
+        command["name"] = name;
+        command.content = value;
+        if (!invalidateName.empty()) {
+            command["invalidateName"] = invalidateName;
+        }
+        tester->executeWaitVerifyContent(command);
+    }
+
+    SData readCache(const string& name) {
+        SData command("ReadCache");
+        command["name"] = name;
+        return tester->executeWaitMultipleData({command}, 1).front();
+    }
+
+    // Returns the Cache plugin's info from Status.
+    STable getInfo() {
+        STable status = tester->executeWaitVerifyContentTable(SData("Status"));
+        for (const string& plugin : SParseJSONArray(status["plugins"])) {
+            STable info = SParseJSONObject(plugin);
+            if (info["name"] == "Cache") {
+                return info;
+            }
+        }
+        return STable();
+    }
+
+    void exactName() {
+        const string value = "one\r\ntwo";
+        writeCache("exact", value);
+        SData response = readCache("exact");
+        ASSERT_TRUE(SStartsWith(response.methodLine, "200"));
+        ASSERT_EQUAL(response["name"], "exact");
+        ASSERT_EQUAL(response.content, value);
+        ASSERT_EQUAL(getInfo()["nameFilterHits"], "1");
+    }
+
+    void namePattern() {
+        writeCache("pattern/v1", "one");
+        SData response = readCache("pattern/*");
+        ASSERT_TRUE(SStartsWith(response.methodLine, "200"));
+        ASSERT_EQUAL(response["name"], "pattern/v1");
+        ASSERT_EQUAL(response.content, "one");
+    }
+
+    void missingName() {
+        // The name filter answers for a name that's never been written, without the database.
+        const uint64_t misses = SToUInt64(getInfo()["nameFilterDefiniteMisses"]);
+        writeCache("present", "here");
+        ASSERT_TRUE(SStartsWith(readCache("absent").methodLine, "404"));
+        STable info = getInfo();
+        ASSERT_EQUAL(SToUInt64(info["nameFilterDefiniteMisses"]), misses + 1);
+        ASSERT_EQUAL(info["nameFilterFalsePositives"], "0");
+        ASSERT_FALSE(info["nameFilterExpectedFalsePositiveRate"].empty());
+    }
+
+    void invalidatedName() {
+        // An invalidated name is still in the filter, but not in the cache.
+        const uint64_t falsePositives = SToUInt64(getInfo()["nameFilterFalsePositives"]);
+        writeCache("versioned/v1", "one");
+        writeCache("versioned/v2", "two", "versioned/*");
+        ASSERT_TRUE(SStartsWith(readCache("versioned/v1").methodLine, "404"));
+        ASSERT_EQUAL(readCache("versioned/*").content, "two");
+        ASSERT_EQUAL(SToUInt64(getInfo()["nameFilterFalsePositives"]), falsePositives + 1);
+    }
+
+    void writtenByQuery() {
+        // Names written straight into the table are added to the filter too.
+        readCache("nothing");
+        SData command("Query");
+        command["query"] = "INSERT INTO cache (name, value) VALUES ('direct', 'value');";
+        tester->executeWaitVerifyContent(command);
+        SData response = readCache("direct");
+        ASSERT_TRUE(SStartsWith(response.methodLine, "200"));
+        ASSERT_EQUAL(response.content, "value");
+    }
+
+    void hotValues() {
+        // The second read comes from memory.
+        writeCache("hot", "one");
+        ASSERT_EQUAL(readCache("hot").content, "one");
+        const uint64_t hits = SToUInt64(getInfo()["hotValueHits"]);
+        SData response = readCache("hot");
+        ASSERT_EQUAL(response["name"], "hot");
+        ASSERT_EQUAL(response.content, "one");
+        ASSERT_EQUAL(SToUInt64(getInfo()["hotValueHits"]), hits + 1);
+
+        // Until the value's written again, or changed or deleted any other way.
+        writeCache("hot", "two");
+        ASSERT_EQUAL(readCache("hot").content, "two");
+        SData command("Query");
+        command["query"] = "UPDATE cache SET value = 'three' WHERE name = 'hot';";
+        tester->executeWaitVerifyContent(command);
+        ASSERT_EQUAL(readCache("hot").content, "three");
+        writeCache("other", "value", "h*");
+        ASSERT_TRUE(SStartsWith(readCache("hot").methodLine, "404"));
+        ASSERT_EQUAL(getInfo()["hotValues"], "0");
+    }
+
+    void filterRebuilt() {
+        // Fill the filter past what it was sized for, so the next lookup builds a bigger one, from every name.
+        readCache("nothing");
+        SData command("Query");
+        command["query"] = "INSERT INTO cache (name, value) "
+                           "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 1500) "
+                           "SELECT 'bulk/' || i, 'value' FROM n;";
+        tester->executeWaitVerifyContent(command);
+        ASSERT_TRUE(SStartsWith(readCache("absent").methodLine, "404"));
+        STable info = getInfo();
+        ASSERT_EQUAL(info["nameFilterNames"], "1500");
+        ASSERT_EQUAL(info["nameFilterBytes"], SToStr((3000 * 10 + 63) / 64 * 8));
+
+        // And it still has every name.
+        for (int i = 1; i <= 1500; i += 499) {
+            SData response = readCache("bulk/" + SToStr(i));
+            ASSERT_TRUE(SStartsWith(response.methodLine, "200"));
+            ASSERT_EQUAL(response.content, "value");
+        }
+    }
+
+} __CacheTest;
@@ -0,0 +1,104 @@
+#include <zlib.h>
+#include <test/lib/BedrockTester.h>
+
+struct CompressionTest : tpunit::TestFixture {
+    CompressionTest()
+        : tpunit::TestFixture("Compression",
+                              TEST(CompressionTest::testNegotiation),
+                              TEST(CompressionTest::testOnWorkers)) { }
+
+    // Decompresses a gzip stream, returning an empty string if it isn't one.
+    string gunzip(const string& content) {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        if (inflateInit2(&stream, MAX_WBITS | 16) != Z_OK) {
+            return "";
+        }
+        stream.next_in = (Bytef*)content.data();
+        stream.avail_in = (uInt)content.size();
+        string result;
+        char buffer[16384];
+        int status = Z_OK;
+        while (status == Z_OK) {
+            stream.next_out = (Bytef*)buffer;
+            stream.avail_out = sizeof(buffer);
+            status = inflate(&stream, Z_NO_FLUSH);
+            result.append(buffer, sizeof(buffer) - stream.avail_out);
+        }
+        inflateEnd(&stream);
+        return status == Z_STREAM_END ? result : "";
+    }
+
+    // A query with a response of about `rows` * 20 bytes.
+    SData makeQuery(int rows, const string& acceptEncoding) {
+        SData query("Query");
+        // It has to start with SELECT to be peeked as a read.
+        query["query"] = "SELECT x, 'some repeated text' FROM (WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 "
+                         "FROM c LIMIT " + to_string(rows) + ") SELECT x FROM c);";
+        query["format"] = "json";
+        if (!acceptEncoding.empty()) {
+            query["Accept-Encoding"] = acceptEncoding;
+        }
+        return query;
+    }
+
+    void verifyCompression(BedrockTester& tester) {
+        // A large response is compressed for a client that accepts gzip, and not for one that doesn't.
+        vector<SData> responses = tester.executeWaitMultipleData({makeQuery(1000, "deflate, gzip;q=0.5"),
+                                                                  makeQuery(1000, "gzip;q=0"),
+                                                                  makeQuery(1000, ""),
+                                                                  makeQuery(5, "gzip")}, 1);
+        ASSERT_EQUAL(responses.size(), 4);
+        for (const SData& response : responses) {
+            ASSERT_TRUE(SStartsWith(response.methodLine, "200"));
+        }
+        ASSERT_EQUAL(responses[0]["Content-Encoding"], "gzip");
+        string uncompressed = gunzip(responses[0].content);
+        ASSERT_TRUE(responses[0].content.size() < uncompressed.size());
+        ASSERT_EQUAL(uncompressed, responses[1].content);
+        ASSERT_TRUE(SContains(uncompressed, "some repeated text"));
+
+        // Nor is anything for a client that doesn't accept it, or a response that's under the minimum size.
+        for (size_t i = 1; i < responses.size(); i++) {
+            ASSERT_FALSE(responses[i].isSet("Content-Encoding"));
+        }
+    }
+
+    void testNegotiation() {
+        BedrockTester tester({{"-responseCompression", "6"}, {"-responseCompressionMinSize", "1000"}}, {});
+        verifyCompression(tester);
+    }
+
+    void testOnWorkers() {
+        // Writes are only committed on the sync thread without multi-write.
+        BedrockTester tester({{"-plugins", "Jobs,DB"}, {"-responseCompression", "1"},
+                              {"-responseCompressionMinSize", "1000"}, {"-compressOnWorkers", ""},
+                              {"-ioThreads", "2"}, {"-enableMultiWrite", "false"}}, {});
+        verifyCompression(tester);
+
+        // A read-only Query is answered by the worker that ran it, but GetJob has to be committed on the sync thread,
+        // which hands its response back to a worker to compress.
+        string text;
+        for (int i = 0; i < 100; i++) {
+            text += "some repeated text ";
+        }
+        const string data = "{\"text\":\"" + text + "\"}";
+        SData command("CreateJob");
+        command["name"] = "compressed";
+        command["data"] = data;
+        tester.executeWaitVerifyContent(command);
+        const uint64_t before = SToUInt64(tester.executeWaitVerifyContentTable(SData("Status"))
+                                          ["responsesCompressedOnWorkers"]);
+        command.clear();
+        command.methodLine = "GetJob";
+        command["name"] = "compressed";
+        command["Accept-Encoding"] = "gzip";
+        SData response = tester.executeWaitMultipleData({command}, 1).front();
+        ASSERT_TRUE(SStartsWith(response.methodLine, "200"));
+        ASSERT_EQUAL(response["Content-Encoding"], "gzip");
+        ASSERT_EQUAL(SParseJSONObject(gunzip(response.content))["data"], data);
+        ASSERT_EQUAL(SToUInt64(tester.executeWaitVerifyContentTable(SData("Status"))["responsesCompressedOnWorkers"]),
+                     before + 1);
+    }
+
+} __CompressionTest;
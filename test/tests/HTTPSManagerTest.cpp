@@ -0,0 +1,164 @@
+#include <libstuff/libstuff.h>
+#include <test/lib/BedrockTester.h>
+
+struct HTTPSManagerTest : tpunit::TestFixture {
+    HTTPSManagerTest()
+        : tpunit::TestFixture("HTTPSManager",
+                              TEST(HTTPSManagerTest::testConnectionReuse),
+                              TEST(HTTPSManagerTest::testConnectionClose),
+                              TEST(HTTPSManagerTest::testIdleConnectionClosed),
+                              TEST(HTTPSManagerTest::testIdleConnectionClosedPOST),
+                              TEST(HTTPSManagerTest::testIdleLimits)) { }
+
+    // A local stand-in for a remote server. It answers every request with a short `200 OK`, and closes the connection
+    // after it if `closeConnections` is set.
+    struct TestServer : public STCPServer {
+        TestServer() : STCPServer("127.0.0.1:19876"), closeConnections(false), requests(0) { }
+        bool closeConnections;
+        int requests;
+
+        void handleRequests() {
+            while (acceptSocket()) { }
+            for (auto it = socketList.begin(); it != socketList.end();) {
+                Socket* s = *it++;
+                SData request;
+                while (s->state == Socket::CONNECTED && s->httpParser.parse(s->recvBuffer, request)) {
+                    requests++;
+                    s->send(string("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n") +
+                            (closeConnections ? "Connection: close\r\n" : "") + "\r\nOK");
+                    if (closeConnections) {
+                        shutdownSocket(s);
+                    }
+                }
+                if (s->state == Socket::CLOSED) {
+                    closeSocket(s);
+                }
+            }
+        }
+
+        // Closes every connection, as a server does with ones that have been idle too long.
+        void closeAll() {
+            while (!socketList.empty()) {
+                closeSocket(socketList.front());
+            }
+        }
+    };
+
+    // Polls both ends until `t` has a response, or until `timeout` passes if there's no transaction to wait for.
+    void poll(TestHTTPS& https, TestServer& server, SHTTPSManager::Transaction* t, uint64_t timeout = STIME_US_PER_S) {
+        uint64_t stop = STimeNow() + timeout;
+        while ((!t || !t->response) && STimeNow() < stop) {
+            fd_map fdm;
+            https.prePoll(fdm);
+            server.prePoll(fdm);
+            S_poll(fdm, STIME_US_PER_MS * 10);
+            uint64_t nextActivity = STimeNow() + STIME_US_PER_S;
+            server.postPoll(fdm);
+            server.handleRequests();
+            https.postPoll(fdm, nextActivity);
+        }
+    }
+
+    // Sends a request to the test server, waits for the response, and closes the transaction.
+    void sendAndClose(TestHTTPS& https, TestServer& server) {
+        SData request("GET / HTTP/1.1");
+        request["Host"] = "127.0.0.1";
+        SHTTPSManager::Transaction* t = https.sendRequest("http://127.0.0.1:19876/", request);
+        poll(https, server, t);
+        ASSERT_EQUAL(t->response, 200);
+        ASSERT_EQUAL(t->fullResponse.content, "OK");
+        https.closeTransaction(t);
+    }
+
+    void testConnectionReuse() {
+        TestServer server;
+        TestHTTPS https;
+        for (int i = 0; i < 10; i++) {
+            sendAndClose(https, server);
+        }
+        ASSERT_EQUAL(server.requests, 10);
+        ASSERT_EQUAL(https.connectionsOpened.load(), 1);
+        ASSERT_EQUAL(https.connectionsReused.load(), 9);
+
+        // The counters are reported for Status.
+        STable info;
+        https.getPoolInfo(info);
+        ASSERT_EQUAL(info["httpsConnectionsReused"], "9");
+        ASSERT_EQUAL(info["httpsIdleConnections"], "1");
+    }
+
+    void testConnectionClose() {
+        // If the server closes the connection, we don't reuse it.
+        TestServer server;
+        server.closeConnections = true;
+        TestHTTPS https;
+        for (int i = 0; i < 3; i++) {
+            sendAndClose(https, server);
+        }
+        ASSERT_EQUAL(https.connectionsOpened.load(), 3);
+        ASSERT_EQUAL(https.connectionsReused.load(), 0);
+    }
+
+    void testIdleConnectionClosed() {
+        // If the server closes an idle connection just as we send a request on it, the request is sent again on a new
+        // connection, rather than failing.
+        TestServer server;
+        TestHTTPS https;
+        sendAndClose(https, server);
+        server.closeAll();
+        sendAndClose(https, server);
+        ASSERT_EQUAL(server.requests, 2);
+        ASSERT_EQUAL(https.connectionsReused.load(), 1);
+        ASSERT_EQUAL(https.connectionsRetried.load(), 1);
+        ASSERT_EQUAL(https.connectionsOpened.load(), 2);
+    }
+
+    void testIdleConnectionClosedPOST() {
+        // A POST isn't sent again, as the server may have processed it before closing the connection.
+        TestServer server;
+        TestHTTPS https;
+        sendAndClose(https, server);
+        server.closeAll();
+        SData request("POST / HTTP/1.1");
+        request["Host"] = "127.0.0.1";
+        request.content = "{}";
+        SHTTPSManager::Transaction* t = https.sendRequest("http://127.0.0.1:19876/", request);
+        poll(https, server, t);
+        ASSERT_EQUAL(t->response, 501);
+        https.closeTransaction(t);
+        ASSERT_EQUAL(server.requests, 1);
+        ASSERT_EQUAL(https.connectionsReused.load(), 1);
+        ASSERT_EQUAL(https.connectionsRetried.load(), 0);
+    }
+
+    void testIdleLimits() {
+        TestServer server;
+        TestHTTPS https;
+        https.maxIdleConnectionsPerHost = 2;
+        https.idleConnectionTimeout = STIME_US_PER_MS * 200;
+
+        // Three requests at once need three connections, but only two are kept once they're done.
+        SData request("GET / HTTP/1.1");
+        request["Host"] = "127.0.0.1";
+        list<SHTTPSManager::Transaction*> transactions;
+        for (int i = 0; i < 3; i++) {
+            transactions.push_back(https.sendRequest("http://127.0.0.1:19876/", request));
+        }
+        for (auto t : transactions) {
+            poll(https, server, t);
+            ASSERT_EQUAL(t->response, 200);
+        }
+        for (auto t : transactions) {
+            https.closeTransaction(t);
+        }
+        ASSERT_EQUAL(https.connectionsOpened.load(), 3);
+        ASSERT_EQUAL(https.idleConnectionsClosed.load(), 1);
+
+        // After the idle timeout, the other two are closed as well, and the next request opens a new connection.
+        poll(https, server, nullptr, STIME_US_PER_MS * 300);
+        ASSERT_EQUAL(https.idleConnectionsClosed.load(), 3);
+        sendAndClose(https, server);
+        ASSERT_EQUAL(https.connectionsOpened.load(), 4);
+        ASSERT_EQUAL(https.connectionsReused.load(), 0);
+    }
+} __HTTPSManagerTest;
@@ -0,0 +1,41 @@
+#include <test/lib/BedrockTester.h>
+
+struct IOThreadsTest : tpunit::TestFixture {
+    IOThreadsTest()
+        : tpunit::TestFixture("IOThreads",
+                              BEFORE_CLASS(IOThreadsTest::setup),
+                              TEST(IOThreadsTest::test),
+                              AFTER_CLASS(IOThreadsTest::tearDown)) { }
+
+    BedrockTester* tester;
+
+    void setup() { tester = new BedrockTester({{"-ioThreads", "3"}}, {}); }
+
+    void tearDown() { delete tester; }
+
+    void test() {
+        // A mix of requests that are handled by workers and ones that are handed back to the main thread, spread
+        // across enough connections that every IO thread gets some.
+        vector<SData> requests;
+        for (int i = 0; i < 300; i++) {
+            SData request(i % 3 ? "Ping" : "Status");
+            if (i % 5 == 0) {
+                request.methodLine = "Query";
+                request["query"] = "SELECT " + to_string(i) + ";";
+                request["format"] = "json";
+            }
+            requests.push_back(request);
+        }
+        vector<SData> responses = tester->executeWaitMultipleData(requests, 12);
+        ASSERT_EQUAL(responses.size(), requests.size());
+        for (size_t i = 0; i < responses.size(); i++) {
+            ASSERT_TRUE(SStartsWith(responses[i].methodLine, "200"));
+            if (requests[i].methodLine == "Query") {
+                ASSERT_TRUE(SContains(responses[i].content, to_string(i)));
+            } else if (requests[i].methodLine == "Status") {
+                ASSERT_TRUE(SContains(responses[i].content, "plugins"));
+            }
+        }
+    }
+
+} __IOThreadsTest;
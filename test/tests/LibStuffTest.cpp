@@ -14,6 +14,12 @@ struct LibStuff : tpunit::TestFixture {
                                     TEST(LibStuff::testChunkedEncoding),
                                     TEST(LibStuff::testDaysInMonth),
                                     TEST(LibStuff::testGZip),
+                                    TEST(LibStuff::testDeflate),
+                                    TEST(LibStuff::testSTCPNodeFrames),
+                                    TEST(LibStuff::testSBuffer),
+                                    TEST(LibStuff::testEventLoopRegistration),
+                                    TEST(LibStuff::testHTTPParser),
+                                    TEST(LibStuff::testSHeaderTable),
                                     TEST(LibStuff::testConstantTimeEquals),
                                     TEST(LibStuff::testParseIntegerList),
                                     TEST(LibStuff::testSData),
@@ -311,6 +317,370 @@ struct LibStuff : tpunit::TestFixture {
         // Ok, this actually tests for correctness.
         data = "this is a test";
         ASSERT_EQUAL(SToHex(SGZip(data)), "1F8B08000000000002032BC9C82C5600A2448592D4E21200EAE71E0D0E000000");
+
+        // Each thread reuses its compression context, so make sure that doesn't change anything, including after
+        // switching levels.
+        string repetitive;
+        for (int i = 0; i < 10000; i++) {
+            repetitive += "{\"jobID\":" + to_string(i) + ",\"name\":\"www-prod/job\"},";
+        }
+        string fast = SGZip(repetitive, 1);
+        string best = SGZip(repetitive, 9);
+        ASSERT_TRUE(best.size() < fast.size() && fast.size() < repetitive.size());
+        ASSERT_EQUAL(SGZip(repetitive, 1), fast);
+        ASSERT_EQUAL(SGZip(repetitive, 9), best);
+        ASSERT_EQUAL(SToHex(SGZip(data)), "1F8B08000000000002032BC9C82C5600A2448592D4E21200EAE71E0D0E000000");
+
+        // Content-encoding negotiation.
+        ASSERT_TRUE(SAcceptsEncoding("gzip", "gzip"));
+        ASSERT_TRUE(SAcceptsEncoding("deflate, GZIP;q=0.5", "gzip"));
+        ASSERT_TRUE(SAcceptsEncoding("br, *", "gzip"));
+        ASSERT_FALSE(SAcceptsEncoding("", "gzip"));
+        ASSERT_FALSE(SAcceptsEncoding("deflate, br", "gzip"));
+        ASSERT_FALSE(SAcceptsEncoding("gzip;q=0", "gzip"));
+        ASSERT_FALSE(SAcceptsEncoding("*, gzip; q=0.0", "gzip"));
+        ASSERT_FALSE(SAcceptsEncoding("gzipped", "gzip"));
+    }
+
+    void testDeflate() {
+        // Round trip something compressible and something random.
+        string data;
+        for (int i = 0; i < 1000; i++) {
+            data += "INSERT INTO test VALUES (" + to_string(i) + ", 'some repetitive text');";
+        }
+        string deflated = SDeflate(data);
+        ASSERT_TRUE(deflated.size() < data.size());
+        string inflated;
+        ASSERT_TRUE(SInflate(deflated, inflated));
+        ASSERT_EQUAL(inflated, data);
+
+        data = "";
+        for (int i = 0; i < 100000; i++) {
+            data += (char)(SRandom::rand64() % 256);
+        }
+        ASSERT_TRUE(SInflate(SDeflate(data, 9), inflated));
+        ASSERT_EQUAL(inflated, data);
+
+        // Truncated and garbage input both fail.
+        ASSERT_FALSE(SInflate(deflated.substr(0, deflated.size() / 2), inflated));
+        ASSERT_TRUE(inflated.empty());
+        ASSERT_FALSE(SInflate("not deflated", inflated));
+
+        // As does anything that inflates to more than we'll take, however small it is to start with.
+        string zeros(10 * 1024 * 1024, '\0');
+        deflated = SDeflate(zeros, 9);
+        ASSERT_TRUE(deflated.size() < 100 * 1024);
+        ASSERT_FALSE(SInflate(deflated, inflated, 1024 * 1024));
+        ASSERT_TRUE(inflated.empty());
+        ASSERT_TRUE(SInflate(deflated, inflated, zeros.size()));
+        ASSERT_EQUAL(inflated.size(), zeros.size());
+    }
+
+    void testSTCPNodeFrames() {
+        // A known message type with an ID, a normal hash, an escaped-looking header and binary content.
+        SData message("BEGIN_TRANSACTION");
+        message["ID"] = "ASYNC_1234";
+        message["NewCount"] = "1234";
+        message["Weird"] = "line\r\nbreak";
+        message["CommitCount"] = "ignored";
+        message.content = string("INSERT INTO foo VALUES (1);\0\xFF", 30);
+        const string hash = SToHex(SHashSHA1("test"));
+        string frame = STCPNode::serializeFrame(message, 1233, hash);
+        ASSERT_EQUAL((unsigned char)frame[0], STCPNode::STCP_FRAME_MAGIC);
+
+        // Partial frames aren't consumed, and frames and text can be mixed in one buffer.
+        SData parsed;
+        ASSERT_EQUAL(STCPNode::deserializeMessage(frame.substr(0, frame.size() - 1), parsed), 0);
+        string buffer = frame + SData("STATE").serialize();
+        int consumed = STCPNode::deserializeMessage(buffer, parsed);
+        ASSERT_EQUAL(consumed, (int)frame.size());
+        ASSERT_EQUAL(parsed.methodLine, "BEGIN_TRANSACTION");
+        ASSERT_EQUAL(parsed["ID"], "ASYNC_1234");
+        ASSERT_EQUAL(parsed["NewCount"], "1234");
+        ASSERT_EQUAL(parsed["Weird"], "line\r\nbreak");
+        ASSERT_EQUAL(parsed["CommitCount"], "1233");
+        ASSERT_EQUAL(parsed["Hash"], hash);
+        ASSERT_EQUAL(parsed.content, message.content);
+        SConsumeFront(buffer, consumed);
+        ASSERT_TRUE(STCPNode::deserializeMessage(buffer, parsed));
+        ASSERT_EQUAL(parsed.methodLine, "STATE");
+
+        // Headers in an SHeaderTable, as nodes send them, frame the same as the SData they were copied from.
+        SHeaderTable table(message.nameValueMap);
+        ASSERT_EQUAL(STCPNode::serializeFrame(message.methodLine, table, message.content, 1233, hash),
+                     STCPNode::serializeFrame(message, 1233, hash));
+
+        // Unknown method lines, no ID and an empty hash survive as well.
+        SData other("SOMETHING_NEW");
+        frame = STCPNode::serializeFrame(other, 0, "");
+        ASSERT_EQUAL(STCPNode::deserializeMessage(frame, parsed), (int)frame.size());
+        ASSERT_EQUAL(parsed.methodLine, "SOMETHING_NEW");
+        ASSERT_FALSE(parsed.isSet("ID"));
+        ASSERT_TRUE(parsed.isSet("Hash"));
+        ASSERT_EQUAL(parsed["CommitCount"], "0");
+
+        // Messages with fields too long for their length prefixes, or too many headers, can't be framed at all.
+        SData tooLong("SOMETHING_NEW");
+        tooLong["ID"] = string(70000, 'x');
+        ASSERT_EQUAL(STCPNode::serializeFrame(tooLong, 0, ""), "");
+        SData tooMany("BEGIN_TRANSACTION");
+        for (int i = 0; i < 70000; i++) {
+            tooMany["Header" + to_string(i)] = "x";
+        }
+        ASSERT_EQUAL(STCPNode::serializeFrame(tooMany, 0, ""), "");
+        tooMany.nameValueMap.erase(tooMany.nameValueMap.begin(), next(tooMany.nameValueMap.begin(), 5000));
+        frame = STCPNode::serializeFrame(tooMany, 0, "");
+        ASSERT_EQUAL(STCPNode::deserializeMessage(frame, parsed), (int)frame.size());
+        ASSERT_EQUAL(parsed.nameValueMap.size(), tooMany.nameValueMap.size() + 2);
+
+        // As are frames we can't make sense of.
+        frame[5] = (char)200;
+        bool threw = false;
+        try {
+            STCPNode::deserializeMessage(frame, parsed);
+        } catch (const char* e) {
+            threw = true;
+        }
+        ASSERT_TRUE(threw);
+    }
+
+    void testEventLoopRegistration() {
+        SEventLoop loop;
+        STCPServer server("127.0.0.1:19879");
+        auto iterate = [&]() {
+            fd_map fdm;
+            server.prePoll(loop);
+            loop.wait(fdm, STIME_US_PER_MS * 10);
+            server.postPoll(fdm);
+        };
+
+        // An accepted socket is registered to read.
+        int client = S_socket("127.0.0.1:19879", true, false, false);
+        ASSERT_TRUE(client > 0);
+        for (int i = 0; i < 100 && server.socketList.empty(); i++) {
+            iterate();
+            server.acceptSocket();
+        }
+        ASSERT_EQUAL(server.socketList.size(), 1);
+        STCPManager::Socket* socket = server.socketList.front();
+        iterate();
+        ASSERT_EQUAL(loop.size(), 2);
+        ASSERT_EQUAL(socket->registeredEvents, SREADEVTS);
+
+        // Sending more than the kernel will take registers it to write, until the rest has been sent.
+        socket->send(string(16 * 1024 * 1024, 'x'));
+        ASSERT_FALSE(socket->sendBuffer.empty());
+        iterate();
+        ASSERT_EQUAL(socket->registeredEvents, SREADEVTS | SWRITEEVTS);
+        char buffer[65536];
+        for (int i = 0; i < 10000 && !socket->sendBuffer.empty(); i++) {
+            while (::recv(client, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) { }
+            iterate();
+        }
+        ASSERT_TRUE(socket->sendBuffer.empty());
+        ASSERT_EQUAL(socket->registeredEvents, SREADEVTS);
+
+        // And it's unregistered once the other end closes it.
+        ::close(client);
+        for (int i = 0; i < 100 && socket->state != STCPManager::Socket::CLOSED; i++) {
+            iterate();
+        }
+        ASSERT_EQUAL(socket->state, STCPManager::Socket::CLOSED);
+        ASSERT_EQUAL(loop.size(), 1);
+        server.closeSocket(socket);
+    }
+
+    void testSBuffer() {
+        // Build up something bigger than a segment out of lots of small appends, and make sure it comes back intact.
+        SBuffer buffer;
+        string expected;
+        for (int i = 0; expected.size() < SBuffer::SEGMENT_SIZE * 3; i++) {
+            string piece = "request " + to_string(i) + "\n";
+            buffer += piece;
+            expected += piece;
+        }
+        ASSERT_EQUAL(buffer.size(), expected.size());
+        ASSERT_EQUAL(buffer.str(), expected);
+        ASSERT_EQUAL(string(buffer.c_str()), expected);
+
+        // Consume from the front across segment boundaries.
+        SConsumeFront(buffer, 10);
+        expected = expected.substr(10);
+        buffer.append("tail", 4);
+        expected += "tail";
+        SConsumeFront(buffer, SBuffer::SEGMENT_SIZE + 7);
+        expected = expected.substr(SBuffer::SEGMENT_SIZE + 7);
+        ASSERT_EQUAL(string(buffer.c_str(), buffer.size()), expected);
+        SConsumeFront(buffer, buffer.size());
+        ASSERT_TRUE(buffer.empty());
+        ASSERT_EQUAL(string(buffer.c_str()), "");
+
+        // Every byte consumed above is counted.
+        ASSERT_EQUAL(buffer.consumed(), expected.size() + SBuffer::SEGMENT_SIZE + 17);
+
+        // Send a large buffer through a socket pair and read it back.
+        int sockets[2];
+        ASSERT_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+        fcntl(sockets[0], F_SETFL, O_NONBLOCK);
+        fcntl(sockets[1], F_SETFL, O_NONBLOCK);
+        string payload;
+        for (int i = 0; i < 100000; i++) {
+            payload += (char)('a' + i % 26);
+        }
+        SBuffer sendBuffer(payload);
+        SBuffer recvBuffer;
+        while (!sendBuffer.empty() || recvBuffer.size() < payload.size()) {
+            ASSERT_TRUE(S_sendconsume(sockets[0], sendBuffer));
+            ASSERT_TRUE(S_recvappend(sockets[1], recvBuffer));
+        }
+        ASSERT_EQUAL(recvBuffer.str(), payload);
+
+        // A shared message can be queued on several buffers at once, mixed with ordinary appends, without being copied.
+        SSharedMessage shared = SMakeSharedMessage(string(payload));
+        SBuffer first("before ");
+        SBuffer second;
+        first.append(shared);
+        second.append(shared);
+        first += " after";
+        ASSERT_EQUAL(shared.use_count(), 3);
+        ASSERT_EQUAL(first.size(), payload.size() + 13);
+        ASSERT_EQUAL(first.str(), "before " + payload + " after");
+        SConsumeFront(first, 10);
+        ASSERT_EQUAL(string(first.c_str()), payload.substr(3) + " after");
+        ASSERT_EQUAL(shared.use_count(), 2);
+        while (!second.empty()) {
+            ASSERT_TRUE(S_sendconsume(sockets[0], second));
+            ASSERT_TRUE(S_recvappend(sockets[1], recvBuffer));
+        }
+        ASSERT_EQUAL(shared.use_count(), 1);
+        while (recvBuffer.size() < payload.size() * 2) {
+            ASSERT_TRUE(S_recvappend(sockets[1], recvBuffer));
+        }
+        ASSERT_EQUAL(recvBuffer.str(), payload + payload);
+
+        // Small ones are just copied.
+        SSharedMessage small = SMakeSharedMessage("small");
+        second.append(small);
+        ASSERT_EQUAL(small.use_count(), 1);
+        ASSERT_EQUAL(second.str(), "small");
+
+        close(sockets[0]);
+        ASSERT_FALSE(S_recvappend(sockets[1], recvBuffer));
+        close(sockets[1]);
+    }
+
+    void testHTTPParser() {
+        // Feed a few pipelined messages in one byte at a time, and make sure they come out the same as SParseHTTP
+        // gives us when it's handed them whole.
+        string chunked = "POST /chunked HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                         "5\r\nhello\r\n7;ext=1\r\n, world\r\n0\r\nFooter: yes\r\n\r\n";
+        SData withContent("Query");
+        withContent["query"] = "SELECT 1;";
+        withContent.content = string(SBuffer::SEGMENT_SIZE * 2 + 17, 'x');
+        string pipelined = withContent.serialize() + "\r\n" + chunked + "Ping\nA: b\n  continued\n\n";
+        list<SData> expected;
+        for (string remaining = pipelined; !remaining.empty();) {
+            SData message;
+            int size = message.deserialize(remaining);
+            ASSERT_TRUE(size);
+            expected.push_back(message);
+            remaining = remaining.substr(size);
+        }
+        ASSERT_EQUAL(expected.size(), 3);
+        ASSERT_EQUAL(expected.back()["A"], "b  continued");
+        ASSERT_EQUAL(expected.begin()->content.size(), withContent.content.size());
+
+        for (size_t step : {(size_t)1, (size_t)7, (size_t)4096, pipelined.size()}) {
+            SBuffer buffer;
+            SHTTPParser parser;
+            list<SData> parsed;
+            for (size_t offset = 0; offset < pipelined.size(); offset += step) {
+                buffer.append(pipelined.data() + offset, min(step, pipelined.size() - offset));
+                SData message;
+                while (parser.parse(buffer, message)) {
+                    parsed.push_back(message);
+                }
+            }
+            ASSERT_FALSE(parser.inProgress());
+            ASSERT_TRUE(buffer.empty());
+            ASSERT_EQUAL(parsed.size(), expected.size());
+            for (auto a = parsed.begin(), b = expected.begin(); a != parsed.end(); a++, b++) {
+                ASSERT_EQUAL(a->methodLine, b->methodLine);
+                ASSERT_TRUE(a->nameValueMap == b->nameValueMap);
+                ASSERT_EQUAL(a->content, b->content);
+            }
+        }
+
+        // Anything but a plain number for Content-Length is rejected as soon as the headers are in.
+        for (string length : {"-1", "12abc", "99999999999"}) {
+            SBuffer buffer("Query\r\nContent-Length: " + length + "\r\n\r\n");
+            SHTTPParser parser;
+            SData message;
+            bool threw = false;
+            try {
+                parser.parse(buffer, message);
+            } catch (const char* e) {
+                threw = true;
+            }
+            ASSERT_TRUE(threw);
+        }
+
+        // A huge Content-Length is believed, but its body is only stored as it arrives.
+        SBuffer buffer("Query\r\nContent-Length: " + to_string(SHTTPParser::MAX_CONTENT_LENGTH) + "\r\n\r\nhello");
+        SHTTPParser parser;
+        SData message;
+        ASSERT_FALSE(parser.parse(buffer, message));
+        ASSERT_TRUE(parser.inProgress());
+        ASSERT_TRUE(buffer.empty());
+    }
+
+    void testSHeaderTable() {
+        SHeaderTable headers;
+        ASSERT_TRUE(headers.empty());
+        headers["Content-Type"] = "text/plain";
+        headers.set("count", 7);
+        headers.set("enabled", true);
+        headers["content-type"] = "text/html";
+        ASSERT_EQUAL(headers.size(), 3);
+        ASSERT_EQUAL(headers.begin()->first, "Content-Type");
+        ASSERT_EQUAL(headers.begin()->second, "text/html");
+        ASSERT_TRUE(headers.isSet("CONTENT-TYPE"));
+        ASSERT_TRUE(SContains(headers, "Count"));
+        ASSERT_EQUAL(headers.calc("count"), 7);
+        ASSERT_EQUAL(headers.calcU64("COUNT"), 7);
+        ASSERT_TRUE(headers.test("enabled"));
+        ASSERT_FALSE(headers.test("missing"));
+
+        // Looking something up through a const table doesn't add it.
+        const SHeaderTable& constHeaders = headers;
+        ASSERT_EQUAL(constHeaders["missing"], "");
+        ASSERT_EQUAL(headers.size(), 3);
+
+        // Precomputed keys find the same entries as names do.
+        headers[SHeaderTable::CONTENT_LENGTH] = "12";
+        ASSERT_EQUAL(headers["content-length"], "12");
+        ASSERT_TRUE(headers.find(SHeaderTable::CONTENT_LENGTH) == headers.find("Content-Length"));
+        ASSERT_EQUAL(headers.erase("CONTENT-length"), 1);
+        ASSERT_EQUAL(headers.erase("Content-Length"), 0);
+        ASSERT_TRUE(headers.find(SHeaderTable::CONTENT_LENGTH) == headers.end());
+
+        // Parsing and composing give the same results as they do with an STable.
+        SData request("Query");
+        request["query"] = "SELECT 1;";
+        request["Connection"] = "wait";
+        request["Set-Cookie"] = string("a=1") + S_COOKIE_SEPARATOR + "b=2";
+        request.content = "some content";
+        string serialized = request.serialize();
+        string methodLine, content;
+        SHeaderTable parsed;
+        ASSERT_EQUAL(SParseHTTP(serialized, methodLine, parsed, content), (int)serialized.size());
+        ASSERT_EQUAL(methodLine, "Query");
+        ASSERT_EQUAL(content, request.content);
+        SData reparsed;
+        reparsed.deserialize(serialized);
+        ASSERT_TRUE(parsed.toSTable() == reparsed.nameValueMap);
+        SHeaderTable converted(request.nameValueMap);
+        ASSERT_EQUAL(SComposeHTTP(methodLine, converted, content), serialized);
     }
 
     void testConstantTimeEquals() {
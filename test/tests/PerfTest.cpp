@@ -0,0 +1,761 @@
+#include <zlib.h>
+#include <libstuff/libstuff.h>
+#include <test/lib/BedrockTester.h>
+
+// These are benchmarks rather than tests. They're skipped unless the test binary is run with `-perf`.
+struct PerfTest : tpunit::TestFixture {
+    PerfTest() : tpunit::TestFixture("Perf",
+                                     TEST(PerfTest::testReplicationCompression),
+                                     TEST(PerfTest::testNodeMessageFraming),
+                                     TEST(PerfTest::testEventLoopScaling),
+                                     TEST(PerfTest::testPipelinedParsing),
+                                     TEST(PerfTest::testIncrementalParsing),
+                                     TEST(PerfTest::testHeaderTables),
+                                     TEST(PerfTest::testResponseCompression),
+                                     TEST(PerfTest::testLocalSocketLatency),
+                                     TEST(PerfTest::testBroadcastBuffers),
+                                     TEST(PerfTest::testBulkJobs),
+                                     TEST(PerfTest::testJobsLoad))
+    { }
+
+    // Minimal STCPNode that just counts the messages it gets.
+    class CountingNode : public STCPNode {
+      public:
+        CountingNode(const string& name, const string& host) : STCPNode(name, host), received(0) { }
+        virtual void _onConnect(Peer* peer) { }
+        virtual void _onDisconnect(Peer* peer) { }
+        virtual void _onMESSAGE(Peer* peer, const SData& message) { received++; }
+        uint64_t received;
+    };
+
+    // Runs one iteration of both nodes' event loops.
+    void pollNodes(STCPNode& a, STCPNode& b) {
+        fd_map fdm;
+        uint64_t nextActivity = STimeNow() + STIME_US_PER_MS * 100;
+        a.prePoll(fdm);
+        b.prePoll(fdm);
+        S_poll(fdm, STIME_US_PER_MS * 100);
+        a.postPoll(fdm, nextActivity);
+        b.postPoll(fdm, nextActivity);
+    }
+
+    // Builds a BEGIN_TRANSACTION like the master sends to its slaves, with `rows` INSERTs in the content.
+    SData makeTransaction(int rows) {
+        SData transaction("BEGIN_TRANSACTION");
+        transaction["NewCount"] = "1000000";
+        transaction["NewHash"] = "0123456789ABCDEF0123456789ABCDEF01234567";
+        transaction["ID"] = "ASYNC_1000000";
+        transaction["CommitCount"] = "999999";
+        transaction["Hash"] = "76543210FEDCBA9876543210FEDCBA9876543210";
+        for (int i = 0; i < rows; i++) {
+            transaction.content += "INSERT INTO jobs (created, state, name, nextRun, data) VALUES (" +
+                                   SQ(SCURRENT_TIMESTAMP()) + ", 'QUEUED', " + SQ("www-prod/job" + to_string(i % 50)) +
+                                   ", " + SQ(SCURRENT_TIMESTAMP()) + ", " +
+                                   SQ("{\"accountID\":" + to_string(SRandom::rand64() % 100000) + "}") + ");\n";
+        }
+        return transaction;
+    }
+
+    // Sends a burst of transactions over a simulated link of a given bandwidth, once as-is and once deflated at each
+    // level, and reports the transactions/sec we'd sustain. Link time is computed from the bytes that would go on the
+    // wire; compression and decompression time is measured.
+    void testReplicationCompression() {
+        const int transactions = 500;
+        list<SData> burst;
+        for (int i = 0; i < transactions; i++) {
+            burst.push_back(makeTransaction(1 + i % 20));
+        }
+
+        for (uint64_t megabitsPerSecond : {10, 100, 1000}) {
+            const double bytesPerUS = (double)megabitsPerSecond / 8.0;
+            for (int level : {0, 1, 6}) {
+                uint64_t wireBytes = 0;
+                uint64_t rawBytes = 0;
+                uint64_t start = STimeNow();
+                for (const SData& transaction : burst) {
+                    SData sent = transaction;
+                    rawBytes += sent.content.size();
+                    if (level && sent.content.size() >= 1024) {
+                        sent.content = SDeflate(sent.content, level);
+                        sent["Content-Encoding"] = "deflate";
+                    }
+                    string serialized = sent.serialize();
+                    wireBytes += serialized.size();
+
+                    // Receive it the way STCPNode does.
+                    SData received;
+                    ASSERT_EQUAL(received.deserialize(serialized), (int)serialized.size());
+                    if (SIEquals(received["Content-Encoding"], "deflate")) {
+                        string inflated;
+                        ASSERT_TRUE(SInflate(received.content, inflated));
+                        received.content = move(inflated);
+                    }
+                    ASSERT_EQUAL(received.content, transaction.content);
+                }
+                uint64_t cpuUS = STimeNow() - start;
+                uint64_t linkUS = (uint64_t)(wireBytes / bytesPerUS);
+                uint64_t elapsedUS = max(cpuUS, linkUS);
+                cout << "[Perf] replication " << megabitsPerSecond << "Mbps, level " << level << ": " << wireBytes
+                     << " wire bytes for " << rawBytes << " content bytes, cpu " << cpuUS / STIME_US_PER_MS
+                     << "ms, link " << linkUS / STIME_US_PER_MS << "ms, "
+                     << (transactions * STIME_US_PER_S / max(elapsedUS, (uint64_t)1)) << " transactions/sec" << endl;
+            }
+        }
+    }
+
+    // Pushes a stream of typical replication messages from one STCPNode to another over loopback, as text and as
+    // binary frames, and reports messages/sec through the receiver's postPoll.
+    void testNodeMessageFraming() {
+        CountingNode sender("sender", "127.0.0.1:19876");
+        CountingNode receiver("receiver", "127.0.0.1:19877");
+        STable params;
+        sender.addPeer("receiver", "127.0.0.1:19877", params);
+        receiver.addPeer("sender", "127.0.0.1:19876", params);
+
+        // Only the sender dials out, so there's exactly one connection between them.
+        receiver.peerList.front()->nextReconnect = STimeNow() + STIME_US_PER_M * 10;
+        STCPNode::Peer* toReceiver = sender.peerList.front();
+        toReceiver->nextReconnect = 0;
+        uint64_t timeout = STimeNow() + STIME_US_PER_S * 10;
+        while (!(toReceiver->connected() && receiver.peerList.front()->s) && STimeNow() < timeout) {
+            pollNodes(sender, receiver);
+        }
+        ASSERT_TRUE(toReceiver->connected());
+
+        // A mix of small control messages and transactions.
+        list<SData> messages;
+        for (int i = 0; i < 100; i++) {
+            SData message = (i % 4) ? SData("APPROVE_TRANSACTION") : makeTransaction(1 + i % 5);
+            message["ID"] = "ASYNC_" + to_string(1000000 + i);
+            message["NewCount"] = to_string(1000000 + i);
+            message["CommitCount"] = to_string(999999 + i);
+            message["Hash"] = SToHex(SHashSHA1(to_string(i)));
+            messages.push_back(message);
+        }
+
+        const int rounds = 500;
+        for (bool binary : {false, true}) {
+            list<string> encoded;
+            for (const SData& message : messages) {
+                encoded.push_back(binary ? STCPNode::serializeFrame(message, message.calcU64("CommitCount"),
+                                                                    message["Hash"])
+                                         : message.serialize());
+            }
+            uint64_t expected = receiver.received + rounds * messages.size();
+            uint64_t start = STimeNow();
+            for (int i = 0; i < rounds; i++) {
+                for (const string& message : encoded) {
+                    toReceiver->s->send(message);
+                }
+                pollNodes(sender, receiver);
+            }
+            while (receiver.received < expected && STimeNow() < start + STIME_US_PER_M) {
+                pollNodes(sender, receiver);
+            }
+            uint64_t elapsed = max(STimeNow() - start, (uint64_t)1);
+            ASSERT_EQUAL(receiver.received, expected);
+            cout << "[Perf] " << (binary ? "binary" : "text") << " framing: " << rounds * messages.size()
+                 << " messages in " << elapsed / STIME_US_PER_MS << "ms, "
+                 << (rounds * messages.size() * STIME_US_PER_S / elapsed) << " messages/sec" << endl;
+        }
+    }
+    // Holds open a growing number of idle client connections to an STCPServer, with one connection that's always
+    // active, and reports the cost of one iteration of the server's event loop with `S_poll` and with `SEventLoop`.
+    void testEventLoopScaling() {
+        // The loop has to outlive the server, which unregisters its port from it when it's destroyed.
+        SEventLoop loop;
+        STCPServer server("127.0.0.1:19878");
+        list<int> clients;
+        int active = -1;
+        for (int connections : {10, 100, 1000, 5000}) {
+            while ((int)clients.size() < connections) {
+                int s = S_socket("127.0.0.1:19878", true, false, false);
+                ASSERT_TRUE(s > 0);
+                clients.push_back(s);
+                if (active < 0) {
+                    active = s;
+                }
+            }
+
+            // Accept everything we just opened.
+            uint64_t timeout = STimeNow() + STIME_US_PER_S * 10;
+            while (server.socketList.size() < clients.size() && STimeNow() < timeout) {
+                fd_map fdm;
+                server.prePoll(fdm);
+                S_poll(fdm, STIME_US_PER_MS * 10);
+                server.postPoll(fdm);
+                while (server.acceptSocket()) { }
+            }
+            ASSERT_EQUAL(server.socketList.size(), clients.size());
+
+            const int iterations = 2000;
+            for (bool epoll : {false, true}) {
+                uint64_t start = STimeNow();
+                for (int i = 0; i < iterations; i++) {
+                    // Keep the one active connection busy, so every iteration has something to do.
+                    ASSERT_EQUAL(::send(active, "x", 1, 0), 1);
+                    fd_map fdm;
+                    if (epoll) {
+                        server.prePoll(loop);
+                        loop.wait(fdm, STIME_US_PER_MS * 100);
+                    } else {
+                        server.prePoll(fdm);
+                        S_poll(fdm, STIME_US_PER_MS * 100);
+                    }
+                    server.postPoll(fdm);
+                }
+                uint64_t elapsed = STimeNow() - start;
+                cout << "[Perf] " << (epoll ? "epoll" : "poll") << " loop, " << connections << " connections: "
+                     << (double)elapsed / iterations << "us/iteration" << endl;
+            }
+
+            // Throw away what the active connection sent, so it doesn't grow without bound.
+            for (auto socket : server.socketList) {
+                socket->recvBuffer.clear();
+            }
+        }
+        for (int s : clients) {
+            ::close(s);
+        }
+    }
+    // Parses a receive buffer full of pipelined requests one at a time, the way BedrockServer does, with the buffer as
+    // a string (consumed with SConsumeFront) and as an SBuffer, and reports requests/sec for each.
+    void testPipelinedParsing() {
+        for (int count : {1000, 5000, 20000}) {
+            string pipelined;
+            for (int i = 0; i < count; i++) {
+                SData request("Query");
+                request["query"] = "SELECT * FROM jobs WHERE jobID = " + to_string(i) + ";";
+                request["requestID"] = to_string(i);
+                pipelined += request.serialize();
+            }
+
+            for (bool segmented : {false, true}) {
+                string stringBuffer = pipelined;
+                SBuffer segmentedBuffer;
+                for (size_t offset = 0; offset < pipelined.size(); offset += 4096) {
+                    // Arrives in 4KB reads, like S_recvappend.
+                    segmentedBuffer.append(pipelined.data() + offset, min((size_t)4096, pipelined.size() - offset));
+                }
+                int parsed = 0;
+                uint64_t start = STimeNow();
+                while (true) {
+                    SData request;
+                    int size = segmented ? request.deserialize(segmentedBuffer.c_str(), segmentedBuffer.size())
+                                         : request.deserialize(stringBuffer);
+                    if (!size) {
+                        break;
+                    }
+                    if (segmented) {
+                        SConsumeFront(segmentedBuffer, size);
+                    } else {
+                        SConsumeFront(stringBuffer, size);
+                    }
+                    parsed++;
+                }
+                uint64_t elapsed = max(STimeNow() - start, (uint64_t)1);
+                ASSERT_EQUAL(parsed, count);
+                cout << "[Perf] " << (segmented ? "SBuffer" : "string") << " pipelined parse, " << count
+                     << " requests (" << pipelined.size() / 1024 << "KB): " << elapsed / STIME_US_PER_MS << "ms, "
+                     << (count * STIME_US_PER_S / elapsed) << " requests/sec" << endl;
+            }
+        }
+    }
+
+    // Compares receiving one large message, in 64KB reads, by re-running SParseHTTP on everything received after each
+    // read (what we used to do), against parsing it incrementally as it arrives.
+    void testIncrementalParsing() {
+        for (bool chunked : {false, true}) {
+            // Re-parsing a chunked body is quadratic, so those have to stay small or the old way takes minutes.
+            for (size_t megabytes : chunked ? vector<size_t>{1, 2, 4} : vector<size_t>{1, 8, 32}) {
+                SData write("WriteCache");
+                write["name"] = "big";
+                string message;
+                string body(megabytes * 1024 * 1024, 'x');
+                if (chunked) {
+                    message = "WriteCache\r\nname: big\r\nTransfer-Encoding: chunked\r\n\r\n";
+                    for (size_t offset = 0; offset < body.size(); offset += 4096) {
+                        message += SToHex(4096, 4) + "\r\n" + body.substr(offset, 4096) + "\r\n";
+                    }
+                    message += "0\r\n\r\n";
+                } else {
+                    write.content = body;
+                    message = write.serialize();
+                }
+
+                for (bool incremental : {false, true}) {
+                    const size_t readSize = 64 * 1024;
+                    string stringBuffer;
+                    SBuffer segmentedBuffer;
+                    SHTTPParser parser;
+                    SData received;
+                    uint64_t start = STimeNow();
+                    for (size_t offset = 0; offset < message.size(); offset += readSize) {
+                        size_t length = min(readSize, message.size() - offset);
+                        if (incremental) {
+                            segmentedBuffer.append(message.data() + offset, length);
+                            parser.parse(segmentedBuffer, received);
+                        } else {
+                            stringBuffer.append(message.data() + offset, length);
+                            SConsumeFront(stringBuffer, received.deserialize(stringBuffer));
+                        }
+                    }
+                    uint64_t elapsed = max(STimeNow() - start, (uint64_t)1);
+                    ASSERT_EQUAL(received.content.size(), body.size());
+                    cout << "[Perf] " << (incremental ? "incremental" : "SParseHTTP") << " parse, "
+                         << (chunked ? "chunked " : "") << megabytes << "MB body: " << elapsed / STIME_US_PER_MS
+                         << "ms" << endl;
+                }
+            }
+        }
+    }
+
+    // Times parsing, serializing, and looking up headers with an STable against an SHeaderTable, using messages that
+    // look like the requests and responses we actually handle.
+    template <class Table>
+    void timeHeaderTable(const string& name, const list<string>& messages) {
+        list<Table> tables;
+        string methodLine, content;
+        uint64_t start = STimeNow();
+        for (const string& message : messages) {
+            tables.emplace_back();
+            SParseHTTP(message, methodLine, tables.back(), content);
+        }
+        uint64_t parsed = STimeNow();
+        size_t bytes = 0;
+        for (const Table& table : tables) {
+            bytes += SComposeHTTP(methodLine, table, content).size();
+        }
+        uint64_t serialized = STimeNow();
+        uint64_t found = 0;
+        for (const Table& table : tables) {
+            for (const char* header : {"requestID", "Connection", "commitCount", "priority", "timeout", "jobID",
+                                       "Content-Length", "missing"}) {
+                found += SContains(table, header);
+            }
+        }
+        uint64_t lookedUp = STimeNow();
+        ASSERT_TRUE(bytes && found);
+        cout << "[Perf] " << name << ": parse " << (parsed - start) / STIME_US_PER_MS << "ms, serialize "
+             << (serialized - parsed) / STIME_US_PER_MS << "ms, lookup " << (lookedUp - serialized) / STIME_US_PER_MS
+             << "ms for " << messages.size() << " messages" << endl;
+    }
+
+    void testHeaderTables() {
+        list<string> messages;
+        for (int i = 0; i < 100000; i++) {
+            SData request(i % 2 ? "GetJob" : "200 OK");
+            request["requestID"] = to_string(i);
+            request["Connection"] = "wait";
+            request["name"] = "www-prod/job" + to_string(i % 50);
+            request["priority"] = "500";
+            request["jobID"] = to_string(1000000 + i);
+            request["commandExecuteTime"] = to_string(STimeNow());
+            request["nodeName"] = "bedrock1";
+            request["commitCount"] = to_string(5000000 + i);
+            request.content = "{\"jobID\":" + to_string(1000000 + i) + "}";
+            messages.push_back(request.serialize());
+        }
+        timeHeaderTable<STable>("STable", messages);
+        timeHeaderTable<SHeaderTable>("SHeaderTable", messages);
+    }
+
+    // Builds the content of a `format: json` Query response with `rows` rows from a jobs-like table.
+    string makeQueryResponse(int rows) {
+        list<string> rowList;
+        for (int i = 0; i < rows; i++) {
+            rowList.push_back(SComposeJSONArray(list<string>{to_string(1000000 + i), SCURRENT_TIMESTAMP(),
+                                                             "QUEUED", "www-prod/job" + to_string(i % 50),
+                                                             "{\"accountID\":" + to_string(SRandom::rand64() % 100000) +
+                                                             "}"}));
+        }
+        return "{\"headers\":[\"jobID\",\"created\",\"state\",\"name\",\"data\"],\"rows\":[" +
+               SComposeList(rowList, ",") + "]}";
+    }
+
+    // Gzips a stream of large Query responses, first the way SGZip used to (a new context per response, at the best
+    // compression level and maximum memory level), then with SGZip's reused per-thread context at several levels.
+    void testResponseCompression() {
+        for (int rows : {1000, 10000}) {
+            const int responses = 500000 / rows;
+            string content = makeQueryResponse(rows);
+            uint64_t start = STimeNow();
+            size_t compressedSize = 0;
+            for (int i = 0; i < responses; i++) {
+                z_stream stream;
+                memset(&stream, 0, sizeof(stream));
+                ASSERT_EQUAL(deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, MAX_WBITS | 16, MAX_MEM_LEVEL,
+                                          Z_DEFAULT_STRATEGY), Z_OK);
+                unsigned char* buffer = new unsigned char[content.size() + content.size() / 1000 + 20];
+                stream.next_in = (unsigned char*)content.data();
+                stream.avail_in = content.size();
+                stream.next_out = buffer;
+                stream.avail_out = content.size() + content.size() / 1000 + 20;
+                ASSERT_EQUAL(deflate(&stream, Z_FINISH), Z_STREAM_END);
+                deflateEnd(&stream);
+                compressedSize = string((char*)buffer, stream.total_out).size();
+                delete[] buffer;
+            }
+            cout << "[Perf] " << content.size() << " byte response, new context, level 9: " << compressedSize
+                 << " bytes, " << (STimeNow() - start) / responses << "us/response" << endl;
+            for (int level : {1, 6, 9}) {
+                start = STimeNow();
+                for (int i = 0; i < responses; i++) {
+                    compressedSize = SGZip(content, level).size();
+                }
+                cout << "[Perf] " << content.size() << " byte response, reused context, level " << level << ": "
+                     << compressedSize << " bytes, " << (STimeNow() - start) / responses << "us/response" << endl;
+            }
+        }
+    }
+
+    // Sends requests one at a time to a server that answers each with a `200 OK`, the way a co-located web server
+    // talks to Bedrock, over loopback TCP and over a Unix domain socket, and reports the round trip latency.
+    void testLocalSocketLatency() {
+        const string socketPath = "/tmp/bedrock_perf_" + to_string(getpid()) + ".sock";
+        for (const string& host : {string("127.0.0.1:19879"), "unix:" + socketPath}) {
+            atomic<bool> done(false);
+            STCPServer server(host);
+            thread serverThread([&]() {
+                while (!done.load()) {
+                    fd_map fdm;
+                    server.prePoll(fdm);
+                    S_poll(fdm, STIME_US_PER_MS * 10);
+                    server.postPoll(fdm);
+                    while (server.acceptSocket()) { }
+                    for (auto socket : server.socketList) {
+                        SData request;
+                        while (socket->httpParser.parse(socket->recvBuffer, request)) {
+                            SData response("200 OK");
+                            response["requestID"] = request["requestID"];
+                            socket->send(response.serialize());
+                        }
+                    }
+                }
+            });
+
+            int s = S_socket(host, true, false, true);
+            ASSERT_TRUE(s > 0);
+            const int requests = 20000;
+            vector<uint64_t> latencies;
+            latencies.reserve(requests);
+            SBuffer recvBuffer;
+            SHTTPParser parser;
+            for (int i = 0; i < requests; i++) {
+                uint64_t start = STimeNow();
+                SData request("Ping");
+                request["requestID"] = to_string(i);
+                string sendBuffer = request.serialize();
+                while (!sendBuffer.empty() && S_sendconsume(s, sendBuffer)) { }
+                SData response;
+                while (!parser.parse(recvBuffer, response) && S_recvappend(s, recvBuffer)) { }
+                ASSERT_EQUAL(response["requestID"], to_string(i));
+                latencies.push_back(STimeNow() - start);
+            }
+            ::close(s);
+            done.store(true);
+            serverThread.join();
+
+            sort(latencies.begin(), latencies.end());
+            uint64_t total = 0;
+            for (uint64_t latency : latencies) {
+                total += latency;
+            }
+            cout << "[Perf] " << (SHostIsUnixSocket(host) ? "Unix domain socket" : "loopback TCP") << ": mean "
+                 << (double)total / requests << "us, p50 " << latencies[requests / 2] << "us, p99 "
+                 << latencies[requests * 99 / 100] << "us per round trip" << endl;
+        }
+    }
+
+    // Queues a large BEGIN_TRANSACTION on the send buffers of a cluster's worth of peers, once by copying it into each
+    // buffer, as `_sendToAllPeers` used to, and once by reference, and reports the time per broadcast.
+    void testBroadcastBuffers() {
+        SData transaction = makeTransaction(2000);
+        const string serialized = transaction.serialize();
+        for (int peers : {2, 8, 32}) {
+            for (bool shared : {false, true}) {
+                const int broadcasts = 200;
+                vector<SBuffer> sendBuffers(peers);
+                uint64_t start = STimeNow();
+                for (int i = 0; i < broadcasts; i++) {
+                    SSharedMessage message = SMakeSharedMessage(string(serialized));
+                    for (SBuffer& buffer : sendBuffers) {
+                        if (shared) {
+                            buffer.append(message);
+                        } else {
+                            buffer += *message;
+                        }
+                    }
+
+                    // As if each peer's socket had sent the whole thing.
+                    for (SBuffer& buffer : sendBuffers) {
+                        buffer.consumeFront(buffer.size());
+                    }
+                }
+                uint64_t elapsed = STimeNow() - start;
+                cout << "[Perf] Broadcast of " << serialized.size() / 1024 << "KB to " << peers << " peers, "
+                     << (shared ? "shared" : "copied") << ": " << (double)elapsed / broadcasts << "us per broadcast"
+                     << endl;
+            }
+        }
+    }
+
+    // Creates, gets and finishes a few thousand jobs on a real server, once with a CreateJob and a FinishJob for each,
+    // one after another, and once with one CreateJobs and one FinishJobs for all of them, and reports jobs/sec for
+    // each.
+    void testBulkJobs() {
+        BedrockTester tester({{"-plugins", "Jobs,DB"}}, {});
+        const int count = 2000;
+        for (bool bulk : {false, true}) {
+            uint64_t start = STimeNow();
+            if (bulk) {
+                SData command("CreateJobs");
+                command["jobs"] = SComposeJSONArray(list<string>(count, "{\"name\":\"perf\",\"data\":{\"n\":1}}"));
+                ASSERT_EQUAL(SParseJSONArray(tester.executeWaitVerifyContentTable(command)["jobIDs"]).size(), count);
+            } else {
+                SData command("CreateJob");
+                command["name"] = "perf";
+                command["data"] = "{\"n\":1}";
+                for (const SData& response : tester.executeWaitMultipleData(vector<SData>(count, command), 1)) {
+                    ASSERT_TRUE(SStartsWith(response.methodLine, "200"));
+                }
+            }
+            const uint64_t createUS = STimeNow() - start;
+
+            SData command("GetJobs");
+            command["name"] = "perf";
+            command["numResults"] = to_string(count);
+            list<string> jobIDs;
+            for (const string& job : SParseJSONArray(tester.executeWaitVerifyContentTable(command)["jobs"])) {
+                jobIDs.push_back(SParseJSONObject(job)["jobID"]);
+            }
+            ASSERT_EQUAL(jobIDs.size(), count);
+
+            start = STimeNow();
+            if (bulk) {
+                list<string> jobs;
+                for (const string& jobID : jobIDs) {
+                    jobs.push_back("{\"jobID\":" + jobID + ",\"data\":{\"n\":2}}");
+                }
+                command.clear();
+                command.methodLine = "FinishJobs";
+                command["jobs"] = SComposeJSONArray(jobs);
+                tester.executeWaitVerifyContent(command);
+            } else {
+                vector<SData> requests;
+                for (const string& jobID : jobIDs) {
+                    SData request("FinishJob");
+                    request["jobID"] = jobID;
+                    request["data"] = "{\"n\":2}";
+                    requests.push_back(request);
+                }
+                for (const SData& response : tester.executeWaitMultipleData(requests, 1)) {
+                    ASSERT_TRUE(SStartsWith(response.methodLine, "200"));
+                }
+            }
+            const uint64_t finishUS = STimeNow() - start;
+            ASSERT_EQUAL(tester.readDB("SELECT COUNT(*) FROM jobs;"), "0");
+            cout << "[Perf] " << (bulk ? "CreateJobs/FinishJobs" : "CreateJob/FinishJob") << ", " << count
+                 << " jobs: created " << count * STIME_US_PER_S / max(createUS, (uint64_t)1) << " jobs/sec, finished "
+                 << count * STIME_US_PER_S / max(finishUS, (uint64_t)1) << " jobs/sec" << endl;
+        }
+    }
+
+    // A connection to a Bedrock node that sends one request at a time, and records how long each takes to answer, by
+    // command.
+    struct TimedConnection {
+        TimedConnection(const string& host) : s(S_socket(host, true, false, true)) { }
+        ~TimedConnection() {
+            if (s > 0) {
+                ::close(s);
+            }
+        }
+
+        SData send(const SData& request) {
+            uint64_t start = STimeNow();
+            string sendBuffer = request.serialize();
+            while (!sendBuffer.empty() && S_sendconsume(s, sendBuffer)) { }
+            SData response;
+            while (!parser.parse(recvBuffer, response) && S_recvappend(s, recvBuffer)) { }
+            latencies[request.methodLine].push_back(STimeNow() - start);
+            if (!SStartsWith(response.methodLine, "200") &&
+                !(request.methodLine == "GetJobs" && SStartsWith(response.methodLine, "404"))) {
+                errors[request.methodLine]++;
+            }
+            return response;
+        }
+
+        int s;
+        SBuffer recvBuffer;
+        SHTTPParser parser;
+        map<string, vector<uint64_t>> latencies;
+        map<string, uint64_t> errors;
+    };
+
+    // Starts `nodes` nodes running the Jobs plugin, peered with each other if there's more than one, and waits until
+    // they've all come up as MASTERING or SLAVING. Node 0 has the highest priority, so it's the master.
+    vector<unique_ptr<BedrockTester>> startJobsCluster(int nodes) {
+        vector<unique_ptr<BedrockTester>> cluster;
+        for (int i = 0; i < nodes; i++) {
+            list<string> peers;
+            for (int j = 0; j < nodes; j++) {
+                if (j != i) {
+                    peers.push_back("127.0.0.1:" + to_string(9500 + j) + "?nodeName=perf_node_" + to_string(j));
+                }
+            }
+            map<string, string> args = {
+                {"-serverHost",  "127.0.0.1:" + to_string(9000 + i)},
+                {"-nodeHost",    "127.0.0.1:" + to_string(9500 + i)},
+                {"-controlPort", "127.0.0.1:" + to_string(19999 + i)},
+                {"-db",          BedrockTester::getTempFileName("perf_node_" + to_string(i) + "_")},
+                {"-priority",    to_string(100 - i * 10)},
+                {"-nodeName",    "perf_node_" + to_string(i)},
+                {"-plugins",     "Jobs,DB"},
+            };
+            if (!peers.empty()) {
+                args["-peerList"] = SComposeList(peers, ",");
+            }
+            cluster.emplace_back(new BedrockTester(args, {}, false));
+        }
+
+        // The nodes wait for each other, so they have to be started together.
+        list<thread> threads;
+        for (auto& node : cluster) {
+            threads.emplace_back([&node]() { node->startServer(); });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        for (auto& node : cluster) {
+            uint64_t start = STimeNow();
+            while (STimeNow() - start < 60 * STIME_US_PER_S) {
+                const string state = node->executeWaitVerifyContentTable(SData("Status"))["state"];
+                if (state == "MASTERING" || state == "SLAVING") {
+                    break;
+                }
+                usleep(100 * 1000);
+            }
+        }
+        return cluster;
+    }
+
+    // Returns the total successes and conflicts of each command on the master.
+    map<string, pair<uint64_t, uint64_t>> getConflictCounts(BedrockTester& master) {
+        map<string, pair<uint64_t, uint64_t>> counts;
+        STable status = master.executeWaitVerifyContentTable(SData("Status"));
+        for (auto& command : SParseJSONObject(status["multiWriteConflictCounts"])) {
+            STable count = SParseJSONObject(command.second);
+            counts[command.first] = make_pair(SToUInt64(count["successes"]), SToUInt64(count["conflicts"]));
+        }
+        return counts;
+    }
+
+    // Runs jobs through a node or a cluster the way workers would, with `-jobsPerfConcurrency` connections (8 by
+    // default) each creating jobs, getting up to `-jobsPerfBatch` at a time (10 by default) with GetJobs, retrying
+    // each job the first time it gets it and finishing it the second, until `-jobsPerfJobs` jobs (2000 by default)
+    // are finished. With `-jobsPerfNodes 3`, it runs against a three-node cluster, with the connections spread across
+    // the nodes. Reports jobs/sec, the latency of each command, and how many of each conflicted on the master.
+    void testJobsLoad() {
+        const SData& args = BedrockTester::globalArgs;
+        const int nodes = args.isSet("-jobsPerfNodes") ? max(args.calc("-jobsPerfNodes"), 1) : 1;
+        const int concurrency = args.isSet("-jobsPerfConcurrency") ? max(args.calc("-jobsPerfConcurrency"), 1) : 8;
+        const int64_t jobs = args.isSet("-jobsPerfJobs") ? max(args.calc64("-jobsPerfJobs"), (int64_t)1) : 2000;
+        const int batch = args.isSet("-jobsPerfBatch") ? max(args.calc("-jobsPerfBatch"), 1) : 10;
+
+        vector<unique_ptr<BedrockTester>> cluster = startJobsCluster(nodes);
+        const map<string, pair<uint64_t, uint64_t>> conflictsBefore = getConflictCounts(*cluster[0]);
+
+        atomic<int64_t> created(0);
+        atomic<int64_t> finished(0);
+        mutex resultsMutex;
+        map<string, vector<uint64_t>> latencies;
+        map<string, uint64_t> errors;
+        const uint64_t start = STimeNow();
+        const uint64_t deadline = start + 10 * 60 * STIME_US_PER_S;
+        list<thread> workers;
+        for (int i = 0; i < concurrency; i++) {
+            workers.emplace_back([&, i]() {
+                TimedConnection connection(cluster[i % nodes]->getServerAddr());
+                while (finished.load() < jobs && STimeNow() < deadline) {
+                    int64_t toCreate = created.load();
+                    while (toCreate < jobs && !created.compare_exchange_weak(toCreate, toCreate + 1)) { }
+                    if (toCreate < jobs) {
+                        SData request("CreateJob");
+                        request["name"] = "perf/job";
+                        request["data"] = "{\"attempt\":0}";
+                        if (!SStartsWith(connection.send(request).methodLine, "200")) {
+                            // Leave it for someone to try again.
+                            created--;
+                        }
+                    }
+
+                    // The lease requeues any job whose RetryJob or FinishJob fails, so it's not left RUNNING.
+                    SData request("GetJobs");
+                    request["name"] = "perf/*";
+                    request["numResults"] = to_string(batch);
+                    request["leaseDuration"] = "10";
+                    SData response = connection.send(request);
+                    if (!SStartsWith(response.methodLine, "200")) {
+                        continue;
+                    }
+                    for (const string& jobJSON : SParseJSONArray(SParseJSONObject(response.content)["jobs"])) {
+                        STable job = SParseJSONObject(jobJSON);
+                        const bool retry = SParseJSONObject(job["data"])["attempt"] == "0";
+                        SData next(retry ? "RetryJob" : "FinishJob");
+                        next["jobID"] = job["jobID"];
+                        next["leaseID"] = job["leaseID"];
+                        if (retry) {
+                            next["delay"] = "0";
+                            next["data"] = "{\"attempt\":1}";
+                        }
+                        if (SStartsWith(connection.send(next).methodLine, "200") && !retry) {
+                            finished++;
+                        }
+                    }
+                }
+                lock_guard<mutex> lock(resultsMutex);
+                for (auto& command : connection.latencies) {
+                    latencies[command.first].insert(latencies[command.first].end(), command.second.begin(),
+                                                    command.second.end());
+                }
+                for (auto& command : connection.errors) {
+                    errors[command.first] += command.second;
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        const uint64_t elapsed = STimeNow() - start;
+        const map<string, pair<uint64_t, uint64_t>> conflictsAfter = getConflictCounts(*cluster[0]);
+
+        cout << "[Perf] Jobs load, " << nodes << " node(s), " << concurrency << " connections: " << finished.load()
+             << " jobs in " << elapsed / STIME_US_PER_MS << "ms, " << finished.load() * STIME_US_PER_S / elapsed
+             << " jobs/sec" << endl;
+        for (auto& command : latencies) {
+            vector<uint64_t>& times = command.second;
+            sort(times.begin(), times.end());
+            cout << "[Perf] Jobs load, " << command.first << ": " << times.size() << " requests, "
+                 << errors[command.first] << " errors, p50 " << times[times.size() / 2]
+                 << "us, p99 " << times[times.size() * 99 / 100]
+                 << "us, p999 " << times[times.size() * 999 / 1000] << "us" << endl;
+        }
+        for (auto& command : conflictsAfter) {
+            if (!latencies.count(command.first)) {
+                continue;
+            }
+            auto before = conflictsBefore.find(command.first);
+            const bool isNew = before == conflictsBefore.end();
+            const uint64_t successes = command.second.first - (isNew ? 0 : before->second.first);
+            const uint64_t conflicts = command.second.second - (isNew ? 0 : before->second.second);
+            cout << "[Perf] Jobs load, " << command.first << ": " << conflicts << " conflicts, " << successes
+                 << " parallel commits on master" << endl;
+        }
+        ASSERT_EQUAL(finished.load(), jobs);
+
+        // Stop the slaves first, so they don't try to take over from the master as it goes.
+        while (!cluster.empty()) {
+            cluster.pop_back();
+        }
+    }
+} __PerfTest;
@@ -0,0 +1,96 @@
+#include <test/lib/BedrockTester.h>
+
+struct PipeliningTest : tpunit::TestFixture {
+    PipeliningTest()
+        : tpunit::TestFixture("Pipelining",
+                              TEST(PipeliningTest::testMainThread),
+                              TEST(PipeliningTest::testIOThreads),
+                              TEST(PipeliningTest::testFutureCommand)) { }
+
+    // Sends all of `requests` on one connection without waiting for any responses, then reads back the responses.
+    vector<SData> sendPipelined(BedrockTester& tester, const vector<SData>& requests) {
+        int socket = S_socket(tester.getServerAddr(), true, false, true);
+        string sendBuffer;
+        for (const SData& request : requests) {
+            sendBuffer += request.serialize();
+        }
+        while (!sendBuffer.empty() && S_sendconsume(socket, sendBuffer)) { }
+
+        vector<SData> responses;
+        SBuffer recvBuffer;
+        SHTTPParser parser;
+        uint64_t start = STimeNow();
+        while (responses.size() < requests.size() && STimeNow() < start + STIME_US_PER_S * 60) {
+            SData response;
+            while (responses.size() < requests.size() && parser.parse(recvBuffer, response)) {
+                responses.push_back(move(response));
+            }
+            pollfd readSock = {socket, POLLIN, 0};
+            poll(&readSock, 1, 1000);
+            if ((readSock.revents & POLLIN) && !S_recvappend(socket, recvBuffer)) {
+                break;
+            }
+        }
+        close(socket);
+        return responses;
+    }
+
+    // A mix of queries, which are handled by workers, and pings, which the server answers as soon as it reads them,
+    // so the responses are ready in a different order than the requests were sent.
+    void verifyInOrder(BedrockTester& tester) {
+        vector<SData> requests;
+        for (int i = 0; i < 60; i++) {
+            SData request(i % 3 ? "Query" : "Ping");
+            if (i % 3) {
+                request["query"] = "SELECT " + to_string(i) + ";";
+                request["format"] = "json";
+            }
+            requests.push_back(request);
+        }
+        vector<SData> responses = sendPipelined(tester, requests);
+        ASSERT_EQUAL(responses.size(), requests.size());
+        for (size_t i = 0; i < responses.size(); i++) {
+            ASSERT_TRUE(SStartsWith(responses[i].methodLine, "200"));
+            if (requests[i].methodLine == "Query") {
+                ASSERT_TRUE(SContains(responses[i].content, to_string(i)));
+            } else {
+                ASSERT_TRUE(responses[i].content.empty());
+            }
+        }
+    }
+
+    void testMainThread() {
+        BedrockTester tester({{"-maxRequestsInFlight", "8"}}, {});
+        verifyInOrder(tester);
+    }
+
+    void testIOThreads() {
+        BedrockTester tester({{"-maxRequestsInFlight", "8"}, {"-ioThreads", "2"}}, {});
+        verifyInOrder(tester);
+    }
+
+    void testFutureCommand() {
+        // Commands scheduled to run later are answered with a 202 as soon as they're read. When they do run, they
+        // mustn't send anything else, or the responses after them would be out of step with their requests.
+        BedrockTester tester({{"-ioThreads", "2"}}, {});
+        vector<SData> requests;
+        for (int i = 0; i < 4; i++) {
+            SData request("Query");
+            request["query"] = "SELECT " + to_string(i * 100) + ";";
+            request["format"] = "json";
+            if (i == 0 || i == 3) {
+                request["commandExecuteTime"] = to_string(STimeNow() + STIME_US_PER_S);
+            }
+            requests.push_back(request);
+        }
+        vector<SData> responses = sendPipelined(tester, requests);
+        ASSERT_EQUAL(responses.size(), requests.size());
+        ASSERT_TRUE(SStartsWith(responses[0].methodLine, "202"));
+        ASSERT_TRUE(SStartsWith(responses[1].methodLine, "200"));
+        ASSERT_TRUE(SContains(responses[1].content, "100"));
+        ASSERT_TRUE(SStartsWith(responses[2].methodLine, "200"));
+        ASSERT_TRUE(SContains(responses[2].content, "200"));
+        ASSERT_TRUE(SStartsWith(responses[3].methodLine, "202"));
+    }
+
+} __PipeliningTest;
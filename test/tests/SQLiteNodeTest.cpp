@@ -13,6 +13,10 @@ class SQLiteNodeTester {
     static void updateSyncPeer(SQLiteNode& node) {
         node._updateSyncPeer();
     }
+
+    static void addMasterCommit(SQLiteNode& node, uint64_t commitCount, uint64_t time) {
+        node._masterCommits.emplace_back(commitCount, time);
+    }
 };
 
 class TestServer : public SQLiteServer {
@@ -26,7 +30,8 @@ class TestServer : public SQLiteServer {
 
 struct SQLiteNodeTest : tpunit::TestFixture {
     SQLiteNodeTest() : tpunit::TestFixture("SQLiteNode",
-                                           TEST(SQLiteNodeTest::testFindSyncPeer)) { }
+                                           TEST(SQLiteNodeTest::testFindSyncPeer),
+                                           TEST(SQLiteNodeTest::testStalenessBound)) { }
 
     void testFindSyncPeer() {
 
@@ -109,4 +114,40 @@ struct SQLiteNodeTest : tpunit::TestFixture {
         ASSERT_EQUAL(SQLiteNodeTester::getSyncPeer(testNode), fastest);
     }
 
+    void testStalenessBound() {
+        SQLite db(":memory:", 1000000, 100, 5000, -1, -1);
+        TestServer server("");
+        SQLiteNode testNode(server, db, "test", "localhost:9999", "", 1, 1000000000, "1.0", 100);
+
+        // Nothing from the master, so no lag, and any read can be served.
+        uint64_t commits, ms;
+        testNode.getReplicationLag(commits, ms);
+        ASSERT_EQUAL(commits, 0);
+        ASSERT_EQUAL(ms, 0);
+
+        // The master has told us about three newer commits, 10s, 5s, and 1s ago.
+        uint64_t base = db.getCommitCount();
+        uint64_t now = STimeNow();
+        SQLiteNodeTester::addMasterCommit(testNode, base + 5, now - 10 * STIME_US_PER_S);
+        SQLiteNodeTester::addMasterCommit(testNode, base + 10, now - 5 * STIME_US_PER_S);
+        SQLiteNodeTester::addMasterCommit(testNode, base + 20, now - 1 * STIME_US_PER_S);
+        testNode.getReplicationLag(commits, ms);
+        ASSERT_EQUAL(commits, 20);
+        ASSERT_GREATER_THAN_EQUAL(ms, 10000);
+
+        // Within 3 seconds means we need everything the master had 3 seconds ago.
+        ASSERT_EQUAL(testNode.getStalenessBoundCommitCount(now, UINT64_MAX, 3000), base + 10);
+
+        // Within 5 commits of what the master has now.
+        ASSERT_EQUAL(testNode.getStalenessBoundCommitCount(now, 5, UINT64_MAX), base + 15);
+
+        // A loose enough bound needs nothing we don't already have.
+        ASSERT_LESS_THAN_EQUAL(testNode.getStalenessBoundCommitCount(now, UINT64_MAX, 60000), base);
+        ASSERT_LESS_THAN_EQUAL(testNode.getStalenessBoundCommitCount(now, 100, UINT64_MAX), base);
+
+        // A request that arrived 6 seconds ago only needed what the master had then, regardless of what it's sent
+        // since.
+        ASSERT_EQUAL(testNode.getStalenessBoundCommitCount(now - 6 * STIME_US_PER_S, 0, UINT64_MAX), base + 5);
+    }
+
 } __SQLiteNodeTest;
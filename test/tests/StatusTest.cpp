@@ -19,6 +19,7 @@ struct StatusTest : tpunit::TestFixture {
         ASSERT_TRUE(SContains(response, "plugins"));
         ASSERT_TRUE(SContains(response, "multiWriteManualBlacklist"));
         ASSERT_TRUE(SContains(response, "multiWriteAutoBlacklist"));
+        ASSERT_TRUE(SContains(response, "multiWriteConflictCounts"));
     }
 
 } __StatusTest;
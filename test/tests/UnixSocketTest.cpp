@@ -0,0 +1,55 @@
+#include <test/lib/BedrockTester.h>
+
+struct UnixSocketTest : tpunit::TestFixture {
+    UnixSocketTest()
+        : tpunit::TestFixture("UnixSocket",
+                              TEST(UnixSocketTest::testCommandPort),
+                              TEST(UnixSocketTest::testControlCommand),
+                              TEST(UnixSocketTest::testExistingSocketFile)) { }
+
+    string socketPath() {
+        return "/tmp/bedrocktest_" + to_string(getpid()) + ".sock";
+    }
+
+    void testCommandPort() {
+        BedrockTester tester({{"-serverHost", "unix:" + socketPath()}}, {});
+        vector<SData> requests(20, SData("Ping"));
+        for (const SData& response : tester.executeWaitMultipleData(requests, 4)) {
+            ASSERT_TRUE(SStartsWith(response.methodLine, "200"));
+        }
+    }
+
+    void testControlCommand() {
+        // Anything connecting on a Unix domain socket is local, so it can run control commands. This one closes the
+        // command port, which should remove the socket file.
+        BedrockTester tester({{"-serverHost", "unix:" + socketPath()}}, {});
+        ASSERT_TRUE(SFileExists(socketPath()));
+        tester.executeWaitVerifyContent(SData("SuppressCommandPort"));
+        uint64_t start = STimeNow();
+        while (SFileExists(socketPath()) && STimeNow() < start + STIME_US_PER_S * 5) {
+            usleep(10000);
+        }
+        ASSERT_FALSE(SFileExists(socketPath()));
+    }
+
+    void testExistingSocketFile() {
+        // We can't take over a path that something is still listening on, and we don't remove its socket file.
+        const string host = "unix:" + socketPath();
+        int listener = S_socket(host, true, true, false);
+        ASSERT_TRUE(listener != -1);
+        ASSERT_EQUAL(S_socket(host, true, true, false), -1);
+        ASSERT_TRUE(SFileExists(socketPath()));
+        int client = S_socket(host, true, false, true);
+        ASSERT_TRUE(client != -1);
+        close(client);
+
+        // Once the listener's gone, the file it left behind is stale, and is replaced.
+        close(listener);
+        ASSERT_TRUE(SFileExists(socketPath()));
+        listener = S_socket(host, true, true, false);
+        ASSERT_TRUE(listener != -1);
+        close(listener);
+        unlink(socketPath().c_str());
+    }
+
+} __UnixSocketTest;
@@ -0,0 +1,191 @@
+#include <test/lib/BedrockTester.h>
+
+struct ArchiveJobsTest : tpunit::TestFixture {
+    ArchiveJobsTest()
+        : tpunit::TestFixture("ArchiveJobs",
+                              BEFORE_CLASS(ArchiveJobsTest::setupClass),
+                              TEST(ArchiveJobsTest::failedJob),
+                              TEST(ArchiveJobsTest::updateAndCancelArchived),
+                              TEST(ArchiveJobsTest::cancelledJob),
+                              TEST(ArchiveJobsTest::uniqueFindsArchived),
+                              TEST(ArchiveJobsTest::childOfRunningParent),
+                              AFTER(ArchiveJobsTest::tearDown),
+                              AFTER_CLASS(ArchiveJobsTest::tearDownClass)) { }
+
+    BedrockTester* tester;
+
+    void setupClass() {
+        tester = new BedrockTester({{"-plugins", "Jobs,DB"}, {"-jobs.archiveInterval", "1"}}, {});
+    }
+
+    // Reset the jobs and archive tables
+    void tearDown() {
+        SData command("Query");
+        command["query"] = "DELETE FROM jobs WHERE jobID > 0;";
+        tester->executeWaitVerifyContent(command);
+        command["query"] = "DELETE FROM jobsArchive WHERE jobID > 0;";
+        tester->executeWaitVerifyContent(command);
+    }
+
+    void tearDownClass() { delete tester; }
+
+    string createJob(const string& name, const string& parentJobID = "") {
+        SData command("CreateJob");
+        command["name"] = name;
+        if (!parentJobID.empty()) {
+            command["parentJobID"] = parentJobID;
+        }
+        return tester->executeWaitVerifyContentTable(command)["jobID"];
+    }
+
+    // Waits up to 10 seconds for a job to be moved to the archive, and returns whether it was.
+    bool waitForArchive(const string& jobID) {
+        uint64_t start = STimeNow();
+        while (STimeNow() - start < 10 * STIME_US_PER_S) {
+            if (tester->readDB("SELECT COUNT(*) FROM jobsArchive WHERE jobID = " + jobID + ";") == "1") {
+                return true;
+            }
+            usleep(100 * 1000);
+        }
+        return false;
+    }
+
+    void failedJob() {
+        // Get a job and fail it. A job that's still queued stays where it is.
+        string jobID = createJob("fail");
+        string queuedID = createJob("queued");
+        SData command("GetJob");
+        command["name"] = "fail";
+        tester->executeWaitVerifyContent(command);
+        command.clear();
+        command.methodLine = "FailJob";
+        command["jobID"] = jobID;
+        tester->executeWaitVerifyContent(command);
+        ASSERT_TRUE(waitForArchive(jobID));
+        ASSERT_EQUAL(tester->readDB("SELECT COUNT(*) FROM jobs WHERE jobID = " + jobID + ";"), "0");
+        ASSERT_EQUAL(tester->readDB("SELECT state FROM jobs WHERE jobID = " + queuedID + ";"), "QUEUED");
+
+        // QueryJob still finds it.
+        command.clear();
+        command.methodLine = "QueryJob";
+        command["jobID"] = jobID;
+        STable job = tester->executeWaitVerifyContentTable(command);
+        ASSERT_EQUAL(job["state"], "FAILED");
+        ASSERT_EQUAL(job["name"], "fail");
+        ASSERT_FALSE(job["archived"].empty());
+
+        // And DeleteJob deletes it from the archive.
+        command.methodLine = "DeleteJob";
+        tester->executeWaitVerifyContent(command);
+        ASSERT_EQUAL(tester->readDB("SELECT COUNT(*) FROM jobsArchive WHERE jobID = " + jobID + ";"), "0");
+        command.methodLine = "QueryJob";
+        tester->executeWaitVerifyContent(command, "404");
+    }
+
+    void updateAndCancelArchived() {
+        // Fail a job and let it be archived.
+        string jobID = createJob("fail");
+        SData command("GetJob");
+        command["name"] = "fail";
+        tester->executeWaitVerifyContent(command);
+        command.clear();
+        command.methodLine = "FailJob";
+        command["jobID"] = jobID;
+        tester->executeWaitVerifyContent(command);
+        ASSERT_TRUE(waitForArchive(jobID));
+
+        // Its data can still be updated, but it can't be rescheduled.
+        command.clear();
+        command.methodLine = "UpdateJob";
+        command["jobID"] = jobID;
+        command["data"] = "{\"updated\":true}";
+        tester->executeWaitVerifyContent(command);
+        ASSERT_EQUAL(tester->readDB("SELECT data FROM jobsArchive WHERE jobID = " + jobID + ";"),
+                     "{\"updated\":true}");
+        command["repeat"] = "SCHEDULED, +1 HOUR";
+        tester->executeWaitVerifyContent(command, "402");
+
+        // And it can still be cancelled, after which cancelling it again is a no-op.
+        command.clear();
+        command.methodLine = "CancelJob";
+        command["jobID"] = jobID;
+        tester->executeWaitVerifyContent(command);
+        ASSERT_EQUAL(tester->readDB("SELECT state FROM jobsArchive WHERE jobID = " + jobID + ";"), "CANCELLED");
+        tester->executeWaitVerifyContent(command);
+
+        // Jobs that were never there are still missing.
+        command["jobID"] = "999999";
+        tester->executeWaitVerifyContent(command, "404");
+        command.clear();
+        command.methodLine = "UpdateJob";
+        command["jobID"] = "999999";
+        command["data"] = "{}";
+        tester->executeWaitVerifyContent(command, "404");
+    }
+
+    void cancelledJob() {
+        // Cancel a child of a job that's gone, so there's no parent to keep it around for.
+        SData command("Query");
+        command["query"] = "INSERT INTO jobs (created, jobID, state, name, nextRun, repeat, data, priority, "
+                           "parentJobID) VALUES (" + SCURRENT_TIMESTAMP() + ", 1000, 'CANCELLED', 'cancelled', " +
+                           SCURRENT_TIMESTAMP() + ", '', '{}', 500, 999);";
+        tester->executeWaitVerifyContent(command);
+        ASSERT_TRUE(waitForArchive("1000"));
+    }
+
+    void uniqueFindsArchived() {
+        // Fail a job and let it be archived.
+        string jobID = createJob("unique");
+        SData command("GetJob");
+        command["name"] = "unique";
+        tester->executeWaitVerifyContent(command);
+        command.clear();
+        command.methodLine = "FailJob";
+        command["jobID"] = jobID;
+        tester->executeWaitVerifyContent(command);
+        ASSERT_TRUE(waitForArchive(jobID));
+
+        // A unique job with the same name still gets it back, with CreateJob or CreateJobs.
+        command.clear();
+        command.methodLine = "CreateJob";
+        command["name"] = "unique";
+        command["unique"] = "true";
+        ASSERT_EQUAL(tester->executeWaitVerifyContentTable(command)["jobID"], jobID);
+        command.clear();
+        command.methodLine = "CreateJobs";
+        command["jobs"] = "[{\"name\":\"unique\",\"unique\":\"true\"},"
+                          "{\"name\":\"unique\",\"unique\":\"true\",\"data\":{\"updated\":true}}]";
+        STable response = tester->executeWaitVerifyContentTable(command);
+        ASSERT_EQUAL(response["jobIDs"], "[" + jobID + "," + jobID + "]");
+
+        // The second one had different data, so the archived job was updated.
+        ASSERT_EQUAL(tester->readDB("SELECT data FROM jobsArchive WHERE jobID = " + jobID + ";"),
+                     "{\"updated\":true}");
+        ASSERT_EQUAL(tester->readDB("SELECT COUNT(*) FROM jobs WHERE name = 'unique';"), "0");
+    }
+
+    void childOfRunningParent() {
+        // A finished child is kept while its parent is still around to get it. FinishJob on the parent deletes it.
+        string parentID = createJob("parent");
+        SData command("GetJob");
+        command["name"] = "parent";
+        tester->executeWaitVerifyContent(command);
+        string childID = createJob("child", parentID);
+        command.clear();
+        command.methodLine = "FinishJob";
+        command["jobID"] = parentID;
+        tester->executeWaitVerifyContent(command);
+        command.clear();
+        command.methodLine = "GetJob";
+        command["name"] = "child";
+        tester->executeWaitVerifyContent(command);
+        command.clear();
+        command.methodLine = "FinishJob";
+        command["jobID"] = childID;
+        tester->executeWaitVerifyContent(command);
+        sleep(3);
+        ASSERT_EQUAL(tester->readDB("SELECT state FROM jobs WHERE jobID = " + childID + ";"), "FINISHED");
+        ASSERT_EQUAL(tester->readDB("SELECT COUNT(*) FROM jobsArchive;"), "0");
+    }
+
+} __ArchiveJobsTest;
@@ -7,6 +7,7 @@ struct CreateJobsTest : tpunit::TestFixture {
                               TEST(CreateJobsTest::create),
                               TEST(CreateJobsTest::createWithInvalidJson),
                               TEST(CreateJobsTest::createWithParentIDNotRunning),
+                              TEST(CreateJobsTest::uniqueWithinList),
                               AFTER(CreateJobsTest::tearDown),
                               AFTER_CLASS(CreateJobsTest::tearDownClass)) { }
 
@@ -53,6 +54,28 @@ struct CreateJobsTest : tpunit::TestFixture {
         tester->executeWaitVerifyContent(command, "405 Can only create child job when parent is RUNNING or PAUSED");
     }
 
+    void uniqueWithinList() {
+        // A unique job finds one earlier in the same list, just as if they'd been created one at a time: the same
+        // data reuses it, and different data is patched into it.
+        SData command("CreateJobs");
+        command["jobs"] = "[{\"name\":\"other\"}, "
+                          "{\"name\":\"unique\", \"data\":{\"a\":1}, \"unique\":\"true\"}, "
+                          "{\"name\":\"unique\", \"data\":{\"a\":1}, \"unique\":\"true\"}, "
+                          "{\"name\":\"unique\", \"data\":{\"b\":2}, \"unique\":\"true\"}, "
+                          "{\"name\":\"unique\", \"data\":{\"a\":1,\"b\":2}, \"unique\":\"true\"}]";
+        vector<string> jobIDs;
+        for (const string& jobID : SParseJSONArray(getJsonResult(command)["jobIDs"])) {
+            jobIDs.push_back(jobID);
+        }
+        ASSERT_EQUAL(jobIDs.size(), 5);
+        ASSERT_NOT_EQUAL(jobIDs[0], jobIDs[1]);
+        for (size_t i = 2; i < jobIDs.size(); i++) {
+            ASSERT_EQUAL(jobIDs[i], jobIDs[1]);
+        }
+        ASSERT_EQUAL(tester->readDB("SELECT data FROM jobs WHERE jobID = " + jobIDs[1] + ";"), "{\"a\":1,\"b\":2}");
+        ASSERT_EQUAL(tester->readDB("SELECT COUNT(*) FROM jobs;"), "2");
+    }
+
     STable getJsonResult(SData command) {
         string resultJson = tester->executeWaitVerifyContent(command);
         return SParseJSONObject(resultJson);
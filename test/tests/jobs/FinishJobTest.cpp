@@ -312,8 +312,8 @@ struct FinishJobTest : tpunit::TestFixture {
         // Assert the new nextRun value is correct
         tester->readDB("SELECT nextRun FROM jobs WHERE jobID = " + jobID + ";", result);
         string currentNextRun = result[0][0];
-        struct tm tm1;
-        struct tm tm2;
+        struct tm tm1 = {};
+        struct tm tm2 = {};
         strptime(originalNextRun.c_str(), "%Y-%m-%d %H:%M:%S", &tm1);
         time_t originalNextRunTime = mktime(&tm1);
         strptime(currentNextRun.c_str(), "%Y-%m-%d %H:%M:%S", &tm2);
@@ -345,8 +345,8 @@ struct FinishJobTest : tpunit::TestFixture {
         // Confirm nextRun is in 1 hour
         SQResult result;
         tester->readDB("SELECT created, nextRun FROM jobs WHERE jobID = " + jobID + ";", result);
-        struct tm tm1;
-        struct tm tm2;
+        struct tm tm1 = {};
+        struct tm tm2 = {};
         strptime(result[0][0].c_str(), "%Y-%m-%d %H:%M:%S", &tm1);
         time_t createdTime = mktime(&tm1);
         strptime(result[0][1].c_str(), "%Y-%m-%d %H:%M:%S", &tm2);
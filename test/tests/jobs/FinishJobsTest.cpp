@@ -0,0 +1,152 @@
+#include <test/lib/BedrockTester.h>
+
+struct FinishJobsTest : tpunit::TestFixture {
+    FinishJobsTest()
+        : tpunit::TestFixture("FinishJobs",
+                              BEFORE_CLASS(FinishJobsTest::setupClass),
+                              TEST(FinishJobsTest::finishMany),
+                              TEST(FinishJobsTest::perJobResults),
+                              TEST(FinishJobsTest::retryMany),
+                              TEST(FinishJobsTest::siblingsResumeParent),
+                              TEST(FinishJobsTest::invalidJson),
+                              AFTER(FinishJobsTest::tearDown),
+                              AFTER_CLASS(FinishJobsTest::tearDownClass)) { }
+
+    BedrockTester* tester;
+
+    void setupClass() { tester = new BedrockTester({{"-plugins", "Jobs,DB"}}, {});}
+
+    // Reset the jobs table
+    void tearDown() {
+        SData command("Query");
+        command["query"] = "DELETE FROM jobs WHERE jobID > 0;";
+        tester->executeWaitVerifyContent(command);
+    }
+
+    void tearDownClass() { delete tester; }
+
+    // Creates `count` jobs called `name`, gets them all, and returns their IDs.
+    list<string> createAndGetJobs(const string& name, int count, const string& repeat = "") {
+        list<string> jobs;
+        for (int i = 0; i < count; i++) {
+            STable job;
+            job["name"] = name;
+            if (!repeat.empty()) {
+                job["repeat"] = repeat;
+            }
+            jobs.push_back(SComposeJSONObject(job));
+        }
+        SData command("CreateJobs");
+        command["jobs"] = SComposeJSONArray(jobs);
+        list<string> jobIDs = SParseJSONArray(tester->executeWaitVerifyContentTable(command)["jobIDs"]);
+        command.clear();
+        command.methodLine = "GetJobs";
+        command["name"] = name;
+        command["numResults"] = to_string(count);
+        tester->executeWaitVerifyContent(command);
+        return jobIDs;
+    }
+
+    // Sends `verb` for each of `jobIDs`, with `extra` added to each, and returns the results.
+    list<string> bulk(const string& verb, const list<string>& jobIDs, const map<string, string>& extra = {}) {
+        list<string> jobs;
+        for (const string& jobID : jobIDs) {
+            STable job;
+            for (auto& value : extra) {
+                job[value.first] = value.second;
+            }
+            job["jobID"] = jobID;
+            jobs.push_back(SComposeJSONObject(job));
+        }
+        SData command(verb);
+        command["jobs"] = SComposeJSONArray(jobs);
+        list<string> results;
+        for (const string& result : SParseJSONArray(tester->executeWaitVerifyContentTable(command)["results"])) {
+            results.push_back(SParseJSONObject(result)["result"]);
+        }
+        return results;
+    }
+
+    void finishMany() {
+        // Finishing standalone jobs deletes them, and their data doesn't matter.
+        list<string> jobIDs = createAndGetJobs("many", 50);
+        list<string> results = bulk("FinishJobs", jobIDs, {{"data", "{\"done\":true}"}});
+        ASSERT_EQUAL(results.size(), 50);
+        for (const string& result : results) {
+            ASSERT_EQUAL(result, "200 OK");
+        }
+        ASSERT_EQUAL(tester->readDB("SELECT COUNT(*) FROM jobs;"), "0");
+    }
+
+    void perJobResults() {
+        // Each job gets the result FinishJob would have given it, and the good ones are finished regardless.
+        list<string> running = createAndGetJobs("running", 2);
+        SData command("CreateJob");
+        command["name"] = "queued";
+        string queued = tester->executeWaitVerifyContentTable(command)["jobID"];
+        list<string> jobIDs = {running.front(), queued, "999999", running.front(), running.back(), "x"};
+        list<string> results = bulk("FinishJobs", jobIDs);
+        ASSERT_EQUAL(results, list<string>({"200 OK", "405 Can only retry/finish RUNNING jobs",
+                                            "404 No job with this jobID", "402 Duplicate jobID", "200 OK",
+                                            "402 Malformed jobID"}));
+        ASSERT_EQUAL(tester->readDB("SELECT GROUP_CONCAT(jobID) FROM jobs;"), queued);
+    }
+
+    void retryMany() {
+        // Retried jobs are requeued with their new data, after their delay, or at their next repeat.
+        list<string> jobIDs = createAndGetJobs("retry", 10);
+        list<string> repeating = createAndGetJobs("repeat", 10, "SCHEDULED, +1 HOUR");
+        list<string> results = bulk("RetryJobs", jobIDs, {{"delay", "5"}, {"data", "{\"retried\":true}"}});
+        for (const string& result : results) {
+            ASSERT_EQUAL(result, "200 OK");
+        }
+        results = bulk("RetryJobs", repeating);
+        for (const string& result : results) {
+            ASSERT_EQUAL(result, "200 OK");
+        }
+        ASSERT_EQUAL(tester->readDB("SELECT COUNT(*) FROM jobs WHERE state = 'QUEUED' AND name = 'retry' "
+                                    "AND data = '{\"retried\":true}' AND nextRun > " + SCURRENT_TIMESTAMP() + ";"),
+                     "10");
+        ASSERT_EQUAL(tester->readDB("SELECT COUNT(*) FROM jobs WHERE state = 'QUEUED' AND name = 'repeat' "
+                                    "AND nextRun > DATETIME(" + SCURRENT_TIMESTAMP() + ", '+50 MINUTES');"),
+                     "10");
+
+        // A negative delay is only an error for the job it's on.
+        list<string> more = createAndGetJobs("negative", 2);
+        ASSERT_EQUAL(bulk("RetryJobs", {more.front()}, {{"delay", "-1"}}).front(),
+                     "402 Must specify a non-negative delay when retrying");
+    }
+
+    void siblingsResumeParent() {
+        // Create a parent with two children, and finish the parent so the children can run.
+        list<string> parent = createAndGetJobs("parent", 1);
+        string parentID = parent.front();
+        SData command("CreateJobs");
+        command["jobs"] = "[{\"name\":\"child\", \"parentJobID\":" + parentID + "}, "
+                          "{\"name\":\"child\", \"parentJobID\":" + parentID + "}]";
+        list<string> children = SParseJSONArray(tester->executeWaitVerifyContentTable(command)["jobIDs"]);
+        ASSERT_EQUAL(bulk("FinishJobs", parent).front(), "200 OK");
+        ASSERT_EQUAL(tester->readDB("SELECT state FROM jobs WHERE jobID = " + parentID + ";"), "PAUSED");
+
+        // Finishing both children at once resumes the parent.
+        command.clear();
+        command.methodLine = "GetJobs";
+        command["name"] = "child";
+        command["numResults"] = "2";
+        tester->executeWaitVerifyContent(command);
+        ASSERT_EQUAL(bulk("FinishJobs", children), list<string>({"200 OK", "200 OK"}));
+        ASSERT_EQUAL(tester->readDB("SELECT state FROM jobs WHERE jobID = " + parentID + ";"), "QUEUED");
+        ASSERT_EQUAL(tester->readDB("SELECT COUNT(*) FROM jobs WHERE parentJobID = " + parentID +
+                                    " AND state = 'FINISHED';"),
+                     "2");
+    }
+
+    void invalidJson() {
+        SData command("FinishJobs");
+        command["jobs"] = "[]";
+        tester->executeWaitVerifyContent(command, "401 Invalid JSON");
+        command["jobs"] = "[{\"jobID\":1}, 2]";
+        tester->executeWaitVerifyContent(command, "401 Invalid JSON");
+    }
+
+} __FinishJobsTest;
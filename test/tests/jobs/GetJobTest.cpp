@@ -0,0 +1,214 @@
+#include <test/lib/BedrockTester.h>
+
+struct GetJobTest : tpunit::TestFixture {
+    GetJobTest()
+        : tpunit::TestFixture("GetJob",
+                              BEFORE_CLASS(GetJobTest::setupClass),
+                              TEST(GetJobTest::noJob),
+                              TEST(GetJobTest::priorityOrder),
+                              TEST(GetJobTest::notYetDue),
+                              TEST(GetJobTest::namePatterns),
+                              TEST(GetJobTest::retriedJob),
+                              TEST(GetJobTest::childAndParentData),
+                              TEST(GetJobTest::changedByQuery),
+                              TEST(GetJobTest::waitForNewJob),
+                              TEST(GetJobTest::waitForDueJob),
+                              TEST(GetJobTest::waitTimeout),
+                              AFTER(GetJobTest::tearDown),
+                              AFTER_CLASS(GetJobTest::tearDownClass)) { }
+
+    BedrockTester* tester;
+
+    void setupClass() { tester = new BedrockTester({{"-plugins", "Jobs,DB"}}, {});}
+
+    // Reset the jobs table
+    void tearDown() {
+        SData command("Query");
+        command["query"] = "DELETE FROM jobs WHERE jobID > 0;";
+        tester->executeWaitVerifyContent(command);
+    }
+
+    void tearDownClass() { delete tester; }
+
+    string createJob(const string& name, const string& priority = "", const string& firstRun = "") {
+        SData command("CreateJob");
+        command["name"] = name;
+        if (!priority.empty()) {
+            command["priority"] = priority;
+        }
+        if (!firstRun.empty()) {
+            command["firstRun"] = firstRun;
+        }
+        return tester->executeWaitVerifyContentTable(command)["jobID"];
+    }
+
+    // Returns the IDs of the jobs GetJobs gives us, in order, or nothing if we get a 404.
+    list<string> getJobs(const string& name, int numResults) {
+        SData command("GetJobs");
+        command["name"] = name;
+        command["numResults"] = to_string(numResults);
+        SData response = tester->executeWaitMultipleData({command}, 1).front();
+        list<string> jobIDs;
+        if (SStartsWith(response.methodLine, "404")) {
+            return jobIDs;
+        }
+        if (!SStartsWith(response.methodLine, "200")) {
+            throw BedrockTestException("Expected 200, but got: " + response.methodLine);
+        }
+        for (const string& job : SParseJSONArray(SParseJSONObject(response.content)["jobs"])) {
+            jobIDs.push_back(SParseJSONObject(job)["jobID"]);
+        }
+        return jobIDs;
+    }
+
+    // Sends a GetJob that waits up to `timeoutMS` for a job, and returns the response.
+    SData waitForJob(const string& name, int timeoutMS) {
+        SData command("GetJob");
+        command["name"] = name;
+        command["Connection"] = "wait";
+        command["timeout"] = to_string(timeoutMS);
+        return tester->executeWaitMultipleData({command}, 1).front();
+    }
+
+    void noJob() {
+        SData command("GetJob");
+        command["name"] = "nothing";
+        tester->executeWaitVerifyContent(command, "404");
+    }
+
+    void priorityOrder() {
+        // Jobs come out highest priority first, then in the order they're due.
+        string low = createJob("order", "0", "2000-01-01 00:00:00");
+        string mediumLater = createJob("order", "500", "2000-01-02 00:00:00");
+        string mediumEarlier = createJob("order", "500", "2000-01-01 00:00:00");
+        string high = createJob("order", "1000", "2000-01-03 00:00:00");
+        ASSERT_EQUAL(getJobs("order", 3), list<string>({high, mediumEarlier, mediumLater}));
+        ASSERT_EQUAL(getJobs("order", 3), list<string>({low}));
+
+        // They're all RUNNING now.
+        SData command("GetJob");
+        command["name"] = "order";
+        tester->executeWaitVerifyContent(command, "404");
+        ASSERT_EQUAL(tester->readDB("SELECT COUNT(*) FROM jobs WHERE state = 'RUNNING';"), "4");
+    }
+
+    void notYetDue() {
+        createJob("future", "", "2100-01-01 00:00:00");
+        SData command("GetJob");
+        command["name"] = "future";
+        tester->executeWaitVerifyContent(command, "404");
+    }
+
+    void namePatterns() {
+        string a = createJob("pattern/a", "", "2000-01-01 00:00:00");
+        string b = createJob("pattern/b", "", "2000-01-02 00:00:00");
+        createJob("other");
+        ASSERT_EQUAL(getJobs("pattern/*", 10), list<string>({a, b}));
+        ASSERT_TRUE(getJobs("pattern/?", 10).empty());
+        ASSERT_EQUAL(getJobs("oth[e]r", 10).size(), 1);
+    }
+
+    void retriedJob() {
+        string jobID = createJob("retry");
+        ASSERT_EQUAL(getJobs("retry", 1), list<string>({jobID}));
+
+        // Once it's retried it's QUEUED again, so we can get it again.
+        SData command("RetryJob");
+        command["jobID"] = jobID;
+        command["delay"] = "0";
+        tester->executeWaitVerifyContent(command);
+        ASSERT_EQUAL(getJobs("retry", 1), list<string>({jobID}));
+    }
+
+    void childAndParentData() {
+        // Create a parent, get it, and give it a child.
+        string parentID = createJob("parent");
+        getJobs("parent", 1);
+        SData command("CreateJob");
+        command["name"] = "child";
+        command["parentJobID"] = parentID;
+        command["data"] = "{\"child\":true}";
+        string childID = tester->executeWaitVerifyContentTable(command)["jobID"];
+        command.clear();
+        command.methodLine = "FinishJob";
+        command["jobID"] = parentID;
+        tester->executeWaitVerifyContent(command);
+
+        // The child gets its parent's data.
+        command.clear();
+        command.methodLine = "GetJob";
+        command["name"] = "child";
+        STable child = tester->executeWaitVerifyContentTable(command);
+        ASSERT_EQUAL(child["jobID"], childID);
+        ASSERT_EQUAL(child["parentJobID"], parentID);
+        ASSERT_EQUAL(child["parentData"], "{}");
+
+        // Once the child finishes, the parent gets the child's data.
+        command.clear();
+        command.methodLine = "FinishJob";
+        command["jobID"] = childID;
+        tester->executeWaitVerifyContent(command);
+        command.clear();
+        command.methodLine = "GetJob";
+        command["name"] = "parent";
+        STable parent = tester->executeWaitVerifyContentTable(command);
+        list<string> finished = SParseJSONArray(parent["finishedChildJobs"]);
+        ASSERT_EQUAL(finished.size(), 1);
+        ASSERT_EQUAL(SParseJSONObject(finished.front())["jobID"], childID);
+        ASSERT_EQUAL(SParseJSONObject(finished.front())["data"], "{\"child\":true}");
+    }
+
+    void changedByQuery() {
+        // Changes made directly to the jobs table, rather than with Jobs commands, are seen as well.
+        string jobID = createJob("query");
+        SData command("Query");
+        command["query"] = "UPDATE jobs SET state = 'FAILED' WHERE jobID = " + jobID + ";";
+        tester->executeWaitVerifyContent(command);
+        ASSERT_TRUE(getJobs("query", 1).empty());
+        command["query"] = "UPDATE jobs SET state = 'QUEUED' WHERE jobID = " + jobID + ";";
+        tester->executeWaitVerifyContent(command);
+        ASSERT_EQUAL(getJobs("query", 1), list<string>({jobID}));
+
+        // Including deleting the whole table at once.
+        createJob("query");
+        command["query"] = "DELETE FROM jobs;";
+        command["nowhere"] = "true";
+        tester->executeWaitVerifyContent(command);
+        ASSERT_TRUE(getJobs("query", 1).empty());
+    }
+
+    void waitForNewJob() {
+        // Start waiting before there's a job, and then create one. Another job with a different name doesn't count.
+        uint64_t start = STimeNow();
+        SData response;
+        thread waiter([&]() { response = waitForJob("wait/*", 10000); });
+        usleep(500 * 1000);
+        createJob("other");
+        usleep(500 * 1000);
+        string jobID = createJob("wait/new");
+        waiter.join();
+        ASSERT_TRUE(SStartsWith(response.methodLine, "200"));
+        ASSERT_EQUAL(SParseJSONObject(response.content)["jobID"], jobID);
+        ASSERT_TRUE(STimeNow() - start < 5 * STIME_US_PER_S);
+    }
+
+    void waitForDueJob() {
+        // A job that's already queued, but not due yet, is picked up as soon as it is.
+        uint64_t start = STimeNow();
+        string jobID = createJob("due", "", SComposeTime("%Y-%m-%d %H:%M:%S", start + 2 * STIME_US_PER_S));
+        SData response = waitForJob("due", 10000);
+        ASSERT_TRUE(SStartsWith(response.methodLine, "200"));
+        ASSERT_EQUAL(SParseJSONObject(response.content)["jobID"], jobID);
+        ASSERT_TRUE(STimeNow() - start > STIME_US_PER_S);
+        ASSERT_TRUE(STimeNow() - start < 5 * STIME_US_PER_S);
+    }
+
+    void waitTimeout() {
+        uint64_t start = STimeNow();
+        SData response = waitForJob("nothing", 500);
+        ASSERT_TRUE(SStartsWith(response.methodLine, "303"));
+        ASSERT_TRUE(STimeNow() - start >= 500 * STIME_US_PER_MS);
+        ASSERT_TRUE(STimeNow() - start < 3 * STIME_US_PER_S);
+    }
+
+} __GetJobTest;
@@ -0,0 +1,143 @@
+#include <test/lib/BedrockTester.h>
+
+struct JobLeaseTest : tpunit::TestFixture {
+    JobLeaseTest()
+        : tpunit::TestFixture("JobLease",
+                              BEFORE_CLASS(JobLeaseTest::setupClass),
+                              TEST(JobLeaseTest::expiredLease),
+                              TEST(JobLeaseTest::renewLease),
+                              TEST(JobLeaseTest::finishedLease),
+                              TEST(JobLeaseTest::renewNotRunning),
+                              TEST(JobLeaseTest::staleRunner),
+                              TEST(JobLeaseTest::badLeaseDuration),
+                              AFTER(JobLeaseTest::tearDown),
+                              AFTER_CLASS(JobLeaseTest::tearDownClass)) { }
+
+    BedrockTester* tester;
+
+    void setupClass() { tester = new BedrockTester({{"-plugins", "Jobs,DB"}}, {});}
+
+    // Reset the jobs table
+    void tearDown() {
+        SData command("Query");
+        command["query"] = "DELETE FROM jobs WHERE jobID > 0;";
+        tester->executeWaitVerifyContent(command);
+    }
+
+    void tearDownClass() { delete tester; }
+
+    // Creates a job and gets it with a lease of `leaseDuration` seconds, returning the GetJob response.
+    STable createAndGetJob(const string& name, int leaseDuration) {
+        SData command("CreateJob");
+        command["name"] = name;
+        tester->executeWaitVerifyContent(command);
+        command.clear();
+        command.methodLine = "GetJob";
+        command["name"] = name;
+        command["leaseDuration"] = to_string(leaseDuration);
+        return tester->executeWaitVerifyContentTable(command);
+    }
+
+    string getState(const string& jobID) {
+        return tester->readDB("SELECT state FROM jobs WHERE jobID = " + jobID + ";");
+    }
+
+    void expiredLease() {
+        // A job whose lease runs out is requeued, and can be got again.
+        STable job = createAndGetJob("lease", 1);
+        ASSERT_FALSE(job["leaseExpires"].empty());
+        ASSERT_EQUAL(getState(job["jobID"]), "RUNNING");
+        uint64_t start = STimeNow();
+        while (getState(job["jobID"]) == "RUNNING" && STimeNow() - start < 10 * STIME_US_PER_S) {
+            usleep(100 * 1000);
+        }
+        ASSERT_EQUAL(getState(job["jobID"]), "QUEUED");
+        ASSERT_EQUAL(tester->readDB("SELECT leaseExpires IS NULL FROM jobs WHERE jobID = " + job["jobID"] + ";"), "1");
+
+        SData command("GetJob");
+        command["name"] = "lease";
+        ASSERT_EQUAL(tester->executeWaitVerifyContentTable(command)["jobID"], job["jobID"]);
+    }
+
+    void renewLease() {
+        STable job = createAndGetJob("renew", 2);
+        ASSERT_FALSE(job["leaseID"].empty());
+        SData command("RenewJobLease");
+        command["jobID"] = job["jobID"];
+        command["leaseDuration"] = "60";
+        command["leaseID"] = job["leaseID"];
+        STable response = tester->executeWaitVerifyContentTable(command);
+        ASSERT_TRUE(response["leaseExpires"] > job["leaseExpires"]);
+
+        // QueryJob shows the new expiry, and the job is still RUNNING after the original lease would have run out.
+        command.clear();
+        command.methodLine = "QueryJob";
+        command["jobID"] = job["jobID"];
+        ASSERT_EQUAL(tester->executeWaitVerifyContentTable(command)["leaseExpires"], response["leaseExpires"]);
+        sleep(4);
+        ASSERT_EQUAL(getState(job["jobID"]), "RUNNING");
+    }
+
+    void finishedLease() {
+        // Retrying a job ends its lease, so it's not in the lease index anymore.
+        STable job = createAndGetJob("finish", 60);
+        SData command("RetryJob");
+        command["jobID"] = job["jobID"];
+        command["delay"] = "0";
+        command["leaseID"] = job["leaseID"];
+        tester->executeWaitVerifyContent(command);
+        ASSERT_EQUAL(tester->readDB("SELECT COUNT(*) FROM jobs WHERE leaseExpires IS NOT NULL OR leaseID IS NOT NULL;"),
+                     "0");
+    }
+
+    void renewNotRunning() {
+        // Once a lease has expired and the job's been requeued, it can't be renewed.
+        SData command("CreateJob");
+        command["name"] = "queued";
+        string jobID = tester->executeWaitVerifyContentTable(command)["jobID"];
+        command.clear();
+        command.methodLine = "RenewJobLease";
+        command["jobID"] = jobID;
+        command["leaseDuration"] = "60";
+        tester->executeWaitVerifyContent(command, "405");
+    }
+
+    void staleRunner() {
+        // A runner whose lease expired can't touch the job once someone else has got it again.
+        STable stale = createAndGetJob("stale", 1);
+        uint64_t start = STimeNow();
+        while (getState(stale["jobID"]) == "RUNNING" && STimeNow() - start < 10 * STIME_US_PER_S) {
+            usleep(100 * 1000);
+        }
+        SData command("GetJob");
+        command["name"] = "stale";
+        command["leaseDuration"] = "60";
+        STable current = tester->executeWaitVerifyContentTable(command);
+        ASSERT_EQUAL(current["jobID"], stale["jobID"]);
+        ASSERT_NOT_EQUAL(current["leaseID"], stale["leaseID"]);
+        for (const char* verb : {"RenewJobLease", "RetryJob", "FinishJob", "FailJob"}) {
+            command.clear();
+            command.methodLine = verb;
+            command["jobID"] = stale["jobID"];
+            command["leaseDuration"] = "60";
+            command["delay"] = "0";
+            command["leaseID"] = stale["leaseID"];
+            tester->executeWaitVerifyContent(command, "409");
+        }
+
+        // Nor can anyone without a leaseID at all, but the runner that holds the lease can.
+        command.erase("leaseID");
+        tester->executeWaitVerifyContent(command, "402");
+        command["leaseID"] = current["leaseID"];
+        tester->executeWaitVerifyContent(command);
+        ASSERT_EQUAL(getState(stale["jobID"]), "FAILED");
+    }
+
+    void badLeaseDuration() {
+        SData command("GetJob");
+        command["name"] = "bad";
+        command["leaseDuration"] = "0";
+        tester->executeWaitVerifyContent(command, "402");
+    }
+
+} __JobLeaseTest;
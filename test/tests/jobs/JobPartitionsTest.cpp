@@ -0,0 +1,149 @@
+#include <test/lib/BedrockTester.h>
+
+struct JobPartitionsTest : tpunit::TestFixture {
+    JobPartitionsTest()
+        : tpunit::TestFixture("JobPartitions",
+                              BEFORE_CLASS(JobPartitionsTest::setupClass),
+                              TEST(JobPartitionsTest::spreadAcrossPartitions),
+                              TEST(JobPartitionsTest::sameQueue),
+                              TEST(JobPartitionsTest::childWithParent),
+                              TEST(JobPartitionsTest::expiredLease),
+                              TEST(JobPartitionsTest::noSuchPartition),
+                              AFTER(JobPartitionsTest::tearDown),
+                              AFTER_CLASS(JobPartitionsTest::tearDownClass)) { }
+
+    BedrockTester* tester;
+
+    void setupClass() { tester = new BedrockTester({{"-plugins", "Jobs,DB"}, {"-jobs.partitions", "4"}}, {});}
+
+    // Reset every partition
+    void tearDown() {
+        SData command("Query");
+        for (const string& table : tables()) {
+            command["query"] = "DELETE FROM " + table + " WHERE jobID > 0;";
+            tester->executeWaitVerifyContent(command);
+        }
+    }
+
+    void tearDownClass() { delete tester; }
+
+    list<string> tables() { return {"jobs", "jobs0001", "jobs0002", "jobs0003"}; }
+
+    int64_t partitionOf(const string& jobID) { return SToInt64(jobID) >> 48; }
+
+    int countRunning() {
+        int running = 0;
+        for (const string& table : tables()) {
+            running += SToInt(tester->readDB("SELECT COUNT(*) FROM " + table + " WHERE state = 'RUNNING';"));
+        }
+        return running;
+    }
+
+    string createJob(const string& name, const string& parentJobID = "") {
+        SData command("CreateJob");
+        command["name"] = name;
+        if (!parentJobID.empty()) {
+            command["parentJobID"] = parentJobID;
+        }
+        return tester->executeWaitVerifyContentTable(command)["jobID"];
+    }
+
+    void spreadAcrossPartitions() {
+        // Jobs in different queues end up in different tables, each in the one its jobID says.
+        list<string> jobIDs;
+        set<int64_t> partitions;
+        for (int i = 0; i < 20; i++) {
+            string jobID = createJob("queue" + to_string(i) + "/job");
+            jobIDs.push_back(jobID);
+            partitions.insert(partitionOf(jobID));
+            string table = partitionOf(jobID) ? "jobs000" + to_string(partitionOf(jobID)) : "jobs";
+            ASSERT_EQUAL(tester->readDB("SELECT name FROM " + table + " WHERE jobID = " + jobID + ";"),
+                         "queue" + to_string(i) + "/job");
+        }
+        ASSERT_TRUE(partitions.size() > 1);
+
+        // GetJobs finds them all, wherever they are, and everything else finds them by jobID.
+        SData command("GetJobs");
+        command["name"] = "queue*";
+        command["numResults"] = "100";
+        STable response = tester->executeWaitVerifyContentTable(command);
+        ASSERT_EQUAL(SParseJSONArray(response["jobs"]).size(), 20);
+        for (const string& jobID : jobIDs) {
+            command.clear();
+            command.methodLine = "QueryJob";
+            command["jobID"] = jobID;
+            ASSERT_EQUAL(tester->executeWaitVerifyContentTable(command)["state"], "RUNNING");
+            command.methodLine = "FinishJob";
+            tester->executeWaitVerifyContent(command);
+        }
+        for (const string& table : tables()) {
+            ASSERT_EQUAL(tester->readDB("SELECT COUNT(*) FROM " + table + ";"), "0");
+        }
+    }
+
+    void sameQueue() {
+        // Jobs in the same queue are always in the same partition.
+        string first = createJob("same/first");
+        ASSERT_EQUAL(partitionOf(createJob("same/second")), partitionOf(first));
+        ASSERT_EQUAL(partitionOf(createJob("same")), partitionOf(first));
+    }
+
+    void childWithParent() {
+        // A child goes in its parent's partition, whatever its name, and the parent gets it back when it resumes. Start
+        // with a parent that isn't in the first partition, so it's clear the child followed it.
+        string parentName;
+        string parentID;
+        for (int i = 0; i < 20 && partitionOf(parentID) == 0; i++) {
+            tearDown();
+            parentName = "parent" + to_string(i);
+            parentID = createJob(parentName);
+        }
+        SData get("GetJob");
+        get["name"] = parentName;
+        tester->executeWaitVerifyContent(get);
+        string childID = createJob("child/job", parentID);
+        ASSERT_EQUAL(partitionOf(childID), partitionOf(parentID));
+
+        SData command("FinishJob");
+        command["jobID"] = parentID;
+        tester->executeWaitVerifyContent(command);
+        command.clear();
+        command.methodLine = "GetJob";
+        command["name"] = "child*";
+        ASSERT_EQUAL(tester->executeWaitVerifyContentTable(command)["jobID"], childID);
+        command.clear();
+        command.methodLine = "FinishJob";
+        command["jobID"] = childID;
+        tester->executeWaitVerifyContent(command);
+        STable parent = tester->executeWaitVerifyContentTable(get);
+        ASSERT_EQUAL(parent["jobID"], parentID);
+        ASSERT_EQUAL(SParseJSONArray(parent["finishedChildJobs"]).size(), 1);
+    }
+
+    void expiredLease() {
+        // The lease sweeper looks in every partition.
+        list<string> jobIDs;
+        for (int i = 0; i < 8; i++) {
+            jobIDs.push_back(createJob("lease" + to_string(i) + "/job"));
+        }
+        SData command("GetJobs");
+        command["name"] = "lease*";
+        command["numResults"] = "8";
+        command["leaseDuration"] = "1";
+        tester->executeWaitVerifyContent(command);
+        uint64_t start = STimeNow();
+        while (countRunning() && STimeNow() - start < 10 * STIME_US_PER_S) {
+            usleep(100 * 1000);
+        }
+        ASSERT_EQUAL(countRunning(), 0);
+    }
+
+    void noSuchPartition() {
+        SData command("QueryJob");
+        command["jobID"] = to_string((int64_t)100 << 48);
+        tester->executeWaitVerifyContent(command, "404");
+        command.methodLine = "DeleteJob";
+        tester->executeWaitVerifyContent(command, "404");
+    }
+
+} __JobPartitionsTest;
@@ -0,0 +1,143 @@
+#include <test/lib/BedrockTester.h>
+
+struct JobTimestampsTest : tpunit::TestFixture {
+    JobTimestampsTest()
+        : tpunit::TestFixture("JobTimestamps",
+                              BEFORE_CLASS(JobTimestampsTest::setupClass),
+                              TEST(JobTimestampsTest::firstRun),
+                              TEST(JobTimestampsTest::malformedFirstRun),
+                              TEST(JobTimestampsTest::repeatMatchesSQLite),
+                              TEST(JobTimestampsTest::insertedByQuery),
+                              TEST(JobTimestampsTest::nextRunChangedByQuery),
+                              AFTER(JobTimestampsTest::tearDown),
+                              AFTER_CLASS(JobTimestampsTest::tearDownClass)) { }
+
+    BedrockTester* tester;
+
+    void setupClass() { tester = new BedrockTester({{"-plugins", "Jobs,DB"}}, {});}
+
+    // Reset the jobs table
+    void tearDown() {
+        SData command("Query");
+        command["query"] = "DELETE FROM jobs WHERE jobID > 0;";
+        tester->executeWaitVerifyContent(command);
+    }
+
+    void tearDownClass() { delete tester; }
+
+    string createJob(const string& name, const string& firstRun, const string& repeat = "") {
+        SData command("CreateJob");
+        command["name"] = name;
+        command["firstRun"] = firstRun;
+        if (!repeat.empty()) {
+            command["repeat"] = repeat;
+        }
+        return tester->executeWaitVerifyContentTable(command)["jobID"];
+    }
+
+    // Returns whether a job's integer nextRun is the same time as its text one.
+    bool timestampsMatch(const string& jobID) {
+        return tester->readDB("SELECT nextRunUS = CAST(STRFTIME('%s', nextRun) AS INTEGER) * 1000000 FROM jobs "
+                              "WHERE jobID = " + jobID + ";") == "1";
+    }
+
+    void firstRun() {
+        string jobID = createJob("first", "2020-06-15 12:34:56");
+        ASSERT_EQUAL(tester->readDB("SELECT nextRun FROM jobs WHERE jobID = " + jobID + ";"), "2020-06-15 12:34:56");
+        ASSERT_TRUE(timestampsMatch(jobID));
+
+        // A date on its own is the start of that day.
+        jobID = createJob("first", "2020-06-15");
+        ASSERT_EQUAL(tester->readDB("SELECT nextRun FROM jobs WHERE jobID = " + jobID + ";"), "2020-06-15 00:00:00");
+        ASSERT_TRUE(timestampsMatch(jobID));
+    }
+
+    void malformedFirstRun() {
+        SData command("CreateJob");
+        command["name"] = "malformed";
+        command["firstRun"] = "next tuesday";
+        tester->executeWaitVerifyContent(command, "402");
+    }
+
+    void repeatMatchesSQLite() {
+        // Each job is scheduled for the same time, run, and finished, and should be rescheduled for the time SQLite
+        // works out from the same modifiers.
+        const string scheduled = "2020-01-31 10:20:30";
+        const list<string> modifiers = {
+            "+1 MONTH",
+            "+1 YEAR, START OF MONTH",
+            "-3 HOURS, +90 MINUTES, +45 SECONDS",
+            "+1 DAY, WEEKDAY 3",
+            "WEEKDAY 5, START OF DAY",
+            "+13 MONTHS, START OF YEAR",
+        };
+        int i = 0;
+        for (const string& modifier : modifiers) {
+            const string name = "repeat" + SToStr(i++);
+            string jobID = createJob(name, scheduled, "SCHEDULED, " + modifier);
+            SData command("GetJob");
+            command["name"] = name;
+            tester->executeWaitVerifyContent(command);
+            command.clear();
+            command.methodLine = "FinishJob";
+            command["jobID"] = jobID;
+            tester->executeWaitVerifyContent(command);
+
+            list<string> sqlModifiers;
+            for (const string& part : SParseList(modifier)) {
+                sqlModifiers.push_back(SQ(part));
+            }
+            const string expected = tester->readDB("SELECT DATETIME(" + SQ(scheduled) + ", " +
+                                                   SComposeList(sqlModifiers) + ");");
+            ASSERT_EQUAL(tester->readDB("SELECT nextRun FROM jobs WHERE jobID = " + jobID + ";"), expected);
+            ASSERT_TRUE(timestampsMatch(jobID));
+        }
+    }
+
+    void insertedByQuery() {
+        // A job inserted without its integer timestamps, eg, with Query, gets them as it's inserted, so GetJob and
+        // GetJobs find it straight away, even once every older job's have been filled in.
+        SData command("Query");
+        command["query"] = "INSERT INTO jobs (created, jobID, state, name, nextRun, lastRun, repeat, data) "
+                           "VALUES ('2020-01-01 00:00:00', 1000, 'QUEUED', 'old', '2020-01-02 00:00:00', "
+                           "'2020-01-01 12:00:00', '', '{}'), "
+                           "('2020-01-01 00:00:00', 1001, 'QUEUED', 'older', '2020-01-02 00:00:00', NULL, '', '{}');";
+        tester->executeWaitVerifyContent(command);
+        ASSERT_TRUE(timestampsMatch("1000"));
+        ASSERT_TRUE(timestampsMatch("1001"));
+        ASSERT_EQUAL(tester->readDB("SELECT lastRunUS FROM jobs WHERE jobID = 1000;"),
+                     tester->readDB("SELECT CAST(STRFTIME('%s', '2020-01-01 12:00:00') AS INTEGER) * 1000000;"));
+        ASSERT_EQUAL(tester->readDB("SELECT lastRunUS IS NULL FROM jobs WHERE jobID = 1001;"), "1");
+
+        command.clear();
+        command.methodLine = "GetJob";
+        command["name"] = "old";
+        ASSERT_EQUAL(tester->executeWaitVerifyContentTable(command)["jobID"], "1000");
+        command.methodLine = "GetJobs";
+        command["name"] = "older";
+        command["numResults"] = "5";
+        ASSERT_TRUE(SContains(tester->executeWaitVerifyContentTable(command)["jobs"], "1001"));
+    }
+
+    void nextRunChangedByQuery() {
+        // A job that isn't due until much later can't be got, until its nextRun is moved earlier by hand.
+        string jobID = createJob("moved", "2099-01-01 00:00:00");
+        SData command("GetJob");
+        command["name"] = "moved";
+        tester->executeWaitVerifyContent(command, "404");
+        SData query("Query");
+        query["query"] = "UPDATE jobs SET nextRun = '2020-01-01 00:00:00' WHERE jobID = " + jobID + ";";
+        tester->executeWaitVerifyContent(query);
+        ASSERT_TRUE(timestampsMatch(jobID));
+        ASSERT_EQUAL(tester->executeWaitVerifyContentTable(command)["jobID"], jobID);
+
+        // And one that was due can be put off.
+        jobID = createJob("postponed", "2020-01-01 00:00:00");
+        query["query"] = "UPDATE jobs SET nextRun = '2099-01-01 00:00:00' WHERE jobID = " + jobID + ";";
+        tester->executeWaitVerifyContent(query);
+        ASSERT_TRUE(timestampsMatch(jobID));
+        command["name"] = "postponed";
+        tester->executeWaitVerifyContent(command, "404");
+    }
+
+} __JobTimestampsTest;